@@ -0,0 +1,76 @@
+// standard library includes
+#include <stdio.h>
+
+// project includes
+#include "parser.h"
+#include "rows.h"
+#include "calculus.h"
+#include "optimize.h"
+#include "bench.h"
+
+#define TERMS 1000000
+#define POOL_TERMS 20000000
+
+int main(void)
+{
+    Token result = create_empty_token();
+    char input[64];
+
+    // one formatted string per term, as client code does without sum
+    double sum = 0;
+    double start = bench_now();
+    for (unsigned int i = 1; i <= TERMS; i++)
+    {
+        snprintf(input, sizeof(input), "1/%u^2", i);
+        if (parse(input, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    double client_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("parse per term", TERMS, client_seconds);
+
+    start = bench_now();
+    parse("sum(i, 1, 10^6, 1/i^2)", &result);
+    double sum_seconds = bench_now() - start;
+    bench_consume(result.value.number);
+    bench_report_rate("sum", TERMS, sum_seconds);
+    printf("  %.2fx of parse per term\n", client_seconds / sum_seconds);
+
+    start = bench_now();
+    parse("integrate(x^2*sin(x), x, 0, pi) + integrate(1/(1+x^2), x, 0, 10^3)", &result);
+    bench_consume(result.value.number);
+    bench_report_rate("integrate", 2, bench_now() - start);
+
+    start = bench_now();
+    parse("root(cos(x) - x, x, 0, 1)", &result);
+    bench_consume(result.value.number);
+    bench_report_rate("root", 1, bench_now() - start);
+
+    // a long sum over one thread and over every processor, same result
+    NameTable names = new_nametable();
+    TokenList body = new_tokenlist();
+    convert_names("1 / (t + 1) ^ 1.5 * cos(t / 1000)", &body, &names);
+    optimize(&body, OPTIMIZE_FOLD | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+
+    RowPool single = new_row_pool(1);
+    start = bench_now();
+    double single_sum = 0;
+    sum_program(&single, body, 0, POOL_TERMS - 1, &single_sum);
+    double single_seconds = bench_now() - start;
+    bench_report_rate("sum 1 thread", POOL_TERMS, single_seconds);
+    delete_row_pool(&single);
+
+    RowPool all = new_row_pool(0);
+    start = bench_now();
+    double all_sum = 0;
+    sum_program(&all, body, 0, POOL_TERMS - 1, &all_sum);
+    double all_seconds = bench_now() - start;
+    bench_report_rate("sum all threads", POOL_TERMS, all_seconds);
+    printf("  %u threads, %.2fx of 1 thread, %s result\n", all.thread_count,
+           single_seconds / all_seconds, single_sum == all_sum ? "same" : "different");
+    delete_row_pool(&all);
+
+    delete_tokenlist(body);
+    delete_nametable(names);
+    return 0;
+}
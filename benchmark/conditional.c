@@ -0,0 +1,107 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "bench.h"
+
+#define ROWS 1000000
+
+// a piecewise price by quantity q and unit cost c
+static const char *conditional = "q < 10 ? q * c * 1.2 : q < 100 ? q * c * (1 - ln(q) / 50) : "
+                                 "q * c * 0.8 + (q - 100) ^ 0.5";
+
+// the same rule as separate programs, selected in client code
+static const char *branches[] = {
+    "q * c * 1.2",
+    "q * c * (1 - ln(q) / 50)",
+    "q * c * 0.8 + (q - 100) ^ 0.5",
+};
+
+static unsigned int branch(double q)
+{
+    return q < 10 ? 0 : q < 100 ? 1 : 2;
+}
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "q", 1);
+    nametable_add(&names, "c", 1);
+
+    double *variables = (double *)malloc(2 * ROWS * sizeof(double));
+    double *results = (double *)malloc(ROWS * sizeof(double));
+    error_type *errors = (error_type *)malloc(ROWS * sizeof(error_type));
+    if (variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        variables[2 * row] = row % 200;
+        variables[2 * row + 1] = 1 + row % 7;
+    }
+
+    TokenList program = new_tokenlist();
+    TokenList branch_programs[3];
+    convert_names(conditional, &program, &names);
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        branch_programs[i] = new_tokenlist();
+        convert_names(branches[i], &branch_programs[i], &names);
+    }
+
+    ParseContext context = new_parse_context();
+    Token result = create_empty_token();
+
+    // every branch evaluated, one picked afterwards
+    double sum = 0;
+    double start = bench_now();
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        double values[3];
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            ResultInfo res = evaluate_context(&context, branch_programs[i],
+                                              variables + 2 * row, &result);
+            values[i] = res.status == SUCCESS ? result.value.number : 0;
+        }
+        sum += values[branch(variables[2 * row])];
+    }
+    double all_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("all branches", ROWS, all_seconds);
+
+    // only the taken branch runs
+    sum = 0;
+    start = bench_now();
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        if (evaluate_context(&context, program, variables + 2 * row, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    double jump_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("jumps", ROWS, jump_seconds);
+    printf("  %.2fx of all branches\n", all_seconds / jump_seconds);
+
+    // each branch over the rows that take it
+    BatchContext batch = new_batch_context();
+    start = bench_now();
+    evaluate_batch(&batch, program, variables, 2, ROWS, results, errors);
+    double batch_seconds = bench_now() - start;
+    bench_consume(results[ROWS - 1]);
+    bench_report_rate("batch", ROWS, batch_seconds);
+    printf("  %.2fx of all branches\n", all_seconds / batch_seconds);
+
+    delete_batch_context(batch);
+    delete_parse_context(context);
+    for (unsigned int i = 0; i < 3; i++)
+        delete_tokenlist(branch_programs[i]);
+    delete_tokenlist(program);
+    free(errors);
+    free(results);
+    free(variables);
+    delete_nametable(names);
+    return 0;
+}
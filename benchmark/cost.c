@@ -0,0 +1,144 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// project includes
+#include "parser.h"
+#include "bench.h"
+
+// terms of a measured expression and evaluations of it
+#define TERMS 64
+#define ROUNDS 5000
+#define RUNS 25
+
+// cycles where the time stamp counter can be read, nanoseconds elsewhere
+static double now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (double)__rdtsc();
+#else
+    return bench_now() * 1e9;
+#endif
+}
+
+// x is a fraction every function accepts, n an integer for fac
+static const double variables[] = {0.5, 5};
+
+// cycles of one evaluation of term repeated TERMS times, summed
+static double measure(NameTable *names, const char *term)
+{
+    char expression[TERMS * 32];
+    expression[0] = '\0';
+    for (unsigned int i = 0; i < TERMS; i++)
+    {
+        if (i > 0)
+            strcat(expression, "+");
+        strcat(expression, term);
+    }
+
+    TokenList program = new_tokenlist();
+    ResultInfo info = convert_names(expression, &program, names);
+    if (info.status != SUCCESS)
+    {
+        fprintf(stderr, "cannot convert %s\n", term);
+        exit(1);
+    }
+
+    // the fastest of a few runs, the others met interrupts or a cold cache
+    ParseContext context = new_parse_context();
+    Token result = create_empty_token();
+    double best = -1;
+    for (unsigned int run = 0; run < RUNS; run++)
+    {
+        double sum = 0;
+        double start = now_cycles();
+        for (unsigned int i = 0; i < ROUNDS; i++)
+        {
+            evaluate_context(&context, program, variables, &result);
+            sum += result.value.number;
+        }
+        double cycles = (now_cycles() - start) / ROUNDS;
+        bench_consume(sum);
+
+        if (best < 0 || cycles < best)
+            best = cycles;
+    }
+
+    delete_parse_context(context);
+    delete_tokenlist(program);
+    return best;
+}
+
+static double positive(double cost)
+{
+    return cost > 0.5 ? cost : 0.5;
+}
+
+int main(int argc, char **argv)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "n", 1);
+
+    CostTable costs = default_cost_table();
+
+    // TERMS operands and TERMS - 1 additions, which cost about the same
+    double reference = measure(&names, "x");
+    costs.operand = reference / (2 * TERMS - 1);
+    costs.operators[ADD] = costs.operand;
+
+    // a binary term adds an operator and an operand
+    static const struct { operator_type type; const char *term; } binary[] = {
+        {SUB, "(x-x)"}, {MULT, "x*x"}, {DIV, "x/x"}, {MOD, "x%x"}, {POW, "x^x"},
+    };
+
+    for (unsigned int i = 0; i < sizeof(binary) / sizeof(binary[0]); i++)
+    {
+        double cycles = (measure(&names, binary[i].term) - reference) / TERMS;
+        costs.operators[binary[i].type] = positive(cycles - costs.operand);
+    }
+
+    // a unary term adds only its operator
+    static const struct { operator_type type; const char *term; } unary[] = {
+        {NEG, "(-x)"},
+        {SIN, "sin(x)"}, {COS, "cos(x)"}, {TAN, "tan(x)"},
+        {ASIN, "asin(x)"}, {ACOS, "acos(x)"}, {ATAN, "atan(x)"},
+        {SIND, "sind(x)"}, {COSD, "cosd(x)"}, {TAND, "tand(x)"},
+        {ASIND, "asind(x)"}, {ACOSD, "acosd(x)"}, {ATAND, "atand(x)"},
+        {LN, "ln(x)"}, {LOG, "log(x)"}, {ABS, "abs(x)"}, {FAC, "fac(n)"},
+    };
+
+    for (unsigned int i = 0; i < sizeof(unary) / sizeof(unary[0]); i++)
+    {
+        double cycles = (measure(&names, unary[i].term) - reference) / TERMS;
+        costs.operators[unary[i].type] = positive(cycles);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("cycles per token\n");
+#else
+    printf("nanoseconds per token\n");
+#endif
+    printf("  %-10s %8.1f\n", "operand", costs.operand);
+    for (unsigned int t = ADD; t <= FAC; t++)
+        printf("  %-10s %8.1f\n", operator_name(t), costs.operators[t]);
+
+    // the table Parser --analyze reads
+    if (argc > 1)
+    {
+        if (!cost_table_save(argv[1], &costs))
+        {
+            fprintf(stderr, "cannot write %s\n", argv[1]);
+            return 1;
+        }
+        printf("written to %s\n", argv[1]);
+    }
+
+    delete_nametable(names);
+    return 0;
+}
@@ -0,0 +1,85 @@
+// standard library includes
+#include <stdio.h>
+
+// project includes
+#include "parser.h"
+#include "functions.h"
+#include "bench.h"
+
+#define COMPILES 20000
+#define ROWS 1000000
+
+static const char *definitions[] = {
+    "sq(x) = x * x",
+    "clamp(x) = x < 0 ? 0 : x > 1 ? 1 : x",
+    "lerp(a, b, t) = a + (b - a) * t",
+    "smooth(t) = sq(clamp(t)) * (3 - 2 * clamp(t))",
+};
+
+#define DEFINITION_COUNT (sizeof(definitions) / sizeof(definitions[0]))
+
+// the same expression with calls and with the helpers pasted in
+static const char *called = "lerp(x, y, smooth(x / y)) + sq(x - y)";
+static const char *pasted = "(x + (y - x) * (((x / y) < 0 ? 0 : (x / y) > 1 ? 1 : (x / y)) * "
+                            "((x / y) < 0 ? 0 : (x / y) > 1 ? 1 : (x / y)) * "
+                            "(3 - 2 * ((x / y) < 0 ? 0 : (x / y) > 1 ? 1 : (x / y))))) + "
+                            "(x - y) * (x - y)";
+
+static double evaluate_rows(const TokenList program)
+{
+    ParseContext context = new_parse_context();
+    double values[2];
+    double sum = 0;
+    Token result = create_empty_token();
+
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        values[0] = row % 100;
+        values[1] = 1 + row % 37;
+        if (evaluate_context(&context, program, values, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+
+    delete_parse_context(context);
+    return sum;
+}
+
+int main(void)
+{
+    FunctionTable functions = new_function_table();
+    for (unsigned int i = 0; i < DEFINITION_COUNT; i++)
+        function_define(&functions, definitions[i]);
+
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+
+    // compiling a call copies lexed tokens, pasting lexes the helpers again
+    double start = bench_now();
+    for (unsigned int i = 0; i < COMPILES; i++)
+        convert_functions(called, &program, &names, &functions);
+    double called_seconds = bench_now() - start;
+    bench_report_rate("compile with calls", COMPILES, called_seconds);
+
+    start = bench_now();
+    for (unsigned int i = 0; i < COMPILES; i++)
+        convert_names(pasted, &program, &names);
+    double pasted_seconds = bench_now() - start;
+    bench_report_rate("compile pasted", COMPILES, pasted_seconds);
+    printf("  %.2fx of pasted\n", pasted_seconds / called_seconds);
+
+    // inlined programs evaluate like the pasted ones
+    convert_functions(called, &program, &names, &functions);
+    start = bench_now();
+    bench_consume(evaluate_rows(program));
+    bench_report_rate("evaluate inlined", ROWS, bench_now() - start);
+
+    convert_names(pasted, &program, &names);
+    start = bench_now();
+    bench_consume(evaluate_rows(program));
+    bench_report_rate("evaluate pasted", ROWS, bench_now() - start);
+
+    delete_tokenlist(program);
+    delete_nametable(names);
+    delete_function_table(&functions);
+    return 0;
+}
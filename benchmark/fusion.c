@@ -0,0 +1,86 @@
+// standard library includes
+#include <stdio.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "bench.h"
+
+#define ROWS 1000000
+
+static const char *formulas[] = {
+    "a * b + c",
+    "x ^ 2 + 3 * x + 1",
+    "sin(-x) * 2 + y / 4",
+    "(a * x + b) * x + c",
+    "a * 1.5 - b * 0.25 + c * 4 - x % 3",
+    "-cos(x) * -sin(y) + a ^ 3 / 7",
+};
+
+#define FORMULA_COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+// evaluate a program over rows of changing inputs
+static double run(const TokenList program, double *seconds)
+{
+    ParseContext context = new_parse_context();
+    double values[5] = { 1.25, -0.5, 3, 0.75, 2 };
+    double sum = 0;
+    Token result = create_empty_token();
+
+    double start = bench_now();
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        values[3] = row * 1e-6;
+        if (evaluate_context(&context, program, values, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    *seconds = bench_now() - start;
+
+    delete_parse_context(context);
+    return sum;
+}
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "a", 1);
+    nametable_add(&names, "b", 1);
+    nametable_add(&names, "c", 1);
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+
+    unsigned int plain_total = 0;
+    unsigned int fused_total = 0;
+
+    for (unsigned int i = 0; i < FORMULA_COUNT; i++)
+    {
+        TokenList plain = new_tokenlist();
+        TokenList fused = new_tokenlist();
+        convert_names(formulas[i], &plain, &names);
+        convert_names(formulas[i], &fused, &names);
+        optimize(&fused, OPTIMIZE_FUSE);
+
+        unsigned int plain_count = program_dispatch_count(plain);
+        unsigned int fused_count = program_dispatch_count(fused);
+        plain_total += plain_count;
+        fused_total += fused_count;
+
+        double plain_seconds, fused_seconds;
+        bench_consume(run(plain, &plain_seconds));
+        bench_consume(run(fused, &fused_seconds));
+
+        printf("%s\n", formulas[i]);
+        printf("  dispatches %u -> %u\n", plain_count, fused_count);
+        bench_report_rate("  plain rows", ROWS, plain_seconds);
+        bench_report_rate("  fused rows", ROWS, fused_seconds);
+
+        delete_tokenlist(fused);
+        delete_tokenlist(plain);
+    }
+
+    printf("total dispatches %u -> %u (%.0f%% fewer)\n", plain_total, fused_total,
+           100.0 * (plain_total - fused_total) / plain_total);
+
+    delete_nametable(names);
+    return 0;
+}
@@ -0,0 +1,73 @@
+// standard library includes
+#include <stdio.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "bench.h"
+
+#define ROWS 1000000
+
+static const char *formulas[] = {
+    "12 * 7 + 3 % 2",
+    "fac(10) / fac(8) - 17 % 5",
+    "2 ^ 40 + 3 ^ 20 - 7 ^ 10",
+    "(1 + 2) * (3 + 4) * (5 + 6) % 97",
+    "99999999 * 99999999 - 12345 * 6789",
+    "fac(20) / fac(18) + x",
+};
+
+#define FORMULA_COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+static double run(const TokenList program, double *seconds)
+{
+    ParseContext context = new_parse_context();
+    double values[1] = { 0 };
+    double sum = 0;
+    Token result = create_empty_token();
+
+    double start = bench_now();
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        values[0] = row;
+        if (evaluate_context(&context, program, values, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    *seconds = bench_now() - start;
+
+    delete_parse_context(context);
+    return sum;
+}
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+
+    for (unsigned int i = 0; i < FORMULA_COUNT; i++)
+    {
+        printf("%s\n", formulas[i]);
+
+        double plain_seconds = 0;
+        for (unsigned int p = 0; p < 2; p++)
+        {
+            TokenList program = new_tokenlist();
+            convert_names(formulas[i], &program, &names);
+            if (p == 1)
+                optimize(&program, OPTIMIZE_INTEGER);
+
+            double seconds;
+            bench_consume(run(program, &seconds));
+            if (p == 0)
+                plain_seconds = seconds;
+
+            bench_report_rate(p == 0 ? "  double" : "  integer", ROWS, seconds);
+            printf("    %.2fx of double\n", plain_seconds / seconds);
+
+            delete_tokenlist(program);
+        }
+    }
+
+    delete_nametable(names);
+    return 0;
+}
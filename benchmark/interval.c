@@ -0,0 +1,75 @@
+// standard library includes
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "sample.h"
+#include "interval.h"
+#include "bench.h"
+
+#define BOUNDS 200000
+#define POINTS 1000000
+
+// a damped wave with a rational term, x in [0, 4], y in [1, 2]
+static const char *formula = "sin(3 * x) * 2 ^ (0 - x) + x / (y + 1) - y ^ 2 / 10";
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    unsigned int x = nametable_add(&names, "x", 1);
+    unsigned int y = nametable_add(&names, "y", 1);
+    convert_names(formula, &program, &names);
+    optimize(&program, OPTIMIZE_FOLD | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+
+    Interval box[2];
+    box[x] = new_interval(0, 4);
+    box[y] = new_interval(1, 2);
+
+    // guaranteed bounds over the whole box
+    Interval bounds;
+    double sum = 0;
+    double start = bench_now();
+    for (unsigned int i = 0; i < BOUNDS; i++)
+    {
+        evaluate_interval(program, box, &bounds);
+        sum += bounds.low;
+    }
+    double bound_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("interval bounds", BOUNDS, bound_seconds);
+    printf("  [%.6f, %.6f]\n", bounds.low, bounds.high);
+
+    // the range seen at points drawn from the box, which only
+    // approaches the true range from inside
+    Sampler sampler = new_sampler(7);
+    sampler_uniform(&sampler, x, 0, 4);
+    sampler_uniform(&sampler, y, 1, 2);
+    double *draws = (double *)malloc(POINTS * 2 * sizeof(double));
+    if (draws == NULL) exit(1);
+    sampler_draw(&sampler, 0, POINTS, draws);
+
+    double low = INFINITY, high = -INFINITY;
+    Token result = create_empty_token();
+    start = bench_now();
+    for (unsigned int i = 0; i < POINTS; i++)
+    {
+        evaluate(program, draws + 2 * i, &result);
+        low = fmin(low, result.value.number);
+        high = fmax(high, result.value.number);
+    }
+    double point_seconds = bench_now() - start;
+    bench_report_rate("point evaluations", POINTS, point_seconds);
+    printf("  [%.6f, %.6f] after %u points\n", low, high, POINTS);
+    printf("  one bound costs %.1f points\n",
+           bound_seconds / BOUNDS / (point_seconds / POINTS));
+
+    free(draws);
+    delete_sampler(&sampler);
+    delete_tokenlist(program);
+    delete_nametable(names);
+    return 0;
+}
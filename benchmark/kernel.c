@@ -0,0 +1,127 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "kernel.h"
+#include "rows.h"
+#include "bench.h"
+
+#define ROWS 1000000
+#define STRIDE 8
+
+// report style columns, many of them built from the same pieces
+static const char *formulas[] = {
+    "a * b",
+    "a * b - c",
+    "(a * b - c) / d",
+    "(a * b - c) * (1 - e)",
+    "(a * b - c) * (1 - e) / f",
+    "a * b / (g + 1)",
+    "c / (g + 1)",
+    "(a * b - c) / (g + 1)",
+    "h * (1 - e)",
+    "h * (1 - e) + a * b",
+    "(h - c) / d",
+    "(h - c) / d * 100",
+    "d * e + f * g",
+    "(d * e + f * g) / (a * b)",
+    "a ^ 2 + b ^ 2",
+    "(a ^ 2 + b ^ 2) ^ 0.5",
+    "ln(1 + a * b)",
+    "ln(1 + a * b) - ln(1 + c)",
+    "abs(a * b - h)",
+    "abs(a * b - h) / (a * b)",
+    "e * f * g",
+    "(a * b - c) * (1 - e) - e * f * g",
+    "(h - c) / d + (a * b - c) / d",
+    "g * h - c",
+};
+
+#define FORMULA_COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+static const unsigned int flags = OPTIMIZE_STRENGTH | OPTIMIZE_FUSE;
+
+int main(void)
+{
+    NameTable names = new_nametable();
+
+    double *variables = (double *)malloc((size_t)ROWS * STRIDE * sizeof(double));
+    double *column_storage = (double *)aligned_alloc(64, (size_t)FORMULA_COUNT * ROWS * sizeof(double));
+    error_type *error_storage = (error_type *)aligned_alloc(64, (size_t)FORMULA_COUNT * ROWS *
+                                                           sizeof(error_type));
+    if (variables == NULL || column_storage == NULL || error_storage == NULL)
+        exit(1);
+
+    double *columns[FORMULA_COUNT];
+    error_type *errors[FORMULA_COUNT];
+    for (unsigned int k = 0; k < FORMULA_COUNT; k++)
+    {
+        columns[k] = column_storage + (size_t)k * ROWS;
+        errors[k] = error_storage + (size_t)k * ROWS;
+    }
+
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        for (unsigned int v = 0; v < STRIDE; v++)
+            variables[(size_t)row * STRIDE + v] = 1 + (row * (v + 3) % 997) * 1e-3;
+    }
+
+    RowPool pool = new_row_pool(1);
+    printf("%u formulas over %d rows of %d variables\n",
+           (unsigned int)FORMULA_COUNT, ROWS, STRIDE);
+
+    // one pass over the table per formula
+    TokenList programs[FORMULA_COUNT];
+    unsigned int separate_dispatches = 0;
+    for (unsigned int k = 0; k < FORMULA_COUNT; k++)
+    {
+        programs[k] = new_tokenlist();
+        convert_names(formulas[k], &programs[k], &names);
+        optimize(&programs[k], flags);
+        separate_dispatches += program_dispatch_count(programs[k]);
+    }
+
+    double start = bench_now();
+    for (unsigned int k = 0; k < FORMULA_COUNT; k++)
+        evaluate_rows(&pool, programs[k], variables, STRIDE, ROWS, columns[k], errors[k]);
+    double separate_seconds = bench_now() - start;
+    bench_consume(columns[FORMULA_COUNT - 1][ROWS / 2]);
+
+    bench_report_rate("  separate", ROWS, separate_seconds);
+    printf("    %u dispatches per row\n", separate_dispatches);
+
+    // one pass over the table for all formulas
+    const unsigned int kernel_flags[] = { flags, flags | OPTIMIZE_SHARE };
+    const char *kernel_names[] = { "  fused", "  fused, shared" };
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        Kernel kernel = new_kernel(kernel_flags[i]);
+        for (unsigned int k = 0; k < FORMULA_COUNT; k++)
+            kernel_add(&kernel, formulas[k], &names);
+        kernel_compile(&kernel);
+
+        start = bench_now();
+        evaluate_kernel_rows(&pool, &kernel, variables, STRIDE, ROWS, columns, errors);
+        double seconds = bench_now() - start;
+        bench_consume(columns[FORMULA_COUNT - 1][ROWS / 2]);
+
+        bench_report_rate(kernel_names[i], ROWS, seconds);
+        printf("    %u dispatches per row, %.2fx of separate\n",
+               program_dispatch_count(kernel.program), separate_seconds / seconds);
+
+        delete_kernel(&kernel);
+    }
+
+    for (unsigned int k = 0; k < FORMULA_COUNT; k++)
+        delete_tokenlist(programs[k]);
+
+    delete_row_pool(&pool);
+    free(error_storage);
+    free(column_storage);
+    free(variables);
+    delete_nametable(names);
+    return 0;
+}
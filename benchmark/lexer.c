@@ -0,0 +1,97 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "parser.h"
+#include "scan.h"
+#include "bench.h"
+
+#define INPUT_SIZE (16u << 20)
+#define REPEATS 5
+
+// machine generated shapes: long numbers and names, runs of indentation,
+// and dense short tokens
+static const char *chunks[] = {
+    "    123456.789012345 * velocityfactor    + (pressuredelta - 42)        / temperature\n+",
+    "\n                                                                "
+    "                                                                1 +",
+    "1+2*3-4/5+",
+};
+
+static const char *chunk_names[] = {
+    "long runs",
+    "deep indentation",
+    "short tokens",
+};
+
+#define CHUNK_COUNT (sizeof(chunks) / sizeof(chunks[0]))
+
+static char *build_input(const char *chunk)
+{
+    size_t chunk_length = strlen(chunk);
+    char *input = (char *)malloc(INPUT_SIZE + chunk_length + 2);
+    if (input == NULL) exit(1);
+
+    size_t length = 0;
+    while (length + chunk_length < INPUT_SIZE)
+    {
+        memcpy(input + length, chunk, chunk_length);
+        length += chunk_length;
+    }
+
+    // close the trailing operator
+    input[length++] = '1';
+    input[length] = '\0';
+
+    return input;
+}
+
+static double lex_rate(const char *input, bool vectors)
+{
+    TokenList tokens = new_tokenlist();
+    NameTable names = new_nametable();
+    double best = 0;
+
+    scan_use_vectors(vectors);
+    for (unsigned int i = 0; i < REPEATS; i++)
+    {
+        double start = bench_now();
+        ResultInfo res = lex_names(input, &tokens, &names);
+        double seconds = bench_now() - start;
+
+        if (res.status != SUCCESS)
+        {
+            printf("lexing failed at %u\n", res.error_index);
+            exit(1);
+        }
+
+        double rate = strlen(input) / seconds / 1e9;
+        if (rate > best)
+            best = rate;
+    }
+    scan_use_vectors(true);
+
+    bench_consume(tokens.count);
+    delete_nametable(names);
+    delete_tokenlist(tokens);
+
+    return best;
+}
+
+int main(void)
+{
+    for (unsigned int i = 0; i < CHUNK_COUNT; i++)
+    {
+        char *input = build_input(chunks[i]);
+
+        printf("%s, %zu bytes\n", chunk_names[i], strlen(input));
+        printf("  byte by byte                %8.3f GB/s\n", lex_rate(input, false));
+        printf("  vector scans                %8.3f GB/s\n", lex_rate(input, true));
+
+        free(input);
+    }
+
+    return 0;
+}
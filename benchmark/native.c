@@ -0,0 +1,128 @@
+// standard library includes
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "functions.h"
+#include "bench.h"
+
+#define ROWS 1000000
+
+static double native_mix(const double *args)
+{
+    return args[0] + (args[1] - args[0]) * args[2];
+}
+
+static void native_mix_vector(const double *const *args, double *results, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+        results[i] = args[0][i] + (args[1][i] - args[0][i]) * args[2][i];
+}
+
+static double native_erf(const double *args)
+{
+    return erf(args[0]);
+}
+
+// the same blend as a native call and written out
+static const char *called = "mix(x, y, 0.25) * 2";
+static const char *written = "(x + (y - x) * 0.25) * 2";
+
+// constant calls that folding computes once
+static const char *constant = "x * mix(1, 3, erf(0.5)) + erf(1) / 2";
+
+static double evaluate_rows(const TokenList program, const double *variables)
+{
+    ParseContext context = new_parse_context();
+    double sum = 0;
+    Token result = create_empty_token();
+
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        if (evaluate_context(&context, program, variables + 2 * row, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+
+    delete_parse_context(context);
+    return sum;
+}
+
+int main(void)
+{
+    FunctionTable functions = new_function_table();
+    function_register(&functions, "mix", 3, native_mix, NULL, NATIVE_PURE);
+    function_register(&functions, "erf", 1, native_erf, NULL, NATIVE_PURE);
+
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+
+    double *variables = (double *)malloc(2 * ROWS * sizeof(double));
+    double *results = (double *)malloc(ROWS * sizeof(double));
+    error_type *errors = (error_type *)malloc(ROWS * sizeof(error_type));
+    if (variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        variables[2 * row] = row % 100;
+        variables[2 * row + 1] = 1 + row % 37;
+    }
+
+    // a call goes straight to the registered pointer
+    TokenList program = new_tokenlist();
+    convert_names(written, &program, &names);
+    double start = bench_now();
+    bench_consume(evaluate_rows(program, variables));
+    double written_seconds = bench_now() - start;
+    bench_report_rate("written out", ROWS, written_seconds);
+
+    convert_functions(called, &program, &names, &functions);
+    start = bench_now();
+    bench_consume(evaluate_rows(program, variables));
+    double called_seconds = bench_now() - start;
+    bench_report_rate("native call", ROWS, called_seconds);
+    printf("  %.2fx of written out\n", written_seconds / called_seconds);
+
+    // batches call the vector form once per block
+    BatchContext batch = new_batch_context();
+    start = bench_now();
+    evaluate_batch(&batch, program, variables, 2, ROWS, results, errors);
+    double scalar_seconds = bench_now() - start;
+    bench_consume(results[ROWS - 1]);
+    bench_report_rate("batch scalar", ROWS, scalar_seconds);
+
+    function_register(&functions, "mix", 3, native_mix, native_mix_vector, NATIVE_PURE);
+    start = bench_now();
+    evaluate_batch(&batch, program, variables, 2, ROWS, results, errors);
+    double vector_seconds = bench_now() - start;
+    bench_consume(results[ROWS - 1]);
+    bench_report_rate("batch vector", ROWS, vector_seconds);
+    printf("  %.2fx of batch scalar\n", scalar_seconds / vector_seconds);
+    delete_batch_context(batch);
+
+    // pure calls with constant arguments are made once when folded
+    convert_functions(constant, &program, &names, &functions);
+    start = bench_now();
+    bench_consume(evaluate_rows(program, variables));
+    double plain_seconds = bench_now() - start;
+    bench_report_rate("constant calls", ROWS, plain_seconds);
+
+    optimize(&program, OPTIMIZE_FOLD);
+    start = bench_now();
+    bench_consume(evaluate_rows(program, variables));
+    double folded_seconds = bench_now() - start;
+    bench_report_rate("folded", ROWS, folded_seconds);
+    printf("  %.2fx of constant calls\n", plain_seconds / folded_seconds);
+
+    delete_tokenlist(program);
+    free(errors);
+    free(results);
+    free(variables);
+    delete_nametable(names);
+    delete_function_table(&functions);
+    return 0;
+}
@@ -0,0 +1,82 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// project includes
+#include "parser.h"
+#include "program_file.h"
+#include "bench.h"
+
+#define FORMULAS 200000
+
+// evaluate every program once so both sets do the same work
+static double evaluate_all(const ProgramSet *set)
+{
+    double values[2] = { 1.5, 2.5 };
+    double sum = 0;
+    Token result = create_empty_token();
+
+    for (unsigned int i = 0; i < program_set_count(set); i++)
+    {
+        if (evaluate(program_set_program(set, i), values, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+
+    return sum;
+}
+
+int main(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/parser_bench_%d.bin", (int)getpid());
+
+    char **sources = (char **)malloc(FORMULAS * sizeof(char *));
+    if (sources == NULL) exit(1);
+    for (unsigned int i = 0; i < FORMULAS; i++)
+    {
+        sources[i] = (char *)malloc(64);
+        if (sources[i] == NULL) exit(1);
+        snprintf(sources[i], 64, "(x * %u + sin(y / %u)) ^ 2 - %u.5 %% 7", i, i + 1, i % 100);
+    }
+
+    ProgramSet set;
+    double start = bench_now();
+    program_set_compile(&set, (const char **)sources, FORMULAS);
+    double compiled = bench_now() - start;
+
+    start = bench_now();
+    program_set_save(&set, path);
+    double saved = bench_now() - start;
+    bench_consume(evaluate_all(&set));
+    delete_program_set(&set);
+
+    start = bench_now();
+    program_set_origin origin = program_set_load(&set, path, (const char **)sources, FORMULAS);
+    double verified = bench_now() - start;
+    delete_program_set(&set);
+
+    start = bench_now();
+    program_set_load(&set, path, NULL, 0);
+    double trusted = bench_now() - start;
+
+    start = bench_now();
+    bench_consume(evaluate_all(&set));
+    double evaluated = bench_now() - start;
+
+    printf("%u formulas, %zu byte image, %s\n", FORMULAS, set.size,
+           origin == PROGRAM_SET_MAPPED ? "mapped" : "not mapped");
+    bench_report_rate("compile from source", FORMULAS, compiled);
+    bench_report_rate("save", FORMULAS, saved);
+    bench_report_rate("load, sources verified", FORMULAS, verified);
+    bench_report_rate("load, file trusted", FORMULAS, trusted);
+    bench_report_rate("evaluate mapped programs", FORMULAS, evaluated);
+
+    delete_program_set(&set);
+    remove(path);
+    for (unsigned int i = 0; i < FORMULAS; i++)
+        free(sources[i]);
+    free(sources);
+
+    return 0;
+}
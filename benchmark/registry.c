@@ -0,0 +1,161 @@
+// standard library includes
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "registry.h"
+#include "bench.h"
+
+#define READERS 2
+#define RUN_SECONDS 0.5
+
+// client code without a registry: expression strings under one lock,
+// parsed on every request
+typedef struct
+{
+    pthread_mutex_t lock;
+    char expression[64];
+} LockedFormula;
+
+typedef struct
+{
+    FormulaRegistry *registry;
+    LockedFormula *locked;
+    atomic_bool *done;
+    unsigned long long reads;
+} Reader;
+
+static void *read_locked(void *argument)
+{
+    Reader *self = (Reader *)argument;
+    Token result = create_empty_token();
+    double sum = 0;
+
+    while (!atomic_load_explicit(self->done, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&self->locked->lock);
+        parse(self->locked->expression, &result);
+        pthread_mutex_unlock(&self->locked->lock);
+        sum += result.value.number;
+        self->reads++;
+    }
+
+    bench_consume(sum);
+    return NULL;
+}
+
+static void *read_registry(void *argument)
+{
+    Reader *self = (Reader *)argument;
+    RegistryReader reader;
+    if (registry_open_reader(self->registry, &reader).status != SUCCESS)
+        return NULL;
+
+    unsigned int id = registry_lookup(&reader, "price");
+    double variables[2] = { 120, 0.2 };
+    Token result = create_empty_token();
+    double sum = 0;
+
+    while (!atomic_load_explicit(self->done, memory_order_relaxed))
+    {
+        registry_evaluate(&reader, id, variables, &result, NULL);
+        sum += result.value.number;
+        self->reads++;
+    }
+
+    bench_consume(sum);
+    registry_close_reader(&reader);
+    return NULL;
+}
+
+// run READERS threads of read for RUN_SECONDS, publishing new versions
+// meanwhile if publish is set, returns the reads per second
+static double run(void *(*read)(void *), FormulaRegistry *registry, LockedFormula *locked,
+                  bool publish, unsigned long long *publishes)
+{
+    atomic_bool done;
+    atomic_init(&done, false);
+    pthread_t threads[READERS];
+    Reader readers[READERS];
+
+    for (unsigned int i = 0; i < READERS; i++)
+    {
+        readers[i].registry = registry;
+        readers[i].locked = locked;
+        readers[i].done = &done;
+        readers[i].reads = 0;
+        pthread_create(&threads[i], NULL, read, &readers[i]);
+    }
+
+    char expression[64];
+    unsigned long long count = 0;
+    double start = bench_now();
+    while (bench_now() - start < RUN_SECONDS)
+    {
+        if (!publish)
+            continue;
+
+        if (registry != NULL)
+        {
+            snprintf(expression, sizeof(expression), "%llu + amount * (1 - discount) * 1.%llu",
+                     count % 7, count % 10);
+            registry_publish(registry, "price", expression);
+        }
+        else
+        {
+            pthread_mutex_lock(&locked->lock);
+            snprintf(locked->expression, sizeof(locked->expression),
+                     "%llu + 120 * (1 - 0.2) * 1.%llu", count % 7, count % 10);
+            pthread_mutex_unlock(&locked->lock);
+        }
+        count++;
+    }
+
+    atomic_store(&done, true);
+    unsigned long long reads = 0;
+    for (unsigned int i = 0; i < READERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        reads += readers[i].reads;
+    }
+
+    double seconds = bench_now() - start;
+    if (publishes != NULL)
+        *publishes = count;
+    bench_report_rate(publish ? "  reads, writer publishing" : "  reads, writer idle", reads, seconds);
+    return reads / seconds;
+}
+
+int main(void)
+{
+    LockedFormula locked;
+    pthread_mutex_init(&locked.lock, NULL);
+    snprintf(locked.expression, sizeof(locked.expression), "120 * (1 - 0.2) * 1.1");
+
+    printf("mutex and parse\n");
+    run(read_locked, NULL, &locked, false, NULL);
+    double locked_rate = run(read_locked, NULL, &locked, true, NULL);
+    pthread_mutex_destroy(&locked.lock);
+
+    NameTable variables = new_nametable();
+    nametable_add(&variables, "amount", 6);
+    nametable_add(&variables, "discount", 8);
+    FormulaRegistry registry = new_formula_registry(&variables, 0);
+    registry_publish(&registry, "price", "amount * (1 - discount) * 1.1");
+
+    unsigned long long publishes;
+    printf("registry\n");
+    double idle_rate = run(read_registry, &registry, NULL, false, NULL);
+    double busy_rate = run(read_registry, &registry, NULL, true, &publishes);
+    printf("  %llu versions published, %u not yet freed\n",
+           publishes, registry_retired_count(&registry));
+    printf("  publishing keeps %.0f%% of idle reads, %.2fx of mutex and parse\n",
+           100 * busy_rate / idle_rate, busy_rate / locked_rate);
+
+    delete_formula_registry(&registry);
+    delete_nametable(variables);
+    return 0;
+}
@@ -0,0 +1,88 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "rows.h"
+#include "bench.h"
+
+#define ROWS 4000000
+#define STRIDE 3
+#define REPEATS 3
+
+static const char *formula = "a * sin(b) + c ^ 2 / (1 + a) - ln(1 + b * b)";
+
+static const unsigned int thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+#define THREAD_COUNT_COUNT (sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    convert_names(formula, &program, &names);
+    optimize(&program, OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+
+    double *variables = (double *)malloc((size_t)ROWS * STRIDE * sizeof(double));
+    double *results = (double *)aligned_alloc(64, (size_t)ROWS * sizeof(double));
+    error_type *errors = (error_type *)aligned_alloc(64, (size_t)ROWS * sizeof(error_type));
+    if (variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        variables[row * STRIDE] = row * 1e-6;
+        variables[row * STRIDE + 1] = (row % 1000) * 1e-3;
+        variables[row * STRIDE + 2] = 2 - row * 1e-7;
+    }
+
+    printf("%s over %d rows\n", formula, ROWS);
+
+    double single_seconds = 0;
+    for (unsigned int i = 0; i < THREAD_COUNT_COUNT; i++)
+    {
+        RowPool pool = new_row_pool(thread_counts[i]);
+
+        // best of a few runs, the first also warms up the contexts
+        double best = 0;
+        for (unsigned int repeat = 0; repeat < REPEATS; repeat++)
+        {
+            double start = bench_now();
+            evaluate_rows(&pool, program, variables, STRIDE, ROWS, results, errors);
+            double seconds = bench_now() - start;
+            if (repeat == 0 || seconds < best)
+                best = seconds;
+        }
+        bench_consume(results[ROWS / 2]);
+
+        if (i == 0)
+            single_seconds = best;
+
+        char name[32];
+        snprintf(name, sizeof(name), "  %u threads", pool.thread_count);
+        bench_report_rate(name, ROWS, best);
+        printf("    %.2fx of one thread\n", single_seconds / best);
+
+        // the same rows reduced on the fly, nothing is written per row
+        Aggregate aggregate = new_histogram_aggregate(-2, 6, 16);
+        double start = bench_now();
+        aggregate_rows(&pool, program, variables, STRIDE, ROWS, &aggregate);
+        double seconds = bench_now() - start;
+        bench_consume(aggregate.sum);
+
+        bench_report_rate("    aggregated", ROWS, seconds);
+        printf("    mean %.17g\n", aggregate.mean);
+        delete_aggregate(&aggregate);
+
+        delete_row_pool(&pool);
+    }
+
+    free(errors);
+    free(results);
+    free(variables);
+    delete_tokenlist(program);
+    delete_nametable(names);
+    return 0;
+}
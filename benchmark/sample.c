@@ -0,0 +1,87 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "rows.h"
+#include "sample.h"
+#include "bench.h"
+
+#define CLIENT_SAMPLES 200000
+#define SAMPLES 20000000
+#define DRAWS 4096
+
+// payoff of an option on a price s with a normal shock z
+static const char *payoff = "s * (1 + 0.2 * z) > 100 ? s * (1 + 0.2 * z) - 100 : 0";
+
+static void report_sample(const char *name, RowPool *pool, const TokenList program,
+                          const Sampler *sampler, double *seconds)
+{
+    Aggregate aggregate = new_aggregate();
+    double start = bench_now();
+    sample_rows(pool, program, sampler, SAMPLES, &aggregate);
+    *seconds = bench_now() - start;
+    bench_report_rate(name, SAMPLES, *seconds);
+
+    double low, high;
+    aggregate_confidence(&aggregate, 0.95, &low, &high);
+    printf("  mean %.6f, 95%% in [%.6f, %.6f]\n", aggregate.mean, low, high);
+    delete_aggregate(&aggregate);
+}
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    convert_names(payoff, &program, &names);
+
+    Sampler sampler = new_sampler(2024);
+    sampler_uniform(&sampler, nametable_add(&names, "s", 1), 90, 110);
+    sampler_normal(&sampler, nametable_add(&names, "z", 1), 0, 1);
+
+    // each sample written into the expression and parsed on its own,
+    // as client code does without sampling
+    char input[256];
+    double draws[2];
+    double sum = 0;
+    Token result = create_empty_token();
+    double start = bench_now();
+    for (unsigned int i = 0; i < CLIENT_SAMPLES; i++)
+    {
+        sampler_draw(&sampler, i, 1, draws);
+        snprintf(input, sizeof(input), "%.17g * (1 + 0.2 * %.17g) > 100 ? %.17g * (1 + 0.2 * %.17g) - 100 : 0",
+                 draws[0], draws[1], draws[0], draws[1]);
+        if (parse(input, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    double client_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("parse per sample", CLIENT_SAMPLES, client_seconds);
+
+    double *block = (double *)malloc(DRAWS * 2 * sizeof(double));
+    if (block == NULL) exit(1);
+    start = bench_now();
+    for (unsigned long long first = 0; first < SAMPLES; first += DRAWS)
+        sampler_draw(&sampler, first, DRAWS, block);
+    bench_consume(block[0]);
+    bench_report_rate("draws only", SAMPLES, bench_now() - start);
+    free(block);
+
+    double single_seconds, all_seconds;
+    RowPool single = new_row_pool(1);
+    report_sample("sample 1 thread", &single, program, &sampler, &single_seconds);
+    delete_row_pool(&single);
+    printf("  %.2fx of parse per sample\n",
+           client_seconds / CLIENT_SAMPLES * SAMPLES / single_seconds);
+
+    RowPool all = new_row_pool(0);
+    report_sample("sample all threads", &all, program, &sampler, &all_seconds);
+    printf("  %u threads, %.2fx of 1 thread\n", all.thread_count, single_seconds / all_seconds);
+    delete_row_pool(&all);
+
+    delete_sampler(&sampler);
+    delete_tokenlist(program);
+    delete_nametable(names);
+    return 0;
+}
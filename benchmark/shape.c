@@ -0,0 +1,112 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+
+// project includes
+#include "parser.h"
+#include "shape.h"
+#include "bench.h"
+
+#define PROGRAMS 400000
+
+// per customer rules, many rules share a template and differ in their numbers
+static const char *templates[] = {
+    "%g * amount + %g",
+    "amount > %g ? amount * %g : %g",
+    "(amount - %g) * %g + days * %g",
+    "amount * (1 + %g) ^ (days / %g)",
+    "days > %g ? amount * %g - %g : amount / %g",
+    "amount * %g + abs(days - %g) * %g",
+};
+
+int main(void)
+{
+    const unsigned int template_count = sizeof(templates) / sizeof(templates[0]);
+    NameTable names = new_nametable();
+    unsigned int amount = nametable_add(&names, "amount", 6);
+    unsigned int days = nametable_add(&names, "days", 4);
+
+    char **inputs = (char **)malloc(PROGRAMS * sizeof(char *));
+    TokenList *programs = (TokenList *)malloc(PROGRAMS * sizeof(TokenList));
+    double *variables = (double *)malloc(PROGRAMS * 2 * sizeof(double));
+    double *results = (double *)malloc(PROGRAMS * sizeof(double));
+    error_type *errors = (error_type *)malloc(PROGRAMS * sizeof(error_type));
+    if (inputs == NULL || programs == NULL || variables == NULL ||
+        results == NULL || errors == NULL) exit(1);
+
+    for (unsigned int p = 0; p < PROGRAMS; p++)
+    {
+        inputs[p] = (char *)malloc(128);
+        if (inputs[p] == NULL) exit(1);
+
+        double a = 1 + (p * 7919 % 1000) / 100.0;
+        double b = 1 + (p * 104729 % 1000) / 1000.0;
+        double c = 10 + p % 90;
+        snprintf(inputs[p], 128, templates[p % template_count], a, b, c, a, b);
+
+        variables[p * 2 + amount] = 50 + p % 200;
+        variables[p * 2 + days] = 1 + p % 30;
+    }
+
+    // each rule converted and evaluated on its own, as client code does
+    ParseContext context = new_parse_context();
+    Token result = create_empty_token();
+    double sum = 0;
+    double start = bench_now();
+    for (unsigned int p = 0; p < PROGRAMS; p++)
+    {
+        convert_context(&context, inputs[p], &names);
+        evaluate_context(&context, context.program, variables + p * 2, &result);
+        sum += result.value.number;
+    }
+    double parse_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("convert and evaluate", PROGRAMS, parse_seconds);
+
+    // converted once, then evaluated one program at a time
+    for (unsigned int p = 0; p < PROGRAMS; p++)
+    {
+        programs[p] = new_tokenlist();
+        convert_names(inputs[p], &programs[p], &names);
+    }
+
+    sum = 0;
+    start = bench_now();
+    for (unsigned int p = 0; p < PROGRAMS; p++)
+    {
+        evaluate_context(&context, programs[p], variables + p * 2, &result);
+        sum += result.value.number;
+    }
+    double single_seconds = bench_now() - start;
+    bench_consume(sum);
+    bench_report_rate("evaluate each program", PROGRAMS, single_seconds);
+
+    ShapeBatch batch = new_shape_batch();
+    start = bench_now();
+    for (unsigned int p = 0; p < PROGRAMS; p++)
+        shape_batch_add_program(&batch, programs[p]);
+    bench_report_rate("group by shape", PROGRAMS, bench_now() - start);
+    printf("  %u shapes\n", batch.group_count);
+
+    start = bench_now();
+    shape_batch_evaluate(&batch, variables, 2, results, errors);
+    double shape_seconds = bench_now() - start;
+    bench_consume(results[PROGRAMS - 1]);
+    bench_report_rate("evaluate by shape", PROGRAMS, shape_seconds);
+    printf("  %.2fx of evaluate each program\n", single_seconds / shape_seconds);
+
+    delete_shape_batch(&batch);
+    for (unsigned int p = 0; p < PROGRAMS; p++)
+    {
+        delete_tokenlist(programs[p]);
+        free(inputs[p]);
+    }
+    delete_parse_context(context);
+    delete_nametable(names);
+    free(inputs);
+    free(programs);
+    free(variables);
+    free(results);
+    free(errors);
+    return 0;
+}
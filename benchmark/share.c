@@ -0,0 +1,76 @@
+// standard library includes
+#include <stdio.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "bench.h"
+
+#define ROWS 1000000
+
+// generated formulas tend to repeat whole subexpressions
+static const char *formulas[] = {
+    "sin(a * b) + sin(a * b) * 2 + sin(a * b) ^ 2 - sin(a * b) / 3 + abs(sin(a * b))",
+    "(x + y) * (x + y) - (x + y) / (c + 1) + ln(c + 1)",
+    "cos(x / 3) * sin(y / 3) + cos(x / 3) * cos(y / 3) - sin(y / 3)",
+    "(a * x ^ 2 + b * x + c) / (1 + (a * x ^ 2 + b * x + c) ^ 2)",
+    "a * b + b * a",
+};
+
+#define FORMULA_COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+// evaluate a program over rows of changing inputs
+static double run(const TokenList program, double *seconds)
+{
+    ParseContext context = new_parse_context();
+    double values[5] = { 1.25, -0.5, 3, 0.75, 2 };
+    double sum = 0;
+    Token result = create_empty_token();
+
+    double start = bench_now();
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        values[3] = row * 1e-6;
+        if (evaluate_context(&context, program, values, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    *seconds = bench_now() - start;
+
+    delete_parse_context(context);
+    return sum;
+}
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "a", 1);
+    nametable_add(&names, "b", 1);
+    nametable_add(&names, "c", 1);
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+
+    for (unsigned int i = 0; i < FORMULA_COUNT; i++)
+    {
+        TokenList plain = new_tokenlist();
+        TokenList shared = new_tokenlist();
+        convert_names(formulas[i], &plain, &names);
+        convert_names(formulas[i], &shared, &names);
+        optimize(&shared, OPTIMIZE_SHARE);
+
+        double plain_seconds, shared_seconds;
+        bench_consume(run(plain, &plain_seconds));
+        bench_consume(run(shared, &shared_seconds));
+
+        printf("%s\n", formulas[i]);
+        printf("  dispatches %u -> %u\n", program_dispatch_count(plain),
+               program_dispatch_count(shared));
+        bench_report_rate("  plain rows", ROWS, plain_seconds);
+        bench_report_rate("  shared rows", ROWS, shared_seconds);
+
+        delete_tokenlist(shared);
+        delete_tokenlist(plain);
+    }
+
+    delete_nametable(names);
+    return 0;
+}
@@ -0,0 +1,164 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// project includes
+#include "parser.h"
+#include "shm_ring.h"
+#include "bench.h"
+
+#define ROUND_TRIPS 100000
+#define PIPELINED 1000000
+
+static const char *expression = "(1+-4/2.5)*16-(7%2)^3/5 + sin(pi/4) * log 100";
+static const char *program = "x * y + sin x - y / 4";
+
+static void fill_text(ShmSlot *slot)
+{
+    slot->kind = SHM_SLOT_TEXT;
+    slot->length = strlen(expression);
+    memcpy(slot->input.text, expression, slot->length);
+}
+
+static void fill_row(ShmSlot *slot, unsigned int i)
+{
+    slot->kind = SHM_SLOT_ROW;
+    slot->length = 2;
+    slot->input.row[0] = i * 0.001;
+    slot->input.row[1] = 3.5;
+}
+
+// one request in flight at a time
+static void round_trips(ShmRing *ring, double *samples, bool rows)
+{
+    for (unsigned int i = 0; i < ROUND_TRIPS; i++)
+    {
+        double start = bench_now();
+
+        ShmSlot *slot = shm_ring_reserve(ring);
+        if (rows)
+            fill_row(slot, i);
+        else
+            fill_text(slot);
+        shm_ring_publish(ring);
+
+        slot = shm_ring_result(ring, true);
+        bench_consume(slot->value);
+        shm_ring_release(ring);
+
+        samples[i] = bench_now() - start;
+    }
+}
+
+// keep the ring as full as possible
+static double pipelined(ShmRing *ring)
+{
+    unsigned int sent = 0;
+    unsigned int received = 0;
+    double start = bench_now();
+
+    while (received < PIPELINED)
+    {
+        ShmSlot *slot;
+        while (sent < PIPELINED && (slot = shm_ring_reserve(ring)) != NULL)
+        {
+            fill_row(slot, sent);
+            shm_ring_publish(ring);
+            sent += 1;
+        }
+
+        slot = shm_ring_result(ring, true);
+        bench_consume(slot->value);
+        shm_ring_release(ring);
+        received += 1;
+    }
+
+    return bench_now() - start;
+}
+
+static void in_process(double *samples)
+{
+    Token result = create_empty_token();
+
+    for (unsigned int i = 0; i < ROUND_TRIPS; i++)
+    {
+        double start = bench_now();
+        parse(expression, &result);
+        bench_consume(result.value.number);
+        samples[i] = bench_now() - start;
+    }
+    bench_report_latency("in process parse()", samples, ROUND_TRIPS);
+
+    ParseContext context = new_parse_context();
+    for (unsigned int i = 0; i < ROUND_TRIPS; i++)
+    {
+        double start = bench_now();
+        parse_context(&context, expression, &result);
+        bench_consume(result.value.number);
+        samples[i] = bench_now() - start;
+    }
+    bench_report_latency("in process parse_context()", samples, ROUND_TRIPS);
+
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+    convert_names(program, &context.program, &names);
+    for (unsigned int i = 0; i < ROUND_TRIPS; i++)
+    {
+        double row[2] = { i * 0.001, 3.5 };
+        double start = bench_now();
+        evaluate_context(&context, context.program, row, &result);
+        bench_consume(result.value.number);
+        samples[i] = bench_now() - start;
+    }
+    bench_report_latency("in process evaluate_context()", samples, ROUND_TRIPS);
+
+    delete_nametable(names);
+    delete_parse_context(context);
+}
+
+int main(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/parser_bench_%d", (int)getpid());
+
+    ShmRing ring;
+    if (!shm_ring_create(&ring, name, 256, program, "x y"))
+    {
+        perror(name);
+        return 1;
+    }
+
+    // the evaluator runs in a separate process on the same mapping
+    pid_t evaluator = fork();
+    if (evaluator == 0)
+    {
+        shm_ring_serve(&ring);
+        _exit(0);
+    }
+
+    double *samples = (double *)malloc(ROUND_TRIPS * sizeof(double));
+    if (samples == NULL) exit(1);
+
+    in_process(samples);
+
+    round_trips(&ring, samples, false);
+    bench_report_latency("ring round trip, text", samples, ROUND_TRIPS);
+
+    round_trips(&ring, samples, true);
+    bench_report_latency("ring round trip, row", samples, ROUND_TRIPS);
+
+    bench_report_rate("ring pipelined, row", PIPELINED, pipelined(&ring));
+
+    shm_ring_shutdown(&ring);
+    waitpid(evaluator, NULL, 0);
+
+    shm_ring_close(&ring);
+    shm_ring_unlink(name);
+    free(samples);
+
+    return 0;
+}
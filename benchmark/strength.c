@@ -0,0 +1,93 @@
+// standard library includes
+#include <stdio.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "bench.h"
+
+#define ROWS 1000000
+
+static const char *formulas[] = {
+    "x ^ 2 + y ^ 2",
+    "3 * x ^ 3 - 2 * x ^ 2 + x / 4 - 7",
+    "(x ^ 2 + y ^ 2) ^ 0.5",
+    "x ^ 5 / 120 - x ^ 3 / 6 + x",
+    "a * x ^ 4 + b * x ^ 3 + c * x ^ 2 + x / 3",
+    "sind(x) ^ 2 + cosd(x) ^ 2 + tand(y * 90)",
+};
+
+#define FORMULA_COUNT (sizeof(formulas) / sizeof(formulas[0]))
+
+static const unsigned int passes[] = {
+    OPTIMIZE_NONE,
+    OPTIMIZE_STRENGTH,
+    OPTIMIZE_STRENGTH | OPTIMIZE_FUSE,
+    OPTIMIZE_STRENGTH | OPTIMIZE_RECIPROCAL | OPTIMIZE_FUSE,
+};
+
+static const char *pass_names[] = {
+    "  plain",
+    "  strength",
+    "  strength, fused",
+    "  reciprocal, fused",
+};
+
+#define PASS_COUNT (sizeof(passes) / sizeof(passes[0]))
+
+// evaluate a program over rows of changing inputs
+static double run(const TokenList program, double *seconds)
+{
+    ParseContext context = new_parse_context();
+    double values[5] = { 1.25, -0.5, 3, 0.75, 2 };
+    double sum = 0;
+    Token result = create_empty_token();
+
+    double start = bench_now();
+    for (unsigned int row = 0; row < ROWS; row++)
+    {
+        values[3] = row * 1e-6;
+        if (evaluate_context(&context, program, values, &result).status == SUCCESS)
+            sum += result.value.number;
+    }
+    *seconds = bench_now() - start;
+
+    delete_parse_context(context);
+    return sum;
+}
+
+int main(void)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "a", 1);
+    nametable_add(&names, "b", 1);
+    nametable_add(&names, "c", 1);
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+
+    for (unsigned int i = 0; i < FORMULA_COUNT; i++)
+    {
+        printf("%s\n", formulas[i]);
+
+        double plain_seconds = 0;
+        for (unsigned int p = 0; p < PASS_COUNT; p++)
+        {
+            TokenList program = new_tokenlist();
+            convert_names(formulas[i], &program, &names);
+            optimize(&program, passes[p]);
+
+            double seconds;
+            bench_consume(run(program, &seconds));
+            if (p == 0)
+                plain_seconds = seconds;
+
+            bench_report_rate(pass_names[p], ROWS, seconds);
+            printf("    %.2fx of plain\n", plain_seconds / seconds);
+
+            delete_tokenlist(program);
+        }
+    }
+
+    delete_nametable(names);
+    return 0;
+}
@@ -0,0 +1,55 @@
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// project includes
+#include "bench.h"
+
+static volatile double sink;
+
+double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double bench_percentile(double *samples, unsigned int count, double p)
+{
+    if (count == 0)
+        return 0;
+
+    qsort(samples, count, sizeof(double), compare_double);
+    return samples[(unsigned int)(p * (count - 1) + 0.5)];
+}
+
+void bench_report_latency(const char *name, double *samples, unsigned int count)
+{
+    double sum = 0;
+    for (unsigned int i = 0; i < count; i++)
+        sum += samples[i];
+
+    double p50 = bench_percentile(samples, count, 0.50);
+    double p99 = bench_percentile(samples, count, 0.99);
+
+    printf("%-32s mean %9.3f us  p50 %9.3f us  p99 %9.3f us\n", name,
+           count > 0 ? sum / count * 1e6 : 0, p50 * 1e6, p99 * 1e6);
+}
+
+void bench_report_rate(const char *name, double operations, double seconds)
+{
+    printf("%-32s %12.0f ops/s  (%.3f s)\n", name, operations / seconds, seconds);
+}
+
+void bench_consume(double value)
+{
+    sink = value;
+}
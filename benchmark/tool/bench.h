@@ -0,0 +1,19 @@
+#ifndef BENCH
+#define BENCH
+
+// monotonic time in seconds
+double bench_now(void);
+
+// sorts samples in place and returns the requested percentile
+double bench_percentile(double *samples, unsigned int count, double p);
+
+// print a latency summary line of samples given in seconds
+void bench_report_latency(const char *name, double *samples, unsigned int count);
+
+// print a throughput line
+void bench_report_rate(const char *name, double operations, double seconds);
+
+// keep the compiler from discarding a computed value
+void bench_consume(double value);
+
+#endif // BENCH
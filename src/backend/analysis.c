@@ -0,0 +1,369 @@
+// standard library includes
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "functions.h"
+
+static const char *operator_names[OPERATOR_TYPE_COUNT] = {
+    [ADD] = "add", [SUB] = "sub", [MULT] = "mult", [DIV] = "div", [MOD] = "mod",
+    [POW] = "pow", [NEG] = "neg",
+    [SIN] = "sin", [COS] = "cos", [TAN] = "tan",
+    [ASIN] = "asin", [ACOS] = "acos", [ATAN] = "atan",
+    [SIND] = "sind", [COSD] = "cosd", [TAND] = "tand",
+    [ASIND] = "asind", [ACOSD] = "acosd", [ATAND] = "atand",
+    [LN] = "ln", [LOG] = "log", [ABS] = "abs", [FAC] = "fac",
+    [MULT_ADD] = "mult_add", [MULT_SUB] = "mult_sub",
+    [ADD_MULT] = "add_mult", [SUB_MULT] = "sub_mult",
+    [ADD_IMM] = "add_imm", [SUB_IMM] = "sub_imm", [MULT_IMM] = "mult_imm",
+    [DIV_IMM] = "div_imm", [MOD_IMM] = "mod_imm", [POW_IMM] = "pow_imm",
+    [NEG_CALL] = "neg_call", [CALL_NEG] = "call_neg",
+    [POW_INT] = "pow_int", [SQRT] = "sqrt",
+    [RESERVE] = "reserve", [STORE] = "store", [LOAD] = "load",
+    [IADD] = "iadd", [ISUB] = "isub", [IMULT] = "imult", [IDIV] = "idiv",
+    [IMOD] = "imod", [IPOW] = "ipow", [INEG] = "ineg", [IABS] = "iabs",
+    [IFAC] = "ifac", [PROMOTE] = "promote",
+    [LESS] = "less", [LESS_EQUAL] = "less_equal", [GREATER] = "greater",
+    [GREATER_EQUAL] = "greater_equal", [EQUAL] = "equal", [NOT_EQUAL] = "not_equal",
+    [QUESTION] = "question", [COLON] = "colon",
+    [JUMP_FALSE] = "jump_false", [JUMP] = "jump",
+    [COMMA] = "comma", [ARGUMENT] = "argument",
+    [INTEGRATE] = "integrate", [SUM] = "sum", [ROOT] = "root",
+};
+
+const char *operator_name(operator_type type)
+{
+    if (type < ADD || type >= OPERATOR_TYPE_COUNT)
+        return "none";
+
+    return operator_names[type];
+}
+
+CostTable default_cost_table(void)
+{
+    CostTable table;
+    for (unsigned int i = 0; i < OPERATOR_TYPE_COUNT; i++)
+        table.operators[i] = 0;
+
+    table.operand = 20;
+    table.native = 30;
+
+    table.operators[ADD] = 20;
+    table.operators[SUB] = 20;
+    table.operators[MULT] = 18;
+    table.operators[DIV] = 18;
+    table.operators[MOD] = 30;
+    table.operators[POW] = 60;
+    table.operators[NEG] = 25;
+    table.operators[SIN] = 50;
+    table.operators[COS] = 50;
+    table.operators[TAN] = 75;
+    table.operators[ASIN] = 45;
+    table.operators[ACOS] = 45;
+    table.operators[ATAN] = 45;
+    table.operators[SIND] = 45;
+    table.operators[COSD] = 45;
+    table.operators[TAND] = 60;
+    table.operators[ASIND] = 45;
+    table.operators[ACOSD] = 45;
+    table.operators[ATAND] = 45;
+    table.operators[LN] = 40;
+    table.operators[LOG] = 45;
+    table.operators[ABS] = 25;
+    table.operators[FAC] = 50;
+
+    return table;
+}
+
+// operators without an entry of their own cost what they stand for
+static double operator_cost(const CostTable *costs, operator_type type, operator_type called)
+{
+    const double *c = costs->operators;
+    if (c[type] != 0)
+        return c[type];
+
+    switch (type)
+    {
+        case MULT_ADD: case MULT_SUB: case ADD_MULT: case SUB_MULT:
+            return c[MULT];
+        case ADD_IMM: case IADD: return c[ADD];
+        case SUB_IMM: case ISUB: return c[SUB];
+        case MULT_IMM: case IMULT: return c[MULT];
+        case DIV_IMM: case IDIV: return c[DIV];
+        case MOD_IMM: case IMOD: return c[MOD];
+        case POW_IMM: case IPOW: return c[POW];
+        case POW_INT: return 2 * c[MULT];
+        case SQRT: return c[DIV];
+        case INEG: return c[NEG];
+        case IABS: return c[ABS];
+        case IFAC: return c[FAC];
+        case NEG_CALL: case CALL_NEG:
+            return c[NEG] + c[called];
+        case LESS: case LESS_EQUAL: case GREATER:
+        case GREATER_EQUAL: case EQUAL: case NOT_EQUAL:
+        case RESERVE: case STORE: case LOAD: case PROMOTE:
+        case JUMP_FALSE: case JUMP:
+            return c[ADD];
+        default:
+            return 0;
+    }
+}
+
+static bool transcendental(operator_type type)
+{
+    return (type >= SIN && type <= ATAND) || type == LN || type == LOG;
+}
+
+static analysis_category operator_category(operator_type type, operator_type called)
+{
+    if (transcendental(type) || ((type == NEG_CALL || type == CALL_NEG) && transcendental(called)))
+        return ANALYSIS_TRANSCENDENTAL;
+
+    switch (type)
+    {
+        case POW: case POW_IMM: case POW_INT: case SQRT: case IPOW:
+            return ANALYSIS_POWER;
+        case FAC: case IFAC:
+            return ANALYSIS_FACTORIAL;
+        case LESS: case LESS_EQUAL: case GREATER:
+        case GREATER_EQUAL: case EQUAL: case NOT_EQUAL:
+            return ANALYSIS_COMPARISON;
+        case RESERVE: case STORE: case LOAD: case JUMP_FALSE: case JUMP:
+            return ANALYSIS_CONTROL;
+        case NEG_CALL: case CALL_NEG:
+            return operator_category(called, called);
+        default:
+            return ANALYSIS_ARITHMETIC;
+    }
+}
+
+// a conditional being analyzed, from its JUMP_FALSE to its end
+typedef struct
+{
+    double cost;            // before either branch
+    double then_cost;
+    bool condition_constant;
+    bool then_constant;
+} Branch;
+
+ProgramAnalysis analyze_program(const TokenList program, const CostTable *costs)
+{
+    CostTable defaults = default_cost_table();
+    if (costs == NULL)
+        costs = &defaults;
+
+    ProgramAnalysis analysis;
+    memset(&analysis, 0, sizeof(analysis));
+
+    // whether each value on the stack is a constant,
+    // temporaries of RESERVE count towards the stack too
+    unsigned int capacity = program.count + 1;
+    for (unsigned int i = 0; i + 1 < program.count; i++)
+    {
+        if (program.list[i].type == OPERATOR && program.list[i].value.operator == RESERVE)
+            capacity += (unsigned int)program.list[i + 1].value.number;
+    }
+
+    bool *constant = (bool *)malloc(capacity * sizeof(bool));
+    Branch *branches = (Branch *)malloc((program.count + 1) * sizeof(Branch));
+    unsigned int *joins = (unsigned int *)calloc(program.count + 1, sizeof(unsigned int));
+    if (constant == NULL || branches == NULL || joins == NULL) exit(1);
+
+    // every JUMP ends its conditional at its target
+    for (unsigned int i = 0; i + 1 < program.count; i++)
+    {
+        const Token *token = &program.list[i];
+        unsigned int target = (unsigned int)token[1].value.number;
+        if (token->type == OPERATOR && token->value.operator == JUMP && target <= program.count)
+            joins[target] += 1;
+    }
+
+    unsigned int depth = 0, open = 0;
+    unsigned int operations = 0, constant_operations = 0;
+    double cost = 0;
+
+    for (unsigned int i = 0; i <= program.count; i++)
+    {
+        // a conditional costs its costlier branch,
+        // its value is constant only if everything in it is
+        for (unsigned int j = 0; j < joins[i] && open > 0 && depth > 0; j++)
+        {
+            Branch *branch = &branches[--open];
+            double else_cost = cost - branch->cost;
+            cost = branch->cost + (branch->then_cost > else_cost ? branch->then_cost : else_cost);
+            constant[depth - 1] = constant[depth - 1] && branch->condition_constant &&
+                                  branch->then_constant;
+        }
+
+        if (i == program.count)
+            break;
+
+        const Token *token = &program.list[i];
+        analysis.token_count += 1;
+
+        if (token->type == NUMBER || token->type == INTEGER || token->type == VARIABLE)
+        {
+            analysis.category_counts[ANALYSIS_OPERAND] += 1;
+            cost += costs->operand;
+            constant[depth++] = token->type != VARIABLE;
+        }
+
+        else if (token->type == NATIVE)
+        {
+            const NativeFunction *native = token->value.native;
+            bool all = (native->flags & NATIVE_PURE) != 0;
+            unsigned int arity = native->arity < depth ? native->arity : depth;
+            for (unsigned int k = 0; k < arity; k++)
+                all = all && constant[depth - 1 - k];
+
+            depth -= arity;
+            constant[depth++] = all;
+            analysis.category_counts[ANALYSIS_NATIVE] += 1;
+            cost += costs->native;
+            operations += 1;
+            constant_operations += all;
+        }
+
+        else if (token->type == OPERATOR)
+        {
+            operator_type type = token->value.operator;
+            bool immediate = hasimmediate(type);
+            operator_type called = type == NEG_CALL || type == CALL_NEG ?
+                                   token[1].value.operator : type;
+
+            analysis.operator_counts[type] += 1;
+            analysis.category_counts[operator_category(type, called)] += 1;
+            analysis.transcendental_count += transcendental(called);
+            cost += operator_cost(costs, type, called);
+
+            if (type == JUMP_FALSE && depth > 0)
+            {
+                Branch *branch = &branches[open++];
+                branch->condition_constant = constant[--depth];
+                branch->cost = cost;
+            }
+
+            else if (type == JUMP && open > 0 && depth > 0)
+            {
+                Branch *branch = &branches[open - 1];
+                branch->then_cost = cost - branch->cost;
+                branch->then_constant = constant[--depth];
+                cost = branch->cost;
+            }
+
+            else if (type == RESERVE)
+            {
+                for (unsigned int k = 0; k < (unsigned int)token[1].value.number; k++)
+                    constant[depth++] = false;
+            }
+
+            // a temporary is not followed back to the value it holds
+            else if (type == LOAD)
+            {
+                constant[depth++] = false;
+            }
+
+            else if (type != STORE)
+            {
+                unsigned int arity = operator_arity(type) < depth ? operator_arity(type) : depth;
+                bool all = true;
+                for (unsigned int k = 0; k < arity; k++)
+                    all = all && constant[depth - 1 - k];
+
+                depth -= arity;
+                constant[depth++] = all;
+                operations += 1;
+                constant_operations += all;
+            }
+
+            if (immediate)
+                i++;
+        }
+
+        if (depth > analysis.stack_depth)
+            analysis.stack_depth = depth;
+    }
+
+    analysis.constant_ratio = operations > 0 ? (double)constant_operations / operations : 0;
+    analysis.cost = cost;
+
+    free(constant);
+    free(branches);
+    free(joins);
+    return analysis;
+}
+
+bool cost_table_load(const char *path, CostTable *costs)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    char line[128];
+    char name[64];
+    double value;
+    bool valid = true;
+
+    while (valid && fgets(line, sizeof(line), file) != NULL)
+    {
+        // blank lines and comments are skipped
+        if (sscanf(line, " %63s", name) != 1 || name[0] == '#')
+            continue;
+
+        if (sscanf(line, " %63s %lf", name, &value) != 2)
+        {
+            valid = false;
+            break;
+        }
+
+        if (!strcmp(name, "operand"))
+        {
+            costs->operand = value;
+            continue;
+        }
+
+        if (!strcmp(name, "native"))
+        {
+            costs->native = value;
+            continue;
+        }
+
+        valid = false;
+        for (unsigned int t = ADD; t < OPERATOR_TYPE_COUNT; t++)
+        {
+            if (!strcmp(name, operator_names[t]))
+            {
+                costs->operators[t] = value;
+                valid = true;
+                break;
+            }
+        }
+    }
+
+    fclose(file);
+    return valid;
+}
+
+bool cost_table_save(const char *path, const CostTable *costs)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "# estimated cycles of one evaluation of each token\n");
+    fprintf(file, "operand %.1f\n", costs->operand);
+    fprintf(file, "native %.1f\n", costs->native);
+
+    // operators without an entry cost what they stand for
+    for (unsigned int t = ADD; t < OPERATOR_TYPE_COUNT; t++)
+    {
+        if (costs->operators[t] != 0)
+            fprintf(file, "%s %.1f\n", operator_names[t], costs->operators[t]);
+    }
+
+    return fclose(file) == 0;
+}
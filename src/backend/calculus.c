@@ -0,0 +1,630 @@
+// standard library includes
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "optimize.h"
+#include "rows.h"
+#include "calculus.h"
+
+// 15 point Kronrod rule on [-1, 1], nodes from the outside in, the last
+// one is 0, every other node is also a node of the 7 point Gauss rule
+static const double kronrod_nodes[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000,
+};
+
+static const double kronrod_weights[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+
+// weights of the Gauss nodes kronrod_nodes[1], [3], [5] and [7]
+static const double gauss_weights[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+#define KRONROD_POINTS 15
+
+static ResultInfo result_info(error_type status, unsigned int error_index)
+{
+    ResultInfo res;
+    res.status = status;
+    res.error_index = error_index;
+    return res;
+}
+
+// compensated sum, adding in the same order gives the same result
+typedef struct
+{
+    double sum;
+    double compensation;
+} Sum;
+
+static void sum_add(Sum *self, double value)
+{
+    double t = self->sum + value;
+    if (fabs(self->sum) >= fabs(value))
+        self->compensation += (self->sum - t) + value;
+    else
+        self->compensation += (value - t) + self->sum;
+    self->sum = t;
+}
+
+// evaluation of a body at batches of points
+typedef struct
+{
+    const TokenList *body;
+    RowPool *pool;
+    RowPool own;
+    bool own_started;
+    BatchContext batch;
+    bool batch_started;
+
+    double *points;
+    double *values;
+    error_type *errors;
+    unsigned int max;
+} Points;
+
+static Points new_points(const TokenList *body, RowPool *pool)
+{
+    Points obj;
+    obj.body = body;
+    obj.pool = pool;
+    obj.own_started = false;
+    obj.batch_started = false;
+    obj.points = NULL;
+    obj.values = NULL;
+    obj.errors = NULL;
+    obj.max = 0;
+
+    return obj;
+}
+
+static void delete_points(Points *self)
+{
+    if (self->own_started)
+        delete_row_pool(&self->own);
+    if (self->batch_started)
+        delete_batch_context(self->batch);
+
+    free(self->points);
+    free(self->values);
+    free(self->errors);
+}
+
+// room for count points, the values are 64 byte aligned for the row pool
+static void reserve_points(Points *self, unsigned int count)
+{
+    if (count <= self->max)
+        return;
+
+    unsigned int max = (count + 7) / 8 * 8;
+    free(self->points);
+    free(self->values);
+    free(self->errors);
+
+    self->points = (double *)malloc(max * sizeof(double));
+    self->values = (double *)aligned_alloc(64, max * sizeof(double));
+    self->errors = (error_type *)aligned_alloc(64, (max * sizeof(error_type) + 63) / 64 * 64);
+    if (self->points == NULL || self->values == NULL || self->errors == NULL) exit(1);
+
+    self->max = max;
+}
+
+// values of the body at the first count points
+// a failure is reported as evaluate reports it for the first failed point
+static ResultInfo evaluate_points(Points *self, unsigned int count)
+{
+    unsigned long long failed;
+    RowPool *pool = NULL;
+
+    if (count >= CALCULUS_PARALLEL_MIN)
+    {
+        pool = self->pool;
+        if (pool == NULL)
+        {
+            if (!self->own_started)
+            {
+                self->own = new_row_pool(0);
+                self->own_started = true;
+            }
+            pool = &self->own;
+        }
+    }
+
+    // the pool evaluates row by row, which only pays off over several threads
+    if (pool != NULL && pool->thread_count > 1)
+        failed = evaluate_rows(pool, *self->body, self->points, 1, count,
+                               self->values, self->errors);
+
+    else
+    {
+        if (!self->batch_started)
+        {
+            self->batch = new_batch_context();
+            self->batch_started = true;
+        }
+
+        failed = evaluate_batch(&self->batch, *self->body, self->points, 1, count,
+                                self->values, self->errors);
+    }
+
+    if (failed == 0)
+        return result_info(SUCCESS, 0);
+
+    unsigned int i = 0;
+    while (self->errors[i] == SUCCESS)
+        i++;
+
+    Token result = create_empty_token();
+    return evaluate(*self->body, &self->points[i], &result);
+}
+
+// a piece of the range of integrate, split depth times
+typedef struct
+{
+    double low;
+    double high;
+    unsigned int depth;
+} Interval;
+
+ResultInfo integrate_program(RowPool *pool, const TokenList body,
+                             double low, double high, double *result)
+{
+    if (!isfinite(low) || !isfinite(high))
+        return result_info(BOUND_NOT_FINITE, 0);
+
+    *result = 0;
+    if (low == high)
+        return result_info(SUCCESS, 0);
+
+    Interval *active = (Interval *)malloc(INTEGRATE_INTERVALS_MAX * sizeof(Interval));
+    Interval *next = (Interval *)malloc(INTEGRATE_INTERVALS_MAX * sizeof(Interval));
+    double *estimates = (double *)malloc(INTEGRATE_INTERVALS_MAX * sizeof(double));
+    double *errors = (double *)malloc(INTEGRATE_INTERVALS_MAX * sizeof(double));
+    if (active == NULL || next == NULL || estimates == NULL || errors == NULL) exit(1);
+
+    unsigned int active_count = INTEGRATE_START_INTERVALS;
+    double width = (high - low) / INTEGRATE_START_INTERVALS;
+    for (unsigned int k = 0; k < active_count; k++)
+    {
+        active[k].low = low + k * width;
+        active[k].high = k + 1 == active_count ? high : low + (k + 1) * width;
+        active[k].depth = 0;
+    }
+
+    Points points = new_points(&body, pool);
+    ResultInfo res = result_info(SUCCESS, 0);
+    Sum accepted = { 0, 0 };
+    double span = fabs(high - low);
+
+    // error of the accepted pieces, and whether one was accepted
+    // at a limit rather than for its error
+    Sum accepted_error = { 0, 0 };
+    bool limited = false;
+
+    while (active_count > 0)
+    {
+        // every node of every interval in one batch
+        reserve_points(&points, active_count * KRONROD_POINTS);
+        for (unsigned int k = 0; k < active_count; k++)
+        {
+            double center = (active[k].low + active[k].high) / 2;
+            double half = (active[k].high - active[k].low) / 2;
+            double *p = points.points + k * KRONROD_POINTS;
+            for (unsigned int j = 0; j < 7; j++)
+            {
+                p[2 * j] = center - half * kronrod_nodes[j];
+                p[2 * j + 1] = center + half * kronrod_nodes[j];
+            }
+            p[14] = center;
+        }
+
+        res = evaluate_points(&points, active_count * KRONROD_POINTS);
+        if (res.status != SUCCESS)
+            break;
+
+        Sum total = accepted;
+        for (unsigned int k = 0; k < active_count; k++)
+        {
+            const double *v = points.values + k * KRONROD_POINTS;
+            double half = (active[k].high - active[k].low) / 2;
+            double kronrod = kronrod_weights[7] * v[14];
+            double gauss = gauss_weights[3] * v[14];
+            for (unsigned int j = 0; j < 7; j++)
+            {
+                double pair = v[2 * j] + v[2 * j + 1];
+                kronrod += kronrod_weights[j] * pair;
+                if (j % 2 == 1)
+                    gauss += gauss_weights[j / 2] * pair;
+            }
+
+            estimates[k] = kronrod * half;
+            errors[k] = fabs((kronrod - gauss) * half);
+            sum_add(&total, estimates[k]);
+        }
+
+        // each interval gets its share of the tolerance of the whole integral
+        double tolerance = fmax(INTEGRATE_ABSOLUTE,
+                                INTEGRATE_RELATIVE * fabs(total.sum + total.compensation));
+        unsigned int next_count = 0;
+        for (unsigned int k = 0; k < active_count; k++)
+        {
+            const Interval *interval = &active[k];
+            double middle = (interval->low + interval->high) / 2;
+            double allowed = tolerance * fabs(interval->high - interval->low) / span;
+
+            bool converged = errors[k] <= allowed;
+            bool done = converged || interval->depth == INTEGRATE_DEPTH_MAX ||
+                        next_count + 2 > INTEGRATE_INTERVALS_MAX ||
+                        middle == interval->low || middle == interval->high;
+            if (done)
+            {
+                sum_add(&accepted, estimates[k]);
+                sum_add(&accepted_error, errors[k]);
+                limited = limited || !converged;
+                continue;
+            }
+
+            next[next_count].low = interval->low;
+            next[next_count].high = middle;
+            next[next_count].depth = interval->depth + 1;
+            next[next_count + 1].low = middle;
+            next[next_count + 1].high = interval->high;
+            next[next_count + 1].depth = interval->depth + 1;
+            next_count += 2;
+        }
+
+        Interval *swap = active;
+        active = next;
+        next = swap;
+        active_count = next_count;
+    }
+
+    // a piece that could not be split any further
+    // may still be within the tolerance of the whole integral
+    if (res.status == SUCCESS && limited)
+    {
+        double value = accepted.sum + accepted.compensation;
+        double tolerance = fmax(INTEGRATE_ABSOLUTE, INTEGRATE_RELATIVE * fabs(value));
+        if (accepted_error.sum + accepted_error.compensation > tolerance)
+            res = result_info(NOT_CONVERGED, 0);
+    }
+
+    if (res.status == SUCCESS)
+        *result = accepted.sum + accepted.compensation;
+
+    delete_points(&points);
+    free(errors);
+    free(estimates);
+    free(next);
+    free(active);
+    return res;
+}
+
+ResultInfo sum_program(RowPool *pool, const TokenList body,
+                       double first, double last, double *result)
+{
+    if (!isfinite(first) || !isfinite(last))
+        return result_info(BOUND_NOT_FINITE, 0);
+
+    *result = 0;
+    if (last < first)
+        return result_info(SUCCESS, 0);
+
+    double terms = floor(last - first) + 1;
+    if (terms > CALCULUS_SUM_MAX)
+        return result_info(CAPACITY_EXCEEDED, 0);
+
+    unsigned long long count = (unsigned long long)terms;
+    Points points = new_points(&body, pool);
+    ResultInfo res = result_info(SUCCESS, 0);
+    Sum total = { 0, 0 };
+
+    for (unsigned long long done = 0; done < count; done += CALCULUS_CHUNK)
+    {
+        unsigned int chunk = count - done < CALCULUS_CHUNK ? count - done : CALCULUS_CHUNK;
+        reserve_points(&points, chunk);
+        for (unsigned int k = 0; k < chunk; k++)
+            points.points[k] = first + (double)(done + k);
+
+        res = evaluate_points(&points, chunk);
+        if (res.status != SUCCESS)
+            break;
+
+        for (unsigned int k = 0; k < chunk; k++)
+            sum_add(&total, points.values[k]);
+    }
+
+    if (res.status == SUCCESS)
+        *result = total.sum + total.compensation;
+
+    delete_points(&points);
+    return res;
+}
+
+// bisection by ROOT_SECTIONS at once, the first piece that
+// changes sign is kept, so the result does not depend on the threads
+ResultInfo root_program(RowPool *pool, const TokenList body,
+                        double low, double high, double *result)
+{
+    if (!isfinite(low) || !isfinite(high))
+        return result_info(BOUND_NOT_FINITE, 0);
+
+    if (low > high)
+    {
+        double swap = low;
+        low = high;
+        high = swap;
+    }
+
+    Points points = new_points(&body, pool);
+    reserve_points(&points, ROOT_SECTIONS);
+    points.points[0] = low;
+    points.points[1] = high;
+
+    ResultInfo res = evaluate_points(&points, 2);
+    double low_value = points.values[0];
+    double high_value = points.values[1];
+
+    if (res.status == SUCCESS && !(low_value == 0 || high_value == 0 ||
+                                   (low_value < 0) != (high_value < 0)))
+        res = result_info(NO_SIGN_CHANGE, 0);
+
+    for (unsigned int round = 0; round < ROOT_ROUNDS_MAX && res.status == SUCCESS &&
+                                 low_value != 0 && high_value != 0; round++)
+    {
+        double middle = low + (high - low) / 2;
+        if (middle <= low || middle >= high)
+            break;
+
+        unsigned int count = ROOT_SECTIONS - 1;
+        for (unsigned int k = 0; k < count; k++)
+            points.points[k] = low + (high - low) * (k + 1) / ROOT_SECTIONS;
+
+        res = evaluate_points(&points, count);
+        if (res.status != SUCCESS)
+            break;
+
+        double new_low = low;
+        double new_low_value = low_value;
+        unsigned int k = 0;
+        for (; k < count; k++)
+        {
+            double value = points.values[k];
+            if (value == 0 || (value < 0) != (low_value < 0))
+                break;
+
+            new_low = points.points[k];
+            new_low_value = value;
+        }
+
+        if (k < count)
+        {
+            high = points.points[k];
+            high_value = points.values[k];
+        }
+
+        low = new_low;
+        low_value = new_low_value;
+    }
+
+    if (res.status == SUCCESS)
+        *result = fabs(low_value) < fabs(high_value) ? low : high;
+
+    delete_points(&points);
+    return res;
+}
+
+static bool iscalculus(const Token *token)
+{
+    return token->type == OPERATOR &&
+           (token->value.operator == INTEGRATE || token->value.operator == SUM ||
+            token->value.operator == ROOT);
+}
+
+// an argument of a call, tokens count starting at list
+typedef struct
+{
+    const Token *list;
+    unsigned int count;
+} CalculusArgument;
+
+// compile an argument that may only depend on the variable bound,
+// which becomes variable 0, or on nothing if bound is NULL
+static ResultInfo compile_argument(CalculusArgument arg, const Token *bound, TokenList *program)
+{
+    ResultInfo res = result_info(SUCCESS, 0);
+    TokenList infix = new_tokenlist();
+    TokenList stack = new_tokenlist();
+
+    for (unsigned int i = 0; i < arg.count && res.status == SUCCESS; i++)
+    {
+        Token t = arg.list[i];
+        if (t.type == BOUND && bound != NULL && t.value.variable == bound->value.variable)
+            t = create_variable_token(0, t.column);
+        else if (t.type == BOUND || t.type == VARIABLE)
+            res = result_info(UNDEFINED_VARIABLE, t.column);
+
+        tokenlist_add(&infix, t);
+    }
+
+    if (res.status == SUCCESS)
+        res = convert_tokens(&infix, program, &stack);
+
+    delete_tokenlist(stack);
+    delete_tokenlist(infix);
+    return res;
+}
+
+static ResultInfo argument_value(CalculusArgument arg, double *value)
+{
+    TokenList program = new_tokenlist();
+    Token result = create_empty_token();
+
+    ResultInfo res = compile_argument(arg, NULL, &program);
+    if (res.status == SUCCESS)
+        res = evaluate(program, NULL, &result);
+
+    if (res.status == SUCCESS)
+    {
+        *value = result.value.number;
+        if (!isfinite(*value))
+            res = result_info(BOUND_NOT_FINITE, arg.list[0].column);
+    }
+
+    delete_tokenlist(program);
+    return res;
+}
+
+static unsigned int fold_calls(Token *list, unsigned int count, ResultInfo *res);
+
+// value of the call at list[call], close gets the index of its )
+static ResultInfo fold_call(Token *list, unsigned int count, unsigned int call,
+                            unsigned int *close, double *value)
+{
+    Token op = list[call];
+    if (call + 1 >= count || list[call + 1].type != PARENTHESIS ||
+        list[call + 1].value.parenthesis != LEFT)
+        return result_info(INVALID_TOKEN, op.column);
+
+    unsigned int depth = 0;
+    *close = call + 2;
+    for (; *close < count; (*close)++)
+    {
+        const Token *t = &list[*close];
+        if (t->type == PARENTHESIS && t->value.parenthesis == LEFT)
+            depth++;
+        else if (t->type == PARENTHESIS && depth == 0)
+            break;
+        else if (t->type == PARENTHESIS)
+            depth--;
+    }
+
+    if (*close >= count)
+        return result_info(UNMATCHED_LEFT_PAR, list[call + 1].column);
+
+    // calls in the arguments are replaced by their values first
+    ResultInfo res = result_info(SUCCESS, 0);
+    unsigned int inner = fold_calls(list + call + 2, *close - call - 2, &res);
+    if (res.status != SUCCESS)
+        return res;
+
+    // split at the commas outside of parentheses
+    CalculusArgument args[4];
+    unsigned int arg_count = 0;
+    unsigned int start = call + 2;
+    depth = 0;
+    for (unsigned int i = start; i <= call + 2 + inner; i++)
+    {
+        const Token *t = i == call + 2 + inner ? &list[*close] : &list[i];
+        if (t->type == PARENTHESIS && t->value.parenthesis == LEFT)
+            depth++;
+        else if (t->type == PARENTHESIS && i < call + 2 + inner)
+            depth--;
+
+        bool separator = t->type == OPERATOR && t->value.operator == COMMA && depth == 0;
+        if (!separator && i < call + 2 + inner)
+            continue;
+
+        // an empty argument, or a fifth one
+        if (i == start || (separator && arg_count == 3))
+            return result_info(INVALID_TOKEN, t->column);
+
+        args[arg_count].list = list + start;
+        args[arg_count].count = i - start;
+        arg_count++;
+        start = i + 1;
+    }
+
+    if (arg_count != 4)
+        return result_info(INVALID_TOKEN, op.column);
+
+    // integrate(f, x, a, b), sum(i, a, b, f), root(f, x, a, b)
+    operator_type type = op.value.operator;
+    CalculusArgument variable = type == SUM ? args[0] : args[1];
+    CalculusArgument body = type == SUM ? args[3] : args[0];
+    CalculusArgument low = type == SUM ? args[1] : args[2];
+    CalculusArgument high = type == SUM ? args[2] : args[3];
+
+    if (variable.count != 1 || variable.list[0].type != BOUND)
+        return result_info(INVALID_TOKEN, variable.list[0].column);
+
+    double low_value = 0;
+    double high_value = 0;
+    res = argument_value(low, &low_value);
+    if (res.status == SUCCESS)
+        res = argument_value(high, &high_value);
+    if (res.status != SUCCESS)
+        return res;
+
+    TokenList program = new_tokenlist();
+    res = compile_argument(body, &variable.list[0], &program);
+    if (res.status == SUCCESS)
+    {
+        optimize(&program, OPTIMIZE_FOLD | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+
+        if (type == INTEGRATE)
+            res = integrate_program(NULL, program, low_value, high_value, value);
+        else if (type == SUM)
+            res = sum_program(NULL, program, low_value, high_value, value);
+        else
+            res = root_program(NULL, program, low_value, high_value, value);
+
+        // tokens of the body come after the call, so a column of 0
+        // can only be an error of the range
+        if (res.status != SUCCESS && res.error_index == 0)
+            res.error_index = op.column;
+    }
+
+    delete_tokenlist(program);
+    return res;
+}
+
+// fold every call in list in place, returns the new count
+static unsigned int fold_calls(Token *list, unsigned int count, ResultInfo *res)
+{
+    unsigned int write = 0;
+    for (unsigned int read = 0; read < count && res->status == SUCCESS; read++)
+    {
+        if (!iscalculus(&list[read]))
+        {
+            list[write++] = list[read];
+            continue;
+        }
+
+        unsigned int column = list[read].column;
+        unsigned int close = read;
+        double value = 0;
+        *res = fold_call(list, count, read, &close, &value);
+
+        list[write++] = create_number_token(value, column);
+        read = close;
+    }
+
+    return write;
+}
+
+ResultInfo expand_calculus(TokenList *infix)
+{
+    ResultInfo res = result_info(SUCCESS, 0);
+
+    bool found = false;
+    for (unsigned int i = 0; i < infix->count && !found; i++)
+        found = iscalculus(&infix->list[i]);
+
+    if (found)
+        infix->count = fold_calls(infix->list, infix->count, &res);
+
+    return res;
+}
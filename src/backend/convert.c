@@ -1,10 +1,15 @@
 // standard library includes
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 // project includes
 #include "token.h"
 #include "parser.h"
+#include "optimize.h"
+#include "functions.h"
+#include "calculus.h"
+#include "probes.h"
 
 // convert process variables
 typedef struct
@@ -12,15 +17,73 @@ typedef struct
     // sign is expected if the current token is + or -
     // and the previous token was an operator or left parenthesis
     bool sign_expected;
+
+    // a ? without its : or a : without its ?
+    error_type status;
+    unsigned int error_index;
 } ConvertData;
 
 static ConvertData init(void)
 {
     ConvertData data;
     data.sign_expected = true;
+    data.status = SUCCESS;
+    data.error_index = 0;
     return data;
 }
 
+static bool ismarker(Token t)
+{
+    return t.type == OPERATOR &&
+           (t.value.operator == QUESTION || t.value.operator == COLON);
+}
+
+// point the most recent jump of type that has no target yet
+// at the end of the output
+static void patch_jump(TokenList *output, operator_type type)
+{
+    for (unsigned int i = output->count; i >= 2; i--)
+    {
+        const Token *t = &output->list[i - 2];
+        if (t->type == OPERATOR && t->value.operator == type &&
+            output->list[i - 1].value.number < 0)
+        {
+            output->list[i - 1].value.number = output->count;
+            return;
+        }
+    }
+}
+
+static void add_jump(TokenList *output, operator_type type, unsigned int column)
+{
+    tokenlist_add(output, create_operator_token(type, column));
+    tokenlist_add(output, create_number_token(-1, column));
+}
+
+// move an operator from the stack to the output
+// a : ends its else branch there, a ? never found its :
+static void emit(TokenList *output, Token t, ConvertData *data)
+{
+    if (t.type == OPERATOR && t.value.operator == COLON)
+    {
+        patch_jump(output, JUMP);
+    }
+
+    else if (t.type == OPERATOR && t.value.operator == QUESTION)
+    {
+        if (data->status == SUCCESS)
+        {
+            data->status = INVALID_TOKEN;
+            data->error_index = t.column;
+        }
+    }
+
+    else
+    {
+        tokenlist_add(output, t);
+    }
+}
+
 static void process_parenthesis (
         TokenList *input,
         TokenList *output,
@@ -51,18 +114,30 @@ static void process_parenthesis (
 
             else
             {
-                tokenlist_add(output, temp);
+                emit(output, temp, data);
             }
         }
         data->sign_expected = false;
     }
 }
 
+// a native call binds like a built-in function
+static unsigned int token_precedence(Token t)
+{
+    return t.type == NATIVE ? precedence(NEG) : precedence(t.value.operator);
+}
+
+static bool token_isunary(Token t)
+{
+    return t.type == NATIVE || isunary(t.value.operator);
+}
+
 static void process_operator (
         TokenList *input,
         TokenList *output,
         TokenList *stack,
-        unsigned int idx)
+        unsigned int idx,
+        ConvertData *data)
 {
     // if the stack is empty, simply push to the stack
     if (stack->count == 0)
@@ -81,8 +156,7 @@ static void process_operator (
     }
 
     // if the top of the stack has lower precedence, push operator on the stack
-    else if (precedence(t.value.operator) <
-            precedence(input->list[idx].value.operator))
+    else if (token_precedence(t) < token_precedence(input->list[idx]))
     {
         tokenlist_add(stack, input->list[idx]);
     }
@@ -90,12 +164,11 @@ static void process_operator (
     // if the top of the stack has higher precedence,
     // move it from the stack to the output
     // and check the top of the stack again
-    else if (precedence(t.value.operator) >
-             precedence(input->list[idx].value.operator))
+    else if (token_precedence(t) > token_precedence(input->list[idx]))
     {
-        tokenlist_add(output, tokenlist_pop(stack));
+        emit(output, tokenlist_pop(stack), data);
 
-        process_operator(input, output, stack, idx);
+        process_operator(input, output, stack, idx, data);
     }
 
     // same precedence
@@ -106,17 +179,69 @@ static void process_operator (
     // binary operators are all left to right associative
     // so move the top of the stack to the output,
     // and push the current operator on the stack
-    else if (isunary(input->list[idx].value.operator))
+    else if (token_isunary(input->list[idx]))
     {
         tokenlist_add(stack, input->list[idx]);
     }
     else
     {
-        tokenlist_add(output, tokenlist_pop(stack));
+        emit(output, tokenlist_pop(stack), data);
         tokenlist_add(stack, input->list[idx]);
     }
 }
 
+// c ? a : b becomes  c JUMP_FALSE [else] a JUMP [end] b
+// the ? and : wait on the stack like operators of the lowest precedence,
+// targets are filled in once the branch they skip is complete
+//
+// conditionals nest to the right, so a ? pushes onto a waiting :,
+// and a : first completes the conditionals nested in its then branch
+static void process_conditional (
+        TokenList *input,
+        TokenList *output,
+        TokenList *stack,
+        unsigned int idx,
+        ConvertData *data)
+{
+    Token t = input->list[idx];
+
+    if (t.value.operator == QUESTION)
+    {
+        while (stack->count > 0 && stack->list[stack->count - 1].type != PARENTHESIS &&
+               !ismarker(stack->list[stack->count - 1]))
+        {
+            emit(output, tokenlist_pop(stack), data);
+        }
+
+        add_jump(output, JUMP_FALSE, t.column);
+        tokenlist_add(stack, t);
+        return;
+    }
+
+    while (stack->count > 0 && stack->list[stack->count - 1].type != PARENTHESIS &&
+           !(ismarker(stack->list[stack->count - 1]) &&
+             stack->list[stack->count - 1].value.operator == QUESTION))
+    {
+        emit(output, tokenlist_pop(stack), data);
+    }
+
+    // a : outside of any conditional
+    if (stack->count == 0 || stack->list[stack->count - 1].type == PARENTHESIS)
+    {
+        if (data->status == SUCCESS)
+        {
+            data->status = INVALID_TOKEN;
+            data->error_index = t.column;
+        }
+        return;
+    }
+
+    tokenlist_pop(stack);
+    add_jump(output, JUMP, t.column);
+    patch_jump(output, JUMP_FALSE);
+    tokenlist_add(stack, t);
+}
+
 static void process (
         TokenList *input,
         TokenList *output,
@@ -125,12 +250,19 @@ static void process (
         ConvertData *data)
 {
     // if operand, add directly to output
-    if (input->list[idx].type == NUMBER)
+    if (input->list[idx].type == NUMBER || input->list[idx].type == VARIABLE)
     {
         tokenlist_add(output, input->list[idx]);
         data->sign_expected = false;
     }
 
+    // a native call waits on the stack for its arguments like a function
+    else if (input->list[idx].type == NATIVE)
+    {
+        process_operator(input, output, stack, idx, data);
+        data->sign_expected = true;
+    }
+
     // parenthesis specific actions
     else if (input->list[idx].type == PARENTHESIS)
     {
@@ -152,14 +284,16 @@ static void process (
             // if sign is - and the next token is a single operand,
             // invert the operand and skip the - token
 
-            // if the next token is a left parenthesis or unary operator,
-            // then push a negative token to the stack
+            // if the next token is a left parenthesis, unary operator
+            // or variable, then push a negative token to the stack
             else if (input->list[idx].value.operator== SUB)
             {
                 if (input->list[idx + 1].type == NUMBER)
                     input->list[idx + 1].value.number *= -1;
 
-                else if ((input->list[idx + 1].type == PARENTHESIS &&
+                else if (input->list[idx + 1].type == VARIABLE ||
+                         input->list[idx + 1].type == NATIVE ||
+                         (input->list[idx + 1].type == PARENTHESIS &&
                          input->list[idx + 1].value.parenthesis == LEFT)
                          ||
                          (input->list[idx + 1].type == OPERATOR &&
@@ -170,57 +304,178 @@ static void process (
             }
         }
 
+        else if (ismarker(input->list[idx]))
+        {
+            process_conditional(input, output, stack, idx, data);
+            data->sign_expected = true;
+        }
+
+        // the arguments of a native call are in parentheses of their own,
+        // so they are complete at the separator
+        else if (input->list[idx].value.operator == ARGUMENT)
+        {
+            data->sign_expected = true;
+        }
+
         else
         {
-            process_operator(input, output, stack, idx);
+            process_operator(input, output, stack, idx, data);
             data->sign_expected = true;
         }
     }
 }
 
 ResultInfo convert(const char *input_string, TokenList *tokens)
+{
+    return convert_names(input_string, tokens, NULL);
+}
+
+ResultInfo convert_tokens(TokenList *infix, TokenList *tokens, TokenList *stack)
 {
     ResultInfo res;
-    TokenList buffer = new_tokenlist();
 
-    // build tokens from input string
-    res = lex(input_string, &buffer);
+    // integrate, sum and root calls become their values
+    res = expand_calculus(infix);
     if (res.status != SUCCESS)
     {
-        delete_tokenlist(buffer);
         return res;
     }
 
     // check validity of constructed tokens
-    res = syntax_check(buffer);
+    res = syntax_check(*infix);
     if (res.status != SUCCESS)
     {
-        delete_tokenlist(buffer);
         return res;
     }
 
     // convert tokens to postfix notation and handle operand signs
     // overwrite input list entirely
     clear_tokenlist(tokens);
-    TokenList stack = new_tokenlist();
+    clear_tokenlist(stack);
     ConvertData data = init();
 
-    for (unsigned int i = 0; i < buffer.count; i++)
+    for (unsigned int i = 0; i < infix->count; i++)
     {
-        process(&buffer, tokens, &stack, i, &data);
+        process(infix, tokens, stack, i, &data);
+
+        if (tokens->overflow || stack->overflow)
+        {
+            res.status = CAPACITY_EXCEEDED;
+            res.error_index = infix->list[i].column;
+            return res;
+        }
+
+        if (data.status != SUCCESS)
+        {
+            res.status = data.status;
+            res.error_index = data.error_index;
+            return res;
+        }
     }
 
     // print all remaining operators from the stack
-    while (stack.count > 0)
+    while (stack->count > 0)
     {
-        tokenlist_add(tokens, tokenlist_pop(&stack));
+        Token t = tokenlist_pop(stack);
+        emit(tokens, t, &data);
+
+        if (tokens->overflow)
+        {
+            res.status = CAPACITY_EXCEEDED;
+            res.error_index = t.column;
+            return res;
+        }
+
+        if (data.status != SUCCESS)
+        {
+            res.status = data.status;
+            res.error_index = data.error_index;
+            return res;
+        }
     }
 
+    res.status = SUCCESS;
+    res.error_index = 0;
+    return res;
+}
+
+// lex, check and convert using caller provided scratch lists
+static ResultInfo convert_stages(const char *input_string, TokenList *tokens,
+                                 NameTable *names, const FunctionTable *functions,
+                                 TokenList *buffer, TokenList *stack)
+{
+    ResultInfo res;
+
+    // build tokens from input string
+    res = lex_functions(input_string, buffer, names,
+                        functions == NULL ? NULL : &functions->names);
+    if (res.status != SUCCESS)
+    {
+        return res;
+    }
+
+    // replace calls by the bodies of their functions,
+    // the stack is free until the conversion starts,
+    // so the expansion goes there and the two lists trade places
+    if (functions != NULL)
+    {
+        res = expand_calls(functions, *buffer, stack, names);
+        if (res.status != SUCCESS)
+        {
+            return res;
+        }
+
+        TokenList expanded = *stack;
+        *stack = *buffer;
+        *buffer = expanded;
+    }
+
+    return convert_tokens(buffer, tokens, stack);
+}
+
+// the length is only measured while a tracer is attached
+static ResultInfo convert_lists(const char *input_string, TokenList *tokens,
+                                NameTable *names, const FunctionTable *functions,
+                                TokenList *buffer, TokenList *stack)
+{
+    PARSER_PROBE(convert_entry,
+                 PARSER_PROBE_ENABLED(convert_entry) ? strlen(input_string) : 0,
+                 0, SUCCESS, 0);
+
+    ResultInfo res = convert_stages(input_string, tokens, names, functions, buffer, stack);
+
+    PARSER_PROBE(convert_return,
+                 PARSER_PROBE_ENABLED(convert_return) ? strlen(input_string) : 0,
+                 res.status == SUCCESS ? tokens->count : 0, res.status, res.error_index);
+    return res;
+}
+
+ResultInfo convert_names(const char *input_string, TokenList *tokens, NameTable *names)
+{
+    return convert_functions(input_string, tokens, names, NULL);
+}
+
+ResultInfo convert_functions(const char *input_string, TokenList *tokens,
+                             NameTable *names, const FunctionTable *functions)
+{
+    TokenList buffer = new_tokenlist();
+    TokenList stack = new_tokenlist();
+
+    ResultInfo res = convert_lists(input_string, tokens, names, functions, &buffer, &stack);
+
     // free data structures
     delete_tokenlist(stack);
     delete_tokenlist(buffer);
 
-    res.status = SUCCESS;
-    res.error_index = 0;
+    return res;
+}
+
+ResultInfo convert_context(ParseContext *context, const char *input_string, NameTable *names)
+{
+    ResultInfo res = convert_lists(input_string, &context->program, names, NULL,
+                                   &context->tokens, &context->stack);
+    if (res.status == SUCCESS)
+        optimize(&context->program, context->optimize);
+
     return res;
 }
@@ -0,0 +1,342 @@
+// standard library includes
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "token.h"
+#include "dag.h"
+
+// FNV-1a over the bytes of value
+static unsigned int mix(unsigned int h, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        h ^= (unsigned int)(value & 0xff);
+        h *= 16777619u;
+        value >>= 8;
+    }
+
+    return h;
+}
+
+// numbers compare by their bits, so 0 and -0 stay apart
+static uint64_t token_key(const Token *token)
+{
+    uint64_t key = 0;
+
+    if (token->type == NUMBER)
+        memcpy(&key, &token->value.number, sizeof(key));
+    else if (token->type == VARIABLE)
+        key = token->value.variable;
+    else if (token->type == OPERATOR)
+        key = token->value.operator;
+    else if (token->type == INTEGER)
+        key = (uint64_t)token->value.integer;
+
+    return key;
+}
+
+static unsigned int hash(const Token *token, const unsigned int *operands)
+{
+    unsigned int h = 2166136261u;
+    h = mix(h, token->type);
+    h = mix(h, token_key(token));
+    h = mix(h, operands[0]);
+    h = mix(h, operands[1]);
+
+    return h;
+}
+
+static bool same_node(const DagNode *node, const Token *token, const unsigned int *operands)
+{
+    return node->token.type == token->type &&
+           token_key(&node->token) == token_key(token) &&
+           node->operands[0] == operands[0] &&
+           node->operands[1] == operands[1];
+}
+
+// returns the slot holding the node, or the empty slot where it belongs
+static unsigned int find_slot(const ExpressionDag *self, const Token *token,
+                              const unsigned int *operands)
+{
+    unsigned int mask = self->slot_count - 1;
+    unsigned int slot = hash(token, operands) & mask;
+
+    while (self->slots[slot] != 0)
+    {
+        if (same_node(&self->nodes[self->slots[slot] - 1], token, operands))
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static void rehash(ExpressionDag *self)
+{
+    free(self->slots);
+    self->slot_count *= 2;
+    self->slots = (unsigned int *)calloc(self->slot_count, sizeof(unsigned int));
+    if (self->slots == NULL) exit(1);
+
+    for (unsigned int i = 0; i < self->count; i++)
+    {
+        const DagNode *node = &self->nodes[i];
+        self->slots[find_slot(self, &node->token, node->operands)] = i + 1;
+    }
+}
+
+// returns the node of token applied to operands, creating it if it is new
+static unsigned int intern(ExpressionDag *self, const Token *token,
+                           const unsigned int *operands, unsigned int operand_count)
+{
+    unsigned int slot = find_slot(self, token, operands);
+    if (self->slots[slot] != 0)
+        return self->slots[slot] - 1;
+
+    if (self->count == self->max)
+    {
+        self->max = self->max * 2;
+        self->nodes = (DagNode *)realloc(self->nodes, self->max * sizeof(DagNode));
+        if (self->nodes == NULL) exit(1);
+    }
+
+    DagNode *node = &self->nodes[self->count];
+    node->token = *token;
+    node->operands[0] = operands[0];
+    node->operands[1] = operands[1];
+    node->operand_count = operand_count;
+    node->uses = 0;
+
+    // only a new node references its operands,
+    // a repeated one reuses the references of its first occurrence
+    for (unsigned int i = 0; i < operand_count; i++)
+        self->nodes[operands[i]].uses += 1;
+
+    self->slots[slot] = self->count + 1;
+    self->count += 1;
+
+    // keep the load factor of the hash at or below one half
+    if (self->count * 2 > self->slot_count)
+        rehash(self);
+
+    return self->count - 1;
+}
+
+// number of operands of a token of a plain postfix program
+static bool plain_arity(const Token *token, unsigned int *arity)
+{
+    if (token->type == NUMBER || token->type == VARIABLE || token->type == INTEGER)
+    {
+        *arity = 0;
+        return true;
+    }
+
+    if (token->type != OPERATOR)
+        return false;
+
+    // integer forms and comparisons are plain operators too,
+    // OPTIMIZE_INTEGER runs first
+    operator_type t = token->value.operator;
+    if (t > FAC && t != SQRT && (t < IADD || t > NOT_EQUAL))
+        return false;
+
+    *arity = isunary(t) ? 1 : 2;
+    return true;
+}
+
+ExpressionDag new_expression_dag(const TokenList program)
+{
+    return new_expression_dag_roots(program, 1);
+}
+
+ExpressionDag new_expression_dag_roots(const TokenList program, unsigned int root_count)
+{
+    ExpressionDag obj;
+    obj.count = 0;
+    obj.max = 8;
+    obj.nodes = (DagNode *)calloc(8, sizeof(DagNode));
+    obj.roots = (unsigned int *)malloc((root_count + 1) * sizeof(unsigned int));
+    obj.root_count = 0;
+    obj.slot_count = 16;
+    obj.slots = (unsigned int *)calloc(16, sizeof(unsigned int));
+    obj.valid = false;
+
+    // node indices of the values a postfix evaluation would hold
+    unsigned int *stack = (unsigned int *)malloc((program.count + 1) * sizeof(unsigned int));
+
+    if (obj.nodes == NULL || obj.roots == NULL || obj.slots == NULL || stack == NULL) exit(1);
+
+    unsigned int depth = 0;
+    for (unsigned int i = 0; i < program.count; i++)
+    {
+        const Token *token = &program.list[i];
+        unsigned int arity;
+
+        if (!plain_arity(token, &arity) || depth < arity)
+        {
+            free(stack);
+            return obj;
+        }
+
+        unsigned int operands[2] = { DAG_NONE, DAG_NONE };
+        for (unsigned int k = arity; k > 0; k--)
+            operands[k - 1] = stack[--depth];
+
+        stack[depth++] = intern(&obj, token, operands, arity);
+    }
+
+    if (depth == root_count && root_count > 0)
+    {
+        for (unsigned int i = 0; i < root_count; i++)
+        {
+            obj.roots[i] = stack[i];
+            obj.nodes[stack[i]].uses += 1;
+        }
+        obj.root_count = root_count;
+        obj.valid = true;
+    }
+
+    free(stack);
+    return obj;
+}
+
+void delete_expression_dag(ExpressionDag dag)
+{
+    free(dag.nodes);
+    free(dag.roots);
+    free(dag.slots);
+}
+
+bool dag_node_shared(const ExpressionDag *dag, unsigned int index)
+{
+    return dag->nodes[index].operand_count > 0 && dag->nodes[index].uses > 1;
+}
+
+unsigned int dag_shared_count(const ExpressionDag *dag)
+{
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < dag->count; i++)
+    {
+        if (dag_node_shared(dag, i))
+            count++;
+    }
+
+    return count;
+}
+
+// pending step of the postfix walk over the dag
+typedef struct
+{
+    unsigned int node;
+    bool expanded;
+} EmitStep;
+
+// state shared by the walks of all roots
+typedef struct
+{
+    // temporary of each shared node once it has been computed
+    unsigned int *slot_of;
+    unsigned int next_slot;
+
+    EmitStep *steps;
+    unsigned int step_max;
+} EmitData;
+
+// walk the tree the dag stands for below root in postfix order,
+// cutting it off at shared nodes that were already computed
+static void emit_tree(const ExpressionDag *dag, unsigned int root,
+                      EmitData *data, TokenList *output)
+{
+    unsigned int step_count = 1;
+    data->steps[0].node = root;
+    data->steps[0].expanded = false;
+
+    while (step_count > 0)
+    {
+        EmitStep step = data->steps[--step_count];
+        const DagNode *node = &dag->nodes[step.node];
+
+        if (data->slot_of[step.node] != DAG_NONE)
+        {
+            tokenlist_add(output, create_operator_token(LOAD, node->token.column));
+            tokenlist_add(output, create_number_token(data->slot_of[step.node], node->token.column));
+        }
+
+        else if (!step.expanded && node->operand_count > 0)
+        {
+            if (step_count + 3 > data->step_max)
+            {
+                data->step_max *= 2;
+                data->steps = (EmitStep *)realloc(data->steps, data->step_max * sizeof(EmitStep));
+                if (data->steps == NULL) exit(1);
+            }
+
+            data->steps[step_count].node = step.node;
+            data->steps[step_count++].expanded = true;
+
+            // operands come off the stack left first
+            for (unsigned int k = node->operand_count; k > 0; k--)
+            {
+                data->steps[step_count].node = node->operands[k - 1];
+                data->steps[step_count++].expanded = false;
+            }
+        }
+
+        else
+        {
+            tokenlist_add(output, node->token);
+
+            if (dag_node_shared(dag, step.node))
+            {
+                data->slot_of[step.node] = data->next_slot++;
+                tokenlist_add(output, create_operator_token(STORE, node->token.column));
+                tokenlist_add(output, create_number_token(data->slot_of[step.node], node->token.column));
+            }
+        }
+    }
+}
+
+bool dag_emit(const ExpressionDag *dag, TokenList *program)
+{
+    if (!dag->valid)
+        return false;
+
+    unsigned int shared = dag_shared_count(dag);
+    if (shared == 0)
+        return false;
+
+    EmitData data;
+    data.slot_of = (unsigned int *)malloc(dag->count * sizeof(unsigned int));
+    data.next_slot = 0;
+    data.step_max = 16;
+    data.steps = (EmitStep *)malloc(data.step_max * sizeof(EmitStep));
+    if (data.slot_of == NULL || data.steps == NULL) exit(1);
+
+    for (unsigned int i = 0; i < dag->count; i++)
+        data.slot_of[i] = DAG_NONE;
+
+    TokenList output = new_tokenlist();
+    tokenlist_add(&output, create_operator_token(RESERVE, 0));
+    tokenlist_add(&output, create_number_token(shared, 0));
+
+    // a value computed for an earlier root is loaded by the later ones
+    for (unsigned int r = 0; r < dag->root_count; r++)
+        emit_tree(dag, dag->roots[r], &data, &output);
+
+    bool fits = !program->fixed || output.count <= program->max;
+    if (fits)
+    {
+        clear_tokenlist(program);
+        for (unsigned int i = 0; i < output.count; i++)
+            tokenlist_add(program, output.list[i]);
+    }
+
+    delete_tokenlist(output);
+    free(data.steps);
+    free(data.slot_of);
+
+    return fits;
+}
@@ -0,0 +1,54 @@
+// standard library includes
+#include <stdlib.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+
+// diagnostic list functions
+DiagnosticList new_diagnostic_list(void)
+{
+    DiagnosticList obj;
+    obj.count = 0;
+    obj.max = 8;
+    obj.list = (ResultInfo *)calloc(8, sizeof(ResultInfo));
+
+    if (obj.list == NULL) exit(1);
+
+    return obj;
+}
+
+void delete_diagnostic_list(DiagnosticList diagnostics)
+{
+    free(diagnostics.list);
+}
+
+void clear_diagnostic_list(DiagnosticList *self)
+{
+    self->count = 0;
+}
+
+void diagnostic_list_add(DiagnosticList *self, error_type status, unsigned int error_index)
+{
+    if (self->count == self->max)
+    {
+        self->max = self->max * 2;
+        self->list = (ResultInfo *)realloc(self->list, self->max * sizeof(ResultInfo));
+        if (self->list == NULL) exit(1);
+    }
+
+    self->list[self->count].status = status;
+    self->list[self->count].error_index = error_index;
+    self->count += 1;
+}
+
+unsigned int validate_expression(const char *input_string, NameTable *names,
+                                 TokenList *tokens, DiagnosticList *diagnostics)
+{
+    clear_diagnostic_list(diagnostics);
+
+    lex_recover(input_string, tokens, names, diagnostics);
+    syntax_check_recover(*tokens, diagnostics);
+
+    return diagnostics->count;
+}
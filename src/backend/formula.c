@@ -0,0 +1,552 @@
+// standard library includes
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+#include "formula.h"
+
+// levels smaller than this are not worth handing to threads
+#define PARALLEL_LEVEL_MIN 64
+
+static ResultInfo result_info(error_type status, unsigned int error_index)
+{
+    ResultInfo res;
+    res.status = status;
+    res.error_index = error_index;
+    return res;
+}
+
+// grow per node storage to cover every interned name
+static void ensure_nodes(FormulaGraph *graph)
+{
+    if (graph->names.count <= graph->node_max)
+        return;
+
+    unsigned int old_max = graph->node_max;
+    unsigned int new_max = old_max;
+    while (new_max < graph->names.count)
+        new_max *= 2;
+
+    graph->nodes = (FormulaNode *)realloc(graph->nodes, new_max * sizeof(FormulaNode));
+    graph->values = (double *)realloc(graph->values, new_max * sizeof(double));
+    graph->mark = (unsigned int *)realloc(graph->mark, new_max * sizeof(unsigned int));
+    graph->pending = (unsigned int *)realloc(graph->pending, new_max * sizeof(unsigned int));
+    if (graph->nodes == NULL || graph->values == NULL ||
+        graph->mark == NULL || graph->pending == NULL)
+        exit(1);
+
+    memset(graph->nodes + old_max, 0, (new_max - old_max) * sizeof(FormulaNode));
+    memset(graph->values + old_max, 0, (new_max - old_max) * sizeof(double));
+    memset(graph->mark + old_max, 0, (new_max - old_max) * sizeof(unsigned int));
+    memset(graph->pending + old_max, 0, (new_max - old_max) * sizeof(unsigned int));
+
+    graph->node_max = new_max;
+}
+
+// start a new traversal, old marks become stale
+static unsigned int next_generation(FormulaGraph *graph)
+{
+    graph->generation += 1;
+    return graph->generation;
+}
+
+static void push_index(unsigned int **list, unsigned int *count,
+                       unsigned int *max, unsigned int value)
+{
+    if (*count == *max)
+    {
+        *max = *max == 0 ? 8 : *max * 2;
+        *list = (unsigned int *)realloc(*list, *max * sizeof(unsigned int));
+        if (*list == NULL) exit(1);
+    }
+
+    (*list)[*count] = value;
+    *count += 1;
+}
+
+static void mark_dirty(FormulaGraph *graph, unsigned int index)
+{
+    if (graph->nodes[index].dirty)
+        return;
+
+    graph->nodes[index].dirty = true;
+    push_index(&graph->dirty_list, &graph->dirty_count, &graph->dirty_max, index);
+}
+
+static bool resolve_name(FormulaGraph *graph, const char *name, unsigned int *index)
+{
+    // a name must lex to a single variable on its own
+    TokenList tokens = new_tokenlist();
+    ResultInfo res = lex_names(name, &tokens, &graph->names);
+    bool valid = res.status == SUCCESS && tokens.count == 1 &&
+                 tokens.list[0].type == VARIABLE && tokens.list[0].column == 0;
+
+    if (valid)
+        *index = tokens.list[0].value.variable;
+
+    delete_tokenlist(tokens);
+    ensure_nodes(graph);
+    return valid;
+}
+
+// remove a formula and its edges from a node
+static void detach(FormulaGraph *graph, unsigned int index)
+{
+    FormulaNode *node = &graph->nodes[index];
+
+    for (unsigned int i = 0; i < node->reference_count; i++)
+    {
+        FormulaNode *ref = &graph->nodes[node->references[i]];
+        for (unsigned int j = 0; j < ref->dependent_count; j++)
+        {
+            if (ref->dependents[j] == index)
+            {
+                ref->dependents[j] = ref->dependents[ref->dependent_count - 1];
+                ref->dependent_count -= 1;
+                break;
+            }
+        }
+    }
+
+    if (node->is_formula)
+        delete_tokenlist(node->program);
+
+    free(node->references);
+    free(node->reference_columns);
+    node->references = NULL;
+    node->reference_columns = NULL;
+    node->reference_count = 0;
+    node->is_formula = false;
+}
+
+// collect distinct references of a program ordered by column
+static unsigned int extract_references(FormulaGraph *graph, const TokenList program,
+                                       unsigned int **references, unsigned int **columns)
+{
+    unsigned int generation = next_generation(graph);
+    unsigned int count = 0;
+
+    *references = (unsigned int *)malloc((program.count + 1) * sizeof(unsigned int));
+    *columns = (unsigned int *)malloc((program.count + 1) * sizeof(unsigned int));
+    if (*references == NULL || *columns == NULL) exit(1);
+
+    for (unsigned int i = 0; i < program.count; i++)
+    {
+        if (program.list[i].type != VARIABLE)
+            continue;
+
+        unsigned int ref = program.list[i].value.variable;
+        unsigned int column = program.list[i].column;
+
+        if (graph->mark[ref] != generation)
+        {
+            graph->mark[ref] = generation;
+            (*references)[count] = ref;
+            (*columns)[count] = column;
+            count += 1;
+        }
+
+        else
+        {
+            // postfix order differs from input order,
+            // keep the leftmost occurrence
+            for (unsigned int j = 0; j < count; j++)
+                if ((*references)[j] == ref && (*columns)[j] > column)
+                    (*columns)[j] = column;
+        }
+    }
+
+    // insertion sort by column, reference lists are short
+    for (unsigned int i = 1; i < count; i++)
+    {
+        unsigned int ref = (*references)[i];
+        unsigned int column = (*columns)[i];
+        unsigned int j = i;
+        while (j > 0 && (*columns)[j - 1] > column)
+        {
+            (*references)[j] = (*references)[j - 1];
+            (*columns)[j] = (*columns)[j - 1];
+            j--;
+        }
+        (*references)[j] = ref;
+        (*columns)[j] = column;
+    }
+
+    return count;
+}
+
+// true if target is reachable from start by following references
+static bool reaches(FormulaGraph *graph, unsigned int start, unsigned int target)
+{
+    if (start == target)
+        return true;
+
+    unsigned int generation = next_generation(graph);
+    unsigned int *stack = NULL;
+    unsigned int count = 0;
+    unsigned int max = 0;
+    bool found = false;
+
+    push_index(&stack, &count, &max, start);
+    graph->mark[start] = generation;
+
+    while (count > 0 && !found)
+    {
+        count -= 1;
+        FormulaNode *node = &graph->nodes[stack[count]];
+
+        for (unsigned int i = 0; i < node->reference_count; i++)
+        {
+            unsigned int ref = node->references[i];
+            if (ref == target)
+            {
+                found = true;
+                break;
+            }
+
+            if (graph->mark[ref] != generation)
+            {
+                graph->mark[ref] = generation;
+                push_index(&stack, &count, &max, ref);
+            }
+        }
+    }
+
+    free(stack);
+    return found;
+}
+
+FormulaGraph new_formula_graph(unsigned int thread_count)
+{
+    FormulaGraph obj;
+    obj.names = new_nametable();
+    obj.node_max = 8;
+    obj.nodes = (FormulaNode *)calloc(8, sizeof(FormulaNode));
+    obj.values = (double *)calloc(8, sizeof(double));
+    obj.mark = (unsigned int *)calloc(8, sizeof(unsigned int));
+    obj.pending = (unsigned int *)calloc(8, sizeof(unsigned int));
+    obj.dirty_list = NULL;
+    obj.dirty_count = 0;
+    obj.dirty_max = 0;
+    obj.generation = 0;
+    obj.thread_count = thread_count > 0 ? thread_count : 1;
+
+    if (obj.nodes == NULL || obj.values == NULL ||
+        obj.mark == NULL || obj.pending == NULL)
+        exit(1);
+
+    return obj;
+}
+
+void delete_formula_graph(FormulaGraph *graph)
+{
+    for (unsigned int i = 0; i < graph->names.count; i++)
+    {
+        FormulaNode *node = &graph->nodes[i];
+        if (node->is_formula)
+            delete_tokenlist(node->program);
+
+        free(node->references);
+        free(node->reference_columns);
+        free(node->dependents);
+    }
+
+    delete_nametable(graph->names);
+    free(graph->nodes);
+    free(graph->values);
+    free(graph->mark);
+    free(graph->pending);
+    free(graph->dirty_list);
+}
+
+ResultInfo formula_define(FormulaGraph *graph, const char *name, const char *expression)
+{
+    unsigned int index;
+    if (!resolve_name(graph, name, &index))
+        return result_info(INVALID_INPUT_CHARACTER, 0);
+
+    TokenList program = new_tokenlist();
+    ResultInfo res = convert_names(expression, &program, &graph->names);
+    ensure_nodes(graph);
+
+    if (res.status != SUCCESS)
+    {
+        delete_tokenlist(program);
+        return res;
+    }
+
+    unsigned int *references;
+    unsigned int *columns;
+    unsigned int count = extract_references(graph, program, &references, &columns);
+
+    // reject the definition if any reference leads back to this name
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (reaches(graph, references[i], index))
+        {
+            res = result_info(CIRCULAR_REFERENCE, columns[i]);
+            free(references);
+            free(columns);
+            delete_tokenlist(program);
+            return res;
+        }
+    }
+
+    detach(graph, index);
+
+    FormulaNode *node = &graph->nodes[index];
+    node->defined = true;
+    node->is_formula = true;
+    node->program = program;
+    node->references = references;
+    node->reference_columns = columns;
+    node->reference_count = count;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        FormulaNode *ref = &graph->nodes[references[i]];
+        push_index(&ref->dependents, &ref->dependent_count, &ref->dependent_max, index);
+    }
+
+    mark_dirty(graph, index);
+    return result_info(SUCCESS, 0);
+}
+
+ResultInfo formula_set_value(FormulaGraph *graph, const char *name, double value)
+{
+    unsigned int index;
+    if (!resolve_name(graph, name, &index))
+        return result_info(INVALID_INPUT_CHARACTER, 0);
+
+    detach(graph, index);
+
+    graph->nodes[index].defined = true;
+    graph->values[index] = value;
+    mark_dirty(graph, index);
+
+    return result_info(SUCCESS, 0);
+}
+
+static void evaluate_node(FormulaGraph *graph, unsigned int index)
+{
+    FormulaNode *node = &graph->nodes[index];
+
+    if (!node->is_formula)
+    {
+        node->status = result_info(SUCCESS, 0);
+        return;
+    }
+
+    // errors of references are reported at the reference
+    for (unsigned int i = 0; i < node->reference_count; i++)
+    {
+        FormulaNode *ref = &graph->nodes[node->references[i]];
+
+        if (!ref->defined)
+        {
+            node->status = result_info(UNDEFINED_VARIABLE, node->reference_columns[i]);
+            return;
+        }
+
+        if (ref->status.status != SUCCESS)
+        {
+            node->status = result_info(ref->status.status, node->reference_columns[i]);
+            return;
+        }
+    }
+
+    Token result = create_empty_token();
+    node->status = evaluate(node->program, graph->values, &result);
+
+    if (node->status.status == SUCCESS)
+        graph->values[index] = result.value.number;
+}
+
+// a contiguous share of one level
+typedef struct
+{
+    FormulaGraph *graph;
+    const unsigned int *level;
+    unsigned int begin;
+    unsigned int end;
+} LevelTask;
+
+static void *evaluate_task(void *arg)
+{
+    LevelTask *task = (LevelTask *)arg;
+    for (unsigned int i = task->begin; i < task->end; i++)
+        evaluate_node(task->graph, task->level[i]);
+
+    return NULL;
+}
+
+// nodes of a level do not reference each other
+// so they can be evaluated in any order
+static void evaluate_level(FormulaGraph *graph, const unsigned int *level, unsigned int count)
+{
+    unsigned int threads = graph->thread_count;
+    if (threads > count / PARALLEL_LEVEL_MIN)
+        threads = count / PARALLEL_LEVEL_MIN;
+
+    if (threads <= 1)
+    {
+        for (unsigned int i = 0; i < count; i++)
+            evaluate_node(graph, level[i]);
+        return;
+    }
+
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    LevelTask *tasks = (LevelTask *)malloc(threads * sizeof(LevelTask));
+    if (ids == NULL || tasks == NULL) exit(1);
+
+    for (unsigned int t = 0; t < threads; t++)
+    {
+        tasks[t].graph = graph;
+        tasks[t].level = level;
+        tasks[t].begin = (unsigned int)((unsigned long)count * t / threads);
+        tasks[t].end = (unsigned int)((unsigned long)count * (t + 1) / threads);
+    }
+
+    // the calling thread takes the first share
+    unsigned int started = 1;
+    for (unsigned int t = 1; t < threads; t++)
+    {
+        if (pthread_create(&ids[t], NULL, evaluate_task, &tasks[t]) != 0)
+            break;
+        started += 1;
+    }
+
+    evaluate_task(&tasks[0]);
+
+    for (unsigned int t = 1; t < started; t++)
+        pthread_join(ids[t], NULL);
+
+    // shares that could not get a thread run here
+    for (unsigned int t = started; t < threads; t++)
+        evaluate_task(&tasks[t]);
+
+    free(ids);
+    free(tasks);
+}
+
+unsigned int formula_recompute(FormulaGraph *graph)
+{
+    if (graph->dirty_count == 0)
+        return 0;
+
+    // collect everything downstream of a dirty node
+    unsigned int generation = next_generation(graph);
+    unsigned int *affected = NULL;
+    unsigned int affected_count = 0;
+    unsigned int affected_max = 0;
+
+    for (unsigned int i = 0; i < graph->dirty_count; i++)
+    {
+        unsigned int index = graph->dirty_list[i];
+        graph->nodes[index].dirty = false;
+
+        if (graph->mark[index] != generation)
+        {
+            graph->mark[index] = generation;
+            push_index(&affected, &affected_count, &affected_max, index);
+        }
+    }
+    graph->dirty_count = 0;
+
+    for (unsigned int i = 0; i < affected_count; i++)
+    {
+        FormulaNode *node = &graph->nodes[affected[i]];
+        for (unsigned int j = 0; j < node->dependent_count; j++)
+        {
+            unsigned int dep = node->dependents[j];
+            if (graph->mark[dep] != generation)
+            {
+                graph->mark[dep] = generation;
+                push_index(&affected, &affected_count, &affected_max, dep);
+            }
+        }
+    }
+
+    // count references that still have to be evaluated first
+    unsigned int *level = NULL;
+    unsigned int level_count = 0;
+    unsigned int level_max = 0;
+
+    for (unsigned int i = 0; i < affected_count; i++)
+    {
+        unsigned int index = affected[i];
+        FormulaNode *node = &graph->nodes[index];
+
+        graph->pending[index] = 0;
+        for (unsigned int j = 0; j < node->reference_count; j++)
+            if (graph->mark[node->references[j]] == generation)
+                graph->pending[index] += 1;
+
+        if (graph->pending[index] == 0)
+            push_index(&level, &level_count, &level_max, index);
+    }
+
+    // evaluate level by level in topological order
+    unsigned int *next = NULL;
+    unsigned int next_count = 0;
+    unsigned int next_max = 0;
+    unsigned int evaluated = 0;
+
+    while (level_count > 0)
+    {
+        evaluate_level(graph, level, level_count);
+
+        next_count = 0;
+        for (unsigned int i = 0; i < level_count; i++)
+        {
+            FormulaNode *node = &graph->nodes[level[i]];
+            if (node->is_formula)
+                evaluated += 1;
+
+            for (unsigned int j = 0; j < node->dependent_count; j++)
+            {
+                unsigned int dep = node->dependents[j];
+                graph->pending[dep] -= 1;
+                if (graph->pending[dep] == 0)
+                    push_index(&next, &next_count, &next_max, dep);
+            }
+        }
+
+        // swap level buffers
+        unsigned int *temp = level;
+        level = next;
+        next = temp;
+
+        unsigned int temp_max = level_max;
+        level_max = next_max;
+        next_max = temp_max;
+
+        level_count = next_count;
+    }
+
+    free(affected);
+    free(level);
+    free(next);
+    return evaluated;
+}
+
+ResultInfo formula_value(const FormulaGraph *graph, const char *name, Token *result)
+{
+    unsigned int index;
+    if (!nametable_find(&graph->names, name, strlen(name), &index) ||
+        !graph->nodes[index].defined)
+    {
+        return result_info(UNDEFINED_VARIABLE, 0);
+    }
+
+    if (graph->nodes[index].status.status != SUCCESS)
+        return graph->nodes[index].status;
+
+    *result = create_number_token(graph->values[index], 0);
+    return result_info(SUCCESS, 0);
+}
@@ -0,0 +1,534 @@
+// standard library includes
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+#include "functions.h"
+
+static ResultInfo result_info(error_type status, unsigned int error_index)
+{
+    ResultInfo res;
+    res.status = status;
+    res.error_index = error_index;
+    return res;
+}
+
+FunctionTable new_function_table(void)
+{
+    FunctionTable obj;
+    obj.names = new_nametable();
+    obj.list = NULL;
+    obj.max = 0;
+
+    return obj;
+}
+
+void delete_function_table(FunctionTable *table)
+{
+    for (unsigned int i = 0; i < table->names.count; i++)
+    {
+        if (table->list[i].defined)
+        {
+            delete_tokenlist(table->list[i].body);
+            delete_nametable(table->list[i].locals);
+        }
+
+        free(table->list[i].native);
+    }
+
+    free(table->list);
+    delete_nametable(table->names);
+
+    table->list = NULL;
+    table->max = 0;
+}
+
+// grow the definitions to cover every interned name
+static void ensure_definitions(FunctionTable *table)
+{
+    if (table->names.count <= table->max)
+        return;
+
+    unsigned int old_max = table->max;
+    unsigned int new_max = old_max == 0 ? 8 : old_max;
+    while (new_max < table->names.count)
+        new_max *= 2;
+
+    table->list = (FunctionDefinition *)realloc(table->list, new_max * sizeof(FunctionDefinition));
+    if (table->list == NULL) exit(1);
+
+    memset(table->list + old_max, 0, (new_max - old_max) * sizeof(FunctionDefinition));
+    table->max = new_max;
+}
+
+// expansion process variables
+typedef struct
+{
+    const FunctionTable *table;
+
+    // receives the free variables of inlined bodies
+    NameTable *names;
+
+    ResultInfo res;
+} ExpandData;
+
+typedef struct Frame Frame;
+
+// tokens of an argument, expanded where its parameter is used
+typedef struct
+{
+    const Token *list;
+    unsigned int count;
+    const Frame *frame;
+} Argument;
+
+// the body being inlined, its parameters stand for args
+// function is NULL for the tokens that were lexed from the input
+struct Frame
+{
+    const FunctionDefinition *function;
+    const Argument *args;
+
+    // column of the call in the input
+    unsigned int column;
+};
+
+static void fail(ExpandData *data, error_type status, unsigned int column)
+{
+    if (data->res.status == SUCCESS)
+        data->res = result_info(status, column);
+}
+
+static unsigned int column_of(const Token *token, const Frame *frame)
+{
+    return frame->function != NULL ? frame->column : token->column;
+}
+
+static void add(ExpandData *data, TokenList *output, Token token)
+{
+    tokenlist_add(output, token);
+    if (output->overflow)
+        fail(data, CAPACITY_EXCEEDED, token.column);
+}
+
+static bool isseparator(const Token *token)
+{
+    return token->type == OPERATOR && token->value.operator == COMMA;
+}
+
+static void expand(ExpandData *data, const Token *list, unsigned int count,
+                   const Frame *frame, TokenList *output);
+
+// a native call stays a call, f(a, b) -> NATIVE ( (a) ARGUMENT (b) )
+// each argument in parentheses, so that an ARGUMENT always follows a complete one
+static void expand_native(ExpandData *data, const NativeFunction *native,
+                          const Argument *args, unsigned int arg_count,
+                          unsigned int column, TokenList *output)
+{
+    add(data, output, create_native_token(native, column));
+    add(data, output, create_parenthesis_token(LEFT, column));
+
+    for (unsigned int k = 0; k < arg_count; k++)
+    {
+        if (k > 0)
+            add(data, output, create_operator_token(ARGUMENT, column));
+
+        add(data, output, create_parenthesis_token(LEFT, column));
+        expand(data, args[k].list, args[k].count, args[k].frame, output);
+        add(data, output, create_parenthesis_token(RIGHT, column));
+    }
+
+    add(data, output, create_parenthesis_token(RIGHT, column));
+}
+
+// inline the call at list[call], its ( is the token after it
+// returns the index of the closing )
+static unsigned int expand_call(ExpandData *data, const Token *list, unsigned int count,
+                                unsigned int call, const Frame *frame, TokenList *output)
+{
+    unsigned int column = column_of(&list[call], frame);
+    const FunctionDefinition *callee = &data->table->list[list[call].value.variable];
+
+    // find the closing ) and count the arguments
+    unsigned int depth = 0;
+    unsigned int separators = 0;
+    unsigned int close = call + 2;
+    for (; close < count; close++)
+    {
+        const Token *t = &list[close];
+        if (t->type == PARENTHESIS && t->value.parenthesis == LEFT)
+            depth++;
+        else if (t->type == PARENTHESIS && depth == 0)
+            break;
+        else if (t->type == PARENTHESIS)
+            depth--;
+        else if (depth == 0 && isseparator(t))
+            separators++;
+    }
+
+    if (close >= count)
+    {
+        fail(data, UNMATCHED_LEFT_PAR, column_of(&list[call + 1], frame));
+        return count;
+    }
+
+    unsigned int arg_count = close == call + 2 ? 0 : separators + 1;
+    if (!callee->defined && callee->native == NULL)
+    {
+        fail(data, UNDEFINED_VARIABLE, column);
+        return close;
+    }
+
+    unsigned int parameter_count = callee->native != NULL ?
+                                   callee->native->arity : callee->parameter_count;
+    if (arg_count != parameter_count)
+    {
+        fail(data, INVALID_TOKEN, column);
+        return close;
+    }
+
+    // an argument is expanded each time its parameter is used
+    Argument args[FUNCTION_PARAMETERS_MAX];
+    unsigned int start = call + 2;
+    unsigned int arg = 0;
+    depth = 0;
+    for (unsigned int i = start; arg < arg_count; i++)
+    {
+        const Token *t = &list[i];
+        if (t->type == PARENTHESIS && t->value.parenthesis == LEFT)
+            depth++;
+        else if (t->type == PARENTHESIS && t->value.parenthesis == RIGHT && i < close)
+            depth--;
+
+        if (i == close || (depth == 0 && isseparator(t)))
+        {
+            if (i == start)
+                fail(data, INVALID_TOKEN, column_of(t, frame));
+
+            args[arg].list = list + start;
+            args[arg].count = i - start;
+            args[arg].frame = frame;
+            arg++;
+            start = i + 1;
+        }
+    }
+
+    if (callee->native != NULL)
+    {
+        expand_native(data, callee->native, args, arg_count, column, output);
+        return close;
+    }
+
+    Frame inner;
+    inner.function = callee;
+    inner.args = args;
+    inner.column = column;
+
+    add(data, output, create_parenthesis_token(LEFT, column));
+    expand(data, callee->body.list, callee->body.count, &inner, output);
+    add(data, output, create_parenthesis_token(RIGHT, column));
+
+    return close;
+}
+
+static void expand(ExpandData *data, const Token *list, unsigned int count,
+                   const Frame *frame, TokenList *output)
+{
+    for (unsigned int i = 0; i < count && data->res.status == SUCCESS; i++)
+    {
+        Token t = list[i];
+
+        if (t.type == FUNCTION)
+        {
+            i = expand_call(data, list, count, i, frame, output);
+        }
+
+        else if (t.type == VARIABLE && frame->function != NULL &&
+                 t.value.variable < frame->function->parameter_count)
+        {
+            const Argument *arg = &frame->args[t.value.variable];
+            add(data, output, create_parenthesis_token(LEFT, frame->column));
+            expand(data, arg->list, arg->count, arg->frame, output);
+            add(data, output, create_parenthesis_token(RIGHT, frame->column));
+        }
+
+        // free variables of a body are looked up by name
+        else if (t.type == VARIABLE && frame->function != NULL)
+        {
+            if (data->names == NULL)
+            {
+                fail(data, UNDEFINED_VARIABLE, frame->column);
+                return;
+            }
+
+            const char *name = nametable_name(&frame->function->locals, t.value.variable);
+            unsigned int index = nametable_add(data->names, name, strlen(name));
+            add(data, output, create_variable_token(index, frame->column));
+        }
+
+        else
+        {
+            t.column = column_of(&t, frame);
+            add(data, output, t);
+        }
+    }
+}
+
+ResultInfo expand_calls(const FunctionTable *table, const TokenList infix,
+                        TokenList *output, NameTable *names)
+{
+    ExpandData data;
+    data.table = table;
+    data.names = names;
+    data.res = result_info(SUCCESS, 0);
+
+    Frame frame;
+    frame.function = NULL;
+    frame.args = NULL;
+    frame.column = 0;
+
+    clear_tokenlist(output);
+    expand(&data, infix.list, infix.count, &frame, output);
+    return data.res;
+}
+
+// whether function from calls target, directly or through others
+// definitions in the table never call themselves, so this ends
+static bool reaches(const FunctionTable *table, unsigned int from,
+                    unsigned int target, bool *visited)
+{
+    if (from == target)
+        return true;
+
+    if (visited[from] || !table->list[from].defined)
+        return false;
+
+    visited[from] = true;
+
+    const TokenList *body = &table->list[from].body;
+    for (unsigned int i = 0; i < body->count; i++)
+    {
+        if (body->list[i].type == FUNCTION &&
+            reaches(table, body->list[i].value.variable, target, visited))
+            return true;
+    }
+
+    return false;
+}
+
+// column of the first call in body that leads back to index, or -1
+static int find_recursion(const FunctionTable *table, const TokenList body, unsigned int index)
+{
+    bool *visited = (bool *)calloc(table->names.count, sizeof(bool));
+    if (visited == NULL) exit(1);
+
+    int column = -1;
+    for (unsigned int i = 0; i < body.count && column < 0; i++)
+    {
+        if (body.list[i].type == FUNCTION &&
+            reaches(table, body.list[i].value.variable, index, visited))
+            column = body.list[i].column;
+    }
+
+    free(visited);
+    return column;
+}
+
+static unsigned int skip_spaces(const char *input, unsigned int i)
+{
+    while (input[i] == ' ' || input[i] == '\t')
+        i++;
+
+    return i;
+}
+
+// the end of a name as the lexer reads it, a built in name ends before a digit
+static unsigned int name_end(const char *input, unsigned int i)
+{
+    unsigned int start = i;
+    while (input[i] >= 'a' && input[i] <= 'z')
+        i++;
+
+    if (i == start || input[i] < '0' || input[i] > '9' || iskeyword(input + start, i - start))
+        return i;
+
+    while ((input[i] >= 'a' && input[i] <= 'z') || (input[i] >= '0' && input[i] <= '9'))
+        i++;
+
+    return i;
+}
+
+// read "name(a, b) =", parameters go into locals in order
+// on success index is left at the first character of the body
+static ResultInfo parse_head(const char *definition, unsigned int *index,
+                             unsigned int *name_start, NameTable *locals)
+{
+    unsigned int i = skip_spaces(definition, 0);
+    *name_start = i;
+    *index = name_end(definition, i);
+    if (*index == i || iskeyword(definition + i, *index - i))
+        return result_info(INVALID_TOKEN, i);
+
+    i = skip_spaces(definition, *index);
+    if (definition[i] != '(')
+        return result_info(INVALID_TOKEN, i);
+
+    i = skip_spaces(definition, i + 1);
+    while (definition[i] != ')')
+    {
+        unsigned int end = name_end(definition, i);
+        unsigned int existing;
+        if (end == i || iskeyword(definition + i, end - i) ||
+            nametable_find(locals, definition + i, end - i, &existing))
+            return result_info(INVALID_TOKEN, i);
+
+        if (locals->count == FUNCTION_PARAMETERS_MAX)
+            return result_info(INVALID_TOKEN, i);
+
+        nametable_add(locals, definition + i, end - i);
+
+        i = skip_spaces(definition, end);
+        if (definition[i] == ',')
+            i = skip_spaces(definition, i + 1);
+        else if (definition[i] != ')')
+            return result_info(INVALID_TOKEN, i);
+    }
+
+    i = skip_spaces(definition, i + 1);
+    if (definition[i] != '=' || definition[i + 1] == '=')
+        return result_info(INVALID_TOKEN, i);
+
+    *index = i + 1;
+    return result_info(SUCCESS, 0);
+}
+
+// the body must make a valid expression with the parameters as variables
+static ResultInfo check_body(const FunctionTable *table, FunctionDefinition *function)
+{
+    TokenList expanded = new_tokenlist();
+    TokenList program = new_tokenlist();
+    TokenList stack = new_tokenlist();
+
+    ResultInfo res = expand_calls(table, function->body, &expanded, &function->locals);
+    if (res.status == SUCCESS)
+        res = convert_tokens(&expanded, &program, &stack);
+
+    delete_tokenlist(stack);
+    delete_tokenlist(program);
+    delete_tokenlist(expanded);
+    return res;
+}
+
+ResultInfo function_define(FunctionTable *table, const char *definition)
+{
+    FunctionDefinition function;
+    function.defined = true;
+    function.locals = new_nametable();
+    function.body = new_tokenlist();
+    function.native = NULL;
+
+    unsigned int body_start;
+    unsigned int name_start;
+    ResultInfo res = parse_head(definition, &body_start, &name_start, &function.locals);
+    function.parameter_count = function.locals.count;
+
+    // the name is known before the body is lexed,
+    // so that a call of the function itself is found
+    unsigned int index = 0;
+    if (res.status == SUCCESS)
+    {
+        unsigned int name_end_index = name_end(definition, name_start);
+        index = nametable_add(&table->names, definition + name_start, name_end_index - name_start);
+        ensure_definitions(table);
+
+        res = lex_functions(definition + body_start, &function.body,
+                            &function.locals, &table->names);
+        res.error_index += body_start;
+    }
+
+    if (res.status == SUCCESS && function.body.count == 0)
+        res = result_info(INVALID_TOKEN, body_start);
+
+    if (res.status == SUCCESS)
+    {
+        int column = find_recursion(table, function.body, index);
+        if (column >= 0)
+            res = result_info(CIRCULAR_REFERENCE, column + body_start);
+    }
+
+    if (res.status == SUCCESS)
+    {
+        res = check_body(table, &function);
+        res.error_index += body_start;
+    }
+
+    if (res.status != SUCCESS)
+    {
+        delete_tokenlist(function.body);
+        delete_nametable(function.locals);
+        return res;
+    }
+
+    if (table->list[index].defined)
+    {
+        delete_tokenlist(table->list[index].body);
+        delete_nametable(table->list[index].locals);
+    }
+
+    free(table->list[index].native);
+    table->list[index] = function;
+    return result_info(SUCCESS, 0);
+}
+
+ResultInfo function_register(FunctionTable *table, const char *name, unsigned int arity,
+                             NativeScalar scalar, NativeVector vector, unsigned int flags)
+{
+    unsigned int length = name_end(name, 0);
+    if (length == 0 || name[length] != '\0' || iskeyword(name, length))
+        return result_info(INVALID_TOKEN, length);
+
+    if (arity == 0 || arity > FUNCTION_PARAMETERS_MAX || scalar == NULL)
+        return result_info(INVALID_TOKEN, 0);
+
+    unsigned int index = nametable_add(&table->names, name, length);
+    ensure_definitions(table);
+
+    FunctionDefinition *function = &table->list[index];
+    if (function->defined)
+    {
+        delete_tokenlist(function->body);
+        delete_nametable(function->locals);
+        function->defined = false;
+    }
+
+    // a replaced registration is updated where it is
+    if (function->native == NULL)
+    {
+        function->native = (NativeFunction *)malloc(sizeof(NativeFunction));
+        if (function->native == NULL) exit(1);
+    }
+
+    function->parameter_count = arity;
+    function->native->arity = arity;
+    function->native->scalar = scalar;
+    function->native->vector = vector;
+    function->native->flags = flags;
+    function->native->name = nametable_name(&table->names, index);
+
+    return result_info(SUCCESS, 0);
+}
+
+bool program_has_vector_natives(const TokenList program)
+{
+    for (unsigned int i = 0; i < program.count; i++)
+    {
+        if (program.list[i].type == NATIVE && program.list[i].value.native->vector != NULL)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,65 @@
+#ifndef CALCULUS
+#define CALCULUS
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "rows.h"
+
+// Integration, summation and root finding
+//
+//   integrate(f, x, a, b)   integral of f over x from a to b
+//   sum(i, a, b, f)         f for i = a, a + 1, ... as long as i <= b
+//   root(f, x, a, b)        x between a and b where f changes sign
+//
+// the body f is compiled once into a program of its variable alone
+// and evaluated at many values of it per batch, in parallel once a batch
+// is large enough
+// values are combined in the order of their points, so results are
+// the same for any number of threads
+
+// batches of at least this many points run on a row pool
+#define CALCULUS_PARALLEL_MIN 16384
+
+// points of sum evaluated per batch
+#define CALCULUS_CHUNK 65536
+
+// terms a sum may have
+#define CALCULUS_SUM_MAX 4294967296.0
+
+// integrate starts from this many equal pieces and splits a piece in two
+// until the Gauss-Kronrod error estimate of every piece is small enough,
+// one that is not after the limits below fails with NOT_CONVERGED
+#define INTEGRATE_START_INTERVALS 8
+#define INTEGRATE_DEPTH_MAX 48
+#define INTEGRATE_INTERVALS_MAX 4096
+#define INTEGRATE_RELATIVE 1e-12
+#define INTEGRATE_ABSOLUTE 1e-15
+
+// root narrows its bracket to one of this many pieces per batch
+#define ROOT_SECTIONS 64
+#define ROOT_ROUNDS_MAX 64
+
+// CALCULUS FUNCTION DECLARATIONS
+// body is a program of variable 0 as built by convert_names,
+// pool runs large batches, without one a pool is started when needed
+// a failed evaluation of body is returned as it is, errors of the range
+// itself have error_index 0
+ResultInfo integrate_program(RowPool *pool, const TokenList body,
+                             double low, double high, double *result);
+ResultInfo sum_program(RowPool *pool, const TokenList body,
+                       double first, double last, double *result);
+
+// integrate is NOT_CONVERGED when its pieces run into the limits
+// with an error beyond the tolerance, as at a pole like 1 / x at 0
+// low and high must bracket a sign change of body, else NO_SIGN_CHANGE
+ResultInfo root_program(RowPool *pool, const TokenList body,
+                        double low, double high, double *result);
+
+// replace every integrate, sum and root call in the lexed tokens infix
+// by a NUMBER of its value, calls in arguments first
+// bodies and bounds may not use variables of the expression,
+// those are UNDEFINED_VARIABLE, a bound that is not finite is BOUND_NOT_FINITE
+ResultInfo expand_calculus(TokenList *infix);
+
+#endif // CALCULUS
@@ -0,0 +1,63 @@
+#ifndef DAG
+#define DAG
+
+// standard library includes
+#include <stdbool.h>
+
+// project includes
+#include "token.h"
+
+// marks a missing operand
+#define DAG_NONE 0xffffffffu
+
+// one distinct subexpression of a program
+typedef struct
+{
+    Token token;                // operand or operator of its first occurrence
+    unsigned int operands[2];   // node indices, DAG_NONE if unused
+    unsigned int operand_count;
+    unsigned int uses;          // references from distinct parent nodes
+} DagNode;
+
+// EXPRESSION DAG DATA STRUCTURE
+// hash-consed form of a postfix program, structurally identical
+// subexpressions share a single node
+// a program of several expressions one after another
+// has one root per expression, in program order
+typedef struct
+{
+    unsigned int count;
+    unsigned int max;
+    DagNode *nodes;
+    unsigned int *roots;
+    unsigned int root_count;
+
+    // open addressing hash of indices into nodes
+    // a slot holds index + 1, 0 marks an empty slot
+    unsigned int slot_count;
+    unsigned int *slots;
+
+    // false if the program was not a plain postfix expression
+    // as built by convert(), for example after fusion
+    bool valid;
+} ExpressionDag;
+
+// EXPRESSION DAG FUNCTION DECLARATIONS
+ExpressionDag new_expression_dag(const TokenList program);
+
+// a program that leaves root_count values, valid only if it leaves exactly that many
+ExpressionDag new_expression_dag_roots(const TokenList program, unsigned int root_count);
+void delete_expression_dag(ExpressionDag dag);
+
+// a node is shared when it is an operation used more than once
+bool dag_node_shared(const ExpressionDag *dag, unsigned int index);
+unsigned int dag_shared_count(const ExpressionDag *dag);
+
+// write the program computing every shared node once,
+// the first occurrence stores its value in a temporary that later ones load
+// the values of the roots are left on the stack in order
+// returns false and leaves program untouched if nothing is shared
+// or a fixed program is too small for the result
+bool dag_emit(const ExpressionDag *dag, TokenList *program);
+
+#endif // DAG
@@ -0,0 +1,81 @@
+#ifndef FORMULA
+#define FORMULA
+
+// standard library includes
+#include <stdbool.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+
+// a named cell of a formula graph
+// it holds either a formula or a plain input value
+typedef struct
+{
+    bool defined;
+    bool is_formula;
+    bool dirty;
+
+    // postfix program of the formula
+    TokenList program;
+
+    // distinct names referenced by the formula
+    // with the column of their first occurrence
+    unsigned int *references;
+    unsigned int *reference_columns;
+    unsigned int reference_count;
+
+    // names whose formula references this one
+    unsigned int *dependents;
+    unsigned int dependent_count;
+    unsigned int dependent_max;
+
+    // outcome of the most recent evaluation
+    ResultInfo status;
+} FormulaNode;
+
+// FORMULA GRAPH DATA STRUCTURE
+// nodes and values are indexed by the name index in names
+typedef struct
+{
+    NameTable names;
+    FormulaNode *nodes;
+    double *values;
+    unsigned int node_max;
+
+    // nodes changed since the last recompute
+    unsigned int *dirty_list;
+    unsigned int dirty_count;
+    unsigned int dirty_max;
+
+    // scratch space for graph traversals
+    unsigned int *mark;
+    unsigned int *pending;
+    unsigned int generation;
+
+    unsigned int thread_count;
+} FormulaGraph;
+
+// FORMULA GRAPH FUNCTION DECLARATIONS
+FormulaGraph new_formula_graph(unsigned int thread_count);
+void delete_formula_graph(FormulaGraph *graph);
+
+// define or redefine name as a formula
+// error_index refers to characters in expression,
+// a definition that would close a cycle is rejected
+// with CIRCULAR_REFERENCE at the offending reference
+ResultInfo formula_define(FormulaGraph *graph, const char *name, const char *expression);
+
+// define or redefine name as an input value
+ResultInfo formula_set_value(FormulaGraph *graph, const char *name, double value);
+
+// re-evaluate every formula downstream of a change in topological order,
+// formulas on the same level are evaluated in parallel
+// returns the number of formulas evaluated
+unsigned int formula_recompute(FormulaGraph *graph);
+
+// value of name as of the most recent recompute
+ResultInfo formula_value(const FormulaGraph *graph, const char *name, Token *result);
+
+#endif // FORMULA
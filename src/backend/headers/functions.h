@@ -0,0 +1,107 @@
+#ifndef FUNCTIONS
+#define FUNCTIONS
+
+// standard library includes
+#include <stdbool.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+
+#define FUNCTION_PARAMETERS_MAX 16
+
+// a native function computes one value from arity arguments
+typedef double (*NativeScalar)(const double *args);
+
+// the vector form computes count values at once,
+// args[k][i] is argument k of value i
+typedef void (*NativeVector)(const double *const *args, double *results, unsigned int count);
+
+typedef enum
+{
+    NATIVE_NONE = 0,
+
+    // same arguments give the same result and the call has no side effects,
+    // so calls with constant arguments are folded by OPTIMIZE_FOLD
+    NATIVE_PURE = 1 << 0
+} native_flag;
+
+// a registered C function, programs call it through a pointer to this
+struct NativeFunction
+{
+    unsigned int arity;
+    NativeScalar scalar;
+    NativeVector vector;    // NULL if there is no vector form
+    unsigned int flags;
+    const char *name;
+};
+
+typedef struct NativeFunction NativeFunction;
+
+// a user function, lexed once and inlined at every call
+typedef struct
+{
+    bool defined;
+    unsigned int parameter_count;
+
+    // lexed tokens of the body, a VARIABLE below parameter_count
+    // is a parameter, any other is a free variable named in locals
+    TokenList body;
+    NameTable locals;
+
+    // set instead of a body for a registered native function
+    NativeFunction *native;
+} FunctionDefinition;
+
+// FUNCTION TABLE DATA STRUCTURE
+// definitions are indexed by the name index in names
+typedef struct
+{
+    NameTable names;
+    FunctionDefinition *list;
+    unsigned int max;
+} FunctionTable;
+
+// FUNCTION TABLE FUNCTION DECLARATIONS
+FunctionTable new_function_table(void);
+void delete_function_table(FunctionTable *table);
+
+// define or redefine a function written as "name(a, b) = body"
+// names of functions and parameters, like those of variables, are a lowercase
+// letter followed by lowercase letters and digits, clamp01 or x2, but a built in
+// name followed by a digit stays the built in, sin2 is sin 2
+// error_index refers to characters in definition,
+// a body that calls its own function, directly or through others,
+// is rejected with CIRCULAR_REFERENCE at the call
+// a failed redefinition keeps the previous definition
+ResultInfo function_define(FunctionTable *table, const char *definition);
+
+// register a native function, or replace the one of the same name
+// the name follows the rules of a function name, arity is 1 to
+// FUNCTION_PARAMETERS_MAX, a vector form is optional
+// a user definition of the same name is replaced
+// programs call a registration through its address, which stays the same
+// when it is registered again, so compiled programs call the replacement,
+// and which is freed when the table is deleted or the name is defined
+// by function_define, programs compiled with it must not run after that
+ResultInfo function_register(FunctionTable *table, const char *name, unsigned int arity,
+                             NativeScalar scalar, NativeVector vector, unsigned int flags);
+
+// whether program calls a native function that has a vector form
+bool program_has_vector_natives(const TokenList program);
+
+// replace every call in the lexed tokens infix by the body of its function,
+// each parameter by its argument in parentheses,
+// a call of a native function by a NATIVE token with its arguments
+// free variables of bodies are added to names, tokens of a body
+// take the column of the call they were inlined at
+ResultInfo expand_calls(const FunctionTable *table, const TokenList infix,
+                        TokenList *output, NameTable *names);
+
+// convert_names with calls of the functions in table inlined,
+// the program has no trace of them left
+ResultInfo convert_functions(const char *input_string, TokenList *tokens,
+                             NameTable *names, const FunctionTable *functions);
+
+#endif // FUNCTIONS
@@ -0,0 +1,54 @@
+#ifndef INTERVAL
+#define INTERVAL
+
+// project includes
+#include "token.h"
+#include "parser.h"
+
+// Interval evaluation
+//
+// a program evaluated over a box of variables, each variable ranging
+// over an interval, gives an interval holding the value the program
+// computes at every point of the box where it does not fail
+// bounds are rounded outwards, so the interval also holds the rounded
+// values evaluate gives, NAN values, like those of x % 0, are not bounded
+// but flagged, a condition or comparison that may see one is not decided
+
+// results of the math library are widened by this many units
+// in the last place, for its error and the one of evaluate
+#define INTERVAL_LIBRARY_ULPS 4
+
+// past this magnitude the period of sin, cos and tan is not resolved
+// and they are bounded by their whole range
+#define INTERVAL_TRIGONOMETRY_MAX 1e6
+
+// INTERVAL DATA STRUCTURE
+// every value from low to high, both included
+typedef struct
+{
+    double low;
+    double high;
+
+    // an operation that fails at some points of the box and not at others
+    // bounds the values where it succeeds and records its error here,
+    // SUCCESS if no point can fail
+    error_type possible;
+    unsigned int possible_index;
+
+    // some point may give NAN, the bounds only hold the other values
+    bool maybe_nan;
+} Interval;
+
+// INTERVAL FUNCTION DECLARATIONS
+Interval new_interval(double low, double high);
+
+// bounds of program over the box, variables[index] is the interval
+// of the VARIABLE index and must have low <= high
+// an operation that fails at every point of the box fails the evaluation
+// with its error at its column, as evaluate does
+// a conditional whose condition is not decided by the box gives the hull
+// of both branches, a branch that always fails leaves only the other
+// native functions are bounded only when pure and called with single points
+ResultInfo evaluate_interval(const TokenList program, const Interval *variables, Interval *result);
+
+#endif // INTERVAL
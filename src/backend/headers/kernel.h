@@ -0,0 +1,51 @@
+#ifndef KERNEL
+#define KERNEL
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+
+// KERNEL DATA STRUCTURE
+// several expressions over the same variables compiled into one program,
+// a row is read once for all of them and subexpressions
+// common to several expressions are computed once
+typedef struct
+{
+    unsigned int output_count;
+    unsigned int output_max;
+
+    // each expression on its own, a row that fails in the fused program
+    // is evaluated again expression by expression to tell
+    // which outputs failed
+    TokenList *programs;
+
+    // every expression one after another, built by kernel_compile
+    TokenList program;
+
+    // optimize_flag passes of both the fused and the single programs
+    unsigned int optimize;
+} Kernel;
+
+// KERNEL FUNCTION DECLARATIONS
+Kernel new_kernel(unsigned int optimize);
+void delete_kernel(Kernel *kernel);
+
+// add expression as the next output
+// error_index refers to characters in expression
+ResultInfo kernel_add(Kernel *kernel, const char *expression, NameTable *names);
+
+// build the fused program of the expressions added so far
+void kernel_compile(Kernel *kernel);
+
+// evaluate rows begin to end of variables, row r reads its variables
+// from variables[r * stride] onwards
+// output k of row r goes to columns[k][r] and its status to errors[k][r],
+// a failed output leaves NAN in its column
+// returns the number of failed outputs
+unsigned long long kernel_evaluate_range(const Kernel *kernel, ParseContext *context,
+                                         const double *variables, unsigned int stride,
+                                         unsigned long long begin, unsigned long long end,
+                                         double *const *columns, error_type *const *errors);
+
+#endif // KERNEL
@@ -0,0 +1,30 @@
+#ifndef NAMETABLE
+#define NAMETABLE
+
+// standard library includes
+#include <stdbool.h>
+
+// NAME TABLE DATA STRUCTURE
+// interns identifiers so that VARIABLE tokens
+// can refer to them by index
+typedef struct
+{
+    unsigned int count;
+    unsigned int max;
+    char **list;
+
+    // open addressing hash of indices into list
+    // a slot holds index + 1, 0 marks an empty slot
+    unsigned int slot_count;
+    unsigned int *slots;
+} NameTable;
+
+// NAME TABLE FUNCTION DECLARATIONS
+NameTable new_nametable(void);
+void delete_nametable(NameTable nametable);
+unsigned int nametable_add(NameTable *self, const char *name, unsigned int length);
+bool nametable_find(const NameTable *self, const char *name,
+                    unsigned int length, unsigned int *index);
+const char *nametable_name(const NameTable *self, unsigned int index);
+
+#endif // NAMETABLE
@@ -0,0 +1,49 @@
+#ifndef OPTIMIZE
+#define OPTIMIZE
+
+// project includes
+#include "token.h"
+
+// optimizer passes over postfix programs, combined as flags
+// all passes but OPTIMIZE_SHARE and OPTIMIZE_INTEGER rewrite the program in place
+// and never make it longer, so they do not touch the heap
+typedef enum
+{
+    OPTIMIZE_NONE = 0,
+
+    // fuse common postfix sequences into superinstructions
+    OPTIMIZE_FUSE = 1 << 0,
+
+    // constant powers with small integer exponents use repeated squaring,
+    // x ^ 0.5 uses sqrt, division by a power of two becomes a multiplication
+    OPTIMIZE_STRENGTH = 1 << 1,
+
+    // together with OPTIMIZE_STRENGTH, division by any nonzero constant
+    // becomes multiplication by its reciprocal, which may change the last bit
+    OPTIMIZE_RECIPROCAL = 1 << 2,
+
+    // compute repeated subexpressions once and reuse them from temporaries,
+    // needs scratch memory and leaves a fixed program alone if it does not fit
+    OPTIMIZE_SHARE = 1 << 3,
+
+    // evaluate subexpressions of integer literals with exact 64 bit integers,
+    // continuing in double when a result overflows or is not a whole number,
+    // grows the program and leaves a fixed program alone if it does not fit
+    OPTIMIZE_INTEGER = 1 << 4,
+
+    // evaluate operators and pure native calls whose operands are all
+    // constants once, an operation that fails is kept for the evaluation to report
+    OPTIMIZE_FOLD = 1 << 5
+} optimize_flag;
+
+// run the passes selected by flags over a program built by convert()
+void optimize(TokenList *program, unsigned int flags);
+
+// number of evaluator dispatches needed to run a program,
+// immediate operands of fused operators are not dispatched
+unsigned int program_dispatch_count(const TokenList program);
+
+// whether program contains a conditional
+bool program_has_jumps(const TokenList program);
+
+#endif // OPTIMIZE
@@ -3,6 +3,7 @@
 
 // project includes
 #include "token.h"
+#include "nametable.h"
 
 // definition of possible error types
 typedef enum
@@ -20,7 +21,13 @@ typedef enum
     TANGENT_UNDEFINED,
     ARCUS_OUT_OF_RANGE,
     LOG_OUT_OF_RANGE,
-    FAC_INPUT_NOT_INT
+    FAC_INPUT_NOT_INT,
+    UNDEFINED_VARIABLE,
+    CIRCULAR_REFERENCE,
+    CAPACITY_EXCEEDED,
+    BOUND_NOT_FINITE,
+    NO_SIGN_CHANGE,
+    NOT_CONVERGED
 } error_type;
 
 // operation return type
@@ -31,10 +38,209 @@ typedef struct
     unsigned int error_index;
 } ResultInfo;
 
+// DIAGNOSTIC LIST DATA STRUCTURE
+// every error found in one expression
+typedef struct
+{
+    unsigned int count;
+    unsigned int max;
+    ResultInfo *list;
+} DiagnosticList;
+
+// DIAGNOSTIC LIST FUNCTION DECLARATIONS
+DiagnosticList new_diagnostic_list(void);
+void delete_diagnostic_list(DiagnosticList diagnostics);
+void clear_diagnostic_list(DiagnosticList *self);
+void diagnostic_list_add(DiagnosticList *self, error_type status, unsigned int error_index);
+
 // operations
 ResultInfo lex (const char *input_string, TokenList *output);
 ResultInfo syntax_check(const TokenList tokens);
 ResultInfo convert(const char *input_string, TokenList *tokens);
 ResultInfo parse(const char *input_string, Token *result);
 
+// parse with integer literals and operations evaluated exactly,
+// result is an INTEGER token if the value is a whole number computed exactly
+ResultInfo parse_exact(const char *input_string, Token *result);
+
+// variants that accept identifiers
+// unknown names are added to names and lexed as VARIABLE tokens
+ResultInfo lex_names(const char *input_string, TokenList *output, NameTable *names);
+ResultInfo convert_names(const char *input_string, TokenList *tokens, NameTable *names);
+
+// like lex_names, a name in functions followed by ( becomes a FUNCTION token
+ResultInfo lex_functions(const char *input_string, TokenList *output,
+                         NameTable *names, const NameTable *functions);
+
+// whether the lowercase name is a built in function or constant
+bool iskeyword(const char *name, unsigned int length);
+
+// check and convert lexed tokens to a postfix program
+// signs are merged into the numbers of infix, stack is scratch space
+ResultInfo convert_tokens(TokenList *infix, TokenList *tokens, TokenList *stack);
+
+// error recovering variants for validation
+// instead of stopping at the first error, each error is added to diagnostics
+// and the pass resynchronizes at the next operator or parenthesis
+//
+// lex_recover puts an EMPTY token where input could not be lexed,
+// syntax_check_recover accepts an EMPTY token as whatever is expected there
+void lex_recover(const char *input_string, TokenList *output,
+                 NameTable *names, DiagnosticList *diagnostics);
+void syntax_check_recover(const TokenList tokens, DiagnosticList *diagnostics);
+
+// lex and check input, collecting every error in diagnostics
+// lexical errors come first, then syntax errors, each in input order,
+// so the first diagnostic is the error convert would report
+// returns the number of errors found
+unsigned int validate_expression(const char *input_string, NameTable *names,
+                                 TokenList *tokens, DiagnosticList *diagnostics);
+
+// evaluate a postfix token list produced by convert
+// VARIABLE tokens read their value from variables[index]
+ResultInfo evaluate(const TokenList program, const double *variables, Token *result);
+
+// apply one of the operators ADD to FAC, or a comparison, to x and,
+// if it is binary, y the way evaluate does
+// status gets its error, the value is NAN if there is one
+double apply_operator(operator_type type, double x, double y, error_type *status);
+
+// like evaluate, but a program optimized with OPTIMIZE_INTEGER
+// whose value is an exact integer gives an INTEGER result
+// instead of rounding it to a NUMBER
+ResultInfo evaluate_exact(const TokenList program, const double *variables, Token *result);
+
+// reusable scratch lists for repeated parsing
+// a context keeps its allocations between calls,
+// so a warmed up context parses without allocating
+typedef struct
+{
+    TokenList tokens;
+    TokenList stack;
+    TokenList program;
+
+    // optimize_flag passes run on every converted program, none by default
+    unsigned int optimize;
+} ParseContext;
+
+ParseContext new_parse_context(void);
+void delete_parse_context(ParseContext context);
+
+// a context over caller storage never touches the heap,
+// running out of room fails with CAPACITY_EXCEEDED
+// at the column of the token that did not fit
+// tokens holds the lexed input, program the postfix output,
+// stack serves both conversion and evaluation
+ParseContext bounded_parse_context(Token *tokens, unsigned int token_capacity,
+                                   Token *stack, unsigned int stack_capacity,
+                                   Token *program, unsigned int program_capacity);
+
+// convert_context leaves its result in context->program
+ResultInfo convert_context(ParseContext *context, const char *input_string, NameTable *names);
+ResultInfo evaluate_context(ParseContext *context, const TokenList program,
+                            const double *variables, Token *result);
+ResultInfo parse_context(ParseContext *context, const char *input_string, Token *result);
+
+// evaluate a program of several expressions one after another,
+// outputs receives the value of each in order
+// program must leave at least output_count values
+ResultInfo evaluate_outputs(ParseContext *context, const TokenList program,
+                            const double *variables, double *outputs, unsigned int output_count);
+
+// rows evaluated together by evaluate_batch
+#define BATCH_ROWS 256
+
+// BATCH CONTEXT DATA STRUCTURE
+// one stack per row of a block, kept between calls
+typedef struct
+{
+    TokenList *stacks;
+    unsigned int *rows;
+    error_type *status;
+
+    // arguments and results of the vector form of a native call
+    double *arguments;
+    double *values;
+} BatchContext;
+
+BatchContext new_batch_context(void);
+void delete_batch_context(BatchContext batch);
+
+// evaluate program over the rows token by token instead of row by row,
+// at a conditional each branch runs only over the rows that take it,
+// native functions with a vector form are called once for all rows
+// row r reads its variables from variables[r * stride] onwards,
+// results[r] gets its value or NAN and errors[r] its status
+// returns the number of failed rows
+unsigned long long evaluate_batch(BatchContext *batch, const TokenList program,
+                                  const double *variables, unsigned int stride,
+                                  unsigned long long row_count,
+                                  double *results, error_type *errors);
+
+// PROGRAM ANALYSIS
+// a static estimate of what evaluating a program costs,
+// without running it
+
+typedef enum
+{
+    ANALYSIS_OPERAND = 0,       // numbers and variables
+    ANALYSIS_ARITHMETIC,        // + - * / %, negation, abs and their fused forms
+    ANALYSIS_POWER,             // ^ in every form, square roots
+    ANALYSIS_TRANSCENDENTAL,    // trigonometric functions and logarithms
+    ANALYSIS_FACTORIAL,
+    ANALYSIS_COMPARISON,
+    ANALYSIS_CONTROL,           // jumps and temporaries
+    ANALYSIS_NATIVE,            // calls of native functions
+    ANALYSIS_CATEGORY_COUNT
+} analysis_category;
+
+// COST TABLE DATA STRUCTURE
+// estimated cycles of one evaluation of each kind of token
+typedef struct
+{
+    double operators[OPERATOR_TYPE_COUNT];  // by operator_type
+    double operand;
+    double native;
+} CostTable;
+
+// PROGRAM ANALYSIS DATA STRUCTURE
+typedef struct
+{
+    // tokens that are evaluated, immediate operands are part of their operator
+    unsigned int token_count;
+    unsigned int category_counts[ANALYSIS_CATEGORY_COUNT];
+    unsigned int operator_counts[OPERATOR_TYPE_COUNT];
+
+    // calls of trigonometric functions and logarithms,
+    // also those fused with a negation
+    unsigned int transcendental_count;
+
+    // most values on the stack at once
+    unsigned int stack_depth;
+
+    // share of the operations whose operands are all constant,
+    // which OPTIMIZE_FOLD computes once, 0 without operations
+    double constant_ratio;
+
+    // estimated cycles of one evaluation,
+    // a conditional counts its condition and its costlier branch
+    double cost;
+} ProgramAnalysis;
+
+// table of an x86-64 machine, measured like BenchCost does
+CostTable default_cost_table(void);
+
+// short name of an operator, as in a cost table file
+const char *operator_name(operator_type type);
+
+// a cost table file has a line "name cycles" for each entry to change,
+// names are those of operator_name, "operand" and "native"
+// load returns false if the file cannot be read or has a line that is
+// not an entry, entries not in the file keep their value in costs
+bool cost_table_load(const char *path, CostTable *costs);
+bool cost_table_save(const char *path, const CostTable *costs);
+
+// analyze a program from convert or optimize, costs NULL uses the default table
+ProgramAnalysis analyze_program(const TokenList program, const CostTable *costs);
+
 #endif // OPERATIONS
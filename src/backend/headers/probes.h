@@ -0,0 +1,59 @@
+#ifndef PROBES
+#define PROBES
+
+// USDT probes
+//
+// static tracepoints at the boundaries of the pipeline for perf and bpftrace,
+// provider "parser", built in with -DPARSER_PROBES=ON where sys/sdt.h exists
+// an unattached probe is a single nop, its arguments are values the
+// function has at hand anyway, those that are not are only computed
+// while a tracer is attached, which PARSER_PROBE_ENABLED tells
+//
+// every probe carries four arguments
+//   arg0  length of the input, characters of the expression for lex,
+//         convert and parse, tokens for syntax_check, rows for a batch chunk
+//   arg1  tokens, those produced on return of lex and convert,
+//         those of the program for parse and a batch chunk
+//   arg2  error_type status, SUCCESS on entry
+//   arg3  error_index, for a batch chunk the first failed row of the batch
+//
+// probes
+//   lex_entry           lex_return
+//   syntax_check_entry  syntax_check_return
+//   convert_entry       convert_return
+//   parse_entry         parse_return
+//   batch_chunk_entry   batch_chunk_return
+
+#if defined(PARSER_PROBES)
+
+// a tracer attaching to a probe increments its semaphore
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+extern unsigned short parser_lex_entry_semaphore;
+extern unsigned short parser_lex_return_semaphore;
+extern unsigned short parser_syntax_check_entry_semaphore;
+extern unsigned short parser_syntax_check_return_semaphore;
+extern unsigned short parser_convert_entry_semaphore;
+extern unsigned short parser_convert_return_semaphore;
+extern unsigned short parser_parse_entry_semaphore;
+extern unsigned short parser_parse_return_semaphore;
+extern unsigned short parser_batch_chunk_entry_semaphore;
+extern unsigned short parser_batch_chunk_return_semaphore;
+
+#define PARSER_PROBE(name, length, count, status, index) \
+    STAP_PROBE4(parser, name, length, count, status, index)
+
+#define PARSER_PROBE_ENABLED(name) __builtin_expect(parser_##name##_semaphore, 0)
+
+#else
+
+// the arguments are not evaluated, no code is left
+#define PARSER_PROBE(name, length, count, status, index) \
+    ((void)sizeof((length) + (count) + (status) + (index)))
+
+#define PARSER_PROBE_ENABLED(name) 0
+
+#endif // PARSER_PROBES
+
+#endif // PROBES
@@ -0,0 +1,117 @@
+#ifndef PROGRAM_FILE
+#define PROGRAM_FILE
+
+// standard library includes
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+
+// Compiled program file
+//
+// A set of compiled formulas is kept as one image that is identical
+// in memory and on disk, so a saved set is used straight from the
+// mapped file without parsing or allocating per formula.
+// All references inside the image are offsets.
+//
+// layout:
+//   ProgramFileHeader
+//   ProgramFileEntry  x program_count
+//   ProgramFileString x variable_count  (names of VARIABLE indices)
+//   Token             x token_count     (postfix programs, back to back)
+//   strings                             (sources and variable names)
+//
+// error_index reporting needs no extra table,
+// every token record keeps the column it was built from
+
+#define PROGRAM_FILE_MAGIC "MPARSER"
+#define PROGRAM_FILE_VERSION 1u
+#define PROGRAM_FILE_BYTE_ORDER 0x01020304u
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;    // PROGRAM_FILE_BYTE_ORDER as written by the host
+    uint32_t token_size;    // sizeof(Token) of the writer
+    uint32_t program_count;
+    uint32_t variable_count;
+    uint32_t token_count;
+    uint64_t strings_size;
+    uint64_t image_size;
+    uint64_t checksum;      // of every byte after the header
+    uint64_t reserved;
+} ProgramFileHeader;
+
+typedef struct
+{
+    uint32_t token_offset;  // first token of the program
+    uint32_t token_count;
+    uint32_t source_offset; // into strings
+    uint32_t source_length;
+    uint32_t status;        // ResultInfo of compiling the source
+    uint32_t error_index;
+    uint64_t source_hash;
+} ProgramFileEntry;
+
+typedef struct
+{
+    uint32_t offset; // into strings
+    uint32_t length;
+} ProgramFileString;
+
+// where the programs of a set came from
+typedef enum
+{
+    PROGRAM_SET_FAILED = 0,
+    PROGRAM_SET_COMPILED,
+    PROGRAM_SET_MAPPED,
+    PROGRAM_SET_RECOMPILED
+} program_set_origin;
+
+// PROGRAM SET DATA STRUCTURE
+typedef struct
+{
+    unsigned char *image;
+    size_t size;
+    bool mapped;
+
+    // views into image
+    const ProgramFileHeader *header;
+    const ProgramFileEntry *entries;
+    const ProgramFileString *variables;
+    const Token *tokens;
+    const char *strings;
+
+    // variable names in index order
+    NameTable names;
+} ProgramSet;
+
+// PROGRAM SET FUNCTION DECLARATIONS
+// compile every source, sources that fail keep their ResultInfo
+program_set_origin program_set_compile(ProgramSet *set, const char **sources, unsigned int count);
+
+// write the image to path, replacing it atomically
+bool program_set_save(const ProgramSet *set, const char *path);
+
+// map a saved set from path
+// the file is used if its version and checksum are valid and,
+// when sources are given, it was built from exactly these sources
+// otherwise the sources are recompiled and the file is rewritten
+program_set_origin program_set_load(ProgramSet *set, const char *path,
+                                    const char **sources, unsigned int count);
+
+void delete_program_set(ProgramSet *set);
+
+unsigned int program_set_count(const ProgramSet *set);
+
+// compile result of a program, and the program as a list view
+// the view must not be modified or deleted
+ResultInfo program_set_status(const ProgramSet *set, unsigned int index);
+TokenList program_set_program(const ProgramSet *set, unsigned int index);
+
+#endif // PROGRAM_FILE
@@ -0,0 +1,89 @@
+#ifndef REGISTRY
+#define REGISTRY
+
+// standard library includes
+#include <stdbool.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+
+// Formula registry
+//
+// named formulas that writers replace while readers evaluate them
+// a writer compiles a new version and publishes it with one atomic swap,
+// a reader takes whichever version is current without ever waiting,
+// the few stores of entering and leaving a read are all it adds
+// replaced versions are freed once every reader that could still
+// hold them has left its read, by epochs: a reader announces the
+// epoch it entered at, a replaced version is tagged with the epoch
+// after its replacement and freed when no reader announces an older one
+
+// readers open at the same time
+#define REGISTRY_READERS_MAX 64
+
+// returned by registry_lookup for a name that was never published
+#define REGISTRY_NONE 0xffffffffu
+
+// state shared by writers and readers, owned by the registry
+typedef struct RegistryState RegistryState;
+
+// FORMULA REGISTRY DATA STRUCTURE
+typedef struct
+{
+    RegistryState *state;
+} FormulaRegistry;
+
+// REGISTRY READER DATA STRUCTURE
+// the evaluation state of one reading thread, not to be shared
+typedef struct
+{
+    RegistryState *state;
+    unsigned int slot;
+    ParseContext context;
+} RegistryReader;
+
+// FORMULA REGISTRY FUNCTION DECLARATIONS
+// formulas read the variables named in variables, by their index there,
+// programs are optimized with the optimize_flag passes in optimize
+FormulaRegistry new_formula_registry(const NameTable *variables, unsigned int optimize);
+
+// no reader may be open
+void delete_formula_registry(FormulaRegistry *registry);
+
+// compile expression and make it the current version of name,
+// readers that already hold the previous version finish with it
+// error_index refers to characters in expression, a name not among
+// the variables of the registry fails with UNDEFINED_VARIABLE
+// a failed publish keeps the current version
+ResultInfo registry_publish(FormulaRegistry *registry, const char *name, const char *expression);
+
+// remove the current version of name, false if it had none
+bool registry_remove(FormulaRegistry *registry, const char *name);
+
+// free every replaced version no reader can still hold,
+// publish and remove do this too
+// returns the number of versions freed
+unsigned int registry_reclaim(FormulaRegistry *registry);
+
+// versions replaced but not yet freed
+unsigned int registry_retired_count(const FormulaRegistry *registry);
+
+// open a reader for the calling thread, CAPACITY_EXCEEDED
+// if REGISTRY_READERS_MAX readers are open
+ResultInfo registry_open_reader(FormulaRegistry *registry, RegistryReader *reader);
+void registry_close_reader(RegistryReader *reader);
+
+// id of name, which stays the same across versions, or REGISTRY_NONE
+unsigned int registry_lookup(RegistryReader *reader, const char *name);
+
+// evaluate the current version of the formula id,
+// UNDEFINED_VARIABLE at index 0 if it has none
+// version, if not NULL, gets the number of the version evaluated,
+// numbers grow with every publish
+ResultInfo registry_evaluate(RegistryReader *reader, unsigned int id,
+                             const double *variables, Token *result,
+                             unsigned long long *version);
+
+#endif // REGISTRY
@@ -0,0 +1,113 @@
+#ifndef ROW_POOL
+#define ROW_POOL
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "kernel.h"
+#include "sample.h"
+
+// rows are handed out in chunks of a multiple of this many rows,
+// so with 64 byte aligned output arrays no two threads
+// ever write to the same cache line
+#define ROW_CHUNK_ALIGN 64
+
+// rows reduced into one partial aggregate, partials are combined
+// in row order, so an aggregate does not depend on the thread count
+#define AGGREGATE_BLOCK 1024
+
+// number of error_type values
+#define ERROR_TYPE_COUNT (NOT_CONVERGED + 1)
+
+// worker threads and their evaluation state, owned by the pool
+typedef struct RowWorkers RowWorkers;
+
+// ROW POOL DATA STRUCTURE
+// a fixed set of threads that evaluates one program over many rows,
+// the threads are started once and wait for work between calls
+typedef struct
+{
+    // threads taking part in an evaluation, the caller included
+    unsigned int thread_count;
+    RowWorkers *workers;
+} RowPool;
+
+// AGGREGATE DATA STRUCTURE
+// summary of the values of a program over many rows
+typedef struct
+{
+    // rows that evaluated successfully and rows that failed
+    unsigned long long count;
+    unsigned long long failed;
+    unsigned long long error_counts[ERROR_TYPE_COUNT];
+
+    // compensated sum, NAN for min, max and mean of no rows
+    double sum;
+    double min;
+    double max;
+    double mean;
+
+    // sample variance, NAN below two rows
+    double variance;
+
+    // optional histogram of bin_count equal bins over [low, high)
+    double low;
+    double high;
+    unsigned int bin_count;
+    unsigned long long *bins;
+    unsigned long long below;
+    unsigned long long above;
+    unsigned long long unordered;   // NAN values
+} Aggregate;
+
+// ROW POOL FUNCTION DECLARATIONS
+// thread_count 0 uses one thread per online processor,
+// threads that fail to start leave their share to the others
+RowPool new_row_pool(unsigned int thread_count);
+void delete_row_pool(RowPool *pool);
+
+// evaluate program once per row, row r reads its variables
+// from variables[r * stride] onwards
+// results[r] gets the value of row r and errors[r] its status,
+// a failed row leaves NAN in results
+// calls on one pool must not overlap
+// returns the number of failed rows
+unsigned long long evaluate_rows(RowPool *pool, const TokenList program,
+                                 const double *variables, unsigned int stride,
+                                 unsigned long long row_count,
+                                 double *results, error_type *errors);
+
+// evaluate every expression of a compiled kernel over the rows,
+// output k of row r goes to columns[k][r] and its status to errors[k][r]
+// returns the number of failed outputs
+unsigned long long evaluate_kernel_rows(RowPool *pool, const Kernel *kernel,
+                                        const double *variables, unsigned int stride,
+                                        unsigned long long row_count,
+                                        double *const *columns, error_type *const *errors);
+
+// AGGREGATE FUNCTION DECLARATIONS
+Aggregate new_aggregate(void);
+Aggregate new_histogram_aggregate(double low, double high, unsigned int bin_count);
+void delete_aggregate(Aggregate *aggregate);
+
+// evaluate program over the rows and reduce the values into aggregate
+// without storing them, the result is the same for any thread count
+void aggregate_rows(RowPool *pool, const TokenList program,
+                    const double *variables, unsigned int stride,
+                    unsigned long long row_count, Aggregate *aggregate);
+
+// evaluate program over samples 0 to sample_count - 1 of sampler
+// and reduce the values into aggregate, every variable of program
+// must have a distribution in sampler
+// samples are drawn and evaluated in blocks by each thread,
+// the result is the same for any thread count
+void sample_rows(RowPool *pool, const TokenList program, const Sampler *sampler,
+                 unsigned long long sample_count, Aggregate *aggregate);
+
+// interval around the mean of aggregate that holds the mean
+// of the distribution of its values with probability confidence,
+// by the normal approximation of the mean of many values
+void aggregate_confidence(const Aggregate *aggregate, double confidence,
+                          double *low, double *high);
+
+#endif // ROW_POOL
@@ -0,0 +1,59 @@
+#ifndef SAMPLE
+#define SAMPLE
+
+// standard library includes
+#include <stdint.h>
+
+// Monte Carlo sampling
+//
+// every variable of a program is drawn from a distribution of its own,
+// draw k of sample i comes from a counter based generator at counter (i, k)
+// under the seed, so a sample is the same whichever thread draws it
+// and in whatever blocks, see sample_rows in rows.h
+
+// rounds of the Philox 4x32 generator
+#define PHILOX_ROUNDS 10
+
+typedef enum
+{
+    DISTRIBUTION_UNIFORM,   // a = low, b = high
+    DISTRIBUTION_NORMAL     // a = mean, b = standard deviation
+} distribution_type;
+
+typedef struct
+{
+    distribution_type type;
+    double a;
+    double b;
+} Distribution;
+
+// SAMPLER DATA STRUCTURE
+// distributions indexed by the variable index in a NameTable
+typedef struct
+{
+    uint64_t seed;
+    unsigned int variable_count;
+    Distribution *distributions;
+} Sampler;
+
+// SAMPLER FUNCTION DECLARATIONS
+Sampler new_sampler(uint64_t seed);
+void delete_sampler(Sampler *sampler);
+
+// give variable a distribution, replacing the one it had,
+// variables below it without one are always 0
+void sampler_uniform(Sampler *sampler, unsigned int variable, double low, double high);
+void sampler_normal(Sampler *sampler, unsigned int variable, double mean, double deviation);
+
+// draws of samples first to first + count - 1,
+// sample r of them at draws[r * variable_count] onwards
+void sampler_draw(const Sampler *sampler, uint64_t first, unsigned int count, double *draws);
+
+// the Philox 4x32 bijection of counter under key
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4]);
+
+// x with a standard normal distribution below it with probability p,
+// NAN outside of (0, 1)
+double normal_quantile(double p);
+
+#endif // SAMPLE
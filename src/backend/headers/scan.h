@@ -0,0 +1,26 @@
+#ifndef SCAN
+#define SCAN
+
+// standard library includes
+#include <stdbool.h>
+
+// byte classes the lexer skips or collects in runs
+typedef enum
+{
+    SCAN_SPACE = 0,  // ' ', '\t', '\n', '\v', '\f', '\r'
+    SCAN_DIGIT,      // '0' - '9'
+    SCAN_LOWER       // 'a' - 'z'
+} scan_class;
+
+// index of the first byte at or after index that is not of the class,
+// or end if all of them are
+// bytes up to end must be readable, vectors are used where they fit
+unsigned int scan_run(const char *input, unsigned int index,
+                      unsigned int end, scan_class class);
+
+// vectors are on by default where the machine supports them,
+// turning them off makes every scan byte by byte
+// (a process wide switch for tests and benchmarks)
+void scan_use_vectors(bool enabled);
+
+#endif // SCAN
@@ -0,0 +1,74 @@
+#ifndef SHAPE
+#define SHAPE
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+
+// Shape batches
+//
+// many different programs, each evaluated once, grouped by their shape,
+// the sequence of their operations with every number left out
+// programs of one shape differ only in their numbers, which are kept
+// in one array per number position with an entry per program,
+// so a group runs each operation once for all of its programs,
+// several programs per vector instruction
+
+// programs of a group evaluated together, the width of the columns
+#define SHAPE_BLOCK 64
+
+// one shape and the numbers of every program that has it
+typedef struct ShapeGroup ShapeGroup;
+
+// SHAPE BATCH DATA STRUCTURE
+// programs are numbered in the order they are added
+typedef struct
+{
+    unsigned int program_count;
+
+    unsigned int group_count;
+    unsigned int group_max;
+    ShapeGroup **groups;
+
+    // open addressing hash of indices into groups
+    // a slot holds index + 1, 0 marks an empty slot
+    unsigned int slot_count;
+    unsigned int *slots;
+
+    // programs that are not plain postfix programs as built by convert,
+    // or call a native function that is not pure, each evaluated on its own
+    unsigned int single_count;
+    unsigned int single_max;
+    TokenList *singles;
+    unsigned int *single_programs;
+
+    // columns and nested conditionals the deepest group needs
+    unsigned int depth_max;
+    unsigned int level_max;
+} ShapeBatch;
+
+// SHAPE BATCH FUNCTION DECLARATIONS
+ShapeBatch new_shape_batch(void);
+void delete_shape_batch(ShapeBatch *batch);
+
+// convert expression and add it as the next program
+// error_index refers to characters in expression,
+// an expression that fails to convert is not added
+ResultInfo shape_batch_add(ShapeBatch *batch, const char *expression, NameTable *names);
+
+// add a copy of program as the next program, returns its number
+unsigned int shape_batch_add_program(ShapeBatch *batch, const TokenList program);
+
+// evaluate every program once, program p reads its variables
+// from variables[p * stride] onwards, stride 0 shares one row
+// results[p] gets the value of program p and errors[p] its status,
+// the status evaluate would give, a failed program leaves NAN in results
+// the vector form of a native function is called for every program of
+// a block, also those that already failed or took the other branch
+// returns the number of failed programs
+unsigned long long shape_batch_evaluate(const ShapeBatch *batch,
+                                        const double *variables, unsigned int stride,
+                                        double *results, error_type *errors);
+
+#endif // SHAPE
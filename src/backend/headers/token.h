@@ -10,7 +10,15 @@ typedef enum
     EMPTY = 0,
     NUMBER,
     OPERATOR,
-    PARENTHESIS
+    PARENTHESIS,
+    VARIABLE,
+    INTEGER,    // exact 64 bit integer, only produced by the optimizer
+    FUNCTION,   // call of a user function, index into a FunctionTable,
+                // only found in lexed input
+    NATIVE,     // call of a registered C function, takes its arity
+                // from the stack like an operator
+    BOUND       // variable of an integrate, sum or root call, identified by
+                // the column it first appears at, only found in lexed input
 } token_type;
 
 // definitions for type implementations
@@ -20,22 +28,69 @@ typedef enum
     ADD = 1, SUB, MULT, DIV, MOD, POW, NEG,
     SIN, COS, TAN, ASIN, ACOS, ATAN,
     SIND, COSD, TAND, ASIND, ACOSD, ATAND,
-    LN, LOG, ABS, FAC
+    LN, LOG, ABS, FAC,
+
+    // superinstructions, only produced by the optimizer on postfix programs
+    MULT_ADD, MULT_SUB,         // x * y + z, x * y - z
+    ADD_MULT, SUB_MULT,         // x + y * z, x - y * z
+    ADD_IMM, SUB_IMM, MULT_IMM, // x op k, with the constant k
+    DIV_IMM, MOD_IMM, POW_IMM,  // stored in the following token
+    NEG_CALL, CALL_NEG,         // f(-x), -f(x), with f in the following token
+    POW_INT, SQRT,              // x ^ n for a small integer n, x ^ 0.5
+    RESERVE, STORE, LOAD,       // temporaries at the bottom of the stack,
+                                // count or index in the following token
+
+    // 64 bit integer forms of ADD to FAC, they continue in double
+    // when an operand is not an INTEGER or the result would not be exact
+    IADD, ISUB, IMULT, IDIV, IMOD, IPOW, INEG, IABS, IFAC,
+    PROMOTE,                    // INTEGER to NUMBER
+
+    // comparisons give 1 or 0
+    LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, EQUAL, NOT_EQUAL,
+
+    // c ? a : b, only found in lexed input
+    QUESTION, COLON,
+
+    // jumps of a postfix program to the index in the following token,
+    // JUMP_FALSE takes a condition off the stack and jumps if it is 0
+    JUMP_FALSE, JUMP,
+
+    // separates the arguments of a function call, only found in lexed input
+    COMMA,
+
+    // separates the arguments of a native call once user functions are inlined
+    ARGUMENT,
+
+    // integrate(f, x, a, b), sum(i, a, b, f), root(f, x, a, b),
+    // only found in lexed input, each call is replaced by its value
+    INTEGRATE, SUM, ROOT
 } operator_type;
 
+// number of operator_type values
+#define OPERATOR_TYPE_COUNT (ROOT + 1)
+
 // operator properties
 bool isunary(operator_type type);
 unsigned int precedence(operator_type t);
+bool hasimmediate(operator_type t);
+unsigned int operator_arity(operator_type t);
+bool iscomparison(operator_type t);
 
 // PARENTHESIS
 typedef enum { LEFT = 1, RIGHT } parenthesis_type;
 
+// NATIVE
+struct NativeFunction;
+
 // Collect possible types in a union for storage in a Token
 typedef union
 {
     double number;
     operator_type operator;
     parenthesis_type parenthesis;
+    unsigned int variable; // index into a NameTable, or a FunctionTable
+    long long integer;
+    const struct NativeFunction *native;
 } TokenValue;
 
 // token container
@@ -52,6 +107,10 @@ Token create_empty_token(void);
 Token create_number_token(double value, unsigned int column);
 Token create_operator_token(operator_type type, int column);
 Token create_parenthesis_token(parenthesis_type type, int column);
+Token create_variable_token(unsigned int index, unsigned int column);
+Token create_integer_token(long long value, unsigned int column);
+Token create_function_token(unsigned int index, unsigned int column);
+Token create_native_token(const struct NativeFunction *native, unsigned int column);
 
 // TOKEN LIST DATA STRUCTURE
 typedef struct
@@ -59,10 +118,16 @@ typedef struct
     unsigned int count;
     unsigned int max;
     Token *list;
+
+    // a fixed list uses caller storage and never allocates,
+    // adding to a full fixed list drops the token and sets overflow
+    bool fixed;
+    bool overflow;
 } TokenList;
 
 // TOKEN LIST FUNCTION DECLARATIONS;
 TokenList new_tokenlist();
+TokenList tokenlist_from_buffer(Token *buffer, unsigned int capacity);
 void delete_tokenlist(TokenList tokenlist);
 void clear_tokenlist(TokenList *self);
 void tokenlist_add(TokenList *self, Token value);
@@ -0,0 +1,1142 @@
+// standard library includes
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "functions.h"
+#include "interval.h"
+
+#define PI 3.14159265358979323846264338327950288
+
+static const double deg_to_rad = PI / 180;
+static const double rad_to_deg = 180 / PI;
+
+// error of the strength reduced power by squaring,
+// up to 32 it takes at most a dozen rounded products
+#define INTERVAL_SQUARING_ULPS 16
+
+// periods a boundary may lie outside an interval and still count as inside,
+// covers the error of dividing by a rounded period
+#define PERIOD_SLACK 1e-9
+
+// largest double below which every whole number is exact
+#define EXACT_INTEGER_MAX 9007199254740992.0
+
+// state of the operation being evaluated
+typedef struct
+{
+    error_type status;
+    unsigned int column;
+} IntervalData;
+
+typedef struct
+{
+    unsigned int count;
+    unsigned int max;
+    Interval *list;
+} IntervalStack;
+
+Interval new_interval(double low, double high)
+{
+    Interval obj;
+    obj.low = low;
+    obj.high = high;
+    obj.possible = SUCCESS;
+    obj.possible_index = 0;
+    obj.maybe_nan = false;
+    return obj;
+}
+
+static void stack_push(IntervalStack *stack, Interval value)
+{
+    if (stack->count == stack->max)
+    {
+        unsigned int max = stack->max == 0 ? 16 : stack->max * 2;
+        Interval *list = (Interval *)realloc(stack->list, max * sizeof(Interval));
+        if (list == NULL) exit(1);
+
+        stack->list = list;
+        stack->max = max;
+    }
+
+    // a bound lost to inf - inf or inf / inf leaves the side open,
+    // the value at that bound is NAN
+    if (isnan(value.low) || isnan(value.high))
+        value.maybe_nan = true;
+    if (isnan(value.low))
+        value.low = -INFINITY;
+    if (isnan(value.high))
+        value.high = INFINITY;
+
+    stack->list[stack->count++] = value;
+}
+
+static Interval stack_pop(IntervalStack *stack)
+{
+    return stack->list[--stack->count];
+}
+
+// record that the operation fails at some points of its operands
+static void possible(Interval *value, error_type status, const IntervalData *data)
+{
+    if (value->possible == SUCCESS)
+    {
+        value->possible = status;
+        value->possible_index = data->column;
+    }
+}
+
+// a failure possible in an operand comes first, it happens before the operation,
+// a NAN operand gives NAN
+static Interval inherit(Interval value, const Interval *operand)
+{
+    if (operand->possible != SUCCESS)
+    {
+        value.possible = operand->possible;
+        value.possible_index = operand->possible_index;
+    }
+
+    value.maybe_nan = value.maybe_nan || operand->maybe_nan;
+    return value;
+}
+
+// an infinite bound may be a value, one that overflowed
+static bool unbounded(Interval x)
+{
+    return isinf(x.low) || isinf(x.high);
+}
+
+static bool contains_zero(Interval x)
+{
+    return x.low <= 0 && x.high >= 0;
+}
+
+// DIRECTED ROUNDING
+// the exact error of a rounded operation tells on which side
+// of the exact result it lies, only then is a bound moved by one step
+
+static double down(double x)
+{
+    return nextafter(x, -INFINITY);
+}
+
+static double up(double x)
+{
+    return nextafter(x, INFINITY);
+}
+
+// results of the math library are off by a few steps either way
+static double library_down(double x, unsigned int ulps)
+{
+    for (unsigned int i = 0; i < ulps; i++)
+        x = down(x);
+    return x;
+}
+
+static double library_up(double x, unsigned int ulps)
+{
+    for (unsigned int i = 0; i < ulps; i++)
+        x = up(x);
+    return x;
+}
+
+// an overflow of finite operands rounds to inf, past any bound
+static double overflow_down(double s, bool operands_infinite)
+{
+    return operands_infinite || s < 0 ? s : DBL_MAX;
+}
+
+static double overflow_up(double s, bool operands_infinite)
+{
+    return operands_infinite || s > 0 ? s : -DBL_MAX;
+}
+
+// Knuth's two sum gives the exact error of a + b
+static double sum_error(double a, double b, double s)
+{
+    double v = s - a;
+    return (a - (s - v)) + (b - v);
+}
+
+static double add_down(double a, double b)
+{
+    double s = a + b;
+    if (isinf(s))
+        return overflow_down(s, isinf(a) || isinf(b));
+    return sum_error(a, b, s) < 0 ? down(s) : s;
+}
+
+static double add_up(double a, double b)
+{
+    double s = a + b;
+    if (isinf(s))
+        return overflow_up(s, isinf(a) || isinf(b));
+    return sum_error(a, b, s) > 0 ? up(s) : s;
+}
+
+// 0 times an infinite bound is 0, the bound only stands for large values
+static double mult_down(double a, double b)
+{
+    if (a == 0 || b == 0)
+        return 0;
+
+    double p = a * b;
+    if (isinf(p))
+        return overflow_down(p, isinf(a) || isinf(b));
+
+    // below DBL_MIN the error of fma is rounded too
+    if (fabs(p) < DBL_MIN)
+        return down(p);
+    return fma(a, b, -p) < 0 ? down(p) : p;
+}
+
+static double mult_up(double a, double b)
+{
+    if (a == 0 || b == 0)
+        return 0;
+
+    double p = a * b;
+    if (isinf(p))
+        return overflow_up(p, isinf(a) || isinf(b));
+    if (fabs(p) < DBL_MIN)
+        return up(p);
+    return fma(a, b, -p) > 0 ? up(p) : p;
+}
+
+// b is not 0, a / b - q has the sign of the remainder a - q * b over b
+static double div_down(double a, double b)
+{
+    if (a == 0 || isinf(b))
+        return isinf(a) ? a / b : 0;
+
+    double q = a / b;
+    if (isinf(q))
+        return overflow_down(q, isinf(a));
+    if (fabs(q) < DBL_MIN)
+        return down(q);
+
+    double r = fma(-q, b, a);
+    return (r < 0 && b > 0) || (r > 0 && b < 0) ? down(q) : q;
+}
+
+static double div_up(double a, double b)
+{
+    if (a == 0 || isinf(b))
+        return isinf(a) ? a / b : 0;
+
+    double q = a / b;
+    if (isinf(q))
+        return overflow_up(q, isinf(a));
+    if (fabs(q) < DBL_MIN)
+        return up(q);
+
+    double r = fma(-q, b, a);
+    return (r > 0 && b > 0) || (r < 0 && b < 0) ? up(q) : q;
+}
+
+static double sqrt_down(double x)
+{
+    double s = sqrt(x);
+    if (s == 0 || isinf(s))
+        return s;
+    return fma(-s, s, x) < 0 ? down(s) : s;
+}
+
+static double sqrt_up(double x)
+{
+    double s = sqrt(x);
+    if (s == 0 || isinf(s))
+        return s;
+    return fma(-s, s, x) > 0 ? up(s) : s;
+}
+
+static double min4(double a, double b, double c, double d)
+{
+    return fmin(fmin(a, b), fmin(c, d));
+}
+
+static double max4(double a, double b, double c, double d)
+{
+    return fmax(fmax(a, b), fmax(c, d));
+}
+
+// ARITHMETIC
+
+static Interval negation(Interval x)
+{
+    return new_interval(-x.high, -x.low);
+}
+
+// inf - inf is NAN
+static Interval addition(Interval x, Interval y)
+{
+    Interval res = new_interval(add_down(x.low, y.low), add_up(x.high, y.high));
+    res.maybe_nan = (x.high == INFINITY && y.low == -INFINITY) ||
+                    (x.low == -INFINITY && y.high == INFINITY);
+    return res;
+}
+
+static Interval subtraction(Interval x, Interval y)
+{
+    return addition(x, negation(y));
+}
+
+// 0 * inf is NAN
+static Interval multiplication(Interval x, Interval y)
+{
+    Interval res = new_interval(min4(mult_down(x.low, y.low), mult_down(x.low, y.high),
+                                     mult_down(x.high, y.low), mult_down(x.high, y.high)),
+                                max4(mult_up(x.low, y.low), mult_up(x.low, y.high),
+                                     mult_up(x.high, y.low), mult_up(x.high, y.high)));
+    res.maybe_nan = (contains_zero(x) && unbounded(y)) || (contains_zero(y) && unbounded(x));
+    return res;
+}
+
+// x * y + z with a single rounding in evaluate, bounded by the exact value
+static Interval multiply_add(Interval x, Interval y, Interval z, bool subtract)
+{
+    Interval product = multiplication(x, y);
+    return subtract ? subtraction(product, z) : addition(product, z);
+}
+
+static Interval division(Interval x, Interval y, IntervalData *data)
+{
+    if (y.low == 0 && y.high == 0)
+    {
+        data->status = ZERO_DIVISON;
+        return x;
+    }
+
+    // inf / inf is NAN
+    bool maybe_nan = unbounded(x) && unbounded(y);
+
+    if (y.low > 0 || y.high < 0)
+    {
+        Interval res = new_interval(min4(div_down(x.low, y.low), div_down(x.low, y.high),
+                                         div_down(x.high, y.low), div_down(x.high, y.high)),
+                                    max4(div_up(x.low, y.low), div_up(x.low, y.high),
+                                         div_up(x.high, y.low), div_up(x.high, y.high)));
+        res.maybe_nan = maybe_nan;
+        return res;
+    }
+
+    // the divisor reaches 0, the quotients near it grow without bound
+    Interval res = new_interval(-INFINITY, INFINITY);
+    if (x.low == 0 && x.high == 0)
+        res = new_interval(0, 0);
+
+    // divisors in (0, high]
+    else if (y.low == 0 && x.low >= 0)
+        res = new_interval(div_down(x.low, y.high), INFINITY);
+    else if (y.low == 0 && x.high <= 0)
+        res = new_interval(-INFINITY, div_up(x.high, y.high));
+
+    // divisors in [low, 0)
+    else if (y.high == 0 && x.low >= 0)
+        res = new_interval(-INFINITY, div_up(x.low, y.low));
+    else if (y.high == 0 && x.high <= 0)
+        res = new_interval(div_down(x.high, y.low), INFINITY);
+
+    res.maybe_nan = maybe_nan;
+    possible(&res, ZERO_DIVISON, data);
+    return res;
+}
+
+// fmod is exact, its value has the sign of x and is smaller than y in size,
+// x % 0 and inf % y are NAN
+static Interval modulo(Interval x, Interval y)
+{
+    double m = fmax(fabs(y.low), fabs(y.high));
+    bool maybe_nan = contains_zero(y) || unbounded(x);
+
+    // within one period of a single divisor the remainder grows with x
+    if (y.low == y.high && y.low != 0 && (x.low >= 0 || x.high <= 0))
+    {
+        double low = fmod(x.low, y.low);
+        double high = fmod(x.high, y.low);
+
+        // a period boundary in between would take the difference down by m
+        if (low <= high && fabs((high - low) - (x.high - x.low)) < m / 2)
+            return new_interval(low, high);
+    }
+
+    Interval res = new_interval(x.low >= 0 ? 0 : fmax(x.low, -m), x.high <= 0 ? 0 : fmin(x.high, m));
+    res.maybe_nan = maybe_nan;
+    return res;
+}
+
+static Interval absolute_value(Interval x)
+{
+    if (x.low >= 0)
+        return x;
+    if (x.high <= 0)
+        return negation(x);
+    return new_interval(0, fmax(-x.low, x.high));
+}
+
+// the span of two values of a monotone library function
+static Interval library_span(double a, double b, unsigned int ulps)
+{
+    return new_interval(library_down(fmin(a, b), ulps), library_up(fmax(a, b), ulps));
+}
+
+// grow hull by the values of part
+static void hull_add(Interval *hull, Interval part)
+{
+    hull->low = fmin(hull->low, part.low);
+    hull->high = fmax(hull->high, part.high);
+}
+
+// x ^ n for a whole number n
+static Interval integer_power(Interval x, double n, IntervalData *data, unsigned int ulps)
+{
+    if (n == 0)
+        return new_interval(1, 1);
+
+    bool even = fmod(n, 2) == 0;
+    double low = pow(x.low, n);
+    double high = pow(x.high, n);
+
+    if (n > 0)
+    {
+        if (even && x.low < 0 && x.high > 0)
+            return new_interval(0, library_up(fmax(low, high), ulps));
+        return library_span(low, high, ulps);
+    }
+
+    if (x.low > 0 || x.high < 0)
+        return library_span(low, high, ulps);
+
+    // a negative power of an interval reaching 0
+    if (x.low == 0 && x.high == 0)
+    {
+        data->status = ZERO_NEGATIVE_EXPONENT;
+        return x;
+    }
+
+    Interval res = new_interval(-INFINITY, INFINITY);
+    if (x.low == 0)
+        res = new_interval(library_down(high, ulps), INFINITY);
+    else if (x.high == 0)
+        res = even ? new_interval(library_down(low, ulps), INFINITY)
+                   : new_interval(-INFINITY, library_up(low, ulps));
+    else if (even)
+        res = new_interval(library_down(fmin(low, high), ulps), INFINITY);
+
+    possible(&res, ZERO_NEGATIVE_EXPONENT, data);
+    return res;
+}
+
+// x ^ y for non-negative x, ln(x) * y is bilinear on the box,
+// so the extremes are at its corners
+static Interval positive_power(Interval x, Interval y, unsigned int ulps)
+{
+    double a = pow(x.low, y.low);
+    double b = pow(x.low, y.high);
+    double c = pow(x.high, y.low);
+    double d = pow(x.high, y.high);
+
+    return new_interval(fmax(library_down(min4(a, b, c, d), ulps), 0), library_up(max4(a, b, c, d), ulps));
+}
+
+static Interval power(Interval x, Interval y, IntervalData *data, unsigned int ulps)
+{
+    if (y.low == y.high && trunc(y.low) == y.low)
+        return integer_power(x, y.low, data, ulps);
+
+    Interval res = new_interval(INFINITY, -INFINITY);
+    error_type failure = SUCCESS;
+
+    // negative bases only have values at whole exponents
+    if (x.low < 0)
+    {
+        double first = ceil(y.low);
+        double last = floor(y.high);
+
+        if (first > last)
+        {
+            failure = NEGATIVE_FRACTIONAL_EXPONENT;
+        }
+        else
+        {
+            // |x| ^ n of either sign, n from first to last
+            Interval size = absolute_value(new_interval(x.low, fmin(x.high, 0)));
+            Interval powers = positive_power(size, new_interval(first, last), ulps);
+            hull_add(&res, new_interval(-powers.high, powers.high));
+            possible(&res, NEGATIVE_FRACTIONAL_EXPONENT, data);
+            if (size.low == 0 && first < 0)
+                possible(&res, ZERO_NEGATIVE_EXPONENT, data);
+        }
+    }
+
+    if (x.high >= 0)
+    {
+        Interval base = new_interval(fmax(x.low, 0), x.high);
+        if (base.high == 0 && y.high < 0)
+        {
+            if (failure == SUCCESS)
+                failure = ZERO_NEGATIVE_EXPONENT;
+        }
+        else
+        {
+            hull_add(&res, positive_power(base, y, ulps));
+            if (base.low == 0 && y.low < 0)
+                possible(&res, ZERO_NEGATIVE_EXPONENT, data);
+        }
+    }
+
+    if (res.low > res.high)
+    {
+        data->status = failure;
+        return x;
+    }
+
+    if (failure != SUCCESS)
+        possible(&res, failure, data);
+    return res;
+}
+
+// FUNCTIONS
+
+// whether offset + k * period lies in [low, high] for a whole number k,
+// a near miss counts as a hit
+static bool hits_period(double low, double high, double offset, double period)
+{
+    double first = ceil((low - offset) / period - PERIOD_SLACK);
+    return first <= (high - offset) / period + PERIOD_SLACK;
+}
+
+static bool resolves_period(Interval x, double period)
+{
+    return x.high - x.low < period && fabs(x.low) <= INTERVAL_TRIGONOMETRY_MAX &&
+           fabs(x.high) <= INTERVAL_TRIGONOMETRY_MAX;
+}
+
+// a function of period 2 pi with its maximum at top and minimum at top + pi
+static Interval wave(Interval x, double (*function)(double), double top)
+{
+    if (!resolves_period(x, 2 * PI))
+    {
+        // sin and cos of inf are NAN
+        Interval res = new_interval(-1, 1);
+        res.maybe_nan = unbounded(x);
+        return res;
+    }
+
+    double a = function(x.low);
+    double b = function(x.high);
+    double low = hits_period(x.low, x.high, top + PI, 2 * PI) ? -1 :
+                 library_down(fmin(a, b), INTERVAL_LIBRARY_ULPS);
+    double high = hits_period(x.low, x.high, top, 2 * PI) ? 1 :
+                  library_up(fmax(a, b), INTERVAL_LIBRARY_ULPS);
+
+    return new_interval(fmax(low, -1), fmin(high, 1));
+}
+
+// tan of radians that are not a single point, increasing between its poles
+static Interval tangent_span(Interval x, IntervalData *data)
+{
+    if (!resolves_period(x, PI) || hits_period(x.low, x.high, PI / 2, PI))
+    {
+        Interval res = new_interval(-INFINITY, INFINITY);
+        res.maybe_nan = unbounded(x);
+        possible(&res, TANGENT_UNDEFINED, data);
+        return res;
+    }
+
+    return new_interval(library_down(tan(x.low), INTERVAL_LIBRARY_ULPS),
+                        library_up(tan(x.high), INTERVAL_LIBRARY_ULPS));
+}
+
+static Interval tangent(Interval x, IntervalData *data)
+{
+    if (x.low != x.high)
+        return tangent_span(x, data);
+
+    if (fabs(fmod(x.low, PI)) == PI / 2)
+    {
+        data->status = TANGENT_UNDEFINED;
+        return x;
+    }
+
+    return library_span(tan(x.low), tan(x.low), INTERVAL_LIBRARY_ULPS);
+}
+
+static Interval to_radians(Interval x)
+{
+    return new_interval(mult_down(x.low, deg_to_rad), mult_up(x.high, deg_to_rad));
+}
+
+static Interval to_degrees(Interval x)
+{
+    return new_interval(mult_down(x.low, rad_to_deg), mult_up(x.high, rad_to_deg));
+}
+
+static Interval tangent_deg(Interval x, IntervalData *data)
+{
+    // only whole odd multiples of 90 fail
+    if (x.low == x.high && trunc(x.low) == x.low && fabs(fmod(x.low, 180)) == 90)
+    {
+        data->status = TANGENT_UNDEFINED;
+        return x;
+    }
+
+    if (x.low != x.high && hits_period(x.low, x.high, 90, 180))
+    {
+        Interval res = new_interval(-INFINITY, INFINITY);
+        res.maybe_nan = unbounded(x);
+        possible(&res, TANGENT_UNDEFINED, data);
+        return res;
+    }
+
+    Interval radians = to_radians(x);
+    if (x.low == x.high)
+    {
+        double value = tan(x.low * deg_to_rad);
+        return library_span(value, value, INTERVAL_LIBRARY_ULPS);
+    }
+
+    return tangent_span(radians, data);
+}
+
+// the part of x in [low, high], failing with status if there is none
+static Interval domain_part(Interval x, double low, double high, error_type status, IntervalData *data)
+{
+    if (x.high < low || x.low > high)
+    {
+        data->status = status;
+        return x;
+    }
+
+    Interval res = new_interval(fmax(x.low, low), fmin(x.high, high));
+    if (x.low < low || x.high > high)
+        possible(&res, status, data);
+    return res;
+}
+
+static Interval arcus(Interval x, operator_type type, IntervalData *data)
+{
+    Interval domain = domain_part(x, -1, 1, ARCUS_OUT_OF_RANGE, data);
+    if (data->status != SUCCESS)
+        return x;
+
+    Interval res;
+    if (type == ASIN || type == ASIND)
+        res = library_span(asin(domain.low), asin(domain.high), INTERVAL_LIBRARY_ULPS);
+    else
+        res = library_span(acos(domain.low), acos(domain.high), INTERVAL_LIBRARY_ULPS);
+
+    if (type == ASIND || type == ACOSD)
+        res = to_degrees(res);
+
+    res.possible = domain.possible;
+    res.possible_index = domain.possible_index;
+    return res;
+}
+
+static Interval logarithm(Interval x, double (*function)(double), IntervalData *data)
+{
+    if (x.high <= 0)
+    {
+        data->status = LOG_OUT_OF_RANGE;
+        return x;
+    }
+
+    if (x.low > 0)
+        return library_span(function(x.low), function(x.high), INTERVAL_LIBRARY_ULPS);
+
+    Interval res = new_interval(-INFINITY, library_up(function(x.high), INTERVAL_LIBRARY_ULPS));
+    possible(&res, LOG_OUT_OF_RANGE, data);
+    return res;
+}
+
+static Interval square_root(Interval x, IntervalData *data)
+{
+    Interval domain = domain_part(x, 0, INFINITY, NEGATIVE_FRACTIONAL_EXPONENT, data);
+    if (data->status != SUCCESS)
+        return x;
+
+    Interval res = new_interval(sqrt_down(domain.low), sqrt_up(domain.high));
+    res.possible = domain.possible;
+    res.possible_index = domain.possible_index;
+    return res;
+}
+
+// the factorial as evaluate computes it, -n! is -(n!),
+// it grows with n over the whole numbers
+static double factorial_value(double n)
+{
+    if (n == 0)
+        return 1;
+
+    // 171! and above are inf
+    if (fabs(n) > 171)
+        return n > 0 ? INFINITY : -INFINITY;
+
+    double res = n > 0 ? 1 : -1;
+    for (int i = 1; i <= fabs(n); i++)
+        res *= i;
+    return res;
+}
+
+static Interval factorial(Interval x, IntervalData *data)
+{
+    double first = ceil(x.low);
+    double last = floor(x.high);
+
+    if (first > last)
+    {
+        data->status = FAC_INPUT_NOT_INT;
+        return x;
+    }
+
+    Interval res = new_interval(factorial_value(first), factorial_value(last));
+    if (x.low != x.high)
+        possible(&res, FAC_INPUT_NOT_INT, data);
+    return res;
+}
+
+// a comparison with NAN is false, != is true, either may hold
+static Interval comparison(operator_type type, Interval x, Interval y)
+{
+    if (x.maybe_nan || y.maybe_nan)
+        return new_interval(0, 1);
+
+    bool point = x.low == x.high && y.low == y.high;
+    bool always = false;
+    bool never = false;
+
+    switch (type)
+    {
+        case LESS: always = x.high < y.low; never = x.low >= y.high; break;
+        case LESS_EQUAL: always = x.high <= y.low; never = x.low > y.high; break;
+        case GREATER: always = x.low > y.high; never = x.high <= y.low; break;
+        case GREATER_EQUAL: always = x.low >= y.high; never = x.high < y.low; break;
+        case EQUAL:
+            always = point && x.low == y.low;
+            never = x.high < y.low || y.high < x.low;
+            break;
+        case NOT_EQUAL:
+            always = x.high < y.low || y.high < x.low;
+            never = point && x.low == y.low;
+            break;
+        default: break;
+    }
+
+    return new_interval(always ? 1 : 0, never ? 0 : 1);
+}
+
+// the double operator an integer form falls back to,
+// the exact integer result is the same value
+static operator_type plain_form(operator_type type)
+{
+    switch (type)
+    {
+        case IADD: return ADD;
+        case ISUB: return SUB;
+        case IMULT: return MULT;
+        case IDIV: return DIV;
+        case IMOD: return MOD;
+        case IPOW: return POW;
+        case INEG: return NEG;
+        case IABS: return ABS;
+        case IFAC: return FAC;
+        default: return type;
+    }
+}
+
+static bool isbinary(operator_type type)
+{
+    return type == ADD || type == SUB || type == MULT || type == DIV ||
+           type == MOD || type == POW || iscomparison(type);
+}
+
+// the error an operator checks its operands for, SUCCESS if it checks none
+static error_type domain_error(operator_type type)
+{
+    switch (type)
+    {
+        case DIV: case DIV_IMM: return ZERO_DIVISON;
+        case POW: case POW_IMM: case POW_INT: case SQRT: return NEGATIVE_FRACTIONAL_EXPONENT;
+        case TAN: case TAND: return TANGENT_UNDEFINED;
+        case ASIN: case ACOS: case ASIND: case ACOSD: return ARCUS_OUT_OF_RANGE;
+        case LN: case LOG: return LOG_OUT_OF_RANGE;
+        case FAC: return FAC_INPUT_NOT_INT;
+        default: return SUCCESS;
+    }
+}
+
+// the bounds do not tell how a NAN operand fares in a domain check,
+// it may fail there or not, the values of a check that failed
+// every other value are only NAN
+static Interval nan_checked(Interval res, operator_type type, bool maybe_nan, IntervalData *data)
+{
+    error_type status = domain_error(type);
+    if (!maybe_nan || status == SUCCESS)
+        return res;
+
+    if (data->status != SUCCESS)
+    {
+        status = data->status;
+        data->status = SUCCESS;
+        res = new_interval(-INFINITY, INFINITY);
+    }
+
+    res.maybe_nan = true;
+    possible(&res, status, data);
+    return res;
+}
+
+static Interval binary(operator_type type, Interval x, Interval y, IntervalData *data)
+{
+    switch (type)
+    {
+        case ADD: return addition(x, y);
+        case SUB: return subtraction(x, y);
+        case MULT: return multiplication(x, y);
+        case DIV: return division(x, y, data);
+        case MOD: return modulo(x, y);
+        case POW: return power(x, y, data, INTERVAL_LIBRARY_ULPS);
+        default: return comparison(type, x, y);
+    }
+}
+
+static Interval unary(operator_type type, Interval x, IntervalData *data)
+{
+    switch (type)
+    {
+        case NEG: return negation(x);
+        case SIN: return wave(x, sin, PI / 2);
+        case COS: return wave(x, cos, 0);
+        case TAN: return tangent(x, data);
+        case ASIN: case ACOS: case ASIND: case ACOSD: return arcus(x, type, data);
+        case ATAN: return library_span(atan(x.low), atan(x.high), INTERVAL_LIBRARY_ULPS);
+        case SIND: return wave(to_radians(x), sin, PI / 2);
+        case COSD: return wave(to_radians(x), cos, 0);
+        case TAND: return tangent_deg(x, data);
+        case ATAND:
+            return to_degrees(library_span(atan(x.low), atan(x.high), INTERVAL_LIBRARY_ULPS));
+        case LN: return logarithm(x, log, data);
+        case LOG: return logarithm(x, log10, data);
+        case ABS: return absolute_value(x);
+        case FAC: return factorial(x, data);
+        case SQRT: return square_root(x, data);
+        default: return x;
+    }
+}
+
+// apply a plain operator to the top of the stack
+static void operation(operator_type type, IntervalStack *stack, IntervalData *data)
+{
+    type = plain_form(type);
+    if (type == PROMOTE)
+        return;
+
+    if (isbinary(type))
+    {
+        Interval y = stack_pop(stack);
+        Interval x = stack_pop(stack);
+        Interval res = nan_checked(binary(type, x, y, data), type, x.maybe_nan || y.maybe_nan, data);
+        res = inherit(inherit(res, &y), &x);
+
+        // a comparison gives 0 or 1 even for NAN
+        if (iscomparison(type))
+            res.maybe_nan = false;
+        stack_push(stack, res);
+    }
+
+    else
+    {
+        Interval x = stack_pop(stack);
+        stack_push(stack, inherit(nan_checked(unary(type, x, data), type, x.maybe_nan, data), &x));
+    }
+}
+
+static Interval constant(const Token *token)
+{
+    if (token->type == NUMBER)
+        return new_interval(token->value.number, token->value.number);
+
+    // an INTEGER beyond 2 ^ 53 is not exact as a double
+    double value = (double)token->value.integer;
+    if (fabs(value) < EXACT_INTEGER_MAX)
+        return new_interval(value, value);
+    return new_interval(down(value), up(value));
+}
+
+// pure natives of single points are called, other calls are unbounded
+// and may give NAN
+static void native_call(const NativeFunction *native, IntervalStack *stack)
+{
+    double args[FUNCTION_PARAMETERS_MAX];
+    bool points = (native->flags & NATIVE_PURE) != 0;
+    unsigned int first = stack->count - native->arity;
+    Interval res = new_interval(-INFINITY, INFINITY);
+    res.maybe_nan = true;
+
+    for (unsigned int k = native->arity; k > 0; k--)
+        res = inherit(res, &stack->list[first + k - 1]);
+
+    for (unsigned int k = 0; k < native->arity; k++)
+    {
+        args[k] = stack->list[first + k].low;
+        points = points && stack->list[first + k].low == stack->list[first + k].high &&
+                 !stack->list[first + k].maybe_nan;
+    }
+
+    if (points)
+    {
+        double value = native->scalar(args);
+        res.low = value;
+        res.high = value;
+        res.maybe_nan = false;
+    }
+
+    stack->count = first;
+    stack_push(stack, res);
+}
+
+static void immediate(const Token *token, IntervalStack *stack, IntervalData *data)
+{
+    Interval k = constant(&token[1]);
+    Interval x = stack_pop(stack);
+    Interval res;
+
+    switch (token->value.operator)
+    {
+        case ADD_IMM: res = addition(x, k); break;
+        case SUB_IMM: res = subtraction(x, k); break;
+        case MULT_IMM: res = multiplication(x, k); break;
+        case DIV_IMM: res = division(x, k, data); break;
+        case MOD_IMM: res = modulo(x, k); break;
+        case POW_IMM: res = power(x, k, data, INTERVAL_LIBRARY_ULPS); break;
+        default: res = power(x, k, data, INTERVAL_SQUARING_ULPS); break;
+    }
+
+    stack_push(stack, inherit(nan_checked(res, token->value.operator, x.maybe_nan, data), &x));
+}
+
+static void process(const Token *token, IntervalStack *stack,
+                    const Interval *variables, IntervalData *data)
+{
+    if (token->type == NUMBER || token->type == INTEGER)
+    {
+        stack_push(stack, constant(token));
+        return;
+    }
+
+    if (token->type == VARIABLE)
+    {
+        if (variables == NULL)
+            data->status = UNDEFINED_VARIABLE;
+        else
+            stack_push(stack, new_interval(variables[token->value.variable].low,
+                                           variables[token->value.variable].high));
+        return;
+    }
+
+    if (token->type == NATIVE)
+    {
+        native_call(token->value.native, stack);
+        return;
+    }
+
+    Interval z, y, x;
+    switch (token->value.operator)
+    {
+        case MULT_ADD: case MULT_SUB:
+            z = stack_pop(stack);
+            y = stack_pop(stack);
+            x = stack_pop(stack);
+            stack_push(stack, inherit(inherit(inherit(
+                multiply_add(x, y, z, token->value.operator == MULT_SUB), &z), &y), &x));
+            break;
+
+        case ADD_MULT: case SUB_MULT:
+            z = stack_pop(stack);
+            y = stack_pop(stack);
+            x = stack_pop(stack);
+            y = token->value.operator == SUB_MULT ? inherit(negation(y), &y) : y;
+            stack_push(stack, inherit(inherit(inherit(
+                multiply_add(y, z, x, false), &z), &y), &x));
+            break;
+
+        case ADD_IMM: case SUB_IMM: case MULT_IMM:
+        case DIV_IMM: case MOD_IMM: case POW_IMM: case POW_INT:
+            immediate(token, stack, data);
+            break;
+
+        case RESERVE:
+            for (unsigned int i = 0; i < (unsigned int)token[1].value.number; i++)
+                stack_push(stack, new_interval(0, 0));
+            break;
+
+        case STORE:
+            stack->list[(unsigned int)token[1].value.number] = stack->list[stack->count - 1];
+            break;
+
+        case LOAD:
+            stack_push(stack, stack->list[(unsigned int)token[1].value.number]);
+            break;
+
+        case NEG_CALL:
+            x = stack_pop(stack);
+            stack_push(stack, inherit(negation(x), &x));
+            operation(token[1].value.operator, stack, data);
+            break;
+
+        case CALL_NEG:
+            operation(token[1].value.operator, stack, data);
+            if (data->status == SUCCESS)
+                stack->list[stack->count - 1] = inherit(negation(stack->list[stack->count - 1]),
+                                                        &stack->list[stack->count - 1]);
+            break;
+
+        default:
+            operation(token->value.operator, stack, data);
+            break;
+    }
+}
+
+static bool isoperator(const Token *token, operator_type type)
+{
+    return token->type == OPERATOR && token->value.operator == type;
+}
+
+static ResultInfo run_range(const TokenList program, unsigned int begin, unsigned int end,
+                            const Interval *variables, IntervalStack *stack);
+
+// c JUMP_FALSE [other] a JUMP [after] b, with the condition c taken off the stack
+// a condition the box does not decide runs both branches, one after the other,
+// NAN holds like any value but 0
+static ResultInfo conditional(const TokenList program, unsigned int index, Interval condition,
+                              const Interval *variables, IntervalStack *stack)
+{
+    unsigned int other = (unsigned int)program.list[index + 1].value.number;
+    unsigned int after = (unsigned int)program.list[other - 1].value.number;
+    bool maybe_true = condition.low != 0 || condition.high != 0 || condition.maybe_nan;
+    bool maybe_false = condition.low <= 0 && condition.high >= 0;
+    ResultInfo taken, skipped;
+    Interval value;
+
+    if (!maybe_false || !maybe_true)
+    {
+        taken = maybe_true ? run_range(program, index + 2, other - 2, variables, stack)
+                           : run_range(program, other, after, variables, stack);
+        if (taken.status != SUCCESS)
+            return taken;
+        value = stack_pop(stack);
+    }
+
+    else
+    {
+        // a branch that fails part way leaves its operands behind,
+        // they are dropped so only the value of a branch remains
+        unsigned int depth = stack->count;
+        taken = run_range(program, index + 2, other - 2, variables, stack);
+        Interval first = taken.status == SUCCESS ? stack_pop(stack) : new_interval(0, 0);
+        stack->count = depth;
+        skipped = run_range(program, other, after, variables, stack);
+        Interval second = skipped.status == SUCCESS ? stack_pop(stack) : new_interval(0, 0);
+        stack->count = depth;
+
+        if (taken.status != SUCCESS && skipped.status != SUCCESS)
+            return taken;
+
+        // a branch that always fails only fails the points that take it
+        if (taken.status != SUCCESS || skipped.status != SUCCESS)
+        {
+            ResultInfo failed = taken.status != SUCCESS ? taken : skipped;
+            value = taken.status != SUCCESS ? second : first;
+            if (value.possible == SUCCESS)
+            {
+                value.possible = failed.status;
+                value.possible_index = failed.error_index;
+            }
+        }
+
+        else
+        {
+            value = first;
+            hull_add(&value, second);
+            value = inherit(value, &second);
+            value = inherit(value, &first);
+        }
+    }
+
+    // the value is one of the branches, NAN only if a branch gives it
+    bool maybe_nan = value.maybe_nan;
+    value = inherit(value, &condition);
+    value.maybe_nan = maybe_nan;
+    stack_push(stack, value);
+
+    ResultInfo res;
+    res.status = SUCCESS;
+    res.error_index = after;
+    return res;
+}
+
+// run the tokens from begin to end, conditionals run their branches
+// on their own, error_index of a successful run is the next token
+static ResultInfo run_range(const TokenList program, unsigned int begin, unsigned int end,
+                            const Interval *variables, IntervalStack *stack)
+{
+    ResultInfo res;
+
+    for (unsigned int i = begin; i < end; i++)
+    {
+        const Token *token = &program.list[i];
+
+        if (isoperator(token, JUMP_FALSE))
+        {
+            res = conditional(program, i, stack_pop(stack), variables, stack);
+            if (res.status != SUCCESS)
+                return res;
+
+            i = res.error_index - 1;
+            continue;
+        }
+
+        IntervalData data;
+        data.status = SUCCESS;
+        data.column = token->column;
+        process(token, stack, variables, &data);
+
+        if (data.status != SUCCESS)
+        {
+            res.status = data.status;
+            res.error_index = token->column;
+            return res;
+        }
+
+        // skip the immediate operand of a fused operator
+        if (token->type == OPERATOR && hasimmediate(token->value.operator))
+            i++;
+    }
+
+    res.status = SUCCESS;
+    res.error_index = end;
+    return res;
+}
+
+ResultInfo evaluate_interval(const TokenList program, const Interval *variables, Interval *result)
+{
+    IntervalStack stack;
+    stack.count = 0;
+    stack.max = 0;
+    stack.list = NULL;
+
+    ResultInfo res = run_range(program, 0, program.count, variables, &stack);
+    if (res.status == SUCCESS)
+    {
+        *result = stack.count > 0 ? stack.list[stack.count - 1] : new_interval(0, 0);
+        res.error_index = 0;
+    }
+
+    free(stack.list);
+    return res;
+}
@@ -0,0 +1,162 @@
+// standard library includes
+#include <math.h>
+#include <stdlib.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "optimize.h"
+#include "dag.h"
+#include "kernel.h"
+
+Kernel new_kernel(unsigned int optimize)
+{
+    Kernel obj;
+    obj.output_count = 0;
+    obj.output_max = 8;
+    obj.programs = (TokenList *)malloc(8 * sizeof(TokenList));
+    obj.program = new_tokenlist();
+    obj.optimize = optimize;
+
+    if (obj.programs == NULL) exit(1);
+
+    return obj;
+}
+
+void delete_kernel(Kernel *kernel)
+{
+    for (unsigned int i = 0; i < kernel->output_count; i++)
+        delete_tokenlist(kernel->programs[i]);
+
+    free(kernel->programs);
+    delete_tokenlist(kernel->program);
+
+    kernel->programs = NULL;
+    kernel->output_count = 0;
+    kernel->output_max = 0;
+}
+
+ResultInfo kernel_add(Kernel *kernel, const char *expression, NameTable *names)
+{
+    TokenList program = new_tokenlist();
+    ResultInfo res = convert_names(expression, &program, names);
+    if (res.status != SUCCESS)
+    {
+        delete_tokenlist(program);
+        return res;
+    }
+
+    // an empty expression evaluates to 0 without leaving a value,
+    // in the fused program it has to leave one
+    if (program.count == 0)
+        tokenlist_add(&program, create_number_token(0, 0));
+
+    if (kernel->output_count == kernel->output_max)
+    {
+        kernel->output_max *= 2;
+        kernel->programs = (TokenList *)realloc(kernel->programs,
+                                                kernel->output_max * sizeof(TokenList));
+        if (kernel->programs == NULL) exit(1);
+    }
+
+    kernel->programs[kernel->output_count] = program;
+    kernel->output_count += 1;
+
+    return res;
+}
+
+void kernel_compile(Kernel *kernel)
+{
+    clear_tokenlist(&kernel->program);
+    for (unsigned int i = 0; i < kernel->output_count; i++)
+    {
+        TokenList single = kernel->programs[i];
+        unsigned int offset = kernel->program.count;
+        for (unsigned int k = 0; k < single.count; k++)
+        {
+            tokenlist_add(&kernel->program, single.list[k]);
+
+            // jump targets move with the expression
+            Token *t = &single.list[k];
+            if (t->type == OPERATOR && (t->value.operator == JUMP_FALSE || t->value.operator == JUMP))
+            {
+                Token target = single.list[++k];
+                target.value.number += offset;
+                tokenlist_add(&kernel->program, target);
+            }
+        }
+    }
+
+    // sharing looks across expression boundaries,
+    // so it runs on the whole program with one root per expression
+    if (kernel->optimize & OPTIMIZE_SHARE)
+    {
+        ExpressionDag dag = new_expression_dag_roots(kernel->program, kernel->output_count);
+        dag_emit(&dag, &kernel->program);
+        delete_expression_dag(dag);
+    }
+
+    optimize(&kernel->program, kernel->optimize & ~OPTIMIZE_SHARE);
+
+    // the single programs only run for rows that failed
+    for (unsigned int i = 0; i < kernel->output_count; i++)
+        optimize(&kernel->programs[i], kernel->optimize);
+}
+
+// evaluate each expression of a failed row on its own
+static unsigned int evaluate_singly(const Kernel *kernel, ParseContext *context,
+                                    const double *row_variables, unsigned long long row,
+                                    double *const *columns, error_type *const *errors)
+{
+    unsigned int failed = 0;
+    Token result = create_empty_token();
+
+    for (unsigned int k = 0; k < kernel->output_count; k++)
+    {
+        ResultInfo res = evaluate_context(context, kernel->programs[k], row_variables, &result);
+        errors[k][row] = res.status;
+        if (res.status == SUCCESS)
+        {
+            columns[k][row] = result.value.number;
+        }
+        else
+        {
+            columns[k][row] = NAN;
+            failed += 1;
+        }
+    }
+
+    return failed;
+}
+
+unsigned long long kernel_evaluate_range(const Kernel *kernel, ParseContext *context,
+                                         const double *variables, unsigned int stride,
+                                         unsigned long long begin, unsigned long long end,
+                                         double *const *columns, error_type *const *errors)
+{
+    unsigned int count = kernel->output_count;
+    double *outputs = (double *)malloc((count + 1) * sizeof(double));
+    if (outputs == NULL) exit(1);
+
+    unsigned long long failed = 0;
+    for (unsigned long long row = begin; row < end; row++)
+    {
+        const double *row_variables = variables + row * stride;
+        ResultInfo res = evaluate_outputs(context, kernel->program, row_variables, outputs, count);
+
+        if (res.status != SUCCESS)
+        {
+            failed += evaluate_singly(kernel, context, row_variables, row, columns, errors);
+            continue;
+        }
+
+        for (unsigned int k = 0; k < count; k++)
+        {
+            columns[k][row] = outputs[k];
+            errors[k][row] = SUCCESS;
+        }
+    }
+
+    free(outputs);
+    return failed;
+}
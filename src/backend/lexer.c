@@ -1,12 +1,14 @@
 // standard library includes
-#include <ctype.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 // project includes
 #include "token.h"
+#include "nametable.h"
 #include "parser.h"
+#include "scan.h"
+#include "probes.h"
 
 #define BUFSIZE 256
 #define PI 3.14159265358979323846264338327950288
@@ -15,40 +17,206 @@
 typedef struct
 {
     error_type status;
+
+    // unknown identifiers become variables when set
+    NameTable *names;
+
+    // names of user functions, followed by ( they become calls
+    const NameTable *functions;
+
+    // index of the terminating \0, runs are scanned up to it
+    unsigned int length;
+
+    // tokens lexed so far
+    const TokenList *output;
+
+    // parenthesis depth, and the depth inside the outermost
+    // integrate, sum or root call, 0 outside of one
+    unsigned int depth;
+    unsigned int calculus_depth;
 } LexData;
 
-static LexData init()
+static LexData init(NameTable *names, const NameTable *functions,
+                    const TokenList *output, unsigned int length)
 {
     LexData data;
     data.status = SUCCESS;
+    data.names = names;
+    data.functions = functions;
+    data.length = length;
+    data.output = output;
+    data.depth = 0;
+    data.calculus_depth = 0;
     return data;
 }
 
+// what a byte can start, independent of the locale
+typedef enum
+{
+    CHAR_INVALID = 0,
+    CHAR_SPACE,
+    CHAR_DIGIT,
+    CHAR_LOWER,
+    CHAR_OPERATOR,
+    CHAR_COMPARISON,
+    CHAR_PARENTHESIS
+} char_class;
+
+// class of a byte, and for single character tokens
+// the operator_type or parenthesis_type they stand for
+typedef struct
+{
+    unsigned char class;
+    unsigned char value;
+} CharInfo;
+
+// bytes not listed are invalid, including '.' and everything above 127
+// a new single character operator only needs its entry here
+static const CharInfo char_table[256] = {
+    [' '] = { CHAR_SPACE, 0 }, ['\t'] = { CHAR_SPACE, 0 },
+    ['\n'] = { CHAR_SPACE, 0 }, ['\v'] = { CHAR_SPACE, 0 },
+    ['\f'] = { CHAR_SPACE, 0 }, ['\r'] = { CHAR_SPACE, 0 },
+
+    ['0'] = { CHAR_DIGIT, 0 }, ['1'] = { CHAR_DIGIT, 0 },
+    ['2'] = { CHAR_DIGIT, 0 }, ['3'] = { CHAR_DIGIT, 0 },
+    ['4'] = { CHAR_DIGIT, 0 }, ['5'] = { CHAR_DIGIT, 0 },
+    ['6'] = { CHAR_DIGIT, 0 }, ['7'] = { CHAR_DIGIT, 0 },
+    ['8'] = { CHAR_DIGIT, 0 }, ['9'] = { CHAR_DIGIT, 0 },
+
+    ['a'] = { CHAR_LOWER, 0 }, ['b'] = { CHAR_LOWER, 0 }, ['c'] = { CHAR_LOWER, 0 },
+    ['d'] = { CHAR_LOWER, 0 }, ['e'] = { CHAR_LOWER, 0 }, ['f'] = { CHAR_LOWER, 0 },
+    ['g'] = { CHAR_LOWER, 0 }, ['h'] = { CHAR_LOWER, 0 }, ['i'] = { CHAR_LOWER, 0 },
+    ['j'] = { CHAR_LOWER, 0 }, ['k'] = { CHAR_LOWER, 0 }, ['l'] = { CHAR_LOWER, 0 },
+    ['m'] = { CHAR_LOWER, 0 }, ['n'] = { CHAR_LOWER, 0 }, ['o'] = { CHAR_LOWER, 0 },
+    ['p'] = { CHAR_LOWER, 0 }, ['q'] = { CHAR_LOWER, 0 }, ['r'] = { CHAR_LOWER, 0 },
+    ['s'] = { CHAR_LOWER, 0 }, ['t'] = { CHAR_LOWER, 0 }, ['u'] = { CHAR_LOWER, 0 },
+    ['v'] = { CHAR_LOWER, 0 }, ['w'] = { CHAR_LOWER, 0 }, ['x'] = { CHAR_LOWER, 0 },
+    ['y'] = { CHAR_LOWER, 0 }, ['z'] = { CHAR_LOWER, 0 },
+
+    ['+'] = { CHAR_OPERATOR, ADD }, ['-'] = { CHAR_OPERATOR, SUB },
+    ['*'] = { CHAR_OPERATOR, MULT }, ['/'] = { CHAR_OPERATOR, DIV },
+    ['%'] = { CHAR_OPERATOR, MOD }, ['^'] = { CHAR_OPERATOR, POW },
+    ['?'] = { CHAR_OPERATOR, QUESTION }, [':'] = { CHAR_OPERATOR, COLON },
+    [','] = { CHAR_OPERATOR, COMMA },
+
+    // the value is the operator without a following '=', 0 if there is none
+    ['<'] = { CHAR_COMPARISON, LESS }, ['>'] = { CHAR_COMPARISON, GREATER },
+    ['='] = { CHAR_COMPARISON, 0 }, ['!'] = { CHAR_COMPARISON, 0 },
+
+    ['('] = { CHAR_PARENTHESIS, LEFT }, [')'] = { CHAR_PARENTHESIS, RIGHT },
+};
+
+static char_class class_of(char c)
+{
+    return (char_class)char_table[(unsigned char)c].class;
+}
+
+// append a run of input to a build buffer
+// once the buffer is full, every further character
+// overwrites its final spot before the \0
+static void buffer_run(char *build_buffer, unsigned int *build_buf_idx,
+                       const char *run, unsigned int run_length)
+{
+    if (*build_buf_idx + run_length < BUFSIZE - 2)
+    {
+        memcpy(build_buffer + *build_buf_idx, run, run_length);
+        *build_buf_idx += run_length;
+        return;
+    }
+
+    for (unsigned int i = 0; i < run_length; i++)
+    {
+        build_buffer[*build_buf_idx] = run[i];
+
+        if (*build_buf_idx < BUFSIZE - 2)
+            *build_buf_idx += 1;
+    }
+}
+
+// the rest of a name, lowercase letters and digits,
+// index of the first character after it
+static unsigned int name_run(const char *input, unsigned int index, unsigned int end)
+{
+    unsigned int next = index;
+    do
+    {
+        index = next;
+        next = scan_run(input, index, end, SCAN_DIGIT);
+        next = scan_run(input, next, end, SCAN_LOWER);
+    } while (next != index);
+
+    return index;
+}
+
+// names inside an integrate, sum or root call belong to it,
+// each one is identified by the column it first appears at
+static Token create_bound_token(const char *input, unsigned int column, unsigned int end,
+                                const LexData *data)
+{
+    unsigned int length = end - column;
+    for (unsigned int i = 0; i < data->output->count; i++)
+    {
+        const Token *t = &data->output->list[i];
+        if (t->type == BOUND && t->column + length <= data->length &&
+            !strncmp(input + t->column, input + column, length) &&
+            class_of(input[t->column + length]) != CHAR_LOWER &&
+            class_of(input[t->column + length]) != CHAR_DIGIT)
+        {
+            Token res = *t;
+            res.column = column;
+            return res;
+        }
+    }
+
+    Token res;
+    res.type = BOUND;
+    res.column = column;
+    res.value.variable = column;
+    return res;
+}
+
+static Token create_calculus_token(operator_type type, unsigned int column, LexData *data)
+{
+    if (data->calculus_depth == 0)
+        data->calculus_depth = data->depth + 1;
+
+    return create_operator_token(type, column);
+}
+
+// whether the next character after index that is not a space is (
+static bool opens_call(const char *input, unsigned int index, const LexData *data)
+{
+    if (class_of(input[index]) == CHAR_SPACE)
+        index = scan_run(input, index, data->length, SCAN_SPACE);
+
+    return input[index] == '(';
+}
+
 static Token process_text(const char *input, unsigned int *input_idx, LexData *data)
 {
     // record first input character as token starting column
     unsigned int column = *input_idx;
 
     // collect characters into a buffer
-    // as long as they are lowercase letters
+    // as long as they make a name
     char build_buffer[BUFSIZE];
     unsigned int build_buf_idx = 0;
 
-    while (islower(input[*input_idx]))
-    {
-        build_buffer[build_buf_idx] = input[*input_idx];
-        *input_idx += 1;
+    *input_idx = scan_run(input, column, data->length, SCAN_LOWER);
 
-        // final spot in the array is reserved for \0
-        if (build_buf_idx < BUFSIZE - 2)
-            build_buf_idx += 1;
-    }
+    // digits go on with a name, clamp01, but a built in name
+    // keeps to itself before a number, sin8 is sin 8
+    if (*input_idx < data->length && class_of(input[*input_idx]) == CHAR_DIGIT &&
+        !iskeyword(input + column, *input_idx - column))
+        *input_idx = name_run(input, *input_idx, data->length);
+    buffer_run(build_buffer, &build_buf_idx, input + column, *input_idx - column);
 
     // set index to last processed character
     *input_idx -= 1;
 
     // add closing \0 to buffer
     build_buffer[build_buf_idx] = '\0';
+    unsigned int index;
 
     // build token based on string matching
     if (!strcmp(build_buffer, "sin"))
@@ -119,6 +287,39 @@ static Token process_text(const char *input, unsigned int *input_idx, LexData *d
     {
         return create_number_token(PI, column);
     }
+    else if (!strcmp(build_buffer, "integrate"))
+    {
+        return create_calculus_token(INTEGRATE, column, data);
+    }
+    else if (!strcmp(build_buffer, "sum"))
+    {
+        return create_calculus_token(SUM, column, data);
+    }
+    else if (!strcmp(build_buffer, "root"))
+    {
+        return create_calculus_token(ROOT, column, data);
+    }
+    else if (data->functions != NULL && opens_call(input, *input_idx + 1, data))
+    {
+        if (nametable_find(data->functions, input + column, *input_idx + 1 - column, &index))
+            return create_function_token(index, column);
+
+        // a call of a function that does not exist
+        data->status = UNDEFINED_VARIABLE;
+        *input_idx = column;
+        return create_empty_token();
+    }
+    else if (data->calculus_depth != 0 && data->depth >= data->calculus_depth)
+    {
+        return create_bound_token(input, column, *input_idx + 1, data);
+    }
+    else if (data->names != NULL)
+    {
+        // intern straight from the input so that
+        // names longer than the buffer are not truncated
+        index = nametable_add(data->names, input + column, *input_idx + 1 - column);
+        return create_variable_token(index, column);
+    }
     else
     {
         // in case of no match there is an error in the input
@@ -132,6 +333,48 @@ static Token process_text(const char *input, unsigned int *input_idx, LexData *d
 
 }
 
+// exact powers of ten for the fast number conversion
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// convert digits with at most one dot
+//
+// if the digits without the dot form an integer below 2^53
+// and at most 22 of them follow the dot, both the integer and
+// the power of ten are exact doubles and a single division
+// rounds the same way atof does, anything else goes to atof
+static double convert_number(const char *buffer, unsigned int length)
+{
+    unsigned long long mantissa = 0;
+    unsigned int digits = 0;
+    unsigned int fraction_digits = 0;
+    bool dot_encountered = false;
+
+    for (unsigned int i = 0; i < length; i++)
+    {
+        if (buffer[i] == '.')
+        {
+            dot_encountered = true;
+            continue;
+        }
+
+        // more digits could overflow the mantissa
+        if (++digits > 19)
+            return atof(buffer);
+
+        mantissa = mantissa * 10 + (buffer[i] - '0');
+        if (dot_encountered)
+            fraction_digits++;
+    }
+
+    if (mantissa > (1ull << 53) || fraction_digits > 22)
+        return atof(buffer);
+
+    return (double)mantissa / powers_of_ten[fraction_digits];
+}
+
 static Token build_number_token(const char *input, unsigned int *input_idx, LexData *data)
 {
     bool dot_encountered = false;
@@ -159,15 +402,12 @@ static Token build_number_token(const char *input, unsigned int *input_idx, LexD
 
     while (processing_number)
     {
-        if (isdigit(input[*input_idx]))
+        if (class_of(input[*input_idx]) == CHAR_DIGIT)
         {
-            // add digit to buffer
-            build_buffer[build_buf_idx] = input[*input_idx];
-            *input_idx += 1;
-
-            // final spot in the array is reserved for \0
-            if (build_buf_idx < BUFSIZE - 2)
-                build_buf_idx += 1;
+            // add the whole run of digits to buffer
+            unsigned int start = *input_idx;
+            *input_idx = scan_run(input, start, data->length, SCAN_DIGIT);
+            buffer_run(build_buffer, &build_buf_idx, input + start, *input_idx - start);
         }
 
         else if (input[*input_idx] == '.')
@@ -218,96 +458,182 @@ static Token build_number_token(const char *input, unsigned int *input_idx, LexD
     build_buffer[build_buf_idx] = '\0';
 
     // build number
-    return create_number_token(atof(build_buffer), column);
+    return create_number_token(convert_number(build_buffer, build_buf_idx), column);
 }
 
-static Token create_token(const char *input, unsigned int *input_idx, LexData *data)
+// < > alone, or <= >= == != with the '=' that follows
+static Token build_comparison_token(const char *input, unsigned int *input_idx, LexData *data)
 {
+    unsigned int column = *input_idx;
+    char c = input[column];
 
-    if (isdigit(input[*input_idx]))
+    if (input[column + 1] == '=')
     {
-        return build_number_token(input, input_idx, data);
+        *input_idx += 1;
+        switch (c)
+        {
+            case '<': return create_operator_token(LESS_EQUAL, column);
+            case '>': return create_operator_token(GREATER_EQUAL, column);
+            case '=': return create_operator_token(EQUAL, column);
+            default: return create_operator_token(NOT_EQUAL, column);
+        }
     }
 
-    else if (islower(input[*input_idx]))
+    operator_type single = (operator_type)char_table[(unsigned char)c].value;
+    if (single == 0)
     {
-        return process_text(input, input_idx, data);
+        data->status = INVALID_INPUT_CHARACTER;
+        return create_empty_token();
     }
 
-    else if (input[*input_idx] == '+')
-    {
-        return create_operator_token(ADD, *input_idx);
-    }
+    return create_operator_token(single, column);
+}
 
-    else if (input[*input_idx] == '-')
-    {
-        return create_operator_token(SUB, *input_idx);
-    }
+static Token create_token(const char *input, unsigned int *input_idx, LexData *data)
+{
+    const CharInfo *info = &char_table[(unsigned char)input[*input_idx]];
 
-    else if (input[*input_idx] == '*')
+    switch (info->class)
     {
-        return create_operator_token(MULT, *input_idx);
-    }
+        case CHAR_DIGIT:
+            return build_number_token(input, input_idx, data);
 
-    else if (input[*input_idx] == '/')
-    {
-        return create_operator_token(DIV, *input_idx);
-    }
+        case CHAR_LOWER:
+            return process_text(input, input_idx, data);
 
-    else if (input[*input_idx] == '%')
-    {
-        return create_operator_token(MOD, *input_idx);
-    }
+        case CHAR_OPERATOR:
+            return create_operator_token((operator_type)info->value, *input_idx);
 
-    else if (input[*input_idx] == '^')
-    {
-        return create_operator_token(POW, *input_idx);
-    }
+        case CHAR_COMPARISON:
+            return build_comparison_token(input, input_idx, data);
 
-    else if (input[*input_idx] == '(')
-    {
-        return create_parenthesis_token(LEFT, *input_idx);
-    }
+        case CHAR_PARENTHESIS:
+            if (info->value == LEFT)
+                data->depth++;
+            else if (data->depth > 0)
+                data->depth--;
 
-    else if (input[*input_idx] == ')')
-    {
-        return create_parenthesis_token(RIGHT, *input_idx);
-    }
+            if (data->depth < data->calculus_depth)
+                data->calculus_depth = 0;
 
-    else
-    {
-        // if no suitable operation is found
-        // then there is an error and the main loop is notified
-        data->status = INVALID_INPUT_CHARACTER;
-        Token res = create_empty_token();
-        return res;
+            return create_parenthesis_token((parenthesis_type)info->value, *input_idx);
+
+        default:
+            // if no suitable operation is found
+            // then there is an error and the main loop is notified
+            data->status = INVALID_INPUT_CHARACTER;
+            return create_empty_token();
     }
 }
 
 ResultInfo lex (const char *input, TokenList *output)
 {
-    LexData data = init();
+    return lex_names(input, output, NULL);
+}
+
+ResultInfo lex_names(const char *input, TokenList *output, NameTable *names)
+{
+    return lex_functions(input, output, names, NULL);
+}
+
+bool iskeyword(const char *name, unsigned int length)
+{
+    LexData data = init(NULL, NULL, NULL, length);
+    unsigned int index = 0;
+    process_text(name, &index, &data);
+
+    return data.status == SUCCESS && index + 1 == length;
+}
+
+ResultInfo lex_functions(const char *input, TokenList *output,
+                         NameTable *names, const NameTable *functions)
+{
+    LexData data = init(names, functions, output, strlen(input));
     clear_tokenlist(output);
 
     ResultInfo res;
+    res.status = SUCCESS;
+    res.error_index = 0;
+    PARSER_PROBE(lex_entry, data.length, 0, SUCCESS, 0);
 
     // build tokens
     for (unsigned int i = 0; input[i] != '\0'; i++)
     {
-        if (isspace(input[i]))
+        // skip the whole run of whitespace,
+        // the loop steps onto the character after it
+        if (class_of(input[i]) == CHAR_SPACE)
+        {
+            i = scan_run(input, i, data.length, SCAN_SPACE) - 1;
             continue;
+        }
 
+        unsigned int column = i;
         tokenlist_add(output, create_token(input, &i, &data));
 
+        if (output->overflow && data.status == SUCCESS)
+        {
+            data.status = CAPACITY_EXCEEDED;
+            i = column;
+        }
+
         if (data.status != SUCCESS)
         {
             res.status = data.status;
             res.error_index = i;
-            return res;
+            break;
         }
     }
 
-    res.status = SUCCESS;
-    res.error_index = 0;
+    PARSER_PROBE(lex_return, data.length, output->count, res.status, res.error_index);
     return res;
 }
+
+// a lexical error ends at the next space, operator or parenthesis
+static bool resynchronizes(char c)
+{
+    char_class class = class_of(c);
+    return c == '\0' || class == CHAR_SPACE || class == CHAR_OPERATOR ||
+           class == CHAR_COMPARISON || class == CHAR_PARENTHESIS;
+}
+
+void lex_recover(const char *input, TokenList *output,
+                 NameTable *names, DiagnosticList *diagnostics)
+{
+    LexData data = init(names, NULL, output, strlen(input));
+    clear_tokenlist(output);
+
+    for (unsigned int i = 0; input[i] != '\0'; i++)
+    {
+        if (class_of(input[i]) == CHAR_SPACE)
+        {
+            i = scan_run(input, i, data.length, SCAN_SPACE) - 1;
+            continue;
+        }
+
+        unsigned int column = i;
+        Token token = create_token(input, &i, &data);
+
+        // report the error where lex would, then skip the rest
+        // of the broken word and leave an EMPTY token in its place
+        if (data.status != SUCCESS)
+        {
+            diagnostic_list_add(diagnostics, data.status, i);
+            data.status = SUCCESS;
+
+            i = column;
+            while (!resynchronizes(input[i + 1]))
+                i++;
+
+            token = create_empty_token();
+            token.column = column;
+        }
+
+        tokenlist_add(output, token);
+
+        if (output->overflow)
+        {
+            diagnostic_list_add(diagnostics, CAPACITY_EXCEEDED, column);
+            return;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+// standard library includes
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "nametable.h"
+
+static unsigned int hash(const char *name, unsigned int length)
+{
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    for (unsigned int i = 0; i < length; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+// returns the slot holding name, or the empty slot where it belongs
+static unsigned int find_slot(const NameTable *self, const char *name, unsigned int length)
+{
+    unsigned int mask = self->slot_count - 1;
+    unsigned int slot = hash(name, length) & mask;
+
+    while (self->slots[slot] != 0)
+    {
+        const char *entry = self->list[self->slots[slot] - 1];
+        if (strncmp(entry, name, length) == 0 && entry[length] == '\0')
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static void rehash(NameTable *self)
+{
+    free(self->slots);
+    self->slot_count *= 2;
+    self->slots = (unsigned int *)calloc(self->slot_count, sizeof(unsigned int));
+    if (self->slots == NULL) exit(1);
+
+    for (unsigned int i = 0; i < self->count; i++)
+    {
+        const char *entry = self->list[i];
+        self->slots[find_slot(self, entry, strlen(entry))] = i + 1;
+    }
+}
+
+NameTable new_nametable(void)
+{
+    NameTable obj;
+    obj.count = 0;
+    obj.max = 8;
+    obj.list = (char **)calloc(8, sizeof(char *));
+    obj.slot_count = 16;
+    obj.slots = (unsigned int *)calloc(16, sizeof(unsigned int));
+
+    if (obj.list == NULL || obj.slots == NULL) exit(1);
+
+    return obj;
+}
+
+void delete_nametable(NameTable nametable)
+{
+    for (unsigned int i = 0; i < nametable.count; i++)
+        free(nametable.list[i]);
+
+    free(nametable.list);
+    free(nametable.slots);
+}
+
+unsigned int nametable_add(NameTable *self, const char *name, unsigned int length)
+{
+    unsigned int slot = find_slot(self, name, length);
+    if (self->slots[slot] != 0)
+        return self->slots[slot] - 1;
+
+    if (self->count == self->max)
+    {
+        self->max = self->max * 2;
+        self->list = (char **)realloc(self->list, self->max * sizeof(char *));
+        if (self->list == NULL) exit(1);
+    }
+
+    char *entry = (char *)malloc(length + 1);
+    if (entry == NULL) exit(1);
+    memcpy(entry, name, length);
+    entry[length] = '\0';
+
+    self->list[self->count] = entry;
+    self->slots[slot] = self->count + 1;
+    self->count += 1;
+
+    // keep the load factor of the hash at or below one half
+    if (self->count * 2 > self->slot_count)
+        rehash(self);
+
+    return self->count - 1;
+}
+
+bool nametable_find(const NameTable *self, const char *name,
+                    unsigned int length, unsigned int *index)
+{
+    unsigned int slot = find_slot(self, name, length);
+    if (self->slots[slot] == 0)
+        return false;
+
+    *index = self->slots[slot] - 1;
+    return true;
+}
+
+const char *nametable_name(const NameTable *self, unsigned int index)
+{
+    if (index >= self->count)
+        return NULL;
+
+    return self->list[index];
+}
@@ -0,0 +1,530 @@
+// standard library includes
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "optimize.h"
+#include "functions.h"
+#include "dag.h"
+
+// largest exponent that is worth a chain of squarings
+#define INTEGER_POWER_MAX 32
+
+// literals below 2^63 in magnitude convert to a long long exactly
+#define INTEGER_LITERAL_LIMIT 9223372036854775808.0
+
+static bool isoperator(const Token *token, operator_type type)
+{
+    return token->type == OPERATOR && token->value.operator == type;
+}
+
+static bool isleaf(const Token *token)
+{
+    return token->type == NUMBER || token->type == VARIABLE;
+}
+
+static bool isfused(const Token *token)
+{
+    return token->type == OPERATOR && hasimmediate(token->value.operator);
+}
+
+// binary operators that have an immediate form
+static bool immediate_form(operator_type type, operator_type *fused)
+{
+    switch (type)
+    {
+        case ADD: *fused = ADD_IMM; return true;
+        case SUB: *fused = SUB_IMM; return true;
+        case MULT: *fused = MULT_IMM; return true;
+        case DIV: *fused = DIV_IMM; return true;
+        case MOD: *fused = MOD_IMM; return true;
+        case POW: *fused = POW_IMM; return true;
+        default: return false;
+    }
+}
+
+// integer forms are left out, they may continue in double
+// but their operand is not a NUMBER to begin with
+static bool isfunction(const Token *token)
+{
+    return token->type == OPERATOR && isunary(token->value.operator) &&
+           token->value.operator != NEG && token->value.operator < IADD;
+}
+
+// peephole pass over a postfix program
+//
+// in postfix the right operand of a binary operator ends right before it,
+// so the sequences below can be recognized by looking at adjacent tokens:
+//
+//   * +      c a b * +    -> c a b ADD_MULT   (c + a * b)
+//   * k +    a b * k +    -> a b k MULT_ADD   (a * b + k, k a leaf)
+//   k op     x k op       -> x OP_IMM [k]
+//   neg f    x neg f      -> x NEG_CALL [f]
+//   f neg    x f neg      -> x CALL_NEG [f]
+//
+// the rewritten program is never longer than the original,
+// so it is written back over the tokens already read
+static void fuse(TokenList *program)
+{
+    Token *list = program->list;
+    unsigned int count = program->count;
+    unsigned int write = 0;
+    unsigned int read = 0;
+
+    while (read < count)
+    {
+        const Token *t = &list[read];
+        unsigned int left = count - read;
+
+        // fused operators and their immediate are copied as they are
+        if (isfused(t) && left >= 2)
+        {
+            list[write++] = list[read++];
+            list[write++] = list[read++];
+        }
+
+        else if (isoperator(t, MULT) && left >= 2 &&
+                 (isoperator(&list[read + 1], ADD) || isoperator(&list[read + 1], SUB)))
+        {
+            operator_type fused = isoperator(&list[read + 1], ADD) ? ADD_MULT : SUB_MULT;
+            list[write++] = create_operator_token(fused, list[read + 1].column);
+            read += 2;
+        }
+
+        else if (isoperator(t, MULT) && left >= 3 && isleaf(&list[read + 1]) &&
+                 (isoperator(&list[read + 2], ADD) || isoperator(&list[read + 2], SUB)))
+        {
+            operator_type fused = isoperator(&list[read + 2], ADD) ? MULT_ADD : MULT_SUB;
+            Token operand = list[read + 1];
+            unsigned int column = list[read + 2].column;
+            list[write++] = operand;
+            list[write++] = create_operator_token(fused, column);
+            read += 3;
+        }
+
+        else if (t->type == NUMBER && left >= 2 && list[read + 1].type == OPERATOR)
+        {
+            operator_type fused;
+            if (immediate_form(list[read + 1].value.operator, &fused))
+            {
+                Token operand = list[read];
+                list[write++] = create_operator_token(fused, list[read + 1].column);
+                list[write++] = operand;
+                read += 2;
+            }
+
+            else
+            {
+                list[write++] = list[read++];
+            }
+        }
+
+        // the function is the only part that can fail,
+        // so the fused token reports errors at its column
+        else if (isoperator(t, NEG) && left >= 2 && isfunction(&list[read + 1]))
+        {
+            Token function = list[read + 1];
+            list[write++] = create_operator_token(NEG_CALL, function.column);
+            list[write++] = function;
+            read += 2;
+        }
+
+        else if (isfunction(t) && left >= 2 && isoperator(&list[read + 1], NEG))
+        {
+            Token function = list[read];
+            list[write++] = create_operator_token(CALL_NEG, function.column);
+            list[write++] = function;
+            read += 2;
+        }
+
+        else
+        {
+            list[write++] = list[read++];
+        }
+    }
+
+    program->count = write;
+}
+
+// dividing by a power of two and multiplying by its reciprocal
+// give the same result, the reciprocal only changes the exponent
+static bool exact_reciprocal(double k)
+{
+    int exponent;
+    return fabs(frexp(k, &exponent)) == 0.5;
+}
+
+// replace expensive operators that have a constant right operand
+//
+//   x n ^      -> x POW_INT [n]   (n a whole number up to INTEGER_POWER_MAX)
+//   x 0.5 ^    -> x SQRT
+//   x k /      -> x 1/k *         (k a power of two, or any k if reciprocal)
+//
+// the error checks of the original operator are kept:
+// POW_INT still rejects zero to a negative power, SQRT rejects negative input,
+// and division by zero is never rewritten
+static void reduce(TokenList *program, bool reciprocal)
+{
+    Token *list = program->list;
+    unsigned int count = program->count;
+    unsigned int write = 0;
+    unsigned int read = 0;
+
+    while (read < count)
+    {
+        const Token *t = &list[read];
+        unsigned int left = count - read;
+
+        if (isfused(t) && left >= 2)
+        {
+            list[write++] = list[read++];
+            list[write++] = list[read++];
+        }
+
+        else if (t->type == NUMBER && left >= 2 && isoperator(&list[read + 1], POW))
+        {
+            double k = t->value.number;
+            Token operand = list[read];
+            unsigned int column = list[read + 1].column;
+
+            if (k == 0.5)
+            {
+                list[write++] = create_operator_token(SQRT, column);
+                read += 2;
+            }
+
+            else if (trunc(k) == k && fabs(k) <= INTEGER_POWER_MAX)
+            {
+                list[write++] = create_operator_token(POW_INT, column);
+                list[write++] = operand;
+                read += 2;
+            }
+
+            else
+            {
+                list[write++] = list[read++];
+            }
+        }
+
+        else if (t->type == NUMBER && left >= 2 && isoperator(&list[read + 1], DIV) &&
+                 t->value.number != 0 && isfinite(1 / t->value.number) &&
+                 (reciprocal || exact_reciprocal(t->value.number)))
+        {
+            list[write++] = create_number_token(1 / t->value.number, t->column);
+            list[write++] = create_operator_token(MULT, list[read + 1].column);
+            read += 2;
+        }
+
+        else
+        {
+            list[write++] = list[read++];
+        }
+    }
+
+    program->count = write;
+}
+
+// operators that have an integer form
+static bool integer_form(operator_type type, operator_type *integer)
+{
+    switch (type)
+    {
+        case ADD: *integer = IADD; return true;
+        case SUB: *integer = ISUB; return true;
+        case MULT: *integer = IMULT; return true;
+        case DIV: *integer = IDIV; return true;
+        case MOD: *integer = IMOD; return true;
+        case POW: *integer = IPOW; return true;
+        case NEG: *integer = INEG; return true;
+        case ABS: *integer = IABS; return true;
+        case FAC: *integer = IFAC; return true;
+        default: return false;
+    }
+}
+
+static bool integer_literal(const Token *token)
+{
+    return token->type == NUMBER && trunc(token->value.number) == token->value.number &&
+           fabs(token->value.number) < INTEGER_LITERAL_LIMIT;
+}
+
+// type of a value on the stack of the inference
+typedef struct
+{
+    bool integer;
+    bool leaf;
+    unsigned int end;   // index of the token that computes the value
+} ValueType;
+
+#define RETYPE 1            // literal becomes INTEGER, operator its integer form
+#define PROMOTE_AFTER 2     // an integer value is needed as a NUMBER
+
+// mark the values an operator takes, returns true if it has an integer form
+// and all its operands are integers
+static bool infer_operator(const Token *token, ValueType *operands, unsigned int arity,
+                           unsigned char *marks)
+{
+    operator_type integer;
+    bool exact = integer_form(token->value.operator, &integer);
+    for (unsigned int k = 0; k < arity; k++)
+        exact = exact && operands[k].integer;
+
+    for (unsigned int k = 0; k < arity; k++)
+    {
+        // an integer literal stays a NUMBER unless an integer operator takes it,
+        // a computed integer has to be promoted for a double operator
+        if (exact && operands[k].leaf)
+            marks[operands[k].end] |= RETYPE;
+        else if (!exact && operands[k].integer && !operands[k].leaf)
+            marks[operands[k].end] |= PROMOTE_AFTER;
+    }
+
+    return exact;
+}
+
+// find subexpressions built only from integer literals and operators
+// that have an integer form, and switch them to INTEGER tokens
+// and integer operators
+//
+//   2 3 + 0.5 *   ->  2i 3i IADD PROMOTE 0.5 *
+//
+// needs scratch memory and grows the program by one PROMOTE per switch
+// back to double, a fixed program that is too small is left alone
+static void infer_integers(TokenList *program)
+{
+    unsigned int count = program->count;
+    ValueType *stack = (ValueType *)malloc((count + 1) * sizeof(ValueType));
+    unsigned char *marks = (unsigned char *)calloc(count + 1, 1);
+    if (stack == NULL || marks == NULL) exit(1);
+
+    unsigned int depth = 0;
+    bool plain = true;
+    for (unsigned int i = 0; i < count && plain; i++)
+    {
+        const Token *token = &program->list[i];
+
+        if (token->type == NUMBER || token->type == VARIABLE)
+        {
+            stack[depth].integer = integer_literal(token);
+            stack[depth].leaf = true;
+            stack[depth].end = i;
+            depth++;
+            continue;
+        }
+
+        // a native call takes doubles and promotes its arguments itself
+        if (token->type == NATIVE)
+        {
+            unsigned int arity = token->value.native->arity;
+            if (depth < arity)
+            {
+                plain = false;
+                break;
+            }
+
+            depth -= arity;
+            stack[depth].integer = false;
+            stack[depth].leaf = false;
+            stack[depth].end = i;
+            depth++;
+            continue;
+        }
+
+        // only programs as built by convert()
+        if (token->type != OPERATOR || token->value.operator > FAC)
+        {
+            plain = false;
+            break;
+        }
+
+        unsigned int arity = isunary(token->value.operator) ? 1 : 2;
+        if (depth < arity)
+        {
+            plain = false;
+            break;
+        }
+
+        depth -= arity;
+        bool exact = infer_operator(token, &stack[depth], arity, marks);
+        if (exact)
+            marks[i] |= RETYPE;
+
+        stack[depth].integer = exact;
+        stack[depth].leaf = false;
+        stack[depth].end = i;
+        depth++;
+    }
+
+    // a lone integer literal is a result of its own
+    if (plain && depth == 1 && stack[0].leaf && stack[0].integer)
+        marks[stack[0].end] |= RETYPE;
+
+    unsigned int retyped = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (marks[i] & RETYPE)
+            retyped++;
+    }
+
+    if (plain && retyped > 0)
+    {
+        TokenList output = new_tokenlist();
+        for (unsigned int i = 0; i < count; i++)
+        {
+            Token token = program->list[i];
+            if ((marks[i] & RETYPE) && token.type == NUMBER)
+                token = create_integer_token((long long)token.value.number, token.column);
+            else if (marks[i] & RETYPE)
+                integer_form(token.value.operator, &token.value.operator);
+
+            tokenlist_add(&output, token);
+            if (marks[i] & PROMOTE_AFTER)
+                tokenlist_add(&output, create_operator_token(PROMOTE, token.column));
+        }
+
+        if (!program->fixed || output.count <= program->max)
+        {
+            clear_tokenlist(program);
+            for (unsigned int i = 0; i < output.count; i++)
+                tokenlist_add(program, output.list[i]);
+        }
+
+        delete_tokenlist(output);
+    }
+
+    free(marks);
+    free(stack);
+}
+
+// operators and native calls whose result depends on nothing but their operands
+// integer forms are left out, OPTIMIZE_INTEGER keeps them exact
+static bool foldable(const Token *token, unsigned int *arity)
+{
+    if (token->type == NATIVE)
+    {
+        *arity = token->value.native->arity;
+        return token->value.native->flags & NATIVE_PURE;
+    }
+
+    if (token->type != OPERATOR)
+        return false;
+
+    operator_type t = token->value.operator;
+    if (t > FAC && t != SQRT && !iscomparison(t))
+        return false;
+
+    *arity = isunary(t) ? 1 : 2;
+    return true;
+}
+
+// replace operations on constants by their value
+//
+//   2 3 * x +     -> 6 x +
+//   1 2 f x *     -> f(1, 2) x *    (f registered with NATIVE_PURE)
+//
+// in postfix the operands of an operator are constants exactly if
+// the tokens right before it are numbers, and as the program is written
+// back over itself a folded value is a number to the operators after it
+// programs with immediate operands are left alone, jump targets are absolute
+static void fold(TokenList *program)
+{
+    for (unsigned int i = 0; i < program->count; i++)
+    {
+        if (isfused(&program->list[i]))
+            return;
+    }
+
+    Token stack_buffer[FUNCTION_PARAMETERS_MAX + 1];
+    ParseContext context = bounded_parse_context(NULL, 0, stack_buffer,
+                                                 FUNCTION_PARAMETERS_MAX + 1, NULL, 0);
+
+    Token *list = program->list;
+    unsigned int write = 0;
+    for (unsigned int read = 0; read < program->count; read++)
+    {
+        list[write++] = list[read];
+
+        unsigned int arity;
+        if (!foldable(&list[write - 1], &arity) || write <= arity)
+            continue;
+
+        unsigned int first = write - 1 - arity;
+        bool constant = true;
+        for (unsigned int k = first; k < write - 1; k++)
+            constant = constant && list[k].type == NUMBER;
+
+        if (!constant)
+            continue;
+
+        TokenList operation = tokenlist_from_buffer(list + first, arity + 1);
+        operation.count = arity + 1;
+
+        Token result;
+        if (evaluate_context(&context, operation, NULL, &result).status == SUCCESS)
+        {
+            unsigned int column = list[write - 1].column;
+            write = first;
+            list[write++] = create_number_token(result.value.number, column);
+        }
+    }
+
+    program->count = write;
+}
+
+bool program_has_jumps(const TokenList program)
+{
+    for (unsigned int i = 0; i < program.count; i++)
+    {
+        if (isoperator(&program.list[i], JUMP_FALSE) || isoperator(&program.list[i], JUMP))
+            return true;
+    }
+
+    return false;
+}
+
+void optimize(TokenList *program, unsigned int flags)
+{
+    // jump targets are absolute, passes that move tokens would break them,
+    // sharing and integer inference give up on jumps by themselves
+    if (program_has_jumps(*program))
+        flags &= ~(OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+
+    // integer forms are plain operators to the later passes
+    if (flags & OPTIMIZE_INTEGER)
+        infer_integers(program);
+
+    // folding only shortens the program, the later passes see fewer operators
+    if (flags & OPTIMIZE_FOLD)
+        fold(program);
+
+    // sharing works on plain operators, so it runs before the other passes
+    if (flags & OPTIMIZE_SHARE)
+    {
+        ExpressionDag dag = new_expression_dag(*program);
+        dag_emit(&dag, program);
+        delete_expression_dag(dag);
+    }
+
+    if (flags & OPTIMIZE_STRENGTH)
+        reduce(program, flags & OPTIMIZE_RECIPROCAL);
+
+    // fusion runs last, other passes do not look into superinstructions
+    if (flags & OPTIMIZE_FUSE)
+        fuse(program);
+}
+
+unsigned int program_dispatch_count(const TokenList program)
+{
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < program.count; i++)
+    {
+        if (isfused(&program.list[i]))
+            i++;
+        count++;
+    }
+
+    return count;
+}
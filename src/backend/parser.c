@@ -1,11 +1,17 @@
 // standard library includes
 #include <math.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <stdbool.h>
 
 // project includes
 #include "token.h"
 #include "parser.h"
+#include "optimize.h"
+#include "functions.h"
+#include "probes.h"
 
 #define PI 3.14159265358979323846264338327950288
 
@@ -70,32 +76,72 @@ static void division(TokenList *stack, ParseData *data)
     }
 }
 
-static void power(TokenList *stack, ParseData *data)
+// check the operands of a power, shared with the fused immediate form
+static bool power_defined(double base, double exponent, ParseData *data)
 {
-    Token right_token = tokenlist_pop(stack);
-    Token left_token = tokenlist_pop(stack);
-
     // handle negative number with fractional exponent
-    if (left_token.value.number < 0 &&
-        trunc(right_token.value.number) != right_token.value.number)
+    if (base < 0 && trunc(exponent) != exponent)
     {
         data->status = NEGATIVE_FRACTIONAL_EXPONENT;
+        return false;
     }
 
     // handle zero with negative exponent
-    else if (left_token.value.number == 0 &&
-             right_token.value.number < 0)
+    if (base == 0 && exponent < 0)
     {
         data->status = ZERO_NEGATIVE_EXPONENT;
+        return false;
     }
 
-    else
+    return true;
+}
+
+static void power(TokenList *stack, ParseData *data)
+{
+    Token right_token = tokenlist_pop(stack);
+    Token left_token = tokenlist_pop(stack);
+
+    if (power_defined(left_token.value.number, right_token.value.number, data))
     {
         double res = pow(left_token.value.number, right_token.value.number);
         tokenlist_add(stack, create_number_token(res, 0));
     }
 }
 
+// exponentiation by squaring for the strength reduced power
+static double integer_power(double base, int exponent)
+{
+    unsigned int n = exponent < 0 ? -exponent : exponent;
+    double res = 1;
+
+    while (n > 0)
+    {
+        if (n & 1)
+            res *= base;
+        base *= base;
+        n >>= 1;
+    }
+
+    return exponent < 0 ? 1 / res : res;
+}
+
+// x ^ 0.5, negative x has a fractional exponent
+static void square_root(TokenList *stack, ParseData *data)
+{
+    double operand = tokenlist_pop(stack).value.number;
+
+    if (operand < 0)
+    {
+        data->status = NEGATIVE_FRACTIONAL_EXPONENT;
+    }
+
+    else
+    {
+        double res = sqrt(operand);
+        tokenlist_add(stack, create_number_token(res, 0));
+    }
+}
+
 static void modulo(TokenList *stack)
 {
     Token right_token = tokenlist_pop(stack);
@@ -197,7 +243,10 @@ static void cosine_deg(TokenList *stack)
 static void tangent_deg(TokenList *stack, ParseData *data)
 {
     double operand = tokenlist_pop(stack).value.number;
-    if (fabs(fmod(operand, 180)) == 90)
+
+    // only whole numbers can be an odd multiple of 90,
+    // so the fmod is skipped for everything else
+    if (trunc(operand) == operand && fabs(fmod(operand, 180)) == 90)
     {
         data->status = TANGENT_UNDEFINED;
     }
@@ -319,98 +368,430 @@ static void factorial(TokenList *stack, ParseData *data)
     }
 }
 
-static void process(Token *token, TokenList *stack, ParseData *data)
+// INTEGER OPERATIONS
+// an operand that was promoted, or a result that would not be exact,
+// makes the integer form continue as the double operator it stands for
+
+static void operation(operator_type type, TokenList *stack, ParseData *data);
+
+// comparisons give 1 if they hold and 0 if not
+static void comparison(operator_type type, TokenList *stack)
+{
+    double y = tokenlist_pop(stack).value.number;
+    double *x = &stack->list[stack->count - 1].value.number;
+
+    switch (type)
+    {
+        case LESS: *x = *x < y; break;
+        case LESS_EQUAL: *x = *x <= y; break;
+        case GREATER: *x = *x > y; break;
+        case GREATER_EQUAL: *x = *x >= y; break;
+        case EQUAL: *x = *x == y; break;
+        case NOT_EQUAL: *x = *x != y; break;
+        default: break;
+    }
+}
+
+static void promote(Token *token)
+{
+    if (token->type == INTEGER)
+        *token = create_number_token((double)token->value.integer, token->column);
+}
+
+static operator_type double_form(operator_type type)
+{
+    switch (type)
+    {
+        case IADD: return ADD;
+        case ISUB: return SUB;
+        case IMULT: return MULT;
+        case IDIV: return DIV;
+        case IMOD: return MOD;
+        case IPOW: return POW;
+        case INEG: return NEG;
+        case IABS: return ABS;
+        default: return FAC;
+    }
+}
+
+// base ^ exponent by squaring, false on overflow
+static bool exact_power(long long base, long long exponent, long long *result)
+{
+    long long res = 1;
+    while (exponent > 0)
+    {
+        if ((exponent & 1) && __builtin_mul_overflow(res, base, &res))
+            return false;
+
+        exponent >>= 1;
+        if (exponent > 0 && __builtin_mul_overflow(base, base, &base))
+            return false;
+    }
+
+    *result = res;
+    return true;
+}
+
+static bool exact_binary(operator_type type, long long x, long long y, long long *result)
+{
+    switch (type)
+    {
+        case IADD: return !__builtin_add_overflow(x, y, result);
+        case ISUB: return !__builtin_sub_overflow(x, y, result);
+        case IMULT: return !__builtin_mul_overflow(x, y, result);
+
+        // only quotients without a remainder stay integers,
+        // LLONG_MIN / -1 is the one quotient that overflows
+        case IDIV:
+            if (y == 0 || (y == -1 && x == LLONG_MIN) || x % y != 0)
+                return false;
+            *result = x / y;
+            return true;
+
+        // x % 0 is NAN like fmod, x % -1 is always 0
+        case IMOD:
+            if (y == 0)
+                return false;
+            *result = y == -1 ? 0 : x % y;
+            return true;
+
+        case IPOW:
+            return y >= 0 && exact_power(x, y, result);
+
+        default:
+            return false;
+    }
+}
+
+static void integer_binary(operator_type type, TokenList *stack, ParseData *data)
+{
+    Token *right = &stack->list[stack->count - 1];
+    Token *left = &stack->list[stack->count - 2];
+    long long res;
+
+    if (left->type == INTEGER && right->type == INTEGER &&
+        exact_binary(type, left->value.integer, right->value.integer, &res))
+    {
+        stack->count -= 1;
+        *left = create_integer_token(res, 0);
+        return;
+    }
+
+    promote(left);
+    promote(right);
+    operation(double_form(type), stack, data);
+}
+
+// 20! is the largest factorial that fits
+#define FACTORIAL_MAX 20
+
+static const long long factorials[FACTORIAL_MAX + 1] = {
+    1LL, 1LL, 2LL, 6LL, 24LL, 120LL, 720LL, 5040LL, 40320LL, 362880LL,
+    3628800LL, 39916800LL, 479001600LL, 6227020800LL, 87178291200LL,
+    1307674368000LL, 20922789888000LL, 355687428096000LL,
+    6402373705728000LL, 121645100408832000LL, 2432902008176640000LL
+};
+
+static bool exact_unary(operator_type type, long long x, long long *result)
+{
+    switch (type)
+    {
+        case INEG: return !__builtin_sub_overflow(0, x, result);
+        case IABS: return !__builtin_sub_overflow(0, x < 0 ? x : -x, result);
+
+        // -n! is -(n!) as in factorial
+        case IFAC:
+            if (x < -FACTORIAL_MAX || x > FACTORIAL_MAX)
+                return false;
+            *result = x < 0 ? -factorials[-x] : factorials[x];
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static void integer_unary(operator_type type, TokenList *stack, ParseData *data)
+{
+    Token *operand = &stack->list[stack->count - 1];
+    long long res;
+
+    if (operand->type == INTEGER && exact_unary(type, operand->value.integer, &res))
+    {
+        *operand = create_integer_token(res, 0);
+        return;
+    }
+
+    promote(operand);
+    operation(double_form(type), stack, data);
+}
+
+static void operation(operator_type type, TokenList *stack, ParseData *data)
+{
+    switch (type)
+    {
+        case ADD: addition(stack); break;
+        case SUB: subtraction(stack); break;
+        case MULT: multiplication(stack); break;
+        case DIV: division(stack, data); break;
+        case MOD: modulo(stack); break;
+        case POW: power(stack, data); break;
+        case NEG: negative_inversion(stack); break;
+        case SIN: sine(stack); break;
+        case COS: cosine(stack); break;
+        case TAN: tangent(stack, data); break;
+        case ASIN: arcus_sine(stack, data); break;
+        case ACOS: arcus_cosine(stack, data); break;
+        case ATAN: arcus_tangent(stack); break;
+        case SIND: sine_deg(stack); break;
+        case COSD: cosine_deg(stack); break;
+        case TAND: tangent_deg(stack, data); break;
+        case ASIND: arcus_sine_deg(stack, data); break;
+        case ACOSD: arcus_cosine_deg(stack, data); break;
+        case ATAND: arcus_tangent_deg(stack); break;
+        case LN: log_nat(stack, data); break;
+        case LOG: log_dec(stack, data); break;
+        case ABS: absolute_value(stack); break;
+        case FAC: factorial(stack, data); break;
+        case SQRT: square_root(stack, data); break;
+        case IADD: case ISUB: case IMULT: case IDIV: case IMOD: case IPOW:
+            integer_binary(type, stack, data);
+            break;
+        case INEG: case IABS: case IFAC:
+            integer_unary(type, stack, data);
+            break;
+        case PROMOTE: promote(&stack->list[stack->count - 1]); break;
+        case LESS: case LESS_EQUAL: case GREATER:
+        case GREATER_EQUAL: case EQUAL: case NOT_EQUAL:
+            comparison(type, stack);
+            break;
+        default: break;
+    }
+}
+
+double apply_operator(operator_type type, double x, double y, error_type *status)
+{
+    Token buffer[2];
+    TokenList stack = tokenlist_from_buffer(buffer, 2);
+    ParseData data = init();
+
+    tokenlist_add(&stack, create_number_token(x, 0));
+    if (!isunary(type))
+        tokenlist_add(&stack, create_number_token(y, 0));
+
+    operation(type, &stack, &data);
+    *status = data.status;
+    return data.status == SUCCESS ? stack.list[0].value.number : NAN;
+}
+
+// superinstructions work on the top of the stack in place
+static double *stack_top(TokenList *stack)
+{
+    return &stack->list[stack->count - 1].value.number;
+}
+
+// x y z -> x * y + z and friends, rounded once by fma
+static void fused_multiplication(operator_type type, TokenList *stack)
+{
+    double z = tokenlist_pop(stack).value.number;
+    double y = tokenlist_pop(stack).value.number;
+    double *x = stack_top(stack);
+
+    if (type == MULT_ADD)
+        *x = fma(*x, y, z);
+    else if (type == MULT_SUB)
+        *x = fma(*x, y, -z);
+    else if (type == ADD_MULT)
+        *x = fma(y, z, *x);
+    else if (type == SUB_MULT)
+        *x = fma(-y, z, *x);
+}
+
+// x -> x op k, with k stored in the token after the operator
+static void immediate(const Token *token, TokenList *stack, ParseData *data)
+{
+    double k = token[1].value.number;
+    double *x = stack_top(stack);
+
+    switch (token->value.operator)
+    {
+        case ADD_IMM: *x += k; break;
+        case SUB_IMM: *x -= k; break;
+        case MULT_IMM: *x *= k; break;
+        case DIV_IMM:
+            if (k == 0)
+                data->status = ZERO_DIVISON;
+            else
+                *x /= k;
+            break;
+        case MOD_IMM: *x = fmod(*x, k); break;
+        case POW_IMM:
+            if (power_defined(*x, k, data))
+                *x = pow(*x, k);
+            break;
+        case POW_INT:
+            if (power_defined(*x, k, data))
+                *x = integer_power(*x, (int)k);
+            break;
+        default: break;
+    }
+}
+
+// the arguments of a native call are the top arity values of the stack
+static void native_call(const NativeFunction *native, TokenList *stack)
+{
+    double args[FUNCTION_PARAMETERS_MAX];
+    unsigned int first = stack->count - native->arity;
+    for (unsigned int k = 0; k < native->arity; k++)
+    {
+        promote(&stack->list[first + k]);
+        args[k] = stack->list[first + k].value.number;
+    }
+
+    stack->count = first;
+    tokenlist_add(stack, create_number_token(native->scalar(args), 0));
+}
+
+static void process(const Token *token, TokenList *stack,
+                    const double *variables, ParseData *data)
 {
     // if token is operand, push it to the stack
-    if (token->type == NUMBER)
+    if (token->type == NUMBER || token->type == INTEGER)
     {
         tokenlist_add(stack, *token);
     }
 
+    // variables are looked up in the bound values
+    else if (token->type == VARIABLE)
+    {
+        if (variables == NULL)
+            data->status = UNDEFINED_VARIABLE;
+        else
+            tokenlist_add(stack, create_number_token(
+                        variables[token->value.variable], token->column));
+    }
+
+    else if (token->type == NATIVE)
+    {
+        native_call(token->value.native, stack);
+    }
+
     // if token is operator, perform the corresponding operation on the stack
     else if (token->type == OPERATOR)
     {
-        if (token->value.operator== ADD)
-            addition(stack);
-        else if (token->value.operator== SUB)
-            subtraction(stack);
-        else if (token->value.operator== MULT)
-            multiplication(stack);
-        else if (token->value.operator== DIV)
-            division(stack, data);
-        else if (token->value.operator== MOD)
-            modulo(stack);
-        else if (token->value.operator== POW)
-            power(stack, data);
-        else if (token->value.operator== NEG)
-            negative_inversion(stack);
-        else if (token->value.operator== SIN)
-            sine(stack);
-        else if (token->value.operator== COS)
-            cosine(stack);
-        else if (token->value.operator== TAN)
-            tangent(stack, data);
-        else if (token->value.operator== ASIN)
-            arcus_sine(stack, data);
-        else if (token->value.operator== ACOS)
-            arcus_cosine(stack, data);
-        else if (token->value.operator== ATAN)
-            arcus_tangent(stack);
-        else if (token->value.operator== SIND)
-            sine_deg(stack);
-        else if (token->value.operator== COSD)
-            cosine_deg(stack);
-        else if (token->value.operator== TAND)
-            tangent_deg(stack, data);
-        else if (token->value.operator== ASIND)
-            arcus_sine_deg(stack, data);
-        else if (token->value.operator== ACOSD)
-            arcus_cosine_deg(stack, data);
-        else if (token->value.operator== ATAND)
-            arcus_tangent_deg(stack);
-        else if (token->value.operator== LN)
-            log_nat(stack, data);
-        else if (token->value.operator== LOG)
-            log_dec(stack, data);
-        else if (token->value.operator== ABS)
-            absolute_value(stack);
-        else if (token->value.operator== FAC)
-            factorial(stack, data);
+        switch (token->value.operator)
+        {
+            case MULT_ADD: case MULT_SUB: case ADD_MULT: case SUB_MULT:
+                fused_multiplication(token->value.operator, stack);
+                break;
+
+            case ADD_IMM: case SUB_IMM: case MULT_IMM:
+            case DIV_IMM: case MOD_IMM: case POW_IMM: case POW_INT:
+                immediate(token, stack, data);
+                break;
+
+            // temporaries live at the bottom of the stack
+            case RESERVE:
+                for (unsigned int i = 0; i < (unsigned int)token[1].value.number; i++)
+                    tokenlist_add(stack, create_number_token(0, 0));
+                break;
+
+            case STORE:
+                stack->list[(unsigned int)token[1].value.number] = stack->list[stack->count - 1];
+                break;
+
+            case LOAD:
+                tokenlist_add(stack, stack->list[(unsigned int)token[1].value.number]);
+                break;
+
+            case NEG_CALL:
+                *stack_top(stack) *= -1;
+                operation(token[1].value.operator, stack, data);
+                break;
+
+            case CALL_NEG:
+                operation(token[1].value.operator, stack, data);
+                if (data->status == SUCCESS)
+                    *stack_top(stack) *= -1;
+                break;
+
+            default:
+                operation(token->value.operator, stack, data);
+                break;
+        }
     }
 }
 
-ResultInfo parse(const char *input_string, Token *result)
+// JUMP_FALSE takes its condition off the stack, any value but 0 holds
+static bool jump_taken(const Token *token, TokenList *stack)
+{
+    if (token->value.operator == JUMP)
+        return true;
+
+    return tokenlist_pop(stack).value.number == 0;
+}
+
+static bool isjump(const Token *token)
+{
+    return token->type == OPERATOR &&
+           (token->value.operator == JUMP_FALSE || token->value.operator == JUMP);
+}
+
+// evaluate using a caller provided stack
+// run program, leaving the values it computes on stack
+static ResultInfo run_program(const TokenList program, const double *variables, TokenList *stack)
 {
     ResultInfo res;
     ParseData data = init();
-    TokenList buffer = new_tokenlist();
 
-    res = convert(input_string, &buffer);
-    if (res.status != SUCCESS)
+    clear_tokenlist(stack);
+    for (unsigned int i = 0; i < program.count; i++)
     {
-        delete_tokenlist(buffer);
-        return res;
-    }
+        // only the branch taken runs, the other one is jumped over
+        if (isjump(&program.list[i]))
+        {
+            if (jump_taken(&program.list[i], stack))
+                i = (unsigned int)program.list[i + 1].value.number - 1;
+            else
+                i++;
+            continue;
+        }
 
-    TokenList stack = new_tokenlist();
-    for (unsigned int i = 0; i < buffer.count; i++)
-    {
-        process(&buffer.list[i], &stack, &data);
+        process(&program.list[i], stack, variables, &data);
+
+        if (stack->overflow)
+            data.status = CAPACITY_EXCEEDED;
 
         if (data.status != SUCCESS)
         {
             res.status = data.status;
-            res.error_index = buffer.list[i].column;
-
-            delete_tokenlist(buffer);
-            delete_tokenlist(stack);
+            res.error_index = program.list[i].column;
             return res;
         }
+
+        // skip the immediate operand of a fused operator
+        if (program.list[i].type == OPERATOR && hasimmediate(program.list[i].value.operator))
+            i++;
     }
 
-    if (stack.count > 0)
+    res.status = SUCCESS;
+    res.error_index = 0;
+    return res;
+}
+
+// an exact evaluation leaves an INTEGER result as it is
+static ResultInfo evaluate_exact_stack(const TokenList program, const double *variables,
+                                       Token *result, TokenList *stack, bool exact)
+{
+    ResultInfo res = run_program(program, variables, stack);
+    if (res.status != SUCCESS)
+        return res;
+
+    if (stack->count > 0)
     {
-        *result = tokenlist_pop(&stack);
+        *result = tokenlist_pop(stack);
+        if (!exact)
+            promote(result);
     }
 
     else
@@ -418,10 +799,356 @@ ResultInfo parse(const char *input_string, Token *result)
         *result = create_number_token(0, 0);
     }
 
+    return res;
+}
+
+static ResultInfo evaluate_stack(const TokenList program, const double *variables,
+                                 Token *result, TokenList *stack)
+{
+    return evaluate_exact_stack(program, variables, result, stack, false);
+}
+
+// the length is only measured while a tracer is attached
+#define PARSE_PROBE(name, input_string, count, status, index) \
+    PARSER_PROBE(name, PARSER_PROBE_ENABLED(name) ? strlen(input_string) : 0, \
+                 count, status, index)
+
+ResultInfo parse(const char *input_string, Token *result)
+{
+    ResultInfo res;
+    TokenList buffer = new_tokenlist();
+    PARSE_PROBE(parse_entry, input_string, 0, SUCCESS, 0);
+
+    res = convert(input_string, &buffer);
+    if (res.status == SUCCESS)
+    {
+        res = evaluate(buffer, NULL, result);
+    }
+
+    PARSE_PROBE(parse_return, input_string, buffer.count, res.status, res.error_index);
     delete_tokenlist(buffer);
+    return res;
+}
+
+ResultInfo parse_exact(const char *input_string, Token *result)
+{
+    ResultInfo res;
+    TokenList buffer = new_tokenlist();
+    PARSE_PROBE(parse_entry, input_string, 0, SUCCESS, 0);
+
+    res = convert(input_string, &buffer);
+    if (res.status == SUCCESS)
+    {
+        optimize(&buffer, OPTIMIZE_INTEGER);
+        res = evaluate_exact(buffer, NULL, result);
+    }
+
+    PARSE_PROBE(parse_return, input_string, buffer.count, res.status, res.error_index);
+    delete_tokenlist(buffer);
+    return res;
+}
+
+ResultInfo evaluate(const TokenList program, const double *variables, Token *result)
+{
+    TokenList stack = new_tokenlist();
+    ResultInfo res = evaluate_stack(program, variables, result, &stack);
     delete_tokenlist(stack);
 
-    res.status = SUCCESS;
-    res.error_index = 0;
+    return res;
+}
+
+ResultInfo evaluate_exact(const TokenList program, const double *variables, Token *result)
+{
+    TokenList stack = new_tokenlist();
+    ResultInfo res = evaluate_exact_stack(program, variables, result, &stack, true);
+    delete_tokenlist(stack);
+
+    return res;
+}
+
+// parse context functions
+ParseContext new_parse_context(void)
+{
+    ParseContext obj;
+    obj.tokens = new_tokenlist();
+    obj.stack = new_tokenlist();
+    obj.program = new_tokenlist();
+    obj.optimize = 0;
+
+    return obj;
+}
+
+ParseContext bounded_parse_context(Token *tokens, unsigned int token_capacity,
+                                   Token *stack, unsigned int stack_capacity,
+                                   Token *program, unsigned int program_capacity)
+{
+    ParseContext obj;
+    obj.tokens = tokenlist_from_buffer(tokens, token_capacity);
+    obj.stack = tokenlist_from_buffer(stack, stack_capacity);
+    obj.program = tokenlist_from_buffer(program, program_capacity);
+    obj.optimize = 0;
+
+    return obj;
+}
+
+void delete_parse_context(ParseContext context)
+{
+    delete_tokenlist(context.tokens);
+    delete_tokenlist(context.stack);
+    delete_tokenlist(context.program);
+}
+
+ResultInfo evaluate_context(ParseContext *context, const TokenList program,
+                            const double *variables, Token *result)
+{
+    return evaluate_stack(program, variables, result, &context->stack);
+}
+
+ResultInfo evaluate_outputs(ParseContext *context, const TokenList program,
+                            const double *variables, double *outputs, unsigned int output_count)
+{
+    ResultInfo res = run_program(program, variables, &context->stack);
+    if (res.status != SUCCESS)
+        return res;
+
+    // temporaries sit below the outputs
+    unsigned int first = context->stack.count - output_count;
+    for (unsigned int i = 0; i < output_count; i++)
+    {
+        promote(&context->stack.list[first + i]);
+        outputs[i] = context->stack.list[first + i].value.number;
+    }
+
+    return res;
+}
+
+// batch context functions
+BatchContext new_batch_context(void)
+{
+    BatchContext obj;
+    obj.stacks = (TokenList *)malloc(BATCH_ROWS * sizeof(TokenList));
+    obj.rows = (unsigned int *)malloc(BATCH_ROWS * sizeof(unsigned int));
+    obj.status = (error_type *)malloc(BATCH_ROWS * sizeof(error_type));
+    obj.arguments = (double *)malloc(FUNCTION_PARAMETERS_MAX * BATCH_ROWS * sizeof(double));
+    obj.values = (double *)malloc(BATCH_ROWS * sizeof(double));
+
+    if (obj.stacks == NULL || obj.rows == NULL || obj.status == NULL ||
+        obj.arguments == NULL || obj.values == NULL) exit(1);
+
+    for (unsigned int i = 0; i < BATCH_ROWS; i++)
+        obj.stacks[i] = new_tokenlist();
+
+    return obj;
+}
+
+void delete_batch_context(BatchContext batch)
+{
+    for (unsigned int i = 0; i < BATCH_ROWS; i++)
+        delete_tokenlist(batch.stacks[i]);
+
+    free(batch.stacks);
+    free(batch.rows);
+    free(batch.status);
+    free(batch.arguments);
+    free(batch.values);
+}
+
+// one block of a batch evaluation
+typedef struct
+{
+    BatchContext *batch;
+    const TokenList *program;
+    const double *variables;
+    unsigned int stride;
+} BatchRun;
+
+// call the vector form of a native once for the active rows,
+// argument k of the i-th row is at arguments[k * BATCH_ROWS + i]
+static void native_rows(const BatchRun *run, const NativeFunction *native,
+                        const unsigned int *rows, unsigned int active)
+{
+    TokenList *stacks = run->batch->stacks;
+    double *arguments = run->batch->arguments;
+    const double *args[FUNCTION_PARAMETERS_MAX];
+
+    for (unsigned int k = 0; k < native->arity; k++)
+        args[k] = arguments + k * BATCH_ROWS;
+
+    for (unsigned int i = 0; i < active; i++)
+    {
+        TokenList *stack = &stacks[rows[i]];
+        unsigned int first = stack->count - native->arity;
+        for (unsigned int k = 0; k < native->arity; k++)
+        {
+            promote(&stack->list[first + k]);
+            arguments[k * BATCH_ROWS + i] = stack->list[first + k].value.number;
+        }
+        stack->count = first;
+    }
+
+    native->vector(args, run->batch->values, active);
+
+    for (unsigned int i = 0; i < active; i++)
+        tokenlist_add(&stacks[rows[i]], create_number_token(run->batch->values[i], 0));
+}
+
+// run program tokens begin to end over the rows listed in rows,
+// each token is applied to every row before the next one
+//
+// at a conditional the rows are partitioned by their condition,
+// then each branch runs over its own part only
+// returns the number of rows still running, moved to the front of rows
+static unsigned int run_rows(const BatchRun *run, unsigned int begin, unsigned int end,
+                             unsigned int *rows, unsigned int active)
+{
+    const Token *list = run->program->list;
+    TokenList *stacks = run->batch->stacks;
+
+    unsigned int i = begin;
+    while (i < end && active > 0)
+    {
+        const Token *token = &list[i];
+
+        // c JUMP_FALSE [else] a JUMP [join] b
+        if (isjump(token))
+        {
+            unsigned int target = (unsigned int)token[1].value.number;
+            if (token->value.operator == JUMP)
+            {
+                i = target;
+                continue;
+            }
+
+            // rows whose condition holds go to the front
+            unsigned int taken = 0;
+            for (unsigned int k = 0; k < active; k++)
+            {
+                unsigned int row = rows[k];
+                if (!jump_taken(token, &stacks[row]))
+                {
+                    rows[k] = rows[taken];
+                    rows[taken] = row;
+                    taken++;
+                }
+            }
+
+            unsigned int join = (unsigned int)list[target - 1].value.number;
+            unsigned int then_active = run_rows(run, i + 2, target - 2, rows, taken);
+            unsigned int else_active = run_rows(run, target, join,
+                                                rows + taken, active - taken);
+
+            memmove(rows + then_active, rows + taken, else_active * sizeof(unsigned int));
+            active = then_active + else_active;
+            i = join;
+            continue;
+        }
+
+        if (token->type == NATIVE && token->value.native->vector != NULL)
+        {
+            native_rows(run, token->value.native, rows, active);
+            i++;
+            continue;
+        }
+
+        unsigned int write = 0;
+        for (unsigned int k = 0; k < active; k++)
+        {
+            unsigned int row = rows[k];
+            const double *variables = run->variables == NULL ? NULL :
+                                      run->variables + (unsigned long long)row * run->stride;
+            ParseData data = init();
+
+            process(token, &stacks[row], variables, &data);
+            if (stacks[row].overflow)
+                data.status = CAPACITY_EXCEEDED;
+
+            if (data.status != SUCCESS)
+                run->batch->status[row] = data.status;
+            else
+                rows[write++] = row;
+        }
+
+        active = write;
+        i += token->type == OPERATOR && hasimmediate(token->value.operator) ? 2 : 1;
+    }
+
+    return active;
+}
+
+unsigned long long evaluate_batch(BatchContext *batch, const TokenList program,
+                                  const double *variables, unsigned int stride,
+                                  unsigned long long row_count,
+                                  double *results, error_type *errors)
+{
+    unsigned long long failed = 0;
+
+    for (unsigned long long block = 0; block < row_count; block += BATCH_ROWS)
+    {
+        unsigned int count = row_count - block < BATCH_ROWS ? row_count - block : BATCH_ROWS;
+        BatchRun run;
+        run.batch = batch;
+        run.program = &program;
+        run.variables = variables == NULL ? NULL : variables + block * stride;
+        run.stride = stride;
+
+        for (unsigned int row = 0; row < count; row++)
+        {
+            clear_tokenlist(&batch->stacks[row]);
+            batch->rows[row] = row;
+            batch->status[row] = SUCCESS;
+        }
+
+        PARSER_PROBE(batch_chunk_entry, count, program.count, SUCCESS, 0);
+        run_rows(&run, 0, program.count, batch->rows, count);
+
+        // the first failed row of the chunk is reported to tracers
+        ResultInfo chunk;
+        chunk.status = SUCCESS;
+        chunk.error_index = 0;
+        for (unsigned int row = 0; row < count; row++)
+        {
+            TokenList *stack = &batch->stacks[row];
+            errors[block + row] = batch->status[row];
+
+            if (batch->status[row] != SUCCESS)
+            {
+                results[block + row] = NAN;
+                failed += 1;
+
+                if (chunk.status == SUCCESS)
+                {
+                    chunk.status = batch->status[row];
+                    chunk.error_index = block + row;
+                }
+            }
+
+            else if (stack->count > 0)
+            {
+                promote(&stack->list[stack->count - 1]);
+                results[block + row] = stack->list[stack->count - 1].value.number;
+            }
+
+            else
+            {
+                results[block + row] = 0;
+            }
+        }
+
+        PARSER_PROBE(batch_chunk_return, count, program.count, chunk.status, chunk.error_index);
+    }
+
+    return failed;
+}
+
+ResultInfo parse_context(ParseContext *context, const char *input_string, Token *result)
+{
+    PARSE_PROBE(parse_entry, input_string, 0, SUCCESS, 0);
+
+    ResultInfo res = convert_context(context, input_string, NULL);
+    if (res.status == SUCCESS)
+        res = evaluate_stack(context->program, NULL, result, &context->stack);
+
+    PARSE_PROBE(parse_return, input_string, context->program.count,
+                res.status, res.error_index);
     return res;
 }
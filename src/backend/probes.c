@@ -0,0 +1,18 @@
+// project includes
+#include "probes.h"
+
+// the semaphores of the probes, in the section tracers look for them,
+// only built with PARSER_PROBES
+#define SEMAPHORE(name) \
+    unsigned short parser_##name##_semaphore __attribute__((unused, section(".probes")))
+
+SEMAPHORE(lex_entry);
+SEMAPHORE(lex_return);
+SEMAPHORE(syntax_check_entry);
+SEMAPHORE(syntax_check_return);
+SEMAPHORE(convert_entry);
+SEMAPHORE(convert_return);
+SEMAPHORE(parse_entry);
+SEMAPHORE(parse_return);
+SEMAPHORE(batch_chunk_entry);
+SEMAPHORE(batch_chunk_return);
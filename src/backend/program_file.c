@@ -0,0 +1,533 @@
+// standard library includes
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// project includes
+#include "token.h"
+#include "nametable.h"
+#include "parser.h"
+#include "program_file.h"
+
+// token records are stored as they are laid out in memory
+_Static_assert(sizeof(Token) == 16, "Token records are 16 bytes");
+_Static_assert(offsetof(Token, value) == 8, "Token value follows type and column");
+_Static_assert(sizeof(ProgramFileHeader) == 64, "header is 64 bytes");
+_Static_assert(sizeof(ProgramFileEntry) % 8 == 0, "entries keep tokens aligned");
+
+// growable byte buffer for building images
+typedef struct
+{
+    unsigned char *data;
+    size_t len;
+    size_t max;
+} ImageBuffer;
+
+static void image_append(ImageBuffer *self, const void *src, size_t n)
+{
+    if (self->len + n > self->max)
+    {
+        size_t max = self->max == 0 ? 4096 : self->max;
+        while (max < self->len + n)
+            max *= 2;
+
+        self->data = (unsigned char *)realloc(self->data, max);
+        if (self->data == NULL) exit(1);
+        self->max = max;
+    }
+
+    memcpy(self->data + self->len, src, n);
+    self->len += n;
+}
+
+// FNV-1a over 64 bit words, then over the remaining bytes
+static uint64_t hash_bytes(const void *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t h = 14695981039346656037ull;
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 1099511628211ull;
+    }
+
+    for (; i < len; i++)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+
+    return h;
+}
+
+// copy only the meaningful part of a token, so records hash the same
+// regardless of what the unused bytes of the value held
+static Token token_record(Token token)
+{
+    Token record;
+    memset(&record, 0, sizeof(Token));
+    record.type = token.type;
+    record.column = token.column;
+
+    if (token.type == NUMBER)
+        record.value.number = token.value.number;
+    else if (token.type == OPERATOR)
+        record.value.operator = token.value.operator;
+    else if (token.type == PARENTHESIS)
+        record.value.parenthesis = token.value.parenthesis;
+    else if (token.type == VARIABLE)
+        record.value.variable = token.value.variable;
+    else if (token.type == INTEGER)
+        record.value.integer = token.value.integer;
+
+    return record;
+}
+
+static void clear_set(ProgramSet *set)
+{
+    set->image = NULL;
+    set->size = 0;
+    set->mapped = false;
+    set->header = NULL;
+    set->entries = NULL;
+    set->variables = NULL;
+    set->tokens = NULL;
+    set->strings = NULL;
+    set->names = new_nametable();
+}
+
+// set up the views, the image is assumed to be valid
+static void attach_image(ProgramSet *set, unsigned char *image, size_t size, bool mapped)
+{
+    set->image = image;
+    set->size = size;
+    set->mapped = mapped;
+
+    const ProgramFileHeader *header = (const ProgramFileHeader *)image;
+    size_t offset = sizeof(ProgramFileHeader);
+
+    set->header = header;
+    set->entries = (const ProgramFileEntry *)(image + offset);
+    offset += header->program_count * sizeof(ProgramFileEntry);
+    set->variables = (const ProgramFileString *)(image + offset);
+    offset += header->variable_count * sizeof(ProgramFileString);
+    set->tokens = (const Token *)(image + offset);
+    offset += (size_t)header->token_count * sizeof(Token);
+    set->strings = (const char *)(image + offset);
+
+    // restore variable indices
+    for (unsigned int i = 0; i < header->variable_count; i++)
+        nametable_add(&set->names, set->strings + set->variables[i].offset,
+                      set->variables[i].length);
+}
+
+program_set_origin program_set_compile(ProgramSet *set, const char **sources, unsigned int count)
+{
+    clear_set(set);
+
+    ParseContext context = new_parse_context();
+    ProgramFileEntry *entries = (ProgramFileEntry *)calloc(count + 1, sizeof(ProgramFileEntry));
+    ImageBuffer tokens = { NULL, 0, 0 };
+    ImageBuffer strings = { NULL, 0, 0 };
+    if (entries == NULL) exit(1);
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        size_t length = strlen(sources[i]);
+        ResultInfo res = convert_context(&context, sources[i], &set->names);
+
+        entries[i].token_offset = tokens.len / sizeof(Token);
+        entries[i].source_offset = strings.len;
+        entries[i].source_length = length;
+        entries[i].status = res.status;
+        entries[i].error_index = res.error_index;
+        entries[i].source_hash = hash_bytes(sources[i], length);
+
+        if (res.status == SUCCESS)
+        {
+            entries[i].token_count = context.program.count;
+            for (unsigned int j = 0; j < context.program.count; j++)
+            {
+                Token record = token_record(context.program.list[j]);
+                image_append(&tokens, &record, sizeof(Token));
+            }
+        }
+
+        image_append(&strings, sources[i], length + 1);
+    }
+
+    ProgramFileString *variables = (ProgramFileString *)calloc(
+            set->names.count + 1, sizeof(ProgramFileString));
+    if (variables == NULL) exit(1);
+
+    for (unsigned int i = 0; i < set->names.count; i++)
+    {
+        const char *name = nametable_name(&set->names, i);
+        variables[i].offset = strings.len;
+        variables[i].length = strlen(name);
+        image_append(&strings, name, variables[i].length + 1);
+    }
+
+    // assemble the image
+    ProgramFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROGRAM_FILE_MAGIC, sizeof(PROGRAM_FILE_MAGIC));
+    header.version = PROGRAM_FILE_VERSION;
+    header.byte_order = PROGRAM_FILE_BYTE_ORDER;
+    header.token_size = sizeof(Token);
+    header.program_count = count;
+    header.variable_count = set->names.count;
+    header.token_count = tokens.len / sizeof(Token);
+    header.strings_size = strings.len;
+
+    ImageBuffer image = { NULL, 0, 0 };
+    image_append(&image, &header, sizeof(header));
+    image_append(&image, entries, count * sizeof(ProgramFileEntry));
+    image_append(&image, variables, set->names.count * sizeof(ProgramFileString));
+    image_append(&image, tokens.data, tokens.len);
+    image_append(&image, strings.data, strings.len);
+
+    ProgramFileHeader *image_header = (ProgramFileHeader *)image.data;
+    image_header->image_size = image.len;
+    image_header->checksum = hash_bytes(image.data + sizeof(header),
+                                        image.len - sizeof(header));
+
+    free(entries);
+    free(variables);
+    free(tokens.data);
+    free(strings.data);
+    delete_parse_context(context);
+
+    // names were interned in index order while compiling,
+    // so attaching finds every one of them already present
+    attach_image(set, image.data, image.len, false);
+
+    return PROGRAM_SET_COMPILED;
+}
+
+bool program_set_save(const ProgramSet *set, const char *path)
+{
+    // write next to the target and rename over it,
+    // so readers never map a half written file
+    size_t tmp_len = strlen(path) + 8;
+    char *tmp_path = (char *)malloc(tmp_len);
+    if (tmp_path == NULL) exit(1);
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    bool saved = file != NULL &&
+                 fwrite(set->image, 1, set->size, file) == set->size;
+
+    if (file != NULL && fclose(file) != 0)
+        saved = false;
+
+    if (saved)
+        saved = rename(tmp_path, path) == 0;
+    else
+        remove(tmp_path);
+
+    free(tmp_path);
+    return saved;
+}
+
+// operators a postfix program may hold
+static bool postfix_operator(operator_type type)
+{
+    return (type >= ADD && type <= PROMOTE) || iscomparison(type) ||
+           type == JUMP_FALSE || type == JUMP;
+}
+
+// an immediate that counts, indexes or jumps, a whole number up to max
+static bool whole_immediate(const Token *token, double max)
+{
+    return token->type == NUMBER && token->value.number >= 0 &&
+           token->value.number <= max && floor(token->value.number) == token->value.number;
+}
+
+// stack depth where a jump lands, every jump to one place must agree
+static bool land(long long *landing, unsigned int target, long long depth)
+{
+    if (landing[target] >= 0 && landing[target] != depth)
+        return false;
+
+    landing[target] = depth;
+    return true;
+}
+
+// a program read from a file is run as it is, so it must only hold
+// what the evaluators rely on: known tokens, variables the set names,
+// immediates of the right kind, conditionals laid out as
+// c JUMP_FALSE [other] a JUMP [after] b, and a stack that never runs short
+static bool program_valid(const Token *tokens, unsigned int count, unsigned int variable_count)
+{
+    // -1 where no jump lands
+    long long *landing = (long long *)malloc((count + 1) * sizeof(long long));
+    if (landing == NULL) exit(1);
+    for (unsigned int i = 0; i <= count; i++)
+        landing[i] = -1;
+
+    long long depth = 0;
+    bool reachable = true;
+    bool valid = true;
+
+    for (unsigned int i = 0; valid && i <= count; i++)
+    {
+        if (landing[i] >= 0)
+        {
+            valid = !reachable || depth == landing[i];
+            depth = landing[i];
+            reachable = true;
+        }
+
+        // after a JUMP only a jump leads on
+        if (!valid || !reachable || i == count)
+        {
+            valid = valid && reachable;
+            break;
+        }
+
+        const Token *token = &tokens[i];
+        if (token->type == NUMBER || token->type == INTEGER || token->type == VARIABLE)
+        {
+            valid = token->type != VARIABLE || token->value.variable < variable_count;
+            depth++;
+            continue;
+        }
+
+        operator_type type = token->value.operator;
+        if (token->type != OPERATOR || !postfix_operator(type) ||
+            (hasimmediate(type) && (i + 1 == count || landing[i + 1] >= 0)))
+        {
+            valid = false;
+            break;
+        }
+
+        // the token after an operator is only read as its immediate
+        const Token *operand = &token[1];
+        unsigned int target = hasimmediate(type) && whole_immediate(operand, count) ?
+                              (unsigned int)operand->value.number : 0;
+        switch (type)
+        {
+            case RESERVE:
+                valid = whole_immediate(operand, count);
+                depth += valid ? target : 0;
+                break;
+
+            case STORE:
+                valid = depth > 0 && whole_immediate(operand, depth - 1);
+                break;
+
+            case LOAD:
+                valid = depth > 0 && whole_immediate(operand, depth - 1);
+                depth++;
+                break;
+
+            case NEG_CALL: case CALL_NEG:
+                valid = depth > 0 && operand->type == OPERATOR &&
+                        postfix_operator(operand->value.operator) && isunary(operand->value.operator);
+                break;
+
+            // the JUMP that ends the branch taken comes right before other
+            case JUMP_FALSE:
+                valid = depth > 0 && whole_immediate(operand, count) && target >= i + 4 &&
+                        tokens[target - 2].type == OPERATOR && tokens[target - 2].value.operator == JUMP;
+                depth--;
+                valid = valid && land(landing, target, depth);
+                break;
+
+            case JUMP:
+                valid = depth > 0 && whole_immediate(operand, count) && target >= i + 2 &&
+                        land(landing, target, depth);
+                reachable = false;
+                break;
+
+            default:
+                valid = (!hasimmediate(type) || operand->type == NUMBER) &&
+                        depth >= operator_arity(type);
+                depth -= operator_arity(type) - 1;
+                break;
+        }
+
+        if (hasimmediate(type))
+            i++;
+    }
+
+    free(landing);
+    return valid && (count == 0 || depth > 0);
+}
+
+// check everything the views rely on
+static bool image_valid(const unsigned char *image, size_t size)
+{
+    if (size < sizeof(ProgramFileHeader))
+        return false;
+
+    const ProgramFileHeader *header = (const ProgramFileHeader *)image;
+    if (memcmp(header->magic, PROGRAM_FILE_MAGIC, sizeof(PROGRAM_FILE_MAGIC)) != 0 ||
+        header->version != PROGRAM_FILE_VERSION ||
+        header->byte_order != PROGRAM_FILE_BYTE_ORDER ||
+        header->token_size != sizeof(Token) ||
+        header->image_size != size)
+    {
+        return false;
+    }
+
+    uint64_t expected = sizeof(ProgramFileHeader) +
+                        (uint64_t)header->program_count * sizeof(ProgramFileEntry) +
+                        (uint64_t)header->variable_count * sizeof(ProgramFileString) +
+                        (uint64_t)header->token_count * sizeof(Token) +
+                        header->strings_size;
+    if (expected != size)
+        return false;
+
+    if (hash_bytes(image + sizeof(ProgramFileHeader),
+                   size - sizeof(ProgramFileHeader)) != header->checksum)
+        return false;
+
+    // offsets must stay inside their sections
+    const ProgramFileEntry *entries =
+        (const ProgramFileEntry *)(image + sizeof(ProgramFileHeader));
+    for (unsigned int i = 0; i < header->program_count; i++)
+    {
+        if ((uint64_t)entries[i].token_offset + entries[i].token_count > header->token_count ||
+            (uint64_t)entries[i].source_offset + entries[i].source_length >= header->strings_size)
+            return false;
+    }
+
+    const ProgramFileString *variables =
+        (const ProgramFileString *)(entries + header->program_count);
+    for (unsigned int i = 0; i < header->variable_count; i++)
+    {
+        if ((uint64_t)variables[i].offset + variables[i].length >= header->strings_size)
+            return false;
+    }
+
+    const Token *tokens = (const Token *)(variables + header->variable_count);
+    for (unsigned int i = 0; i < header->program_count; i++)
+    {
+        if (!program_valid(tokens + entries[i].token_offset, entries[i].token_count,
+                           header->variable_count))
+            return false;
+    }
+
+    return true;
+}
+
+// the file must have been built from exactly these sources
+static bool sources_match(const ProgramSet *set, const char **sources, unsigned int count)
+{
+    if (set->header->program_count != count)
+        return false;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        size_t length = strlen(sources[i]);
+        if (set->entries[i].source_length != length ||
+            set->entries[i].source_hash != hash_bytes(sources[i], length))
+            return false;
+    }
+
+    return true;
+}
+
+static bool map_file(ProgramSet *set, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        return false;
+
+    if (!image_valid((const unsigned char *)image, st.st_size))
+    {
+        munmap(image, st.st_size);
+        return false;
+    }
+
+    attach_image(set, (unsigned char *)image, st.st_size, true);
+    return true;
+}
+
+program_set_origin program_set_load(ProgramSet *set, const char *path,
+                                    const char **sources, unsigned int count)
+{
+    clear_set(set);
+
+    if (map_file(set, path))
+    {
+        if (sources == NULL || sources_match(set, sources, count))
+            return PROGRAM_SET_MAPPED;
+
+        delete_program_set(set);
+    }
+
+    else
+    {
+        delete_nametable(set->names);
+    }
+
+    if (sources == NULL)
+    {
+        clear_set(set);
+        return PROGRAM_SET_FAILED;
+    }
+
+    program_set_compile(set, sources, count);
+    program_set_save(set, path);
+    return PROGRAM_SET_RECOMPILED;
+}
+
+void delete_program_set(ProgramSet *set)
+{
+    if (set->mapped)
+        munmap(set->image, set->size);
+    else
+        free(set->image);
+
+    delete_nametable(set->names);
+    set->image = NULL;
+    set->size = 0;
+}
+
+unsigned int program_set_count(const ProgramSet *set)
+{
+    return set->header != NULL ? set->header->program_count : 0;
+}
+
+ResultInfo program_set_status(const ProgramSet *set, unsigned int index)
+{
+    ResultInfo res;
+    res.status = (error_type)set->entries[index].status;
+    res.error_index = set->entries[index].error_index;
+    return res;
+}
+
+TokenList program_set_program(const ProgramSet *set, unsigned int index)
+{
+    // a list view of the records, max equals count so it never grows
+    TokenList view;
+    view.count = set->entries[index].token_count;
+    view.max = view.count;
+    view.list = (Token *)(set->tokens + set->entries[index].token_offset);
+    view.fixed = true;
+    view.overflow = false;
+    return view;
+}
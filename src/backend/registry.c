@@ -0,0 +1,409 @@
+// standard library includes
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "optimize.h"
+#include "registry.h"
+
+#define CACHE_LINE 64
+
+// a compiled formula, never changed once published
+typedef struct
+{
+    unsigned long long number;
+    TokenList program;
+} RegistryVersion;
+
+// the current version of one name, an entry lives as long as the registry
+// so its address stays valid in every index
+typedef struct
+{
+    _Atomic(RegistryVersion *) current;
+} RegistryEntry;
+
+// names and their entries, never changed once published,
+// adding a name publishes a copy with the name added
+typedef struct
+{
+    NameTable names;
+    RegistryEntry **entries;
+} RegistryIndex;
+
+// a version or index replaced at epoch, freed once no reader is older
+typedef struct Retired
+{
+    RegistryVersion *version;
+    RegistryIndex *index;
+    unsigned long long epoch;
+    struct Retired *next;
+} Retired;
+
+// the epoch a reader entered at, 0 while it is outside a read,
+// each reader on its own cache line
+typedef struct
+{
+    _Alignas(CACHE_LINE) atomic_ullong epoch;
+    atomic_bool open;
+} ReaderSlot;
+
+struct RegistryState
+{
+    ReaderSlot readers[REGISTRY_READERS_MAX];
+
+    // readers load both on every read, writers change them rarely
+    _Alignas(CACHE_LINE) atomic_ullong epoch;
+    _Atomic(RegistryIndex *) index;
+
+    // everything below is only touched by writers, under lock
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    NameTable variables;
+    unsigned int optimize;
+    unsigned long long version_count;
+    Retired *retired;
+    unsigned int retired_count;
+};
+
+static NameTable copy_names(const NameTable *names)
+{
+    NameTable copy = new_nametable();
+    for (unsigned int i = 0; i < names->count; i++)
+        nametable_add(&copy, names->list[i], strlen(names->list[i]));
+
+    return copy;
+}
+
+static void delete_version(RegistryVersion *version)
+{
+    delete_tokenlist(version->program);
+    free(version);
+}
+
+static void delete_index(RegistryIndex *index)
+{
+    delete_nametable(index->names);
+    free(index->entries);
+    free(index);
+}
+
+FormulaRegistry new_formula_registry(const NameTable *variables, unsigned int optimize)
+{
+    RegistryState *state = (RegistryState *)aligned_alloc(CACHE_LINE, sizeof(RegistryState));
+    RegistryIndex *index = (RegistryIndex *)malloc(sizeof(RegistryIndex));
+    if (state == NULL || index == NULL) exit(1);
+
+    for (unsigned int i = 0; i < REGISTRY_READERS_MAX; i++)
+    {
+        atomic_init(&state->readers[i].epoch, 0);
+        atomic_init(&state->readers[i].open, false);
+    }
+
+    index->names = new_nametable();
+    index->entries = NULL;
+
+    // epoch 0 marks a reader outside of a read
+    atomic_init(&state->epoch, 1);
+    atomic_init(&state->index, index);
+
+    pthread_mutex_init(&state->lock, NULL);
+    state->variables = copy_names(variables);
+    state->optimize = optimize;
+    state->version_count = 0;
+    state->retired = NULL;
+    state->retired_count = 0;
+
+    FormulaRegistry obj;
+    obj.state = state;
+    return obj;
+}
+
+void delete_formula_registry(FormulaRegistry *registry)
+{
+    RegistryState *state = registry->state;
+    RegistryIndex *index = atomic_load(&state->index);
+
+    for (unsigned int i = 0; i < index->names.count; i++)
+    {
+        RegistryVersion *version = atomic_load(&index->entries[i]->current);
+        if (version != NULL)
+            delete_version(version);
+        free(index->entries[i]);
+    }
+    delete_index(index);
+
+    while (state->retired != NULL)
+    {
+        Retired *next = state->retired->next;
+        if (state->retired->version != NULL)
+            delete_version(state->retired->version);
+        if (state->retired->index != NULL)
+            delete_index(state->retired->index);
+        free(state->retired);
+        state->retired = next;
+    }
+
+    pthread_mutex_destroy(&state->lock);
+    delete_nametable(state->variables);
+    free(state);
+    registry->state = NULL;
+}
+
+// WRITERS
+
+// the replaced object is tagged with the epoch after the swap,
+// a reader that entered before it may hold the object, one that
+// entered at or after it loads what replaced it
+static void retire(RegistryState *state, RegistryVersion *version, RegistryIndex *index)
+{
+    Retired *retired = (Retired *)malloc(sizeof(Retired));
+    if (retired == NULL) exit(1);
+
+    retired->version = version;
+    retired->index = index;
+    retired->epoch = atomic_fetch_add(&state->epoch, 1) + 1;
+    retired->next = state->retired;
+    state->retired = retired;
+    state->retired_count += 1;
+}
+
+static unsigned int reclaim(RegistryState *state)
+{
+    // the oldest epoch a reader is in, readers that enter
+    // from now on see only current objects
+    unsigned long long oldest = atomic_load(&state->epoch);
+    for (unsigned int i = 0; i < REGISTRY_READERS_MAX; i++)
+    {
+        unsigned long long epoch = atomic_load(&state->readers[i].epoch);
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    unsigned int freed = 0;
+    Retired **link = &state->retired;
+    while (*link != NULL)
+    {
+        Retired *retired = *link;
+        if (retired->epoch > oldest)
+        {
+            link = &retired->next;
+            continue;
+        }
+
+        if (retired->version != NULL)
+            delete_version(retired->version);
+        if (retired->index != NULL)
+            delete_index(retired->index);
+
+        *link = retired->next;
+        free(retired);
+        freed++;
+    }
+
+    state->retired_count -= freed;
+    return freed;
+}
+
+// entry of name, added with a new index if it has none
+static RegistryEntry *find_entry(RegistryState *state, const char *name, bool add)
+{
+    RegistryIndex *index = atomic_load(&state->index);
+    unsigned int length = strlen(name);
+    unsigned int id;
+
+    if (nametable_find(&index->names, name, length, &id))
+        return index->entries[id];
+
+    if (!add)
+        return NULL;
+
+    RegistryIndex *next = (RegistryIndex *)malloc(sizeof(RegistryIndex));
+    RegistryEntry *entry = (RegistryEntry *)malloc(sizeof(RegistryEntry));
+    if (next == NULL || entry == NULL) exit(1);
+
+    next->names = copy_names(&index->names);
+    nametable_add(&next->names, name, length);
+    next->entries = (RegistryEntry **)malloc(next->names.count * sizeof(RegistryEntry *));
+    if (next->entries == NULL) exit(1);
+
+    if (index->names.count > 0)
+        memcpy(next->entries, index->entries, index->names.count * sizeof(RegistryEntry *));
+    atomic_init(&entry->current, NULL);
+    next->entries[index->names.count] = entry;
+
+    atomic_store(&state->index, next);
+    retire(state, NULL, index);
+    return entry;
+}
+
+ResultInfo registry_publish(FormulaRegistry *registry, const char *name, const char *expression)
+{
+    RegistryState *state = registry->state;
+    ResultInfo res;
+
+    // compiled outside of the lock, against a copy of the variables
+    // so that names they do not have are caught
+    pthread_mutex_lock(&state->lock);
+    NameTable names = copy_names(&state->variables);
+    unsigned int variable_count = state->variables.count;
+    unsigned int optimize_flags = state->optimize;
+    pthread_mutex_unlock(&state->lock);
+
+    TokenList program = new_tokenlist();
+    res = convert_names(expression, &program, &names);
+
+    for (unsigned int i = 0; i < program.count && res.status == SUCCESS; i++)
+    {
+        if (program.list[i].type == VARIABLE && program.list[i].value.variable >= variable_count)
+        {
+            res.status = UNDEFINED_VARIABLE;
+            res.error_index = program.list[i].column;
+        }
+    }
+
+    delete_nametable(names);
+    if (res.status != SUCCESS)
+    {
+        delete_tokenlist(program);
+        return res;
+    }
+
+    optimize(&program, optimize_flags);
+
+    RegistryVersion *version = (RegistryVersion *)malloc(sizeof(RegistryVersion));
+    if (version == NULL) exit(1);
+    version->program = program;
+
+    pthread_mutex_lock(&state->lock);
+    version->number = ++state->version_count;
+
+    RegistryEntry *entry = find_entry(state, name, true);
+    RegistryVersion *previous = atomic_exchange(&entry->current, version);
+    if (previous != NULL)
+        retire(state, previous, NULL);
+
+    reclaim(state);
+    pthread_mutex_unlock(&state->lock);
+
+    return res;
+}
+
+bool registry_remove(FormulaRegistry *registry, const char *name)
+{
+    RegistryState *state = registry->state;
+
+    pthread_mutex_lock(&state->lock);
+    RegistryEntry *entry = find_entry(state, name, false);
+    RegistryVersion *previous = entry == NULL ? NULL : atomic_exchange(&entry->current, NULL);
+    if (previous != NULL)
+        retire(state, previous, NULL);
+
+    reclaim(state);
+    pthread_mutex_unlock(&state->lock);
+
+    return previous != NULL;
+}
+
+unsigned int registry_reclaim(FormulaRegistry *registry)
+{
+    pthread_mutex_lock(&registry->state->lock);
+    unsigned int freed = reclaim(registry->state);
+    pthread_mutex_unlock(&registry->state->lock);
+
+    return freed;
+}
+
+unsigned int registry_retired_count(const FormulaRegistry *registry)
+{
+    pthread_mutex_lock(&registry->state->lock);
+    unsigned int count = registry->state->retired_count;
+    pthread_mutex_unlock(&registry->state->lock);
+
+    return count;
+}
+
+// READERS
+
+ResultInfo registry_open_reader(FormulaRegistry *registry, RegistryReader *reader)
+{
+    ResultInfo res;
+    res.status = CAPACITY_EXCEEDED;
+    res.error_index = 0;
+
+    for (unsigned int i = 0; i < REGISTRY_READERS_MAX; i++)
+    {
+        bool closed = false;
+        if (atomic_compare_exchange_strong(&registry->state->readers[i].open, &closed, true))
+        {
+            reader->state = registry->state;
+            reader->slot = i;
+            reader->context = new_parse_context();
+            res.status = SUCCESS;
+            break;
+        }
+    }
+
+    return res;
+}
+
+void registry_close_reader(RegistryReader *reader)
+{
+    delete_parse_context(reader->context);
+    atomic_store(&reader->state->readers[reader->slot].open, false);
+    reader->state = NULL;
+}
+
+// announce the current epoch before loading anything a writer may replace,
+// a writer that does not see the announcement has already swapped
+static void enter(RegistryReader *reader)
+{
+    atomic_store(&reader->state->readers[reader->slot].epoch,
+                 atomic_load(&reader->state->epoch));
+}
+
+static void leave(RegistryReader *reader)
+{
+    atomic_store_explicit(&reader->state->readers[reader->slot].epoch, 0, memory_order_release);
+}
+
+unsigned int registry_lookup(RegistryReader *reader, const char *name)
+{
+    enter(reader);
+
+    RegistryIndex *index = atomic_load(&reader->state->index);
+    unsigned int id;
+    if (!nametable_find(&index->names, name, strlen(name), &id))
+        id = REGISTRY_NONE;
+
+    leave(reader);
+    return id;
+}
+
+ResultInfo registry_evaluate(RegistryReader *reader, unsigned int id,
+                             const double *variables, Token *result,
+                             unsigned long long *version)
+{
+    ResultInfo res;
+    res.status = UNDEFINED_VARIABLE;
+    res.error_index = 0;
+
+    enter(reader);
+
+    RegistryIndex *index = atomic_load(&reader->state->index);
+    RegistryVersion *current = id < index->names.count ?
+                               atomic_load(&index->entries[id]->current) : NULL;
+
+    if (current != NULL)
+    {
+        res = evaluate_context(&reader->context, current->program, variables, result);
+        if (version != NULL)
+            *version = current->number;
+    }
+
+    leave(reader);
+    return res;
+}
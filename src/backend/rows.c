@@ -0,0 +1,719 @@
+// standard library includes
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// project includes
+#include "parser.h"
+#include "optimize.h"
+#include "functions.h"
+#include "kernel.h"
+#include "sample.h"
+#include "rows.h"
+
+// below this many rows per thread the caller evaluates alone
+#define ROW_CHUNK_MIN 1024
+
+// chunks handed out per thread, more chunks even out rows of unequal cost
+#define CHUNKS_PER_THREAD 8
+
+#define CACHE_LINE 64
+
+// evaluation state of one thread
+// each slot starts on its own cache line, the stack count
+// is written on every row and must not share a line with a neighbour
+typedef struct
+{
+    _Alignas(CACHE_LINE) ParseContext context;
+    unsigned long long failed;
+
+    // row stacks for conditional programs, created on first use
+    BatchContext batch;
+
+    // integer counts of an aggregation are kept per thread
+    // and added up at the end, their order does not matter
+    unsigned long long error_counts[ERROR_TYPE_COUNT];
+    unsigned long long *bins;
+    unsigned long long below;
+    unsigned long long above;
+    unsigned long long unordered;
+
+    // one block of samples and their values while sampling
+    double *draws;
+    double *values;
+    error_type *value_errors;
+} WorkerSlot;
+
+// reduction of one AGGREGATE_BLOCK of rows
+typedef struct
+{
+    double sum;
+    double compensation;
+    double min;
+    double max;
+    unsigned long long count;
+
+    // squared deviations from the mean of the block
+    double deviations;
+} BlockPartial;
+
+// sums of the values of a block less its first value,
+// which keeps the squares from cancelling when values are large
+typedef struct
+{
+    double shift;
+    double sum;
+    double squares;
+} BlockShift;
+
+typedef struct
+{
+    RowWorkers *workers;
+    unsigned int index;
+} WorkerStart;
+
+struct RowWorkers
+{
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+
+    pthread_t *threads;
+    WorkerStart *starts;
+    unsigned int started;
+
+    // slot 0 belongs to the calling thread
+    WorkerSlot *slots;
+    unsigned int slot_count;
+
+    // the current call, written under lock before generation changes
+    TokenList program;
+    const double *variables;
+    unsigned int stride;
+    unsigned long long row_count;
+    double *results;
+    error_type *errors;
+    unsigned long long chunk;
+
+    // a program with conditionals runs in batches,
+    // so each branch is only evaluated over the rows that take it,
+    // and so does one that can call vector forms of native functions
+    bool batch;
+
+    // set instead of program when a kernel is evaluated
+    const Kernel *kernel;
+    double *const *columns;
+    error_type *const *column_errors;
+
+    // set instead of results when values are aggregated,
+    // one partial per block of rows
+    const Aggregate *aggregate;
+    BlockPartial *partials;
+
+    // set with aggregate when the variables of each row are drawn
+    const Sampler *sampler;
+
+    // the next row not yet handed out, alone on its cache line
+    _Alignas(CACHE_LINE) atomic_ullong next_row;
+
+    _Alignas(CACHE_LINE) unsigned int generation;
+    unsigned int busy;
+    bool stop;
+};
+
+// Neumaier's variant of Kahan summation,
+// it stays exact when an addend is larger than the running sum
+static void compensated_add(BlockPartial *partial, double value)
+{
+    double t = partial->sum + value;
+    if (fabs(partial->sum) >= fabs(value))
+        partial->compensation += (partial->sum - t) + value;
+    else
+        partial->compensation += (value - t) + partial->sum;
+    partial->sum = t;
+}
+
+static void histogram_add(const Aggregate *aggregate, WorkerSlot *slot, double value)
+{
+    if (isnan(value))
+        slot->unordered += 1;
+    else if (value < aggregate->low)
+        slot->below += 1;
+    else if (value >= aggregate->high)
+        slot->above += 1;
+    else
+    {
+        double position = (value - aggregate->low) / (aggregate->high - aggregate->low);
+        unsigned int bin = (unsigned int)(position * aggregate->bin_count);
+
+        // rounding can push a value just below high into the bin past the end
+        if (bin >= aggregate->bin_count)
+            bin = aggregate->bin_count - 1;
+
+        slot->bins[bin] += 1;
+    }
+}
+
+static void partial_add(BlockPartial *partial, BlockShift *shift, double value)
+{
+    if (partial->count == 0)
+        shift->shift = value;
+
+    double shifted = value - shift->shift;
+    shift->sum += shifted;
+    shift->squares += shifted * shifted;
+
+    compensated_add(partial, value);
+    if (value < partial->min)
+        partial->min = value;
+    if (value > partial->max)
+        partial->max = value;
+    partial->count += 1;
+}
+
+static void partial_finish(BlockPartial *partial, const BlockShift *shift)
+{
+    partial->deviations = 0;
+    if (partial->count > 0)
+        partial->deviations = shift->squares - shift->sum * shift->sum / partial->count;
+}
+
+// draw the samples of a block and evaluate them together
+static void sample_block(RowWorkers *workers, WorkerSlot *slot, unsigned long long block,
+                         unsigned int count, BlockPartial *partial, BlockShift *shift)
+{
+    const Sampler *sampler = workers->sampler;
+    sampler_draw(sampler, block, count, slot->draws);
+
+    if (slot->batch.stacks == NULL)
+        slot->batch = new_batch_context();
+
+    slot->failed += evaluate_batch(&slot->batch, workers->program, slot->draws,
+                                   sampler->variable_count, count,
+                                   slot->values, slot->value_errors);
+
+    for (unsigned int row = 0; row < count; row++)
+    {
+        if (slot->value_errors[row] != SUCCESS)
+        {
+            slot->error_counts[slot->value_errors[row]] += 1;
+            continue;
+        }
+
+        partial_add(partial, shift, slot->values[row]);
+        if (workers->aggregate->bin_count > 0)
+            histogram_add(workers->aggregate, slot, slot->values[row]);
+    }
+}
+
+// begin is a multiple of AGGREGATE_BLOCK
+static void aggregate_range(RowWorkers *workers, WorkerSlot *slot,
+                            unsigned long long begin, unsigned long long end)
+{
+    const Aggregate *aggregate = workers->aggregate;
+    Token result = create_empty_token();
+
+    for (unsigned long long block = begin; block < end; block += AGGREGATE_BLOCK)
+    {
+        BlockPartial partial = { 0, 0, INFINITY, -INFINITY, 0, 0 };
+        BlockShift shift = { 0, 0, 0 };
+        unsigned long long block_end = block + AGGREGATE_BLOCK < end ? block + AGGREGATE_BLOCK : end;
+
+        if (workers->sampler != NULL)
+        {
+            sample_block(workers, slot, block, (unsigned int)(block_end - block), &partial, &shift);
+            partial_finish(&partial, &shift);
+            workers->partials[block / AGGREGATE_BLOCK] = partial;
+            continue;
+        }
+
+        for (unsigned long long row = block; row < block_end; row++)
+        {
+            ResultInfo res = evaluate_context(&slot->context, workers->program,
+                                              workers->variables + row * workers->stride,
+                                              &result);
+            if (res.status != SUCCESS)
+            {
+                slot->failed += 1;
+                slot->error_counts[res.status] += 1;
+                continue;
+            }
+
+            double value = result.value.number;
+            partial_add(&partial, &shift, value);
+
+            if (aggregate->bin_count > 0)
+                histogram_add(aggregate, slot, value);
+        }
+
+        partial_finish(&partial, &shift);
+        workers->partials[block / AGGREGATE_BLOCK] = partial;
+    }
+}
+
+static void evaluate_range(RowWorkers *workers, WorkerSlot *slot,
+                           unsigned long long begin, unsigned long long end)
+{
+    if (workers->aggregate != NULL)
+    {
+        aggregate_range(workers, slot, begin, end);
+        return;
+    }
+
+    if (workers->kernel != NULL)
+    {
+        slot->failed += kernel_evaluate_range(workers->kernel, &slot->context,
+                                              workers->variables, workers->stride,
+                                              begin, end, workers->columns,
+                                              workers->column_errors);
+        return;
+    }
+
+    if (workers->batch)
+    {
+        if (slot->batch.stacks == NULL)
+            slot->batch = new_batch_context();
+
+        slot->failed += evaluate_batch(&slot->batch, workers->program,
+                                       workers->variables + begin * workers->stride,
+                                       workers->stride, end - begin,
+                                       workers->results + begin, workers->errors + begin);
+        return;
+    }
+
+    Token result = create_empty_token();
+    for (unsigned long long row = begin; row < end; row++)
+    {
+        ResultInfo res = evaluate_context(&slot->context, workers->program,
+                                          workers->variables + row * workers->stride,
+                                          &result);
+        workers->errors[row] = res.status;
+        if (res.status == SUCCESS)
+        {
+            workers->results[row] = result.value.number;
+        }
+        else
+        {
+            workers->results[row] = NAN;
+            slot->failed += 1;
+        }
+    }
+}
+
+// take chunks until every row is handed out
+static void evaluate_chunks(RowWorkers *workers, WorkerSlot *slot)
+{
+    while (true)
+    {
+        unsigned long long begin = atomic_fetch_add(&workers->next_row, workers->chunk);
+        if (begin >= workers->row_count)
+            return;
+
+        unsigned long long end = begin + workers->chunk;
+        if (end > workers->row_count)
+            end = workers->row_count;
+
+        evaluate_range(workers, slot, begin, end);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    WorkerStart *start = (WorkerStart *)arg;
+    RowWorkers *workers = start->workers;
+    WorkerSlot *slot = &workers->slots[start->index];
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&workers->lock);
+    while (true)
+    {
+        while (workers->generation == seen && !workers->stop)
+            pthread_cond_wait(&workers->start, &workers->lock);
+
+        if (workers->stop)
+            break;
+
+        seen = workers->generation;
+        pthread_mutex_unlock(&workers->lock);
+
+        evaluate_chunks(workers, slot);
+
+        pthread_mutex_lock(&workers->lock);
+        workers->busy -= 1;
+        if (workers->busy == 0)
+            pthread_cond_signal(&workers->done);
+    }
+    pthread_mutex_unlock(&workers->lock);
+
+    return NULL;
+}
+
+RowPool new_row_pool(unsigned int thread_count)
+{
+    if (thread_count == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (unsigned int)online : 1;
+    }
+
+    RowWorkers *workers = (RowWorkers *)aligned_alloc(CACHE_LINE, sizeof(RowWorkers));
+    WorkerSlot *slots = (WorkerSlot *)aligned_alloc(CACHE_LINE,
+                                                    thread_count * sizeof(WorkerSlot));
+    pthread_t *threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    WorkerStart *starts = (WorkerStart *)malloc(thread_count * sizeof(WorkerStart));
+    if (workers == NULL || slots == NULL || threads == NULL || starts == NULL)
+        exit(1);
+
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->start, NULL);
+    pthread_cond_init(&workers->done, NULL);
+    workers->threads = threads;
+    workers->starts = starts;
+    workers->slots = slots;
+    workers->slot_count = thread_count;
+    workers->generation = 0;
+    workers->busy = 0;
+    workers->stop = false;
+    atomic_init(&workers->next_row, 0);
+
+    for (unsigned int t = 0; t < thread_count; t++)
+    {
+        slots[t].context = new_parse_context();
+        slots[t].failed = 0;
+        slots[t].batch.stacks = NULL;
+        slots[t].bins = NULL;
+        slots[t].draws = NULL;
+        slots[t].values = NULL;
+        slots[t].value_errors = NULL;
+    }
+
+    // the calling thread counts as the first thread
+    workers->started = 1;
+    for (unsigned int t = 1; t < thread_count; t++)
+    {
+        starts[t].workers = workers;
+        starts[t].index = t;
+        if (pthread_create(&threads[t], NULL, worker_main, &starts[t]) != 0)
+            break;
+        workers->started += 1;
+    }
+
+    RowPool pool;
+    pool.thread_count = workers->started;
+    pool.workers = workers;
+    return pool;
+}
+
+void delete_row_pool(RowPool *pool)
+{
+    RowWorkers *workers = pool->workers;
+
+    pthread_mutex_lock(&workers->lock);
+    workers->stop = true;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    for (unsigned int t = 1; t < workers->started; t++)
+        pthread_join(workers->threads[t], NULL);
+
+    // contexts of threads that never started were created too
+    for (unsigned int t = 0; t < workers->slot_count; t++)
+    {
+        delete_parse_context(workers->slots[t].context);
+        if (workers->slots[t].batch.stacks != NULL)
+            delete_batch_context(workers->slots[t].batch);
+    }
+
+    pthread_cond_destroy(&workers->done);
+    pthread_cond_destroy(&workers->start);
+    pthread_mutex_destroy(&workers->lock);
+
+    free(workers->starts);
+    free(workers->threads);
+    free(workers->slots);
+    free(workers);
+
+    pool->thread_count = 0;
+    pool->workers = NULL;
+}
+
+// rows per chunk, a multiple of multiple
+static unsigned long long chunk_size(unsigned long long row_count, unsigned int threads,
+                                     unsigned long long multiple)
+{
+    unsigned long long chunk = row_count / ((unsigned long long)threads * CHUNKS_PER_THREAD);
+    if (chunk < ROW_CHUNK_MIN)
+        chunk = ROW_CHUNK_MIN;
+
+    return (chunk + multiple - 1) / multiple * multiple;
+}
+
+// evaluate the job set up in workers over all of its rows
+static unsigned long long run_rows(RowPool *pool)
+{
+    RowWorkers *workers = pool->workers;
+    WorkerSlot *caller = &workers->slots[0];
+    unsigned long long row_count = workers->row_count;
+
+    // too few rows to be worth waking anyone
+    if (pool->thread_count <= 1 || row_count < 2 * ROW_CHUNK_MIN)
+    {
+        caller->failed = 0;
+        evaluate_range(workers, caller, 0, row_count);
+        return caller->failed;
+    }
+
+    // an aggregation writes one partial per block,
+    // so a chunk must not end inside a block
+    unsigned long long multiple = workers->aggregate != NULL ? AGGREGATE_BLOCK : ROW_CHUNK_ALIGN;
+    workers->chunk = chunk_size(row_count, pool->thread_count, multiple);
+    atomic_store(&workers->next_row, 0);
+    for (unsigned int t = 0; t < pool->thread_count; t++)
+        workers->slots[t].failed = 0;
+
+    pthread_mutex_lock(&workers->lock);
+    workers->busy = pool->thread_count - 1;
+    workers->generation += 1;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+
+    evaluate_chunks(workers, caller);
+
+    pthread_mutex_lock(&workers->lock);
+    while (workers->busy > 0)
+        pthread_cond_wait(&workers->done, &workers->lock);
+    pthread_mutex_unlock(&workers->lock);
+
+    unsigned long long failed = 0;
+    for (unsigned int t = 0; t < pool->thread_count; t++)
+        failed += workers->slots[t].failed;
+
+    return failed;
+}
+
+unsigned long long evaluate_rows(RowPool *pool, const TokenList program,
+                                 const double *variables, unsigned int stride,
+                                 unsigned long long row_count,
+                                 double *results, error_type *errors)
+{
+    RowWorkers *workers = pool->workers;
+    workers->program = program;
+    workers->variables = variables;
+    workers->stride = stride;
+    workers->row_count = row_count;
+    workers->results = results;
+    workers->errors = errors;
+    workers->batch = program_has_jumps(program) || program_has_vector_natives(program);
+    workers->kernel = NULL;
+    workers->aggregate = NULL;
+
+    return run_rows(pool);
+}
+
+unsigned long long evaluate_kernel_rows(RowPool *pool, const Kernel *kernel,
+                                        const double *variables, unsigned int stride,
+                                        unsigned long long row_count,
+                                        double *const *columns, error_type *const *errors)
+{
+    RowWorkers *workers = pool->workers;
+    workers->variables = variables;
+    workers->stride = stride;
+    workers->row_count = row_count;
+    workers->kernel = kernel;
+    workers->columns = columns;
+    workers->column_errors = errors;
+    workers->aggregate = NULL;
+
+    return run_rows(pool);
+}
+
+Aggregate new_aggregate(void)
+{
+    Aggregate obj;
+    memset(&obj, 0, sizeof(obj));
+    obj.min = NAN;
+    obj.max = NAN;
+    obj.mean = NAN;
+    obj.variance = NAN;
+    obj.bins = NULL;
+    return obj;
+}
+
+Aggregate new_histogram_aggregate(double low, double high, unsigned int bin_count)
+{
+    Aggregate obj = new_aggregate();
+    obj.low = low;
+    obj.high = high;
+    obj.bin_count = bin_count;
+    obj.bins = (unsigned long long *)calloc(bin_count + 1, sizeof(unsigned long long));
+    if (obj.bins == NULL) exit(1);
+    return obj;
+}
+
+void delete_aggregate(Aggregate *aggregate)
+{
+    free(aggregate->bins);
+    aggregate->bins = NULL;
+    aggregate->bin_count = 0;
+}
+
+// combine partials first to first + count in a fixed tree,
+// halves are summed on their own before they are added
+static BlockPartial combine_partials(const BlockPartial *partials, unsigned long long count)
+{
+    if (count == 1)
+        return partials[0];
+
+    unsigned long long half = count / 2;
+    BlockPartial left = combine_partials(partials, half);
+    BlockPartial right = combine_partials(partials + half, count - half);
+
+    // deviations of the halves from their own means
+    // plus those of the two means from the common one
+    if (left.count > 0 && right.count > 0)
+    {
+        double delta = (right.sum + right.compensation) / right.count -
+                       (left.sum + left.compensation) / left.count;
+        double weight = (double)left.count * right.count / (left.count + right.count);
+        left.deviations += right.deviations + delta * delta * weight;
+    }
+    else
+    {
+        left.deviations += right.deviations;
+    }
+
+    compensated_add(&left, right.sum);
+    left.compensation += right.compensation;
+    if (right.min < left.min)
+        left.min = right.min;
+    if (right.max > left.max)
+        left.max = right.max;
+    left.count += right.count;
+
+    return left;
+}
+
+// reduce the rows read from variables or drawn by sampler into aggregate
+static void run_aggregate(RowPool *pool, const TokenList program,
+                          const double *variables, unsigned int stride,
+                          const Sampler *sampler, unsigned long long row_count,
+                          Aggregate *aggregate)
+{
+    RowWorkers *workers = pool->workers;
+    unsigned long long block_count = (row_count + AGGREGATE_BLOCK - 1) / AGGREGATE_BLOCK;
+
+    BlockPartial *partials = (BlockPartial *)malloc((block_count + 1) * sizeof(BlockPartial));
+    if (partials == NULL) exit(1);
+
+    for (unsigned int t = 0; t < workers->slot_count; t++)
+    {
+        WorkerSlot *slot = &workers->slots[t];
+        slot->failed = 0;
+        memset(slot->error_counts, 0, sizeof(slot->error_counts));
+        slot->below = 0;
+        slot->above = 0;
+        slot->unordered = 0;
+
+        if (aggregate->bin_count > 0)
+        {
+            slot->bins = (unsigned long long *)calloc(aggregate->bin_count, sizeof(unsigned long long));
+            if (slot->bins == NULL) exit(1);
+        }
+
+        if (sampler != NULL)
+        {
+            unsigned int width = sampler->variable_count > 0 ? sampler->variable_count : 1;
+            slot->draws = (double *)malloc(AGGREGATE_BLOCK * width * sizeof(double));
+            slot->values = (double *)malloc(AGGREGATE_BLOCK * sizeof(double));
+            slot->value_errors = (error_type *)malloc(AGGREGATE_BLOCK * sizeof(error_type));
+            if (slot->draws == NULL || slot->values == NULL || slot->value_errors == NULL)
+                exit(1);
+        }
+    }
+
+    workers->program = program;
+    workers->variables = variables;
+    workers->stride = stride;
+    workers->row_count = row_count;
+    workers->kernel = NULL;
+    workers->aggregate = aggregate;
+    workers->partials = partials;
+    workers->sampler = sampler;
+
+    run_rows(pool);
+    workers->aggregate = NULL;
+    workers->sampler = NULL;
+
+    aggregate->count = 0;
+    aggregate->failed = 0;
+    memset(aggregate->error_counts, 0, sizeof(aggregate->error_counts));
+    aggregate->below = 0;
+    aggregate->above = 0;
+    aggregate->unordered = 0;
+    for (unsigned int b = 0; b < aggregate->bin_count; b++)
+        aggregate->bins[b] = 0;
+
+    for (unsigned int t = 0; t < workers->slot_count; t++)
+    {
+        WorkerSlot *slot = &workers->slots[t];
+        aggregate->failed += slot->failed;
+        for (unsigned int e = 0; e < ERROR_TYPE_COUNT; e++)
+            aggregate->error_counts[e] += slot->error_counts[e];
+
+        aggregate->below += slot->below;
+        aggregate->above += slot->above;
+        aggregate->unordered += slot->unordered;
+        for (unsigned int b = 0; b < aggregate->bin_count; b++)
+            aggregate->bins[b] += slot->bins[b];
+
+        free(slot->bins);
+        slot->bins = NULL;
+
+        free(slot->draws);
+        free(slot->values);
+        free(slot->value_errors);
+        slot->draws = NULL;
+        slot->values = NULL;
+        slot->value_errors = NULL;
+    }
+
+    BlockPartial total = { 0, 0, INFINITY, -INFINITY, 0, 0 };
+    if (block_count > 0)
+        total = combine_partials(partials, block_count);
+
+    aggregate->count = total.count;
+    aggregate->sum = total.sum + total.compensation;
+    aggregate->min = total.count > 0 ? total.min : NAN;
+    aggregate->max = total.count > 0 ? total.max : NAN;
+    aggregate->mean = total.count > 0 ? aggregate->sum / total.count : NAN;
+    aggregate->variance = total.count > 1 ? total.deviations / (total.count - 1) : NAN;
+
+    free(partials);
+}
+
+void aggregate_rows(RowPool *pool, const TokenList program,
+                    const double *variables, unsigned int stride,
+                    unsigned long long row_count, Aggregate *aggregate)
+{
+    run_aggregate(pool, program, variables, stride, NULL, row_count, aggregate);
+}
+
+void sample_rows(RowPool *pool, const TokenList program, const Sampler *sampler,
+                 unsigned long long sample_count, Aggregate *aggregate)
+{
+    run_aggregate(pool, program, NULL, 0, sampler, sample_count, aggregate);
+}
+
+void aggregate_confidence(const Aggregate *aggregate, double confidence,
+                          double *low, double *high)
+{
+    double z = normal_quantile(0.5 + confidence / 2);
+    double margin = z * sqrt(aggregate->variance / aggregate->count);
+
+    *low = aggregate->mean - margin;
+    *high = aggregate->mean + margin;
+}
@@ -0,0 +1,207 @@
+// standard library includes
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "sample.h"
+
+#define PI 3.14159265358979323846264338327950288
+
+// multipliers and key increments of Philox 4x32
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+// samples drawn together, small enough for the uniforms to stay in cache
+#define DRAW_BLOCK 256
+
+Sampler new_sampler(uint64_t seed)
+{
+    Sampler obj;
+    obj.seed = seed;
+    obj.variable_count = 0;
+    obj.distributions = NULL;
+    return obj;
+}
+
+void delete_sampler(Sampler *sampler)
+{
+    free(sampler->distributions);
+    sampler->distributions = NULL;
+    sampler->variable_count = 0;
+}
+
+static void sampler_set(Sampler *sampler, unsigned int variable, Distribution distribution)
+{
+    if (variable >= sampler->variable_count)
+    {
+        Distribution *distributions = (Distribution *)realloc(sampler->distributions,
+                                                              (variable + 1) * sizeof(Distribution));
+        if (distributions == NULL) exit(1);
+
+        for (unsigned int v = sampler->variable_count; v < variable; v++)
+        {
+            distributions[v].type = DISTRIBUTION_UNIFORM;
+            distributions[v].a = 0;
+            distributions[v].b = 0;
+        }
+
+        sampler->distributions = distributions;
+        sampler->variable_count = variable + 1;
+    }
+
+    sampler->distributions[variable] = distribution;
+}
+
+void sampler_uniform(Sampler *sampler, unsigned int variable, double low, double high)
+{
+    Distribution distribution = { DISTRIBUTION_UNIFORM, low, high };
+    sampler_set(sampler, variable, distribution);
+}
+
+void sampler_normal(Sampler *sampler, unsigned int variable, double mean, double deviation)
+{
+    Distribution distribution = { DISTRIBUTION_NORMAL, mean, deviation };
+    sampler_set(sampler, variable, distribution);
+}
+
+// the rounds on words c0 to c3, written out so a loop
+// over many counters can run them for several at once
+static inline void philox_rounds(uint32_t *c0, uint32_t *c1, uint32_t *c2, uint32_t *c3,
+                                 uint32_t k0, uint32_t k1)
+{
+    uint32_t x0 = *c0, x1 = *c1, x2 = *c2, x3 = *c3;
+
+    for (unsigned int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * x0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * x2;
+
+        x0 = (uint32_t)(p1 >> 32) ^ x1 ^ k0;
+        x1 = (uint32_t)p1;
+        x2 = (uint32_t)(p0 >> 32) ^ x3 ^ k1;
+        x3 = (uint32_t)p0;
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    *c0 = x0;
+    *c1 = x1;
+    *c2 = x2;
+    *c3 = x3;
+}
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t output[4])
+{
+    output[0] = counter[0];
+    output[1] = counter[1];
+    output[2] = counter[2];
+    output[3] = counter[3];
+    philox_rounds(&output[0], &output[1], &output[2], &output[3], key[0], key[1]);
+}
+
+// 52 random bits of two words as a double in [0, 1), the bits are the
+// mantissa of a double in [1, 2), which needs no integer conversion
+// and so vectorizes
+static inline double unit(uint32_t high, uint32_t low)
+{
+    uint64_t bits = 0x3FF0000000000000ull | ((uint64_t)high << 20) | (low >> 12);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value - 1;
+}
+
+void sampler_draw(const Sampler *sampler, uint64_t first, unsigned int count, double *draws)
+{
+    unsigned int stride = sampler->variable_count;
+    uint32_t k0 = (uint32_t)sampler->seed;
+    uint32_t k1 = (uint32_t)(sampler->seed >> 32);
+    double u[DRAW_BLOCK];
+    double v[DRAW_BLOCK];
+
+    for (unsigned int begin = 0; begin < count; begin += DRAW_BLOCK)
+    {
+        unsigned int n = count - begin < DRAW_BLOCK ? count - begin : DRAW_BLOCK;
+
+        for (unsigned int variable = 0; variable < stride; variable++)
+        {
+            const Distribution *distribution = &sampler->distributions[variable];
+
+            for (unsigned int r = 0; r < n; r++)
+            {
+                uint64_t sample = first + begin + r;
+                uint32_t c0 = (uint32_t)sample, c1 = (uint32_t)(sample >> 32);
+                uint32_t c2 = variable, c3 = 0;
+                philox_rounds(&c0, &c1, &c2, &c3, k0, k1);
+
+                u[r] = unit(c0, c1);
+                v[r] = unit(c2, c3);
+            }
+
+            double *out = draws + (uint64_t)begin * stride + variable;
+            double a = distribution->a;
+            double b = distribution->b;
+
+            if (distribution->type == DISTRIBUTION_NORMAL)
+            {
+                // Box-Muller, 1 - u is in (0, 1] so its logarithm is finite
+                for (unsigned int r = 0; r < n; r++)
+                    out[r * stride] = a + b * sqrt(-2 * log(1 - u[r])) * cos(2 * PI * v[r]);
+            }
+            else
+            {
+                for (unsigned int r = 0; r < n; r++)
+                    out[r * stride] = a + (b - a) * u[r];
+            }
+        }
+    }
+}
+
+// Acklam's rational approximation, relative error below 1.2e-9,
+// and one Halley step on the error function to full precision
+double normal_quantile(double p)
+{
+    static const double a[6] = { -3.969683028665376e+01, 2.209460984245205e+02,
+                                 -2.759285104469687e+02, 1.383577518672690e+02,
+                                 -3.066479806614716e+01, 2.506628277459239e+00 };
+    static const double b[5] = { -5.447609879822406e+01, 1.615858368580409e+02,
+                                 -1.556989798598866e+02, 6.680131188771972e+01,
+                                 -1.328068155288572e+01 };
+    static const double c[6] = { -7.784894002430293e-03, -3.223964580411365e-01,
+                                 -2.400758277161838e+00, -2.549732539343734e+00,
+                                 4.374664141464968e+00, 2.938163982698783e+00 };
+    static const double d[4] = { 7.784695709041462e-03, 3.224671290700398e-01,
+                                 2.445134137142996e+00, 3.754408661907416e+00 };
+
+    if (!(p > 0 && p < 1))
+        return NAN;
+
+    double x;
+    if (p < 0.02425)
+    {
+        double q = sqrt(-2 * log(p));
+        x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+            ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    else if (p > 1 - 0.02425)
+    {
+        double q = sqrt(-2 * log(1 - p));
+        x = -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+             ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    else
+    {
+        double q = p - 0.5;
+        double r = q * q;
+        x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+            (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+    }
+
+    double e = 0.5 * erfc(-x / sqrt(2)) - p;
+    double u = e * sqrt(2 * PI) * exp(x * x / 2);
+    return x - u / (1 + x * u / 2);
+}
@@ -0,0 +1,143 @@
+// standard library includes
+#include <stdbool.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// project includes
+#include "scan.h"
+
+static bool vectors_enabled = true;
+
+void scan_use_vectors(bool enabled)
+{
+    vectors_enabled = enabled;
+}
+
+static bool in_class(unsigned char c, scan_class class)
+{
+    switch (class)
+    {
+        case SCAN_SPACE: return c == ' ' || (c >= '\t' && c <= '\r');
+        case SCAN_DIGIT: return c >= '0' && c <= '9';
+        case SCAN_LOWER: return c >= 'a' && c <= 'z';
+        default: return false;
+    }
+}
+
+static unsigned int scan_scalar(const char *input, unsigned int index,
+                                unsigned int end, scan_class class)
+{
+    while (index < end && in_class((unsigned char)input[index], class))
+        index++;
+
+    return index;
+}
+
+#if defined(__SSE2__)
+
+// a byte range [low, low + width) is checked with one signed compare
+// after shifting low down to -128
+static __m128i range_sse2(__m128i bytes, char low, char width)
+{
+    __m128i shifted = _mm_add_epi8(bytes, _mm_set1_epi8((char)(-128 - low)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + width)));
+}
+
+static __m128i class_sse2(__m128i bytes, scan_class class)
+{
+    if (class == SCAN_DIGIT)
+        return range_sse2(bytes, '0', 10);
+
+    if (class == SCAN_LOWER)
+        return range_sse2(bytes, 'a', 26);
+
+    return _mm_or_si128(range_sse2(bytes, '\t', 5),
+                        _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+}
+
+static unsigned int scan_sse2(const char *input, unsigned int index,
+                              unsigned int end, scan_class class)
+{
+    while (index + 16 <= end)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(input + index));
+        unsigned int outside = ~_mm_movemask_epi8(class_sse2(bytes, class)) & 0xffff;
+
+        if (outside != 0)
+            return index + __builtin_ctz(outside);
+
+        index += 16;
+    }
+
+    return scan_scalar(input, index, end, class);
+}
+
+// the AVX2 version is compiled for the instruction set on its own
+// and only called after the processor was checked for it
+__attribute__((target("avx2")))
+static __m256i range_avx2(__m256i bytes, char low, char width)
+{
+    __m256i shifted = _mm256_add_epi8(bytes, _mm256_set1_epi8((char)(-128 - low)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + width)), shifted);
+}
+
+__attribute__((target("avx2")))
+static unsigned int scan_avx2(const char *input, unsigned int index,
+                              unsigned int end, scan_class class)
+{
+    while (index + 32 <= end)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(input + index));
+        __m256i inside;
+
+        if (class == SCAN_DIGIT)
+            inside = range_avx2(bytes, '0', 10);
+        else if (class == SCAN_LOWER)
+            inside = range_avx2(bytes, 'a', 26);
+        else
+            inside = _mm256_or_si256(range_avx2(bytes, '\t', 5),
+                                     _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+
+        unsigned int outside = ~(unsigned int)_mm256_movemask_epi8(inside);
+
+        if (outside != 0)
+            return index + __builtin_ctz(outside);
+
+        index += 32;
+    }
+
+    // the compiler leaves the upper halves dirty on this tail call,
+    // which slows down every SSE instruction of the caller after it
+    _mm256_zeroupper();
+    return scan_sse2(input, index, end, class);
+}
+
+#endif // __SSE2__
+
+unsigned int scan_run(const char *input, unsigned int index,
+                      unsigned int end, scan_class class)
+{
+    // most runs in hand written input are a byte or two long,
+    // the vectors only pay off once the first bytes are all in the class
+    unsigned int start = index;
+    while (index < end && index - start < 4)
+    {
+        if (!in_class((unsigned char)input[index], class))
+            return index;
+        index++;
+    }
+
+#if defined(__SSE2__)
+    if (vectors_enabled)
+    {
+        if (__builtin_cpu_supports("avx2"))
+            return scan_avx2(input, index, end, class);
+
+        return scan_sse2(input, index, end, class);
+    }
+#endif
+
+    return scan_scalar(input, index, end, class);
+}
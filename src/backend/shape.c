@@ -0,0 +1,751 @@
+// standard library includes
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "token.h"
+#include "parser.h"
+#include "functions.h"
+#include "shape.h"
+
+// programs shorter than this are shaped without allocating
+#define SHAPE_LOCAL_TOKENS 64
+
+// operations of a shape, the numbers of a program are left out
+// and read from the columns of its group instead
+typedef enum
+{
+    SHAPE_CONSTANT = 0,  // the next number of each program
+    SHAPE_VARIABLE,      // index is the variable
+    SHAPE_OPERATOR,      // index is the operator_type, ADD to FAC or a comparison
+    SHAPE_NATIVE,        // a pure native function
+    SHAPE_BRANCH,        // JUMP_FALSE, programs whose condition holds run on
+    SHAPE_ELSE,          // JUMP, the other programs run on
+    SHAPE_JOIN           // end of both branches, each program keeps its own value
+} shape_kind;
+
+typedef struct
+{
+    shape_kind kind;
+    unsigned int index;
+    const NativeFunction *native;
+} ShapeOp;
+
+struct ShapeGroup
+{
+    unsigned int op_count;
+    ShapeOp *ops;
+    unsigned int hash;
+
+    // number k of lane l at constants[k * lane_max + l],
+    // so a block of lanes reads each number from one column
+    unsigned int constant_count;
+    unsigned int lane_count;
+    unsigned int lane_max;
+    double *constants;
+
+    // program number of each lane
+    unsigned int *programs;
+};
+
+ShapeBatch new_shape_batch(void)
+{
+    ShapeBatch obj;
+    obj.program_count = 0;
+    obj.group_count = 0;
+    obj.group_max = 8;
+    obj.groups = (ShapeGroup **)malloc(8 * sizeof(ShapeGroup *));
+    obj.slot_count = 16;
+    obj.slots = (unsigned int *)calloc(16, sizeof(unsigned int));
+    obj.single_count = 0;
+    obj.single_max = 8;
+    obj.singles = (TokenList *)malloc(8 * sizeof(TokenList));
+    obj.single_programs = (unsigned int *)malloc(8 * sizeof(unsigned int));
+    obj.depth_max = 1;
+    obj.level_max = 0;
+
+    if (obj.groups == NULL || obj.slots == NULL ||
+        obj.singles == NULL || obj.single_programs == NULL) exit(1);
+
+    return obj;
+}
+
+void delete_shape_batch(ShapeBatch *batch)
+{
+    for (unsigned int i = 0; i < batch->group_count; i++)
+    {
+        ShapeGroup *group = batch->groups[i];
+        free(group->ops);
+        free(group->constants);
+        free(group->programs);
+        free(group);
+    }
+
+    for (unsigned int i = 0; i < batch->single_count; i++)
+        delete_tokenlist(batch->singles[i]);
+
+    free(batch->groups);
+    free(batch->slots);
+    free(batch->singles);
+    free(batch->single_programs);
+
+    batch->groups = NULL;
+    batch->slots = NULL;
+    batch->singles = NULL;
+    batch->single_programs = NULL;
+    batch->program_count = 0;
+    batch->group_count = 0;
+    batch->single_count = 0;
+}
+
+// FNV-1a over the bytes of value
+static unsigned int mix(unsigned int h, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        h ^= (unsigned int)(value & 0xff);
+        h *= 16777619u;
+        value >>= 8;
+    }
+
+    return h;
+}
+
+static unsigned int hash(const ShapeOp *ops, unsigned int op_count)
+{
+    unsigned int h = 2166136261u;
+    for (unsigned int i = 0; i < op_count; i++)
+    {
+        h = mix(h, (uint64_t)ops[i].kind << 32 | ops[i].index);
+        if (ops[i].kind == SHAPE_NATIVE)
+            h = mix(h, (uint64_t)(uintptr_t)ops[i].native);
+    }
+
+    return h;
+}
+
+static bool same_shape(const ShapeGroup *group, const ShapeOp *ops,
+                       unsigned int op_count, unsigned int h)
+{
+    if (group->hash != h || group->op_count != op_count)
+        return false;
+
+    for (unsigned int i = 0; i < op_count; i++)
+    {
+        if (group->ops[i].kind != ops[i].kind || group->ops[i].index != ops[i].index ||
+            group->ops[i].native != ops[i].native)
+            return false;
+    }
+
+    return true;
+}
+
+// returns the slot holding the group, or the empty slot where it belongs
+static unsigned int find_slot(const ShapeBatch *self, const ShapeOp *ops,
+                              unsigned int op_count, unsigned int h)
+{
+    unsigned int mask = self->slot_count - 1;
+    unsigned int slot = h & mask;
+
+    while (self->slots[slot] != 0)
+    {
+        if (same_shape(self->groups[self->slots[slot] - 1], ops, op_count, h))
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static void rehash(ShapeBatch *self)
+{
+    free(self->slots);
+    self->slot_count *= 2;
+    self->slots = (unsigned int *)calloc(self->slot_count, sizeof(unsigned int));
+    if (self->slots == NULL) exit(1);
+
+    for (unsigned int i = 0; i < self->group_count; i++)
+    {
+        const ShapeGroup *group = self->groups[i];
+        self->slots[find_slot(self, group->ops, group->op_count, group->hash)] = i + 1;
+    }
+}
+
+// shape of program, or false if it is not a plain postfix program
+// with one value, numbers go to constants in program order
+// depth and level get the columns and nested conditionals it needs
+static bool build_shape(const TokenList program, ShapeOp *ops, unsigned int *op_count,
+                        double *constants, unsigned int *constant_count,
+                        unsigned int *joins, unsigned int *depth, unsigned int *level)
+{
+    // joins of conditionals before each index, every JUMP ends
+    // its conditional at its target
+    memset(joins, 0, (program.count + 1) * sizeof(unsigned int));
+
+    for (unsigned int i = 0; i + 1 < program.count; i++)
+    {
+        const Token *token = &program.list[i];
+        if (token->type == OPERATOR && token->value.operator == JUMP)
+        {
+            unsigned int target = (unsigned int)token[1].value.number;
+            if (target > program.count)
+                return false;
+            joins[target] += 1;
+        }
+    }
+
+    unsigned int count = 0, constant = 0;
+    unsigned int current = 0, open = 0;
+    bool plain = program.count > 0;
+    *depth = 0;
+    *level = 0;
+
+    for (unsigned int i = 0; i <= program.count && plain; i++)
+    {
+        for (unsigned int j = 0; j < joins[i]; j++)
+        {
+            if (open == 0 || current < 2)
+            {
+                plain = false;
+                break;
+            }
+            ops[count++] = (ShapeOp){ SHAPE_JOIN, 0, NULL };
+            current -= 1;
+            open -= 1;
+        }
+
+        if (i == program.count || !plain)
+            break;
+
+        const Token *token = &program.list[i];
+        ShapeOp op = { SHAPE_CONSTANT, 0, NULL };
+        unsigned int arity = 0;
+
+        if (token->type == NUMBER)
+        {
+            constants[constant++] = token->value.number;
+        }
+
+        else if (token->type == VARIABLE)
+        {
+            op.kind = SHAPE_VARIABLE;
+            op.index = token->value.variable;
+        }
+
+        else if (token->type == NATIVE && (token->value.native->flags & NATIVE_PURE))
+        {
+            op.kind = SHAPE_NATIVE;
+            op.native = token->value.native;
+            arity = op.native->arity;
+        }
+
+        else if (token->type == OPERATOR && token->value.operator == JUMP_FALSE)
+        {
+            op.kind = SHAPE_BRANCH;
+            arity = 1;
+            open += 1;
+            if (open > *level)
+                *level = open;
+        }
+
+        else if (token->type == OPERATOR && token->value.operator == JUMP)
+        {
+            op.kind = SHAPE_ELSE;
+        }
+
+        else if (token->type == OPERATOR &&
+                 ((token->value.operator >= ADD && token->value.operator <= FAC) ||
+                  iscomparison(token->value.operator)))
+        {
+            op.kind = SHAPE_OPERATOR;
+            op.index = token->value.operator;
+            arity = isunary(token->value.operator) ? 1 : 2;
+        }
+
+        else
+        {
+            plain = false;
+            break;
+        }
+
+        if (current < arity)
+        {
+            plain = false;
+            break;
+        }
+
+        // a branch takes its condition, everything else leaves one value
+        current = current - arity + (op.kind == SHAPE_BRANCH || op.kind == SHAPE_ELSE ? 0 : 1);
+        if (current > *depth)
+            *depth = current;
+
+        ops[count++] = op;
+
+        // a jump is followed by its target
+        if (op.kind == SHAPE_BRANCH || op.kind == SHAPE_ELSE)
+            i++;
+    }
+
+    *op_count = count;
+    *constant_count = constant;
+    return plain && current == 1 && open == 0;
+}
+
+static ShapeGroup *new_group(const ShapeOp *ops, unsigned int op_count,
+                             unsigned int constant_count, unsigned int h)
+{
+    ShapeGroup *group = (ShapeGroup *)malloc(sizeof(ShapeGroup));
+    if (group == NULL) exit(1);
+
+    group->op_count = op_count;
+    group->ops = (ShapeOp *)malloc(op_count * sizeof(ShapeOp));
+    group->hash = h;
+    group->constant_count = constant_count;
+    group->lane_count = 0;
+    group->lane_max = 4;
+    group->constants = (double *)malloc((constant_count > 0 ? constant_count : 1) *
+                                        4 * sizeof(double));
+    group->programs = (unsigned int *)malloc(4 * sizeof(unsigned int));
+
+    if (group->ops == NULL || group->constants == NULL || group->programs == NULL) exit(1);
+
+    memcpy(group->ops, ops, op_count * sizeof(ShapeOp));
+    return group;
+}
+
+static void group_add(ShapeGroup *group, const double *constants, unsigned int program)
+{
+    if (group->lane_count == group->lane_max)
+    {
+        // the columns move apart, so they are laid out again
+        unsigned int lane_max = group->lane_max * 2;
+        unsigned int size = group->constant_count > 0 ? group->constant_count : 1;
+        double *columns = (double *)malloc(size * lane_max * sizeof(double));
+        unsigned int *programs = (unsigned int *)realloc(group->programs,
+                                                         lane_max * sizeof(unsigned int));
+        if (columns == NULL || programs == NULL) exit(1);
+
+        for (unsigned int k = 0; k < group->constant_count; k++)
+            memcpy(columns + k * lane_max, group->constants + k * group->lane_max,
+                   group->lane_count * sizeof(double));
+
+        free(group->constants);
+        group->constants = columns;
+        group->programs = programs;
+        group->lane_max = lane_max;
+    }
+
+    for (unsigned int k = 0; k < group->constant_count; k++)
+        group->constants[k * group->lane_max + group->lane_count] = constants[k];
+
+    group->programs[group->lane_count] = program;
+    group->lane_count += 1;
+}
+
+static void add_single(ShapeBatch *batch, const TokenList program, unsigned int number)
+{
+    if (batch->single_count == batch->single_max)
+    {
+        batch->single_max *= 2;
+        batch->singles = (TokenList *)realloc(batch->singles,
+                                              batch->single_max * sizeof(TokenList));
+        batch->single_programs = (unsigned int *)realloc(batch->single_programs,
+                                                         batch->single_max * sizeof(unsigned int));
+        if (batch->singles == NULL || batch->single_programs == NULL) exit(1);
+    }
+
+    TokenList copy = new_tokenlist();
+    for (unsigned int i = 0; i < program.count; i++)
+        tokenlist_add(&copy, program.list[i]);
+
+    batch->singles[batch->single_count] = copy;
+    batch->single_programs[batch->single_count] = number;
+    batch->single_count += 1;
+}
+
+unsigned int shape_batch_add_program(ShapeBatch *batch, const TokenList program)
+{
+    unsigned int number = batch->program_count++;
+
+    // a shape has at most one operation per token and one join per jump,
+    // the buffers of short programs are on the stack
+    ShapeOp local_ops[SHAPE_LOCAL_TOKENS * 2];
+    double local_constants[SHAPE_LOCAL_TOKENS];
+    unsigned int local_joins[SHAPE_LOCAL_TOKENS];
+    ShapeOp *ops = local_ops;
+    double *constants = local_constants;
+    unsigned int *joins = local_joins;
+
+    bool local = program.count < SHAPE_LOCAL_TOKENS;
+    if (!local)
+    {
+        ops = (ShapeOp *)malloc((program.count + 1) * 2 * sizeof(ShapeOp));
+        constants = (double *)malloc((program.count + 1) * sizeof(double));
+        joins = (unsigned int *)malloc((program.count + 1) * sizeof(unsigned int));
+        if (ops == NULL || constants == NULL || joins == NULL) exit(1);
+    }
+
+    unsigned int op_count, constant_count, depth, level;
+    bool shaped = build_shape(program, ops, &op_count, constants, &constant_count,
+                              joins, &depth, &level);
+    if (!shaped)
+        add_single(batch, program, number);
+
+    unsigned int h = shaped ? hash(ops, op_count) : 0;
+    unsigned int slot = shaped ? find_slot(batch, ops, op_count, h) : 0;
+
+    if (shaped && batch->slots[slot] == 0)
+    {
+        if (batch->group_count == batch->group_max)
+        {
+            batch->group_max *= 2;
+            batch->groups = (ShapeGroup **)realloc(batch->groups,
+                                                   batch->group_max * sizeof(ShapeGroup *));
+            if (batch->groups == NULL) exit(1);
+        }
+
+        batch->groups[batch->group_count] = new_group(ops, op_count, constant_count, h);
+        batch->slots[slot] = batch->group_count + 1;
+        batch->group_count += 1;
+
+        if (depth > batch->depth_max)
+            batch->depth_max = depth;
+        if (level > batch->level_max)
+            batch->level_max = level;
+
+        // keep the load factor of the hash at or below one half
+        if (batch->group_count * 2 > batch->slot_count)
+            rehash(batch);
+
+        slot = find_slot(batch, ops, op_count, h);
+    }
+
+    if (shaped)
+        group_add(batch->groups[batch->slots[slot] - 1], constants, number);
+
+    if (!local)
+    {
+        free(ops);
+        free(constants);
+        free(joins);
+    }
+    return number;
+}
+
+ResultInfo shape_batch_add(ShapeBatch *batch, const char *expression, NameTable *names)
+{
+    TokenList program = new_tokenlist();
+    ResultInfo res = convert_names(expression, &program, names);
+    if (res.status == SUCCESS)
+        shape_batch_add_program(batch, program);
+
+    delete_tokenlist(program);
+    return res;
+}
+
+// EVALUATION
+
+// scratch space of one block, every column is SHAPE_BLOCK wide
+typedef struct
+{
+    // the values of a program sit at one lane of the columns,
+    // a number is read from its group without being copied
+    double *columns;
+    const double **values;
+
+    // lanes running at each level of nested conditionals,
+    // and whether their condition held
+    unsigned char *active;
+    unsigned char *taken;
+
+    error_type status[SHAPE_BLOCK];
+} ShapeScratch;
+
+// the first error of a lane is the one evaluate stops at,
+// lanes on the other branch of a conditional do not fail
+static inline void fail(ShapeScratch *s, const unsigned char *active,
+                        unsigned int lane, error_type error)
+{
+    if (active[lane] && s->status[lane] == SUCCESS)
+        s->status[lane] = error;
+}
+
+static inline void lanes_operator(ShapeScratch *s, const unsigned char *active,
+                                  operator_type type, const double *x, const double *y,
+                                  double *out, unsigned int n)
+{
+    switch (type)
+    {
+        case ADD: for (unsigned int l = 0; l < n; l++) out[l] = x[l] + y[l]; break;
+        case SUB: for (unsigned int l = 0; l < n; l++) out[l] = x[l] - y[l]; break;
+        case MULT: for (unsigned int l = 0; l < n; l++) out[l] = x[l] * y[l]; break;
+        case NEG: for (unsigned int l = 0; l < n; l++) out[l] = -1.0 * x[l]; break;
+        case ABS: for (unsigned int l = 0; l < n; l++) out[l] = fabs(x[l]); break;
+        case LESS: for (unsigned int l = 0; l < n; l++) out[l] = x[l] < y[l]; break;
+        case LESS_EQUAL: for (unsigned int l = 0; l < n; l++) out[l] = x[l] <= y[l]; break;
+        case GREATER: for (unsigned int l = 0; l < n; l++) out[l] = x[l] > y[l]; break;
+        case GREATER_EQUAL: for (unsigned int l = 0; l < n; l++) out[l] = x[l] >= y[l]; break;
+        case EQUAL: for (unsigned int l = 0; l < n; l++) out[l] = x[l] == y[l]; break;
+        case NOT_EQUAL: for (unsigned int l = 0; l < n; l++) out[l] = x[l] != y[l]; break;
+
+        case DIV:
+            for (unsigned int l = 0; l < n; l++)
+                out[l] = x[l] / y[l];
+            for (unsigned int l = 0; l < n; l++)
+                if (y[l] == 0)
+                    fail(s, active, l, ZERO_DIVISON);
+            break;
+
+        // the rest go lane by lane the way evaluate computes them,
+        // skipping lanes that failed or do not run
+        default:
+            for (unsigned int l = 0; l < n; l++)
+            {
+                if (!active[l] || s->status[l] != SUCCESS)
+                {
+                    out[l] = NAN;
+                    continue;
+                }
+
+                error_type error;
+                out[l] = apply_operator(type, x[l], y == NULL ? 0 : y[l], &error);
+                if (error != SUCCESS)
+                    s->status[l] = error;
+            }
+            break;
+    }
+}
+
+static inline void lanes_native(ShapeScratch *s, const unsigned char *active,
+                                const NativeFunction *native, const double **args,
+                                double *out, unsigned int n)
+{
+    if (native->vector != NULL)
+    {
+        native->vector(args, out, n);
+        return;
+    }
+
+    double arguments[FUNCTION_PARAMETERS_MAX];
+    for (unsigned int l = 0; l < n; l++)
+    {
+        if (!active[l] || s->status[l] != SUCCESS)
+        {
+            out[l] = NAN;
+            continue;
+        }
+
+        for (unsigned int k = 0; k < native->arity; k++)
+            arguments[k] = args[k][l];
+        out[l] = native->scalar(arguments);
+    }
+}
+
+// run lanes first to first + n - 1 of group, leaving
+// the value of each lane in values[0] and its status in status
+static inline __attribute__((always_inline))
+void run_block_body(const ShapeGroup *group, unsigned int first, unsigned int n,
+                    const double *variables, unsigned int stride, ShapeScratch *s)
+{
+    const double **values = s->values;
+    unsigned char *active = s->active;
+    unsigned int depth = 0, level = 0, constant = 0;
+
+    for (unsigned int l = 0; l < n; l++)
+    {
+        active[l] = 1;
+        s->status[l] = SUCCESS;
+    }
+
+    for (unsigned int i = 0; i < group->op_count; i++)
+    {
+        const ShapeOp *op = &group->ops[i];
+        unsigned char *running = active + level * SHAPE_BLOCK;
+        double *column;
+
+        switch (op->kind)
+        {
+            case SHAPE_CONSTANT:
+                values[depth++] = group->constants + constant * group->lane_max + first;
+                constant++;
+                break;
+
+            case SHAPE_VARIABLE:
+                column = s->columns + depth * SHAPE_BLOCK;
+                if (variables == NULL)
+                {
+                    for (unsigned int l = 0; l < n; l++)
+                    {
+                        column[l] = NAN;
+                        fail(s, running, l, UNDEFINED_VARIABLE);
+                    }
+                }
+                else
+                {
+                    for (unsigned int l = 0; l < n; l++)
+                        column[l] = variables[(unsigned long long)group->programs[first + l] *
+                                              stride + op->index];
+                }
+                values[depth++] = column;
+                break;
+
+            case SHAPE_OPERATOR:
+            {
+                operator_type type = (operator_type)op->index;
+                bool unary = isunary(type);
+                unsigned int base = depth - (unary ? 1 : 2);
+                column = s->columns + base * SHAPE_BLOCK;
+
+                lanes_operator(s, running, type, values[base], unary ? NULL : values[base + 1],
+                               column, n);
+                values[base] = column;
+                depth = base + 1;
+                break;
+            }
+
+            case SHAPE_NATIVE:
+            {
+                unsigned int base = depth - op->native->arity;
+                column = s->columns + base * SHAPE_BLOCK;
+
+                lanes_native(s, running, op->native, values + base, column, n);
+                values[base] = column;
+                depth = base + 1;
+                break;
+            }
+
+            // any value but 0 holds
+            case SHAPE_BRANCH:
+            {
+                const double *condition = values[--depth];
+                unsigned char *taken = s->taken + level * SHAPE_BLOCK;
+                unsigned char *inner = running + SHAPE_BLOCK;
+
+                for (unsigned int l = 0; l < n; l++)
+                {
+                    taken[l] = condition[l] != 0;
+                    inner[l] = running[l] & taken[l];
+                }
+                level++;
+                break;
+            }
+
+            case SHAPE_ELSE:
+            {
+                const unsigned char *outer = running - SHAPE_BLOCK;
+                const unsigned char *taken = s->taken + (level - 1) * SHAPE_BLOCK;
+
+                for (unsigned int l = 0; l < n; l++)
+                    running[l] = outer[l] & !taken[l];
+                break;
+            }
+
+            case SHAPE_JOIN:
+            {
+                const unsigned char *taken = s->taken + (level - 1) * SHAPE_BLOCK;
+                const double *then = values[depth - 2];
+                const double *other = values[depth - 1];
+                column = s->columns + (depth - 2) * SHAPE_BLOCK;
+
+                for (unsigned int l = 0; l < n; l++)
+                    column[l] = taken[l] ? then[l] : other[l];
+                values[depth - 2] = column;
+                depth--;
+                level--;
+                break;
+            }
+        }
+    }
+}
+
+static void run_block(const ShapeGroup *group, unsigned int first, unsigned int n,
+                      const double *variables, unsigned int stride, ShapeScratch *s)
+{
+    run_block_body(group, first, n, variables, stride, s);
+}
+
+#if defined(__SSE2__)
+
+// the same block compiled for AVX2, four lanes per instruction,
+// only called after the processor was checked for it
+__attribute__((target("avx2")))
+static void run_block_avx2(const ShapeGroup *group, unsigned int first, unsigned int n,
+                           const double *variables, unsigned int stride, ShapeScratch *s)
+{
+    run_block_body(group, first, n, variables, stride, s);
+}
+
+#endif // __SSE2__
+
+unsigned long long shape_batch_evaluate(const ShapeBatch *batch,
+                                        const double *variables, unsigned int stride,
+                                        double *results, error_type *errors)
+{
+    unsigned long long failed = 0;
+
+    ShapeScratch *s = (ShapeScratch *)malloc(sizeof(ShapeScratch));
+    if (s == NULL) exit(1);
+    s->columns = (double *)malloc(batch->depth_max * SHAPE_BLOCK * sizeof(double));
+    s->values = (const double **)malloc(batch->depth_max * sizeof(const double *));
+    s->active = (unsigned char *)malloc((batch->level_max + 1) * SHAPE_BLOCK);
+    s->taken = (unsigned char *)malloc((batch->level_max + 1) * SHAPE_BLOCK);
+    if (s->columns == NULL || s->values == NULL || s->active == NULL || s->taken == NULL) exit(1);
+
+    bool avx2 = false;
+#if defined(__SSE2__)
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    for (unsigned int g = 0; g < batch->group_count; g++)
+    {
+        const ShapeGroup *group = batch->groups[g];
+
+        for (unsigned int first = 0; first < group->lane_count; first += SHAPE_BLOCK)
+        {
+            unsigned int n = group->lane_count - first < SHAPE_BLOCK ?
+                             group->lane_count - first : SHAPE_BLOCK;
+
+#if defined(__SSE2__)
+            if (avx2)
+                run_block_avx2(group, first, n, variables, stride, s);
+            else
+#endif
+                run_block(group, first, n, variables, stride, s);
+
+            for (unsigned int l = 0; l < n; l++)
+            {
+                unsigned int program = group->programs[first + l];
+                errors[program] = s->status[l];
+                results[program] = s->status[l] == SUCCESS ? s->values[0][l] : NAN;
+                failed += s->status[l] != SUCCESS;
+            }
+        }
+    }
+    (void)avx2;
+
+    // programs without a shape run on their own
+    ParseContext context = new_parse_context();
+    for (unsigned int i = 0; i < batch->single_count; i++)
+    {
+        unsigned int program = batch->single_programs[i];
+        const double *row = variables == NULL ? NULL :
+                            variables + (unsigned long long)program * stride;
+        Token result = create_empty_token();
+        ResultInfo res = evaluate_context(&context, batch->singles[i], row, &result);
+
+        errors[program] = res.status;
+        results[program] = res.status == SUCCESS ? result.value.number : NAN;
+        failed += res.status != SUCCESS;
+    }
+    delete_parse_context(context);
+
+    free(s->columns);
+    free(s->values);
+    free(s->active);
+    free(s->taken);
+    free(s);
+    return failed;
+}
@@ -4,6 +4,7 @@
 // project includes
 #include "token.h"
 #include "parser.h"
+#include "probes.h"
 
 // syntax check process variables
 typedef struct
@@ -88,7 +89,14 @@ static bool validate_operand_expected(Token token, SyntaxCheckData *data)
         return false;
     }
 
-    if (token.type == NUMBER)
+    // a native call is followed by its arguments like a function
+    if (token.type == NATIVE)
+    {
+        data->sign_allowed = true;
+        return true;
+    }
+
+    if (token.type == NUMBER || token.type == VARIABLE)
     {
         data->operand_expected = false;
         data->sign_allowed = true;
@@ -115,7 +123,8 @@ static bool validate_operator_expected(Token token, SyntaxCheckData *data)
 
     if (token.type == OPERATOR)
     {
-        if (isunary(token.value.operator))
+        // commas are consumed by the calls they belong to
+        if (isunary(token.value.operator) || token.value.operator == COMMA)
         {
             data->status = INVALID_TOKEN;
             return false;
@@ -158,7 +167,7 @@ static bool final_validate(Token token, SyntaxCheckData *data)
         return false;
     }
 
-    if (token.type == NUMBER)
+    if (token.type == NUMBER || token.type == VARIABLE)
     {
         return true;
     }
@@ -202,13 +211,122 @@ ResultInfo syntax_check(const TokenList tokens)
     ResultInfo res;
 
     SyntaxCheckData data = init();
+    PARSER_PROBE(syntax_check_entry, tokens.count, tokens.count, SUCCESS, 0);
 
-    if (!validate(tokens, &data, &res))
+    if (validate(tokens, &data, &res))
     {
-        return res;
+        res.status = SUCCESS;
+        res.error_index = 0;
     }
 
-    res.status = SUCCESS;
-    res.error_index = 0;
+    PARSER_PROBE(syntax_check_return, tokens.count, tokens.count, res.status, res.error_index);
     return res;
 }
+
+// after an invalid token, continue as if the expression
+// had been written the way the token suggests
+static void resynchronize(Token token, SyntaxCheckData *data)
+{
+    // an unmatched right parenthesis is dropped
+    if (data->status == UNMATCHED_RIGHT_PAR)
+    {
+        data->right_par_count -= 1;
+    }
+
+    // an operand is missing, a right parenthesis still closes its group
+    // and anything else in place of the operand is dropped
+    else if (data->operand_expected)
+    {
+        if (token.type == PARENTHESIS && token.value.parenthesis == RIGHT)
+        {
+            if (data->right_par_count < data->left_par_count)
+                data->right_par_count += 1;
+
+            data->operand_expected = false;
+            data->operator_expected = true;
+        }
+    }
+
+    // an operator is missing before an operand, a left parenthesis
+    // or a function, which then start the next operand
+    else if (token.type == PARENTHESIS && token.value.parenthesis == LEFT)
+    {
+        data->left_par_count += 1;
+        data->operator_expected = false;
+        data->operand_expected = true;
+        data->sign_allowed = true;
+    }
+
+    else if (token.type == NATIVE ||
+             (token.type == OPERATOR && isunary(token.value.operator)))
+    {
+        data->operator_expected = false;
+        data->operand_expected = true;
+        data->sign_allowed = true;
+    }
+
+    data->status = SUCCESS;
+}
+
+// an EMPTY token from lex_recover stands in for whatever was expected
+static void accept_placeholder(SyntaxCheckData *data)
+{
+    data->operand_expected = !data->operand_expected;
+    data->operator_expected = !data->operand_expected;
+    data->sign_allowed = true;
+}
+
+// errors are found in column order, an error already reported
+// at the same column, as after resynchronizing, is not added again
+static void report(DiagnosticList *diagnostics, error_type status, unsigned int column)
+{
+    for (unsigned int i = diagnostics->count; i > 0; i--)
+    {
+        ResultInfo previous = diagnostics->list[i - 1];
+        if (previous.error_index != column)
+            break;
+        if (previous.status == status)
+            return;
+    }
+
+    diagnostic_list_add(diagnostics, status, column);
+}
+
+void syntax_check_recover(const TokenList tokens, DiagnosticList *diagnostics)
+{
+    SyntaxCheckData data = init();
+
+    for (unsigned int i = 0; i < tokens.count; i++)
+    {
+        if (tokens.list[i].type == EMPTY)
+        {
+            accept_placeholder(&data);
+        }
+
+        else if (!validate_token(tokens.list[i], &data))
+        {
+            // right after a placeholder the error most likely follows
+            // from the guess about what the broken word was, so it is
+            // not reported, as in "sinc(x)" taken as an operand
+            if (i == 0 || tokens.list[i - 1].type != EMPTY)
+                report(diagnostics, data.status, tokens.list[i].column);
+
+            resynchronize(tokens.list[i], &data);
+        }
+    }
+
+    if (tokens.count == 0)
+        return;
+
+    // same checks as final_validate, reporting both if both fail
+    Token last = tokens.list[tokens.count - 1];
+
+    if (data.right_par_count < data.left_par_count)
+        report(diagnostics, UNMATCHED_LEFT_PAR, last.column);
+
+    if (last.type != NUMBER && last.type != VARIABLE && last.type != EMPTY &&
+        !(last.type == PARENTHESIS && last.value.parenthesis == RIGHT))
+    {
+        report(diagnostics, INVALID_TOKEN, last.column);
+    }
+}
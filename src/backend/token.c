@@ -1,12 +1,13 @@
 // standard library includes
+#include <stdatomic.h>
 #include <stdlib.h>
 
 // project includes
 #include "token.h"
 
 // global allocation trackers
-// (not thread safe)
-static unsigned int list_alloc_count = 0;
+// (atomic, so lists may be created and deleted from multiple threads)
+static atomic_uint list_alloc_count = 0;
 
 Token create_empty_token(void)
 {
@@ -41,29 +42,38 @@ unsigned int precedence(operator_type t)
 {
     switch(t)
     {
-        case ADD: return 1; break;
-        case SUB: return 1; break;
-        case MULT: return 2; break;
-        case DIV: return 2; break;
-        case MOD: return 2; break;
-        case POW: return 3; break;
-        case NEG: return 4; break;
-        case SIN: return 4; break;
-        case COS: return 4; break;
-        case TAN: return 4; break;
-        case ASIN: return 4; break;
-        case ACOS: return 4; break;
-        case ATAN: return 4; break;
-        case SIND: return 4; break;
-        case COSD: return 4; break;
-        case TAND: return 4; break;
-        case ASIND: return 4; break;
-        case ACOSD: return 4; break;
-        case ATAND: return 4; break;
-        case LN: return 4; break;
-        case LOG: return 4; break;
-        case ABS: return 4; break;
-        case FAC: return 4; break;
+        case QUESTION: return 1; break;
+        case COLON: return 1; break;
+        case LESS: return 2; break;
+        case LESS_EQUAL: return 2; break;
+        case GREATER: return 2; break;
+        case GREATER_EQUAL: return 2; break;
+        case EQUAL: return 2; break;
+        case NOT_EQUAL: return 2; break;
+        case ADD: return 3; break;
+        case SUB: return 3; break;
+        case MULT: return 4; break;
+        case DIV: return 4; break;
+        case MOD: return 4; break;
+        case POW: return 5; break;
+        case NEG: return 6; break;
+        case SIN: return 6; break;
+        case COS: return 6; break;
+        case TAN: return 6; break;
+        case ASIN: return 6; break;
+        case ACOS: return 6; break;
+        case ATAN: return 6; break;
+        case SIND: return 6; break;
+        case COSD: return 6; break;
+        case TAND: return 6; break;
+        case ASIND: return 6; break;
+        case ACOSD: return 6; break;
+        case ATAND: return 6; break;
+        case LN: return 6; break;
+        case LOG: return 6; break;
+        case ABS: return 6; break;
+        case FAC: return 6; break;
+        case SQRT: return 6; break;
         default: return 0; break;
     }
 }
@@ -75,7 +85,8 @@ bool isunary(operator_type t)
         t == SIND || t == COSD || t == TAND ||
         t == ASIND || t == ACOSD || t == ATAND ||
         t == LN || t == LOG || t == ABS || t == FAC ||
-        t == NEG)
+        t == NEG || t == SQRT ||
+        t == INEG || t == IABS || t == IFAC || t == PROMOTE)
     {
         return true;
     }
@@ -83,6 +94,43 @@ bool isunary(operator_type t)
     return false;
 }
 
+// fused operators whose operand is stored in the token that follows them
+bool hasimmediate(operator_type t)
+{
+    if (t == ADD_IMM || t == SUB_IMM || t == MULT_IMM ||
+        t == DIV_IMM || t == MOD_IMM || t == POW_IMM ||
+        t == NEG_CALL || t == CALL_NEG || t == POW_INT ||
+        t == RESERVE || t == STORE || t == LOAD ||
+        t == JUMP_FALSE || t == JUMP)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+// values an operator takes off the stack, it leaves one,
+// RESERVE, STORE, LOAD and the jumps are not counted by it
+unsigned int operator_arity(operator_type t)
+{
+    switch (t)
+    {
+        case MULT_ADD: case MULT_SUB: case ADD_MULT: case SUB_MULT:
+            return 3;
+        case ADD_IMM: case SUB_IMM: case MULT_IMM: case DIV_IMM: case MOD_IMM:
+        case POW_IMM: case POW_INT: case NEG_CALL: case CALL_NEG:
+            return 1;
+        default:
+            return isunary(t) ? 1 : 2;
+    }
+}
+
+bool iscomparison(operator_type t)
+{
+    return t == LESS || t == LESS_EQUAL || t == GREATER ||
+           t == GREATER_EQUAL || t == EQUAL || t == NOT_EQUAL;
+}
+
 Token create_parenthesis_token(parenthesis_type type, int column)
 {
     Token res;
@@ -97,6 +145,46 @@ Token create_parenthesis_token(parenthesis_type type, int column)
     return res;
 }
 
+Token create_variable_token(unsigned int index, unsigned int column)
+{
+    Token res;
+    res.type = VARIABLE;
+    res.column = column;
+    res.value.variable = index;
+
+    return res;
+}
+
+Token create_integer_token(long long value, unsigned int column)
+{
+    Token res;
+    res.type = INTEGER;
+    res.column = column;
+    res.value.integer = value;
+
+    return res;
+}
+
+Token create_function_token(unsigned int index, unsigned int column)
+{
+    Token res;
+    res.type = FUNCTION;
+    res.column = column;
+    res.value.variable = index;
+
+    return res;
+}
+
+Token create_native_token(const struct NativeFunction *native, unsigned int column)
+{
+    Token res;
+    res.type = NATIVE;
+    res.column = column;
+    res.value.native = native;
+
+    return res;
+}
+
 // token list functions
 TokenList new_tokenlist()
 {
@@ -104,6 +192,8 @@ TokenList new_tokenlist()
     obj.count = 0;
     obj.max = 8;
     obj.list = (Token *)calloc(8, sizeof(Token));
+    obj.fixed = false;
+    obj.overflow = false;
     list_alloc_count += 1;
 
     if (obj.list == NULL) exit(1);
@@ -111,8 +201,24 @@ TokenList new_tokenlist()
     return obj;
 }
 
+TokenList tokenlist_from_buffer(Token *buffer, unsigned int capacity)
+{
+    TokenList obj;
+    obj.count = 0;
+    obj.max = capacity;
+    obj.list = buffer;
+    obj.fixed = true;
+    obj.overflow = false;
+
+    return obj;
+}
+
 void delete_tokenlist(TokenList tokenlist)
 {
+    // caller storage is not ours to free
+    if (tokenlist.fixed)
+        return;
+
     free(tokenlist.list);
     list_alloc_count -= 1;
 }
@@ -120,6 +226,7 @@ void delete_tokenlist(TokenList tokenlist)
 void clear_tokenlist(TokenList *self)
 {
     self->count = 0;
+    self->overflow = false;
 }
 
 void tokenlist_add(TokenList *self, Token value)
@@ -130,6 +237,11 @@ void tokenlist_add(TokenList *self, Token value)
         self->count += 1;
     }
 
+    else if (self->fixed)
+    {
+        self->overflow = true;
+    }
+
     else
     {
         self->max = self->max * 2;
@@ -0,0 +1,97 @@
+// getline is POSIX 2008
+#define _POSIX_C_SOURCE 200809L
+
+// standard library includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// project includes
+#include "parser.h"
+#include "check.h"
+
+const char *error_message(error_type status)
+{
+    switch (status)
+    {
+        case MULTIPLE_DECIMAL_POINTS: return "SyntaxError: Multiple decimal points in number";
+        case NUM_ENDS_WITH_DOT: return "SyntaxError: Number ending with decimal point";
+        case INVALID_INPUT_CHARACTER: return "SyntaxError: Invalid input";
+        case INVALID_TOKEN: return "SyntaxError: Invalid token";
+        case UNMATCHED_LEFT_PAR: return "SyntaxError: ')' expected";
+        case UNMATCHED_RIGHT_PAR: return "SyntaxError: Unmatched right parentheses";
+        case ZERO_DIVISON: return "MathError: Divison by zero";
+        case NEGATIVE_FRACTIONAL_EXPONENT:
+            return "ParseError: Negative number with fractional exponent not supported";
+        case ZERO_NEGATIVE_EXPONENT: return "MathError: Zero with negative exponent";
+        case TANGENT_UNDEFINED: return "MathError: Tangent of argument is undefined";
+        case ARCUS_OUT_OF_RANGE: return "MathError: Arcus function argument out of range";
+        case LOG_OUT_OF_RANGE: return "MathError: Logarithm function argument out of range";
+        case FAC_INPUT_NOT_INT: return "MathError: Factorial input must be an integer";
+        case UNDEFINED_VARIABLE: return "NameError: Undefined variable";
+        case CIRCULAR_REFERENCE: return "NameError: Circular reference";
+        case CAPACITY_EXCEEDED: return "MemoryError: Token capacity exceeded";
+        case BOUND_NOT_FINITE: return "MathError: Bound must be finite";
+        case NO_SIGN_CHANGE: return "MathError: No sign change between root bounds";
+        case NOT_CONVERGED: return "MathError: Integral does not converge";
+        default: return "";
+    }
+}
+
+int run_check(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+
+    // identifiers are allowed, formula sheets refer to their inputs by name
+    NameTable names = new_nametable();
+    TokenList tokens = new_tokenlist();
+    DiagnosticList diagnostics = new_diagnostic_list();
+
+    char *line = NULL;
+    size_t line_size = 0;
+    unsigned int line_number = 0;
+    unsigned int expression_count = 0;
+    unsigned int failed_count = 0;
+    unsigned int error_count = 0;
+
+    while (getline(&line, &line_size, file) != -1)
+    {
+        line_number += 1;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        // blank lines separate groups of formulas
+        if (line[strspn(line, " \t")] == '\0')
+            continue;
+
+        expression_count += 1;
+        if (validate_expression(line, &names, &tokens, &diagnostics) == 0)
+            continue;
+
+        failed_count += 1;
+        error_count += diagnostics.count;
+
+        // columns are printed counting from one, as editors do
+        for (unsigned int i = 0; i < diagnostics.count; i++)
+        {
+            printf("%s:%u:%u: %s\n", path, line_number,
+                   diagnostics.list[i].error_index + 1,
+                   error_message(diagnostics.list[i].status));
+        }
+    }
+
+    printf("%u of %u expressions have errors, %u errors in total\n",
+           failed_count, expression_count, error_count);
+
+    free(line);
+    delete_diagnostic_list(diagnostics);
+    delete_tokenlist(tokens);
+    delete_nametable(names);
+    fclose(file);
+
+    return failed_count > 0 ? 1 : 0;
+}
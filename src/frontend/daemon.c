@@ -0,0 +1,693 @@
+// accept4 is a GNU extension
+#define _GNU_SOURCE
+
+// standard library includes
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// project includes
+#include "parser.h"
+#include "protocol.h"
+#include "shm_ring.h"
+#include "daemon.h"
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 65536
+
+// growable byte buffer
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t max;
+} Buffer;
+
+// one client connection, owned by the event loop
+typedef struct
+{
+    int fd;
+    unsigned long id; // tells apart connections that reuse a descriptor
+    Buffer in;
+    Buffer out;
+    size_t out_pos;
+    bool busy;        // a batch of this connection is with the workers
+    bool peer_closed; // no more input, close once the output is flushed
+    bool registered;  // descriptor is in the epoll set
+} Connection;
+
+// one batch travelling between the event loop and a worker
+typedef struct Job
+{
+    struct Job *next;
+    int fd;
+    unsigned long id;
+    Buffer request;  // request frame body
+    Buffer response; // complete response frame
+    bool malformed;
+} Job;
+
+typedef struct
+{
+    Job *head;
+    Job *tail;
+} JobQueue;
+
+// state shared between the event loop and the workers
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    JobQueue pending;
+    JobQueue done;
+    bool stopping;
+    int event_fd; // signals finished jobs to the event loop
+} Pool;
+
+// event loop state
+typedef struct
+{
+    int epoll_fd;
+    int listen_fd;
+    Connection **by_fd;
+    unsigned int by_fd_max;
+    unsigned long next_id;
+    Pool *pool;
+} Loop;
+
+static volatile sig_atomic_t stop_requested = 0;
+static ShmRing *served_ring = NULL;
+
+static void handle_stop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
+
+    if (served_ring != NULL)
+        shm_ring_shutdown(served_ring);
+}
+
+static void install_stop_handler(void)
+{
+    // no SA_RESTART, so a signal interrupts blocking waits
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+// BUFFER FUNCTIONS
+static void buffer_reserve(Buffer *self, size_t extra)
+{
+    if (self->len + extra <= self->max)
+        return;
+
+    size_t max = self->max == 0 ? 256 : self->max;
+    while (max < self->len + extra)
+        max *= 2;
+
+    self->data = (char *)realloc(self->data, max);
+    if (self->data == NULL) exit(1);
+    self->max = max;
+}
+
+static void buffer_append(Buffer *self, const void *src, size_t n)
+{
+    buffer_reserve(self, n);
+    memcpy(self->data + self->len, src, n);
+    self->len += n;
+}
+
+static void buffer_consume(Buffer *self, size_t n)
+{
+    memmove(self->data, self->data + n, self->len - n);
+    self->len -= n;
+}
+
+static bool read_u32(const Buffer *self, size_t *pos, uint32_t *value)
+{
+    if (self->len - *pos < sizeof(uint32_t))
+        return false;
+
+    memcpy(value, self->data + *pos, sizeof(uint32_t));
+    *pos += sizeof(uint32_t);
+    return true;
+}
+
+// JOB QUEUE FUNCTIONS
+static void queue_push(JobQueue *self, Job *job)
+{
+    job->next = NULL;
+    if (self->tail == NULL)
+        self->head = job;
+    else
+        self->tail->next = job;
+    self->tail = job;
+}
+
+static Job *queue_pop(JobQueue *self)
+{
+    Job *job = self->head;
+    if (job != NULL)
+    {
+        self->head = job->next;
+        if (self->head == NULL)
+            self->tail = NULL;
+    }
+
+    return job;
+}
+
+static void delete_job(Job *job)
+{
+    free(job->request.data);
+    free(job->response.data);
+    free(job);
+}
+
+// WORKER FUNCTIONS
+static void process_batch(Job *job, ParseContext *context, Buffer *text)
+{
+    size_t pos = 0;
+    uint32_t count;
+
+    if (!read_u32(&job->request, &pos, &count) ||
+        count > job->request.len / sizeof(uint32_t) ||
+        count > (PROTOCOL_MAX_FRAME - sizeof(uint32_t)) / sizeof(ProtocolResult))
+    {
+        job->malformed = true;
+        return;
+    }
+
+    uint32_t frame_len = sizeof(uint32_t) + count * sizeof(ProtocolResult);
+    buffer_reserve(&job->response, sizeof(uint32_t) + frame_len);
+    buffer_append(&job->response, &frame_len, sizeof(uint32_t));
+    buffer_append(&job->response, &count, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t length;
+        if (!read_u32(&job->request, &pos, &length) ||
+            job->request.len - pos < length)
+        {
+            job->malformed = true;
+            return;
+        }
+
+        // the parser expects a terminated string
+        text->len = 0;
+        buffer_append(text, job->request.data + pos, length);
+        buffer_append(text, "", 1);
+        pos += length;
+
+        Token result = create_empty_token();
+        ResultInfo res = parse_context(context, text->data, &result);
+
+        ProtocolResult out;
+        out.status = res.status;
+        out.error_index = res.error_index;
+        out.value = res.status == SUCCESS ? result.value.number : 0;
+        buffer_append(&job->response, &out, sizeof(ProtocolResult));
+    }
+
+    if (pos != job->request.len)
+        job->malformed = true;
+}
+
+static void *worker_main(void *arg)
+{
+    Pool *pool = (Pool *)arg;
+
+    // per worker parser state, reused by every batch
+    ParseContext context = new_parse_context();
+    Buffer text = { NULL, 0, 0 };
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending.head == NULL && !pool->stopping)
+            pthread_cond_wait(&pool->ready, &pool->lock);
+
+        Job *job = queue_pop(&pool->pending);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (job == NULL)
+            break;
+
+        process_batch(job, &context, &text);
+
+        pthread_mutex_lock(&pool->lock);
+        queue_push(&pool->done, job);
+        pthread_mutex_unlock(&pool->lock);
+
+        uint64_t one = 1;
+        if (write(pool->event_fd, &one, sizeof(one)) < 0) {}
+    }
+
+    delete_parse_context(context);
+    free(text.data);
+    return NULL;
+}
+
+// CONNECTION FUNCTIONS
+static void close_connection(Loop *loop, Connection *conn)
+{
+    if (conn->registered)
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    loop->by_fd[conn->fd] = NULL;
+
+    // a batch still with the workers is dropped when it returns
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+}
+
+static bool frame_complete(const Buffer *in, uint32_t *body_len)
+{
+    size_t pos = 0;
+    if (!read_u32(in, &pos, body_len))
+        return false;
+
+    return in->len - pos >= *body_len;
+}
+
+static void update_interest(Loop *loop, Connection *conn)
+{
+    uint32_t body_len;
+    struct epoll_event ev;
+    ev.data.fd = conn->fd;
+    ev.events = 0;
+
+    // stop reading while a complete frame is already waiting
+    if (!conn->peer_closed && !(conn->busy && frame_complete(&conn->in, &body_len)))
+        ev.events |= EPOLLIN;
+    if (conn->out_pos < conn->out.len)
+        ev.events |= EPOLLOUT;
+
+    // hangups are reported regardless of the interest set,
+    // so a connection with nothing to wait for leaves the set
+    if (ev.events == 0)
+    {
+        if (conn->registered)
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        conn->registered = false;
+    }
+
+    else
+    {
+        epoll_ctl(loop->epoll_fd,
+                  conn->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                  conn->fd, &ev);
+        conn->registered = true;
+    }
+}
+
+// hand the next complete frame to the workers
+// batches of one connection are answered in order, one at a time
+static void dispatch(Loop *loop, Connection *conn)
+{
+    uint32_t body_len;
+    if (conn->busy || !frame_complete(&conn->in, &body_len))
+        return;
+
+    Job *job = (Job *)calloc(1, sizeof(Job));
+    if (job == NULL) exit(1);
+
+    job->fd = conn->fd;
+    job->id = conn->id;
+    buffer_append(&job->request, conn->in.data + sizeof(uint32_t), body_len);
+    buffer_consume(&conn->in, sizeof(uint32_t) + body_len);
+    conn->busy = true;
+
+    pthread_mutex_lock(&loop->pool->lock);
+    queue_push(&loop->pool->pending, job);
+    pthread_cond_signal(&loop->pool->ready);
+    pthread_mutex_unlock(&loop->pool->lock);
+}
+
+// returns false if the connection was closed
+static bool flush_connection(Loop *loop, Connection *conn)
+{
+    while (conn->out_pos < conn->out.len)
+    {
+        ssize_t n = send(conn->fd, conn->out.data + conn->out_pos,
+                         conn->out.len - conn->out_pos, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+
+            close_connection(loop, conn);
+            return false;
+        }
+
+        conn->out_pos += n;
+    }
+
+    if (conn->out_pos == conn->out.len)
+    {
+        conn->out.len = 0;
+        conn->out_pos = 0;
+
+        if (conn->peer_closed && !conn->busy)
+        {
+            close_connection(loop, conn);
+            return false;
+        }
+    }
+
+    update_interest(loop, conn);
+    return true;
+}
+
+// reading stops once the frame at the front is complete, so at most
+// that frame and one read past it are buffered, a header over the
+// limit closes the connection before its body is read
+static void read_connection(Loop *loop, Connection *conn)
+{
+    while (true)
+    {
+        size_t want = READ_CHUNK;
+        uint32_t body_len;
+        size_t pos = 0;
+
+        if (read_u32(&conn->in, &pos, &body_len))
+        {
+            if (body_len > PROTOCOL_MAX_FRAME)
+            {
+                close_connection(loop, conn);
+                return;
+            }
+
+            if (conn->in.len - pos >= body_len)
+                break;
+
+            size_t missing = body_len - (conn->in.len - pos);
+            if (missing < want)
+                want = missing;
+        }
+
+        buffer_reserve(&conn->in, want);
+        ssize_t n = read(conn->fd, conn->in.data + conn->in.len, want);
+
+        if (n > 0)
+        {
+            conn->in.len += n;
+            continue;
+        }
+
+        if (n == 0)
+        {
+            conn->peer_closed = true;
+            break;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+        close_connection(loop, conn);
+        return;
+    }
+
+    dispatch(loop, conn);
+    flush_connection(loop, conn);
+}
+
+static void accept_connections(Loop *loop)
+{
+    while (true)
+    {
+        int fd = accept4(loop->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        if ((unsigned int)fd >= loop->by_fd_max)
+        {
+            unsigned int old_max = loop->by_fd_max;
+            while (loop->by_fd_max <= (unsigned int)fd)
+                loop->by_fd_max *= 2;
+
+            loop->by_fd = (Connection **)realloc(loop->by_fd,
+                    loop->by_fd_max * sizeof(Connection *));
+            if (loop->by_fd == NULL) exit(1);
+            memset(loop->by_fd + old_max, 0,
+                   (loop->by_fd_max - old_max) * sizeof(Connection *));
+        }
+
+        Connection *conn = (Connection *)calloc(1, sizeof(Connection));
+        if (conn == NULL) exit(1);
+        conn->fd = fd;
+        conn->id = loop->next_id++;
+        loop->by_fd[fd] = conn;
+
+        update_interest(loop, conn);
+    }
+}
+
+static void collect_done(Loop *loop)
+{
+    uint64_t count;
+    if (read(loop->pool->event_fd, &count, sizeof(count)) < 0) {}
+
+    pthread_mutex_lock(&loop->pool->lock);
+    Job *job = loop->pool->done.head;
+    loop->pool->done.head = NULL;
+    loop->pool->done.tail = NULL;
+    pthread_mutex_unlock(&loop->pool->lock);
+
+    while (job != NULL)
+    {
+        Job *next = job->next;
+        Connection *conn = loop->by_fd[job->fd];
+
+        if (conn != NULL && conn->id == job->id)
+        {
+            conn->busy = false;
+
+            if (job->malformed)
+            {
+                close_connection(loop, conn);
+            }
+
+            else
+            {
+                buffer_append(&conn->out, job->response.data, job->response.len);
+                dispatch(loop, conn);
+                flush_connection(loop, conn);
+            }
+        }
+
+        delete_job(job);
+        job = next;
+    }
+}
+
+static int open_socket(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0)
+    {
+        perror(socket_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int run_daemon(const char *socket_path, unsigned int worker_count)
+{
+    if (worker_count == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = online > 0 ? (unsigned int)online : 1;
+    }
+
+    Loop loop;
+    loop.listen_fd = open_socket(socket_path);
+    if (loop.listen_fd < 0)
+        return 1;
+
+    Pool pool;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pool.pending.head = pool.pending.tail = NULL;
+    pool.done.head = pool.done.tail = NULL;
+    pool.stopping = false;
+    pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop.by_fd_max = 64;
+    loop.by_fd = (Connection **)calloc(loop.by_fd_max, sizeof(Connection *));
+    loop.next_id = 1;
+    loop.pool = &pool;
+    if (loop.by_fd == NULL) exit(1);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = loop.listen_fd;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.listen_fd, &ev);
+    ev.data.fd = pool.event_fd;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, pool.event_fd, &ev);
+
+    install_stop_handler();
+
+    // the stop signals are only taken while the loop waits, one that comes
+    // in between is held until then instead of being missed before a wait,
+    // the workers inherit the mask and never take them
+    sigset_t stop_signals, original_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &original_mask);
+
+    sigset_t wait_mask = original_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+
+    // a pool short of workers is not started, the ones running are stopped
+    int exit_code = 0;
+    pthread_t *workers = (pthread_t *)malloc(worker_count * sizeof(pthread_t));
+    if (workers == NULL) exit(1);
+    for (unsigned int i = 0; i < worker_count; i++)
+    {
+        int error = pthread_create(&workers[i], NULL, worker_main, &pool);
+        if (error != 0)
+        {
+            fprintf(stderr, "Cannot start worker: %s\n", strerror(error));
+            worker_count = i;
+            exit_code = 1;
+            break;
+        }
+    }
+
+    if (exit_code == 0)
+    {
+        printf("Listening on %s with %u workers\n", socket_path, worker_count);
+        fflush(stdout);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (exit_code == 0 && !stop_requested)
+    {
+        int n = epoll_pwait(loop.epoll_fd, events, MAX_EVENTS, -1, &wait_mask);
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == loop.listen_fd)
+            {
+                accept_connections(&loop);
+            }
+
+            else if (fd == pool.event_fd)
+            {
+                collect_done(&loop);
+            }
+
+            else if (loop.by_fd[fd] != NULL)
+            {
+                Connection *conn = loop.by_fd[fd];
+
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read_connection(&loop, conn);
+                else if (events[i].events & EPOLLOUT)
+                    flush_connection(&loop, conn);
+            }
+        }
+    }
+
+    // stop the workers and release everything
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (unsigned int i = 0; i < worker_count; i++)
+        pthread_join(workers[i], NULL);
+    pthread_sigmask(SIG_SETMASK, &original_mask, NULL);
+
+    Job *job;
+    while ((job = queue_pop(&pool.pending)) != NULL)
+        delete_job(job);
+    while ((job = queue_pop(&pool.done)) != NULL)
+        delete_job(job);
+
+    for (unsigned int fd = 0; fd < loop.by_fd_max; fd++)
+        if (loop.by_fd[fd] != NULL)
+            close_connection(&loop, loop.by_fd[fd]);
+
+    free(loop.by_fd);
+    free(workers);
+    close(loop.epoll_fd);
+    close(pool.event_fd);
+    close(loop.listen_fd);
+    unlink(socket_path);
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.ready);
+
+    return exit_code;
+}
+
+int run_shm_evaluator(const char *name, const char *program, const char *variables)
+{
+    ShmRing ring;
+    if (!shm_ring_create(&ring, name, 1024, program, variables))
+    {
+        perror(name);
+        return 1;
+    }
+
+    served_ring = &ring;
+    install_stop_handler();
+
+    printf("Serving shared memory ring %s\n", name);
+    fflush(stdout);
+
+    bool valid = shm_ring_serve(&ring);
+    if (!valid)
+        fprintf(stderr, "Invalid row program, row requests were answered with its error\n");
+
+    served_ring = NULL;
+    shm_ring_close(&ring);
+    shm_ring_unlink(name);
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef CHECK
+#define CHECK
+
+// project includes
+#include "parser.h"
+
+// message printed for an error
+const char *error_message(error_type status);
+
+// validate every line of a file as one expression and print
+// all errors as path:line:column: message
+// returns the process exit code, 1 if any expression has errors
+int run_check(const char *path);
+
+#endif // CHECK
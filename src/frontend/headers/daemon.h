@@ -0,0 +1,14 @@
+#ifndef DAEMON
+#define DAEMON
+
+// serve parse requests on a unix domain socket until SIGINT or SIGTERM
+// worker_count of 0 uses one worker per online processor
+// returns the process exit code
+int run_daemon(const char *socket_path, unsigned int worker_count);
+
+// create a shared memory ring and evaluate its requests
+// until a client shuts it down or SIGINT or SIGTERM
+// program and variables may be NULL when only text is served
+int run_shm_evaluator(const char *name, const char *program, const char *variables);
+
+#endif // DAEMON
@@ -0,0 +1,31 @@
+#ifndef PROTOCOL
+#define PROTOCOL
+
+// standard library includes
+#include <stdint.h>
+
+// Daemon wire protocol
+//
+// every message is a frame: a uint32_t body length followed by the body
+// all integers are in host byte order, the socket is local only
+//
+// request body:
+//   uint32_t count
+//   count times: uint32_t length, length bytes of expression text
+//
+// response body:
+//   uint32_t count
+//   count times: a ProtocolResult
+//
+// a malformed request closes the connection
+
+#define PROTOCOL_MAX_FRAME (64u * 1024u * 1024u)
+
+typedef struct
+{
+    uint32_t status;      // error_type of the ResultInfo
+    uint32_t error_index; // error_index of the ResultInfo
+    double value;         // result when status is SUCCESS
+} ProtocolResult;
+
+#endif // PROTOCOL
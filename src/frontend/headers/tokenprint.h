@@ -3,9 +3,12 @@
 
 // project includes
 #include "token.h"
+#include "dag.h"
 
 void print_token(Token token);
 
 void print_tokenlist(TokenList tokenlist);
 
+void print_expression_dag(const ExpressionDag *dag);
+
 #endif // TOKENPRINT
@@ -1,15 +1,21 @@
 // standard library includes
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // project includes
 #include "tokenprint.h"
 #include "parser.h"
+#include "optimize.h"
+#include "dag.h"
+#include "daemon.h"
+#include "check.h"
 
 #define BUFSIZE 1024
 
 static void print_result_error(ResultInfo resinfo, const char *input_string);
 static void interactive_mode(void);
+static int analyze_mode(const char *expression, const char *cost_path);
 
 int main(int argc, const char **argv)
 {
@@ -23,11 +29,20 @@ int main(int argc, const char **argv)
     {
         if (!strcmp(argv[1], "-h"))
         {
-            printf( "usage: %s [-p] [expression]\n\n", *argv);
+            printf( "usage: %s [-p|-o|-d] [expression]\n\n", *argv);
             printf( "%s",
                     "default           interactive mode\n"
                     "expression        calculate expression\n"
                     "-p  expression    print expression in postfix notation\n"
+                    "-o  expression    print optimized postfix notation\n"
+                    "-d  expression    print shared subexpressions\n"
+                    "--check file      report every error of each line of file\n"
+                    "--analyze expression [costfile]\n"
+                    "                  estimate the cost of evaluating expression\n"
+                    "--daemon socket [workers]\n"
+                    "                  serve batches on a unix domain socket\n"
+                    "--shm name [expression [variable ...]]\n"
+                    "                  serve a shared memory ring\n"
                     "\nOperators: + - * / % ^\n"
                     "Functions: sin, cos, tan, ln, log, abs, fac\n"
                     "For trig functions prepend 'a' for arcus and append 'd' for degree.\n"
@@ -38,7 +53,7 @@ int main(int argc, const char **argv)
         }
 
         Token result = create_empty_token();
-        ResultInfo parse_res = parse(argv[1], &result);
+        ResultInfo parse_res = parse_exact(argv[1], &result);
 
         if (parse_res.status != SUCCESS)
         {
@@ -54,7 +69,7 @@ int main(int argc, const char **argv)
         return 0;
     }
 
-    else if (argc == 3 && !strcmp(argv[1], "-p"))
+    else if (argc == 3 && (!strcmp(argv[1], "-p") || !strcmp(argv[1], "-o")))
     {
         TokenList t_list = new_tokenlist();
         ResultInfo conv_res = convert(argv[2], &t_list);
@@ -66,6 +81,8 @@ int main(int argc, const char **argv)
 
         else
         {
+            if (!strcmp(argv[1], "-o"))
+                optimize(&t_list, OPTIMIZE_FOLD | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
             print_tokenlist(t_list);
         }
 
@@ -73,9 +90,77 @@ int main(int argc, const char **argv)
         return 0;
     }
 
+    else if (argc == 3 && !strcmp(argv[1], "-d"))
+    {
+        TokenList t_list = new_tokenlist();
+        ResultInfo conv_res = convert(argv[2], &t_list);
+
+        if (conv_res.status != SUCCESS)
+        {
+            print_result_error(conv_res, argv[2]);
+        }
+
+        else
+        {
+            ExpressionDag dag = new_expression_dag(t_list);
+
+            // conditionals have no graph, their program is shown as it is
+            if (!dag.valid)
+                print_tokenlist(t_list);
+
+            else
+            {
+                print_expression_dag(&dag);
+
+                if (dag_emit(&dag, &t_list))
+                    print_tokenlist(t_list);
+            }
+
+            delete_expression_dag(dag);
+        }
+
+        delete_tokenlist(t_list);
+        return 0;
+    }
+
+    else if (argc == 3 && !strcmp(argv[1], "--check"))
+    {
+        return run_check(argv[2]);
+    }
+
+    else if ((argc == 3 || argc == 4) && !strcmp(argv[1], "--analyze"))
+    {
+        return analyze_mode(argv[2], argc == 4 ? argv[3] : NULL);
+    }
+
+    else if ((argc == 3 || argc == 4) && !strcmp(argv[1], "--daemon"))
+    {
+        unsigned int workers = 0;
+        if (argc == 4)
+            workers = (unsigned int)strtoul(argv[3], NULL, 10);
+
+        return run_daemon(argv[2], workers);
+    }
+
+    else if (argc >= 3 && !strcmp(argv[1], "--shm"))
+    {
+        // row values are bound to the variables in the listed order
+        char variables[BUFSIZE] = "";
+        for (int i = 4; i < argc; i++)
+        {
+            if (strlen(variables) + strlen(argv[i]) + 2 > sizeof(variables))
+                break;
+
+            strcat(variables, argv[i]);
+            strcat(variables, " ");
+        }
+
+        return run_shm_evaluator(argv[2], argc > 3 ? argv[3] : NULL, variables);
+    }
+
     else
     {
-        printf( "usage: %s [-p] [expression]\n", *argv);
+        printf( "usage: %s [-p|-o|-d] [expression]\n", *argv);
         return 0;
     }
 }
@@ -95,7 +180,7 @@ static void print_result_error(ResultInfo resinfo, const char *input_string)
         printf("^\n");
 
         // error message
-        printf("SyntaxError: ')' expected\n");
+        printf("%s\n", error_message(resinfo.status));
         return;
     }
 
@@ -106,30 +191,62 @@ static void print_result_error(ResultInfo resinfo, const char *input_string)
     printf("^\n");
 
     // print error message
-    if (resinfo.status == MULTIPLE_DECIMAL_POINTS)
-        printf("SyntaxError: Multiple decimal points in number\n");
-    else if (resinfo.status == NUM_ENDS_WITH_DOT)
-        printf("SyntaxError: Number ending with decimal point\n");
-    else if (resinfo.status == INVALID_INPUT_CHARACTER)
-        printf("SyntaxError: Invalid input\n");
-    else if (resinfo.status == INVALID_TOKEN)
-        printf("SyntaxError: Invalid token\n");
-    else if (resinfo.status == UNMATCHED_RIGHT_PAR)
-        printf("SyntaxError: Unmatched right parentheses\n");
-    else if (resinfo.status == ZERO_DIVISON)
-        printf("MathError: Divison by zero\n");
-    else if (resinfo.status == NEGATIVE_FRACTIONAL_EXPONENT)
-        printf("ParseError: Negative number with fractional exponent not supported\n");
-    else if (resinfo.status == ZERO_NEGATIVE_EXPONENT)
-        printf("MathError: Zero with negative exponent\n");
-    else if (resinfo.status == TANGENT_UNDEFINED)
-        printf("MathError: Tangent of argument is undefined\n");
-    else if (resinfo.status == ARCUS_OUT_OF_RANGE)
-        printf("MathError: Arcus function argument out of range\n");
-    else if (resinfo.status == LOG_OUT_OF_RANGE)
-        printf("MathError: Logarithm function argument out of range\n");
-    else if (resinfo.status == FAC_INPUT_NOT_INT)
-        printf("MathError: Factorial input must be an integer\n");
+    printf("%s\n", error_message(resinfo.status));
+}
+
+static int analyze_mode(const char *expression, const char *cost_path)
+{
+    static const char *category_names[ANALYSIS_CATEGORY_COUNT] = {
+        "operand", "arithmetic", "power", "transcendental",
+        "factorial", "comparison", "control", "native",
+    };
+
+    // a table from BenchCost replaces the defaults it has entries for
+    CostTable costs = default_cost_table();
+    if (cost_path != NULL && !cost_table_load(cost_path, &costs))
+    {
+        printf("cannot read cost table %s\n", cost_path);
+        return 1;
+    }
+
+    // variables are accepted, the analysis does not need their values
+    NameTable names = new_nametable();
+    TokenList t_list = new_tokenlist();
+    ResultInfo conv_res = convert_names(expression, &t_list, &names);
+
+    if (conv_res.status != SUCCESS)
+    {
+        print_result_error(conv_res, expression);
+    }
+
+    else
+    {
+        ProgramAnalysis analysis = analyze_program(t_list, &costs);
+
+        printf("tokens            %u\n", analysis.token_count);
+        for (unsigned int c = 0; c < ANALYSIS_CATEGORY_COUNT; c++)
+        {
+            if (analysis.category_counts[c] > 0)
+                printf("  %-16s%u\n", category_names[c], analysis.category_counts[c]);
+        }
+
+        printf("operators        ");
+        for (unsigned int t = ADD; t < OPERATOR_TYPE_COUNT; t++)
+        {
+            if (analysis.operator_counts[t] > 0)
+                printf(" %s %u", operator_name(t), analysis.operator_counts[t]);
+        }
+        putchar('\n');
+
+        printf("transcendental    %u\n", analysis.transcendental_count);
+        printf("stack depth       %u\n", analysis.stack_depth);
+        printf("constant ratio    %.2f\n", analysis.constant_ratio);
+        printf("estimated cycles  %.0f\n", analysis.cost);
+    }
+
+    delete_tokenlist(t_list);
+    delete_nametable(names);
+    return conv_res.status == SUCCESS ? 0 : 1;
 }
 
 static void interactive_mode(void)
@@ -180,7 +297,7 @@ static void interactive_mode(void)
 
         // parse the string and print error or result
         if (buf_idx > 0)
-            parse_res = parse(buffer, &result);
+            parse_res = parse_exact(buffer, &result);
 
         if (parse_res.status != SUCCESS)
         {
@@ -5,6 +5,8 @@
 
 // project includes
 #include "token.h"
+#include "functions.h"
+#include "dag.h"
 
 static bool print_token_empty (Token token)
 {
@@ -79,6 +81,18 @@ static bool print_token_number (Token token)
     return false;
 }
 
+// exact integers are printed in full
+static bool print_token_integer (Token token)
+{
+    if (token.type == INTEGER)
+    {
+        printf("%lld", token.value.integer);
+        return true;
+    }
+
+    return false;
+}
+
 static bool print_token_operator (Token token)
 {
     if (token.type == OPERATOR)
@@ -127,6 +141,86 @@ static bool print_token_operator (Token token)
             printf("ln");
         else if (t == LOG)
             printf("log");
+        else if (t == ABS)
+            printf("abs");
+        else if (t == FAC)
+            printf("fac");
+        else if (t == MULT_ADD)
+            printf("*+");
+        else if (t == MULT_SUB)
+            printf("*-");
+        else if (t == ADD_MULT)
+            printf("+*");
+        else if (t == SUB_MULT)
+            printf("-*");
+        else if (t == ADD_IMM)
+            printf("+k");
+        else if (t == SUB_IMM)
+            printf("-k");
+        else if (t == MULT_IMM)
+            printf("*k");
+        else if (t == DIV_IMM)
+            printf("/k");
+        else if (t == MOD_IMM)
+            printf("%%k");
+        else if (t == POW_IMM)
+            printf("^k");
+        else if (t == NEG_CALL)
+            printf("negcall");
+        else if (t == CALL_NEG)
+            printf("callneg");
+        else if (t == POW_INT)
+            printf("^n");
+        else if (t == SQRT)
+            printf("sqrt");
+        else if (t == RESERVE)
+            printf("reserve");
+        else if (t == STORE)
+            printf("store");
+        else if (t == LOAD)
+            printf("load");
+        else if (t == IADD)
+            printf("i+");
+        else if (t == ISUB)
+            printf("i-");
+        else if (t == IMULT)
+            printf("i*");
+        else if (t == IDIV)
+            printf("i/");
+        else if (t == IMOD)
+            printf("i%%");
+        else if (t == IPOW)
+            printf("i^");
+        else if (t == INEG)
+            printf("ineg");
+        else if (t == IABS)
+            printf("iabs");
+        else if (t == IFAC)
+            printf("ifac");
+        else if (t == PROMOTE)
+            printf("promote");
+        else if (t == LESS)
+            printf("<");
+        else if (t == LESS_EQUAL)
+            printf("<=");
+        else if (t == GREATER)
+            printf(">");
+        else if (t == GREATER_EQUAL)
+            printf(">=");
+        else if (t == EQUAL)
+            printf("==");
+        else if (t == NOT_EQUAL)
+            printf("!=");
+        else if (t == QUESTION)
+            printf("?");
+        else if (t == COLON)
+            printf(":");
+        else if (t == JUMP_FALSE)
+            printf("jumpfalse");
+        else if (t == JUMP)
+            printf("jump");
+        else if (t == COMMA || t == ARGUMENT)
+            printf(",");
 
         return true;
     }
@@ -151,12 +245,26 @@ static bool print_token_parenthesis (Token token)
     return false;
 }
 
+// native calls print their registered name
+static bool print_token_native (Token token)
+{
+    if (token.type == NATIVE)
+    {
+        printf("%s", token.value.native->name);
+        return true;
+    }
+
+    return false;
+}
+
 void print_token(Token token)
 {
     if (print_token_empty(token)) {}
     else if (print_token_number(token)) {}
+    else if (print_token_integer(token)) {}
     else if (print_token_operator(token)) {}
     else if (print_token_parenthesis(token)) {}
+    else if (print_token_native(token)) {}
 }
 
 void print_tokenlist(TokenList t_list)
@@ -172,3 +280,35 @@ void print_tokenlist(TokenList t_list)
     }
     putchar('\n');
 }
+
+// one line per node, operations refer to their operands by node index
+void print_expression_dag(const ExpressionDag *dag)
+{
+    for (unsigned int i = 0; i < dag->count; i++)
+    {
+        const DagNode *node = &dag->nodes[i];
+        printf("n%u = ", i);
+
+        if (node->operand_count == 2)
+        {
+            printf("n%u ", node->operands[0]);
+            print_token(node->token);
+            printf(" n%u", node->operands[1]);
+        }
+
+        else if (node->operand_count == 1)
+        {
+            print_token(node->token);
+            printf(" n%u", node->operands[0]);
+        }
+
+        else
+        {
+            print_token(node->token);
+        }
+
+        if (dag_node_shared(dag, i))
+            printf("    shared, %u uses", node->uses);
+        putchar('\n');
+    }
+}
@@ -0,0 +1,272 @@
+// standard library includes
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// project includes
+#include "protocol.h"
+
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_BATCHES 1000
+#define DEFAULT_BATCH_SIZE 64
+#define DEFAULT_EXPRESSION "(1+-4/2.5)*16-(7%2)^3/5 + sin(pi/4) * log 100"
+
+// settings shared by every connection
+typedef struct
+{
+    const char *socket_path;
+    unsigned int batches;
+    unsigned int batch_size;
+    const char *expression;
+} Settings;
+
+// per connection results
+typedef struct
+{
+    const Settings *settings;
+    double *latencies; // seconds per batch
+    unsigned int completed;
+    unsigned long errors;
+    bool failed;
+    bool started; // its thread runs, one that cannot start is a failed connection
+} Client;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static bool read_all(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read(fd, data, len);
+        if (n <= 0)
+            return false;
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static int connect_socket(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// the same request frame is sent for every batch
+static char *build_request(const Settings *settings, size_t *frame_len)
+{
+    uint32_t length = strlen(settings->expression);
+    uint32_t count = settings->batch_size;
+    uint32_t body_len = sizeof(uint32_t) + count * (sizeof(uint32_t) + length);
+
+    *frame_len = sizeof(uint32_t) + body_len;
+    char *frame = (char *)malloc(*frame_len);
+    if (frame == NULL) exit(1);
+
+    char *pos = frame;
+    memcpy(pos, &body_len, sizeof(uint32_t)); pos += sizeof(uint32_t);
+    memcpy(pos, &count, sizeof(uint32_t)); pos += sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(pos, &length, sizeof(uint32_t)); pos += sizeof(uint32_t);
+        memcpy(pos, settings->expression, length); pos += length;
+    }
+
+    return frame;
+}
+
+static void *client_main(void *arg)
+{
+    Client *client = (Client *)arg;
+    const Settings *settings = client->settings;
+
+    int fd = connect_socket(settings->socket_path);
+    if (fd < 0)
+    {
+        client->failed = true;
+        return NULL;
+    }
+
+    size_t request_len;
+    char *request = build_request(settings, &request_len);
+
+    size_t response_len = sizeof(uint32_t) + settings->batch_size * sizeof(ProtocolResult);
+    char *response = (char *)malloc(response_len);
+    if (response == NULL) exit(1);
+
+    for (unsigned int i = 0; i < settings->batches; i++)
+    {
+        double start = now();
+
+        uint32_t body_len;
+        if (!write_all(fd, request, request_len) ||
+            !read_all(fd, (char *)&body_len, sizeof(uint32_t)) ||
+            body_len != response_len ||
+            !read_all(fd, response, response_len))
+        {
+            client->failed = true;
+            break;
+        }
+
+        client->latencies[i] = now() - start;
+        client->completed += 1;
+
+        for (unsigned int j = 0; j < settings->batch_size; j++)
+        {
+            ProtocolResult res;
+            memcpy(&res, response + sizeof(uint32_t) + j * sizeof(ProtocolResult),
+                   sizeof(ProtocolResult));
+            if (res.status != 0)
+                client->errors += 1;
+        }
+    }
+
+    free(request);
+    free(response);
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, unsigned int count, double p)
+{
+    if (count == 0)
+        return 0;
+
+    unsigned int idx = (unsigned int)(p * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 2 || argc > 6 || !strcmp(argv[1], "-h"))
+    {
+        printf("usage: %s socket [connections] [batches] [batch_size] [expression]\n", *argv);
+        return argc < 2 ? 1 : 0;
+    }
+
+    Settings settings;
+    settings.socket_path = argv[1];
+    unsigned int connections = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_CONNECTIONS;
+    settings.batches = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_BATCHES;
+    settings.batch_size = argc > 4 ? strtoul(argv[4], NULL, 10) : DEFAULT_BATCH_SIZE;
+    settings.expression = argc > 5 ? argv[5] : DEFAULT_EXPRESSION;
+
+    if (connections == 0 || settings.batches == 0 || settings.batch_size == 0)
+    {
+        fprintf(stderr, "connections, batches and batch_size must be positive\n");
+        return 1;
+    }
+
+    Client *clients = (Client *)calloc(connections, sizeof(Client));
+    pthread_t *threads = (pthread_t *)malloc(connections * sizeof(pthread_t));
+    double *latencies = (double *)malloc(
+            (size_t)connections * settings.batches * sizeof(double));
+    if (clients == NULL || threads == NULL || latencies == NULL) exit(1);
+
+    double start = now();
+    for (unsigned int i = 0; i < connections; i++)
+    {
+        clients[i].settings = &settings;
+        clients[i].latencies = latencies + (size_t)i * settings.batches;
+
+        int error = pthread_create(&threads[i], NULL, client_main, &clients[i]);
+        if (error != 0)
+        {
+            fprintf(stderr, "Cannot start connection %u: %s\n", i, strerror(error));
+            clients[i].failed = true;
+        }
+        clients[i].started = error == 0;
+    }
+
+    for (unsigned int i = 0; i < connections; i++)
+        if (clients[i].started)
+            pthread_join(threads[i], NULL);
+    double elapsed = now() - start;
+
+    // gather latencies of completed batches
+    unsigned int completed = 0;
+    unsigned long errors = 0;
+    bool failed = false;
+    for (unsigned int i = 0; i < connections; i++)
+    {
+        memmove(latencies + completed, clients[i].latencies,
+                clients[i].completed * sizeof(double));
+        completed += clients[i].completed;
+        errors += clients[i].errors;
+        failed = failed || clients[i].failed;
+    }
+    qsort(latencies, completed, sizeof(double), compare_double);
+
+    unsigned long expressions = (unsigned long)completed * settings.batch_size;
+    printf("connections:  %u\n", connections);
+    printf("batches:      %u of %u, %u expressions each\n",
+           completed, connections * settings.batches, settings.batch_size);
+    printf("errors:       %lu\n", errors);
+    printf("elapsed:      %.3f s\n", elapsed);
+    printf("throughput:   %.0f batches/s, %.0f expressions/s\n",
+           completed / elapsed, expressions / elapsed);
+    printf("latency p50:  %.1f us\n", percentile(latencies, completed, 0.50) * 1e6);
+    printf("latency p99:  %.1f us\n", percentile(latencies, completed, 0.99) * 1e6);
+
+    free(clients);
+    free(threads);
+    free(latencies);
+
+    if (failed)
+    {
+        fprintf(stderr, "Some connections failed\n");
+        return 1;
+    }
+
+    return 0;
+}
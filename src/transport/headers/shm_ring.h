@@ -0,0 +1,108 @@
+#ifndef SHM_RING
+#define SHM_RING
+
+// standard library includes
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shared memory request ring
+//
+// A single producer (client process) and a single consumer
+// (evaluator process) share a POSIX shared memory object.
+// The client fills slots with expression text or variable rows
+// and publishes them by advancing head. The evaluator writes the
+// result into the same slot and publishes it by advancing tail.
+// Both sides spin briefly and then sleep on a futex.
+//
+// Slots are answered in order, so every slot below tail holds a
+// result, and the client reuses a slot once it has read the result.
+
+#define SHM_RING_MAGIC 0x474e4952u // "RING"
+#define SHM_RING_VERSION 1u
+
+#define SHM_RING_TEXT_MAX 232
+#define SHM_RING_ROW_MAX (SHM_RING_TEXT_MAX / sizeof(double))
+#define SHM_RING_PROGRAM_MAX 1024
+
+// slot kinds
+typedef enum
+{
+    SHM_SLOT_TEXT = 1, // parse input.text
+    SHM_SLOT_ROW       // evaluate the ring program over input.row
+} shm_slot_kind;
+
+typedef struct
+{
+    uint32_t kind;
+    uint32_t length; // bytes of text or number of row values
+
+    union
+    {
+        char text[SHM_RING_TEXT_MAX];
+        double row[SHM_RING_ROW_MAX];
+    } input;
+
+    // written back by the evaluator
+    uint32_t status;      // error_type of the ResultInfo
+    uint32_t error_index; // error_index of the ResultInfo
+    double value;
+} ShmSlot;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity; // number of slots, a power of two
+    _Atomic uint32_t shutdown_requested;
+
+    // program for row requests and its space separated variable names,
+    // row value i is bound to the i-th name
+    char program[SHM_RING_PROGRAM_MAX];
+    char variables[SHM_RING_PROGRAM_MAX];
+
+    // counters are free running and wrap, each side writes one of them
+    // and the two live on separate cache lines
+    alignas(64) _Atomic uint32_t head;
+    _Atomic uint32_t evaluator_sleeping;
+
+    alignas(64) _Atomic uint32_t tail;
+    _Atomic uint32_t client_sleeping;
+} ShmRingHeader;
+
+// a process local view of a ring
+typedef struct
+{
+    ShmRingHeader *header;
+    ShmSlot *slots;
+    size_t size;
+
+    // client side count of slots whose result has been read
+    uint32_t reclaimed;
+} ShmRing;
+
+// RING FUNCTION DECLARATIONS
+// create allocates a new shared memory object, open attaches to one
+bool shm_ring_create(ShmRing *ring, const char *name, uint32_t capacity,
+                     const char *program, const char *variables);
+bool shm_ring_open(ShmRing *ring, const char *name);
+void shm_ring_close(ShmRing *ring);
+void shm_ring_unlink(const char *name);
+
+// client side
+// reserve returns NULL while every slot is in use
+ShmSlot *shm_ring_reserve(ShmRing *ring);
+void shm_ring_publish(ShmRing *ring);
+// next result in publish order, NULL if none is ready and wait is false
+ShmSlot *shm_ring_result(ShmRing *ring, bool wait);
+void shm_ring_release(ShmRing *ring);
+// ask the evaluator to return from shm_ring_serve
+void shm_ring_shutdown(ShmRing *ring);
+
+// evaluator side
+// serve requests until shutdown, returns false if the program is invalid
+bool shm_ring_serve(ShmRing *ring);
+
+#endif // SHM_RING
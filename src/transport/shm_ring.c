@@ -0,0 +1,335 @@
+// standard library includes
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// project includes
+#include "parser.h"
+#include "shm_ring.h"
+
+// polls of a counter before falling back to the futex
+#define SPIN_COUNT 4000
+
+_Static_assert(sizeof(ShmSlot) == 256, "ShmSlot should span whole cache lines");
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// the futex word lives in memory shared between processes,
+// so the private futex operations must not be used
+static void futex_wait(_Atomic uint32_t *word, uint32_t observed)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, observed, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// wait until word differs from observed or stop is set
+static uint32_t wait_for_change(_Atomic uint32_t *word, uint32_t observed,
+                                _Atomic uint32_t *sleeping, _Atomic uint32_t *stop)
+{
+    for (unsigned int i = 0; i < SPIN_COUNT; i++)
+    {
+        uint32_t value = atomic_load_explicit(word, memory_order_acquire);
+        if (value != observed)
+            return value;
+        cpu_relax();
+    }
+
+    while (true)
+    {
+        // announce the sleep before the final check,
+        // the publisher stores first and checks the flag second
+        atomic_store(sleeping, 1);
+
+        uint32_t value = atomic_load(word);
+        if (value != observed || (stop != NULL && atomic_load(stop)))
+        {
+            atomic_store(sleeping, 0);
+            return value;
+        }
+
+        futex_wait(word, observed);
+        atomic_store(sleeping, 0);
+
+        value = atomic_load(word);
+        if (value != observed || (stop != NULL && atomic_load(stop)))
+            return value;
+    }
+}
+
+static void publish(_Atomic uint32_t *word, uint32_t value, _Atomic uint32_t *sleeping)
+{
+    atomic_store(word, value);
+    if (atomic_load(sleeping))
+        futex_wake(word);
+}
+
+static size_t ring_size(uint32_t capacity)
+{
+    return sizeof(ShmRingHeader) + (size_t)capacity * sizeof(ShmSlot);
+}
+
+static bool map_ring(ShmRing *ring, int fd, size_t size)
+{
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return false;
+
+    ring->header = (ShmRingHeader *)base;
+    ring->slots = (ShmSlot *)((char *)base + sizeof(ShmRingHeader));
+    ring->size = size;
+    ring->reclaimed = 0;
+    return true;
+}
+
+bool shm_ring_create(ShmRing *ring, const char *name, uint32_t capacity,
+                     const char *program, const char *variables)
+{
+    // round capacity up to a power of two so indices can be masked
+    uint32_t slots = 1;
+    while (slots < capacity)
+        slots *= 2;
+
+    if ((program != NULL && strlen(program) >= SHM_RING_PROGRAM_MAX) ||
+        (variables != NULL && strlen(variables) >= SHM_RING_PROGRAM_MAX))
+        return false;
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        return false;
+
+    size_t size = ring_size(slots);
+    if (ftruncate(fd, size) < 0 || !map_ring(ring, fd, size))
+    {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    close(fd);
+
+    // the new object is zero filled
+    ShmRingHeader *header = ring->header;
+    header->capacity = slots;
+    if (program != NULL)
+        strcpy(header->program, program);
+    if (variables != NULL)
+        strcpy(header->variables, variables);
+
+    header->version = SHM_RING_VERSION;
+    atomic_thread_fence(memory_order_release);
+    header->magic = SHM_RING_MAGIC;
+
+    return true;
+}
+
+bool shm_ring_open(ShmRing *ring, const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmRingHeader) ||
+        !map_ring(ring, fd, st.st_size))
+    {
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    ShmRingHeader *header = ring->header;
+    if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION ||
+        ring_size(header->capacity) != ring->size)
+    {
+        shm_ring_close(ring);
+        return false;
+    }
+
+    // resume after whatever was already answered
+    ring->reclaimed = atomic_load(&header->tail);
+    return true;
+}
+
+void shm_ring_close(ShmRing *ring)
+{
+    munmap(ring->header, ring->size);
+    ring->header = NULL;
+    ring->slots = NULL;
+}
+
+void shm_ring_unlink(const char *name)
+{
+    shm_unlink(name);
+}
+
+ShmSlot *shm_ring_reserve(ShmRing *ring)
+{
+    // only the client writes head
+    uint32_t head = atomic_load_explicit(&ring->header->head, memory_order_relaxed);
+    if (head - ring->reclaimed >= ring->header->capacity)
+        return NULL;
+
+    return &ring->slots[head & (ring->header->capacity - 1)];
+}
+
+void shm_ring_publish(ShmRing *ring)
+{
+    ShmRingHeader *header = ring->header;
+    uint32_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    publish(&header->head, head + 1, &header->evaluator_sleeping);
+}
+
+ShmSlot *shm_ring_result(ShmRing *ring, bool wait)
+{
+    ShmRingHeader *header = ring->header;
+    uint32_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+
+    if (tail == ring->reclaimed)
+    {
+        // nothing outstanding, nothing to wait for
+        uint32_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+        if (!wait || head == ring->reclaimed)
+            return NULL;
+
+        wait_for_change(&header->tail, tail, &header->client_sleeping, NULL);
+    }
+
+    return &ring->slots[ring->reclaimed & (header->capacity - 1)];
+}
+
+void shm_ring_release(ShmRing *ring)
+{
+    ring->reclaimed += 1;
+}
+
+void shm_ring_shutdown(ShmRing *ring)
+{
+    // only atomics and a system call, so this is safe in a signal handler
+    atomic_store(&ring->header->shutdown_requested, 1);
+    futex_wake(&ring->header->head);
+}
+
+// intern the declared variables in order
+static unsigned int declare_variables(const char *variables, NameTable *names)
+{
+    unsigned int i = 0;
+    while (variables[i] != '\0')
+    {
+        if (variables[i] == ' ')
+        {
+            i++;
+            continue;
+        }
+
+        unsigned int begin = i;
+        while (variables[i] != '\0' && variables[i] != ' ')
+            i++;
+
+        nametable_add(names, variables + begin, i - begin);
+    }
+
+    return names->count;
+}
+
+static void answer(ShmSlot *slot, ResultInfo res, Token result)
+{
+    slot->status = res.status;
+    slot->error_index = res.error_index;
+    slot->value = res.status == SUCCESS ? result.value.number : 0;
+}
+
+bool shm_ring_serve(ShmRing *ring)
+{
+    ShmRingHeader *header = ring->header;
+    ParseContext context = new_parse_context();
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+
+    // compile the row program once
+    unsigned int declared = declare_variables(header->variables, &names);
+    ResultInfo program_res = convert_names(header->program, &program, &names);
+
+    if (program_res.status == SUCCESS && names.count > declared)
+    {
+        // report the first name that was not declared
+        program_res.status = UNDEFINED_VARIABLE;
+        for (unsigned int i = 0; i < program.count; i++)
+        {
+            if (program.list[i].type == VARIABLE &&
+                program.list[i].value.variable >= declared)
+            {
+                program_res.error_index = program.list[i].column;
+                break;
+            }
+        }
+    }
+
+    char text[SHM_RING_TEXT_MAX + 1];
+    uint32_t tail = atomic_load(&header->tail);
+
+    while (!atomic_load(&header->shutdown_requested))
+    {
+        uint32_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+        if (head == tail)
+        {
+            wait_for_change(&header->head, tail, &header->evaluator_sleeping,
+                            &header->shutdown_requested);
+            continue;
+        }
+
+        ShmSlot *slot = &ring->slots[tail & (header->capacity - 1)];
+        Token result = create_empty_token();
+        ResultInfo res;
+
+        if (slot->kind == SHM_SLOT_TEXT)
+        {
+            uint32_t length = slot->length < SHM_RING_TEXT_MAX ? slot->length : SHM_RING_TEXT_MAX;
+            memcpy(text, slot->input.text, length);
+            text[length] = '\0';
+            res = parse_context(&context, text, &result);
+        }
+
+        else if (slot->kind == SHM_SLOT_ROW && program_res.status != SUCCESS)
+        {
+            res = program_res;
+        }
+
+        else if (slot->kind == SHM_SLOT_ROW && slot->length >= declared &&
+                 declared <= SHM_RING_ROW_MAX)
+        {
+            res = evaluate_context(&context, program, slot->input.row, &result);
+        }
+
+        else
+        {
+            res.status = UNDEFINED_VARIABLE;
+            res.error_index = 0;
+        }
+
+        answer(slot, res, result);
+
+        tail += 1;
+        publish(&header->tail, tail, &header->client_sleeping);
+    }
+
+    delete_tokenlist(program);
+    delete_nametable(names);
+    delete_parse_context(context);
+
+    return program_res.status == SUCCESS;
+}
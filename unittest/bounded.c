@@ -0,0 +1,60 @@
+// standard library includes
+#include <stdbool.h>
+#include <stddef.h>
+
+// project includes
+#include "bounded.h"
+
+// the C library allocator, used while the heap is allowed
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static bool heap_forbidden = false;
+static unsigned int heap_attempts = 0;
+
+// these replace the allocator of the whole test program
+void *malloc(size_t size)
+{
+    if (heap_forbidden)
+    {
+        heap_attempts += 1;
+        return NULL;
+    }
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (heap_forbidden)
+    {
+        heap_attempts += 1;
+        return NULL;
+    }
+
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (heap_forbidden)
+    {
+        heap_attempts += 1;
+        return NULL;
+    }
+
+    return __libc_realloc(ptr, size);
+}
+
+void forbid_heap(void)
+{
+    heap_attempts = 0;
+    heap_forbidden = true;
+}
+
+unsigned int allow_heap(void)
+{
+    heap_forbidden = false;
+    return heap_attempts;
+}
@@ -0,0 +1,10 @@
+#ifndef BOUNDED
+#define BOUNDED
+
+// make every allocation fail until allow_heap
+void forbid_heap(void);
+
+// returns the number of allocations attempted meanwhile
+unsigned int allow_heap(void);
+
+#endif // BOUNDED
@@ -1,12 +1,44 @@
+// standard library includes
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 // project includes
 #include "unittest.h"
 #include "parser.h"
+#include "formula.h"
+#include "shm_ring.h"
+#include "program_file.h"
+#include "optimize.h"
+#include "dag.h"
+#include "scan.h"
+#include "kernel.h"
+#include "rows.h"
+#include "bounded.h"
+#include "functions.h"
+#include "calculus.h"
+#include "sample.h"
+#include "interval.h"
+#include "shape.h"
+#include "registry.h"
+#include "daemon.h"
+#include "protocol.h"
 
 static void lexer_test(void)
 {
     begin_test_domain("Lexer");
 
-    TokenList subject = new_tokenlist();
+    TokenList subject = test_tokenlist();
 
     assert_error(lex("(3 + 17) * 2.57.7 - 8", &subject),
                  MULTIPLE_DECIMAL_POINTS, 15);
@@ -38,9 +70,19 @@ static void lexer_test(void)
     assert_error(lex(".1 + 3", &subject),
                  INVALID_INPUT_CHARACTER, 0);
 
+    // bytes outside of ASCII are invalid in every locale
+    assert_error(lex("3 +\xa0 4", &subject),
+                 INVALID_INPUT_CHARACTER, 3);
+
+    assert_error(lex("2 * \xe9t\xe9", &subject),
+                 INVALID_INPUT_CHARACTER, 4);
+
+    assert_success(lex("\v1\f+\r2\t", &subject));
+    assert_count(3, subject.count);
+
 
     // manual result verification
-    TokenList expected = new_tokenlist();
+    TokenList expected = test_tokenlist();
     assert_success(lex("(32+3.14) - 42 % 8 * 5.0 / 2 ^ 0.5", &subject));
     tokenlist_add(&expected, create_parenthesis_token(LEFT, 0));
     tokenlist_add(&expected, create_number_token(32, 1));
@@ -96,7 +138,7 @@ static void lexer_test(void)
 static void syntax_check_test(void)
 {
     begin_test_domain("Syntax");
-    TokenList subject = new_tokenlist();
+    TokenList subject = test_tokenlist();
 
     lex(")3+5", &subject);
     assert_error(syntax_check(subject), INVALID_TOKEN, 0);
@@ -178,21 +220,21 @@ static void syntax_check_test(void)
 static void convert_test(void)
 {
     begin_test_domain("Convert");
-    TokenList subject = new_tokenlist();
+    TokenList subject = test_tokenlist();
 
-    assert_error(convert("a", &subject),
+    assert_error(test_convert("a", &subject),
             INVALID_INPUT_CHARACTER, 0);
 
-    assert_error(convert("*", &subject),
+    assert_error(test_convert("*", &subject),
             INVALID_TOKEN, 0);
 
     // test for zero length input
-    assert_success(convert("", &subject));
-    TokenList expected = new_tokenlist();
+    assert_success(test_convert("", &subject));
+    TokenList expected = test_tokenlist();
     assert_tokenlists_equal(expected, subject);
 
     // manual result verification
-    assert_success(convert("(((8+9)*10)^2)-(1+2-3*4/5^6%2-1)", &subject));
+    assert_success(test_convert("(((8+9)*10)^2)-(1+2-3*4/5^6%2-1)", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(8, 3));
     tokenlist_add(&expected, create_number_token(9, 5));
@@ -219,31 +261,31 @@ static void convert_test(void)
     tokenlist_add(&expected, create_operator_token(SUB, 14));
     assert_tokenlists_equal(expected, subject);
 
-    assert_success(convert("-5", &subject));
+    assert_success(test_convert("-5", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(-5, 1));
     assert_tokenlists_equal(expected, subject);
 
-    assert_success(convert(" - (5)", &subject));
+    assert_success(test_convert(" - (5)", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(5, 4));
     tokenlist_add(&expected, create_operator_token(NEG, 1));
     assert_tokenlists_equal(expected, subject);
 
-    assert_success(convert("sind 90", &subject));
+    assert_success(test_convert("sind 90", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(90, 5));
     tokenlist_add(&expected, create_operator_token(SIND, 0));
     assert_tokenlists_equal(expected, subject);
 
-    assert_success(convert("-cos -90", &subject));
+    assert_success(test_convert("-cos -90", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(-90, 6));
     tokenlist_add(&expected, create_operator_token(COS, 1));
     tokenlist_add(&expected, create_operator_token(NEG, 0));
     assert_tokenlists_equal(expected, subject);
 
-    assert_success(convert("sin cos tan 90", &subject));
+    assert_success(test_convert("sin cos tan 90", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(90, 12));
     tokenlist_add(&expected, create_operator_token(TAN, 8));
@@ -251,7 +293,7 @@ static void convert_test(void)
     tokenlist_add(&expected, create_operator_token(SIN, 0));
     assert_tokenlists_equal(expected, subject);
 
-    assert_success(convert("-sin cos -tan -90", &subject));
+    assert_success(test_convert("-sin cos -tan -90", &subject));
     clear_tokenlist(&expected);
     tokenlist_add(&expected, create_number_token(-90, 15));
     tokenlist_add(&expected, create_operator_token(TAN, 10));
@@ -274,55 +316,55 @@ static void parse_test(void)
     begin_test_domain("Parse");
     Token subject = create_empty_token();
 
-    assert_error(parse("a", &subject),
+    assert_error(test_parse("a", &subject),
             INVALID_INPUT_CHARACTER, 0);
 
-    assert_error(parse("*", &subject),
+    assert_error(test_parse("*", &subject),
             INVALID_TOKEN, 0);
 
-    assert_error(parse("1 / 0", &subject),
+    assert_error(test_parse("1 / 0", &subject),
             ZERO_DIVISON, 2);
 
-    assert_error(parse("1.0 / 0", &subject),
+    assert_error(test_parse("1.0 / 0", &subject),
             ZERO_DIVISON, 4);
 
-    assert_error(parse("-1 ^ 0.25", &subject),
+    assert_error(test_parse("-1 ^ 0.25", &subject),
             NEGATIVE_FRACTIONAL_EXPONENT, 3);
 
-    assert_error(parse("0 ^ -5", &subject),
+    assert_error(test_parse("0 ^ -5", &subject),
             ZERO_NEGATIVE_EXPONENT, 2);
 
-    assert_error(parse("tan(pi/2)", &subject),
+    assert_error(test_parse("tan(pi/2)", &subject),
             TANGENT_UNDEFINED, 0);
 
-    assert_error(parse("tan(5*pi/2)", &subject),
+    assert_error(test_parse("tan(5*pi/2)", &subject),
             TANGENT_UNDEFINED, 0);
 
-    assert_error(parse("tand 90", &subject),
+    assert_error(test_parse("tand 90", &subject),
             TANGENT_UNDEFINED, 0);
 
-    assert_error(parse("tand(90 + 180 * 3)", &subject),
+    assert_error(test_parse("tand(90 + 180 * 3)", &subject),
             TANGENT_UNDEFINED, 0);
 
-    assert_error(parse("asin 2", &subject),
+    assert_error(test_parse("asin 2", &subject),
             ARCUS_OUT_OF_RANGE, 0);
 
-    assert_error(parse("acos -2", &subject),
+    assert_error(test_parse("acos -2", &subject),
             ARCUS_OUT_OF_RANGE, 0);
 
-    assert_error(parse("asind -2", &subject),
+    assert_error(test_parse("asind -2", &subject),
             ARCUS_OUT_OF_RANGE, 0);
 
-    assert_error(parse("acosd 2", &subject),
+    assert_error(test_parse("acosd 2", &subject),
             ARCUS_OUT_OF_RANGE, 0);
 
-    assert_error(parse("fac 2.5", &subject),
+    assert_error(test_parse("fac 2.5", &subject),
             FAC_INPUT_NOT_INT, 0);
 
-    assert_error(parse("ln 0", &subject),
+    assert_error(test_parse("ln 0", &subject),
             LOG_OUT_OF_RANGE, 0);
 
-    assert_error(parse("log -1", &subject),
+    assert_error(test_parse("log -1", &subject),
             LOG_OUT_OF_RANGE, 0);
 
     // test for zero length input
@@ -393,7 +435,2962 @@ static void parse_test(void)
     assert_parse_result("fac 5", 120);
     assert_parse_result("fac -5", -120);
 
+    // a context gives the same results when reused
+    ParseContext context = test_parse_context();
+    assert_success(parse_context(&context, "(1+-4/2.5)*16-(7%2)^3/5", &subject));
+    assert_number(subject, -9.8);
+    assert_error(parse_context(&context, "1 / 0", &subject), ZERO_DIVISON, 2);
+    assert_error(parse_context(&context, "(2", &subject), UNMATCHED_LEFT_PAR, 1);
+    assert_success(parse_context(&context, "2^4*(10%4+17.5-5)/2.5", &subject));
+    assert_number(subject, 92.8);
+    delete_parse_context(context);
+
+    // release resources and conclude
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+static void bounded_test(void)
+{
+    begin_test_domain("Bounded");
+
+    Token tokens[4];
+    Token stack[2];
+    Token program[8];
+    Token result = create_empty_token();
+
+    ParseContext context = bounded_parse_context(tokens, 4, stack, 2, program, 8);
+    assert_success(parse_context(&context, "1+2", &result));
+    assert_number(result, 3);
+
+    // the fifth token does not fit
+    assert_error(parse_context(&context, "1+2+3", &result),
+                 CAPACITY_EXCEEDED, 4);
+
+    // nesting exceeds the conversion stack
+    Token more_tokens[16];
+    context = bounded_parse_context(more_tokens, 16, stack, 2, program, 8);
+    assert_error(parse_context(&context, "(((1)))", &result),
+                 CAPACITY_EXCEEDED, 2);
+
+    // the third operand exceeds the evaluation stack
+    Token more_program[16];
+    context = bounded_parse_context(more_tokens, 16, stack, 2, more_program, 16);
+    assert_error(parse_context(&context, "1*2+3*4+5*6", &result),
+                 CAPACITY_EXCEEDED, 6);
+
+    // the output of conversion does not fit
+    context = bounded_parse_context(more_tokens, 16, stack, 2, program, 4);
+    assert_error(parse_context(&context, "1*2+3", &result),
+                 CAPACITY_EXCEEDED, 3);
+
+    // a full fixed list drops further tokens
+    TokenList list = tokenlist_from_buffer(tokens, 1);
+    tokenlist_add(&list, create_number_token(1, 0));
+    tokenlist_add(&list, create_number_token(2, 1));
+    assert_count(1, list.count);
+    assert_count(1, list.overflow);
+    clear_tokenlist(&list);
+    assert_count(0, list.overflow);
+    delete_tokenlist(list);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#ifdef BOUNDED_TEST
+
+// run the core corpus on fixed storage with every allocation failing
+int main()
+{
+    use_bounded_storage();
+
+    // stdout allocates its buffer on first use
+    printf("Heap free run\n\n");
+
+    forbid_heap();
+    lexer_test();
+    syntax_check_test();
+    convert_test();
+    parse_test();
+    bounded_test();
+    unsigned int attempts = allow_heap();
+
+    begin_test_domain("Heap");
+    assert_count(0, attempts);
+    conclude_test_domain();
+}
+
+#else
+
+// domains below need the heap
+
+static void variable_test(void)
+{
+    begin_test_domain("Variable");
+
+    TokenList subject = new_tokenlist();
+    TokenList expected = new_tokenlist();
+    NameTable names = new_nametable();
+
+    // without a name table identifiers remain invalid
+    assert_error(lex("x + 1", &subject),
+                 INVALID_INPUT_CHARACTER, 0);
+
+    assert_success(lex_names("rate * sin rate - cost", &subject, &names));
+    tokenlist_add(&expected, create_variable_token(0, 0));
+    tokenlist_add(&expected, create_operator_token(MULT, 5));
+    tokenlist_add(&expected, create_operator_token(SIN, 7));
+    tokenlist_add(&expected, create_variable_token(0, 11));
+    tokenlist_add(&expected, create_operator_token(SUB, 16));
+    tokenlist_add(&expected, create_variable_token(1, 18));
+    assert_tokenlists_equal(expected, subject);
+    assert_count(2, names.count);
+
+    assert_success(syntax_check(subject));
+
+    lex_names("x y", &subject, &names);
+    assert_error(syntax_check(subject), INVALID_TOKEN, 2);
+
+    // a negated variable is negated before the power
+    assert_success(convert_names("-x^2", &subject, &names));
+    clear_tokenlist(&expected);
+    tokenlist_add(&expected, create_variable_token(2, 1));
+    tokenlist_add(&expected, create_operator_token(NEG, 0));
+    tokenlist_add(&expected, create_number_token(2, 3));
+    tokenlist_add(&expected, create_operator_token(POW, 2));
+    assert_tokenlists_equal(expected, subject);
+
+    Token result = create_empty_token();
+    double values[] = { 2, 0.5, 3 };
+
+    assert_success(evaluate(subject, values, &result));
+    assert_number(result, 9);
+
+    assert_error(evaluate(subject, NULL, &result), UNDEFINED_VARIABLE, 1);
+
+    convert_names("cost / (rate - 2)", &subject, &names);
+    assert_error(evaluate(subject, values, &result), ZERO_DIVISON, 5);
+
+    // release resources and conclude
+    delete_nametable(names);
+    delete_tokenlist(expected);
+    delete_tokenlist(subject);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+static void formula_test(void)
+{
+    begin_test_domain("Formula");
+
+    FormulaGraph graph = new_formula_graph(1);
+    Token result = create_empty_token();
+
+    assert_success(formula_set_value(&graph, "revenue", 10));
+    assert_success(formula_set_value(&graph, "cost", 4));
+    assert_success(formula_define(&graph, "margin", "revenue - cost"));
+    assert_success(formula_define(&graph, "tax", "margin * 0.25"));
+    assert_success(formula_define(&graph, "doubled", "cost * 2"));
+    assert_count(3, formula_recompute(&graph));
+
+    assert_success(formula_value(&graph, "margin", &result));
+    assert_number(result, 6);
+    assert_success(formula_value(&graph, "tax", &result));
+    assert_number(result, 1.5);
+
+    // only formulas downstream of the change are evaluated
+    formula_set_value(&graph, "revenue", 20);
+    assert_count(2, formula_recompute(&graph));
+    assert_success(formula_value(&graph, "tax", &result));
+    assert_number(result, 4);
+    assert_count(0, formula_recompute(&graph));
+
+    // cycles are rejected at the offending reference
+    assert_error(formula_define(&graph, "cost", "2 + tax"),
+                 CIRCULAR_REFERENCE, 4);
+    assert_error(formula_define(&graph, "loop", "1 + loop"),
+                 CIRCULAR_REFERENCE, 4);
+    assert_success(formula_value(&graph, "cost", &result));
+    assert_number(result, 4);
+
+    // syntax errors and invalid names
+    assert_error(formula_define(&graph, "bad", "revenue +"),
+                 INVALID_TOKEN, 8);
+    assert_error(formula_define(&graph, "sin", "1"),
+                 INVALID_INPUT_CHARACTER, 0);
+
+    // undefined references resolve once defined
+    formula_define(&graph, "pending", "missing * 2");
+    assert_count(1, formula_recompute(&graph));
+    assert_error(formula_value(&graph, "pending", &result),
+                 UNDEFINED_VARIABLE, 0);
+    formula_set_value(&graph, "missing", 3);
+    assert_count(1, formula_recompute(&graph));
+    assert_success(formula_value(&graph, "pending", &result));
+    assert_number(result, 6);
+
+    // errors are reported at the reference in dependents
+    formula_set_value(&graph, "zero", 0);
+    formula_define(&graph, "ratio", "1 / zero");
+    formula_define(&graph, "shifted", "2 + ratio");
+    formula_recompute(&graph);
+    assert_error(formula_value(&graph, "ratio", &result), ZERO_DIVISON, 2);
+    assert_error(formula_value(&graph, "shifted", &result), ZERO_DIVISON, 4);
+
+    // redefining a formula moves its edges
+    formula_define(&graph, "ratio", "cost / 2");
+    assert_count(2, formula_recompute(&graph));
+    assert_success(formula_value(&graph, "shifted", &result));
+    assert_number(result, 4);
+    formula_set_value(&graph, "zero", 1);
+    assert_count(0, formula_recompute(&graph));
+
+    delete_formula_graph(&graph);
+
+    // wide levels are evaluated in parallel
+    graph = new_formula_graph(4);
+    formula_set_value(&graph, "base", 1);
+
+    char name[8];
+    char expression[32];
+    for (unsigned int i = 0; i < 26 * 26; i++)
+    {
+        name[0] = 'n';
+        name[1] = 'a' + i / 26;
+        name[2] = 'a' + i % 26;
+        name[3] = '\0';
+        snprintf(expression, sizeof(expression), "base * %d", i);
+        formula_define(&graph, name, expression);
+    }
+    formula_define(&graph, "total", "nzz + naz + nba");
+    assert_count(26 * 26 + 1, formula_recompute(&graph));
+
+    formula_set_value(&graph, "base", 2);
+    assert_count(26 * 26 + 1, formula_recompute(&graph));
+    assert_success(formula_value(&graph, "total", &result));
+    assert_number(result, 2 * (675 + 25 + 26));
+
+    delete_formula_graph(&graph);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+static void *serve_ring(void *ring)
+{
+    shm_ring_serve((ShmRing *)ring);
+    return NULL;
+}
+
+static void shm_ring_test(void)
+{
+    begin_test_domain("Ring");
+
+    char name[64];
+    snprintf(name, sizeof(name), "/parser_test_%d", (int)getpid());
+
+    ShmRing ring;
+    if (!shm_ring_create(&ring, name, 3, "x / y", "x y"))
+    {
+        printf("Shared memory unavailable, skipping\n\n");
+        return;
+    }
+
+    // capacity is rounded up to a power of two
+    assert_count(4, ring.header->capacity);
+
+    ShmRing client;
+    assert_count(1, shm_ring_open(&client, name));
+
+    pthread_t evaluator;
+    pthread_create(&evaluator, NULL, serve_ring, &ring);
+
+    // fill the ring before reading any result
+    const char *texts[] = { "2 * (3 + 4)", "1 / 0" };
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        ShmSlot *slot = shm_ring_reserve(&client);
+        slot->kind = SHM_SLOT_TEXT;
+        slot->length = strlen(texts[i]);
+        memcpy(slot->input.text, texts[i], slot->length);
+        shm_ring_publish(&client);
+    }
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        ShmSlot *slot = shm_ring_reserve(&client);
+        slot->kind = SHM_SLOT_ROW;
+        slot->length = 2;
+        slot->input.row[0] = 9;
+        slot->input.row[1] = 3 * i;
+        shm_ring_publish(&client);
+    }
+    assert_count(1, shm_ring_reserve(&client) == NULL);
+
+    ShmSlot *slot = shm_ring_result(&client, true);
+    assert_error((ResultInfo){ slot->status, slot->error_index }, SUCCESS, 0);
+    assert_number(create_number_token(slot->value, 0), 14);
+    shm_ring_release(&client);
+
+    slot = shm_ring_result(&client, true);
+    assert_error((ResultInfo){ slot->status, slot->error_index }, ZERO_DIVISON, 2);
+    shm_ring_release(&client);
+
+    slot = shm_ring_result(&client, true);
+    assert_error((ResultInfo){ slot->status, slot->error_index }, ZERO_DIVISON, 2);
+    shm_ring_release(&client);
+
+    slot = shm_ring_result(&client, true);
+    assert_number(create_number_token(slot->value, 0), 3);
+    shm_ring_release(&client);
+
+    assert_count(1, shm_ring_result(&client, true) == NULL);
+
+    shm_ring_shutdown(&client);
+    pthread_join(evaluator, NULL);
+
+    shm_ring_close(&client);
+    shm_ring_close(&ring);
+    shm_ring_unlink(name);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+typedef struct
+{
+    const char *path;
+    int exit_code;
+} DaemonRun;
+
+static void *serve_daemon(void *argument)
+{
+    DaemonRun *run = (DaemonRun *)argument;
+    run->exit_code = run_daemon(run->path, 2);
+    return NULL;
+}
+
+// a blocking client, a read that waits too long fails
+static int daemon_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct timeval timeout = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // the daemon may not be listening yet
+    for (unsigned int attempt = 0; attempt < 500; attempt++)
+    {
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        usleep(10000);
+    }
+
+    close(fd);
+    return -1;
+}
+
+static void daemon_send(int fd, const void *data, size_t length)
+{
+    if (send(fd, data, length, MSG_NOSIGNAL) < 0) {}
+}
+
+static void daemon_send_batch(int fd, const char **texts, uint32_t count)
+{
+    char frame[1024];
+    uint32_t length = sizeof(uint32_t);
+    memcpy(frame + sizeof(uint32_t), &count, sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t text_length = strlen(texts[i]);
+        memcpy(frame + sizeof(uint32_t) + length, &text_length, sizeof(uint32_t));
+        memcpy(frame + 2 * sizeof(uint32_t) + length, texts[i], text_length);
+        length += sizeof(uint32_t) + text_length;
+    }
+
+    memcpy(frame, &length, sizeof(uint32_t));
+    daemon_send(fd, frame, sizeof(uint32_t) + length);
+}
+
+// false if the connection closed or timed out first
+static bool daemon_receive(int fd, void *data, size_t length)
+{
+    for (size_t done = 0; done < length; )
+    {
+        ssize_t n = recv(fd, (char *)data + done, length - done, 0);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+
+    return true;
+}
+
+static bool daemon_closed(int fd)
+{
+    char byte;
+    return recv(fd, &byte, 1, 0) == 0;
+}
+
+static void daemon_test(void)
+{
+    begin_test_domain("Daemon");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/parser_daemon_%d.sock", (int)getpid());
+
+    DaemonRun run = { path, -1 };
+    pthread_t daemon;
+    pthread_create(&daemon, NULL, serve_daemon, &run);
+
+    int fd = daemon_connect(path);
+    assert_true(fd >= 0);
+
+    // two batches back to back are answered in order
+    const char *texts[] = { "2 * (3 + 4)", "1 / 0", "2 * (3", "10 % 4" };
+    daemon_send_batch(fd, texts, 4);
+    daemon_send_batch(fd, texts + 3, 1);
+
+    uint32_t header[2];
+    ProtocolResult results[4];
+    assert_true(daemon_receive(fd, header, sizeof(header)));
+    assert_count(sizeof(uint32_t) + 4 * sizeof(ProtocolResult), header[0]);
+    assert_count(4, header[1]);
+    assert_true(daemon_receive(fd, results, 4 * sizeof(ProtocolResult)));
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        Token expected = create_empty_token();
+        ResultInfo res = parse(texts[i], &expected);
+        assert_error((ResultInfo){ results[i].status, results[i].error_index },
+                     res.status, res.error_index);
+        if (res.status == SUCCESS)
+            assert_number(create_number_token(results[i].value, 0), expected.value.number);
+    }
+
+    assert_true(daemon_receive(fd, header, sizeof(header)));
+    assert_count(1, header[1]);
+    assert_true(daemon_receive(fd, results, sizeof(ProtocolResult)));
+    assert_number(create_number_token(results[0].value, 0), 2);
+    close(fd);
+
+    // a batch that claims more expressions than it has closes the connection
+    fd = daemon_connect(path);
+    uint32_t malformed[2] = { sizeof(uint32_t), 5 };
+    daemon_send(fd, malformed, sizeof(malformed));
+    assert_true(daemon_closed(fd));
+    close(fd);
+
+    // so does a frame over the limit, as soon as its header is in
+    fd = daemon_connect(path);
+    uint32_t oversize[2] = { PROTOCOL_MAX_FRAME + 1, 0 };
+    daemon_send(fd, oversize, sizeof(oversize));
+    assert_true(daemon_closed(fd));
+    close(fd);
+
+    // the daemon still serves other connections
+    fd = daemon_connect(path);
+    daemon_send_batch(fd, texts, 1);
+    assert_true(daemon_receive(fd, header, sizeof(header)));
+    assert_true(daemon_receive(fd, results, sizeof(ProtocolResult)));
+    assert_number(create_number_token(results[0].value, 0), 14);
+    close(fd);
+
+    // an idle daemon stops on the signal alone
+    pthread_kill(daemon, SIGTERM);
+    pthread_join(daemon, NULL);
+    assert_count(0, run.exit_code);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// the checksum of a program file, FNV-1a over 64 bit words and then bytes
+static uint64_t program_file_checksum(const unsigned char *bytes, size_t len)
+{
+    uint64_t h = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 1099511628211ull;
+    }
+
+    for (; i < len; i++)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+
+    return h;
+}
+
+// overwrite a token of the first program in the file at path,
+// with a checksum that matches again
+static void replace_program_token(const char *path, unsigned int index, Token token)
+{
+    FILE *file = fopen(path, "r+b");
+    fseek(file, 0, SEEK_END);
+    size_t size = (size_t)ftell(file);
+    unsigned char *image = (unsigned char *)malloc(size);
+    if (image == NULL)
+        exit(1);
+    fseek(file, 0, SEEK_SET);
+    assert_true(fread(image, 1, size, file) == size);
+
+    ProgramFileHeader *header = (ProgramFileHeader *)image;
+    ProgramFileEntry *entries = (ProgramFileEntry *)(image + sizeof(ProgramFileHeader));
+    Token *tokens = (Token *)(image + sizeof(ProgramFileHeader) +
+                              header->program_count * sizeof(ProgramFileEntry) +
+                              header->variable_count * sizeof(ProgramFileString));
+    tokens[entries[0].token_offset + index] = token;
+    header->checksum = program_file_checksum(image + sizeof(ProgramFileHeader),
+                                             size - sizeof(ProgramFileHeader));
+
+    fseek(file, 0, SEEK_SET);
+    assert_true(fwrite(image, 1, size, file) == size);
+    fclose(file);
+    free(image);
+}
+
+static void program_file_test(void)
+{
+    begin_test_domain("ProgramFile");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/parser_programs_%d.bin", (int)getpid());
+    remove(path);
+
+    const char *sources[] = { "rate * 2 + offset", "(2", "sind 90 / rate", "" };
+    const char *changed[] = { "rate * 3 + offset", "(2", "sind 90 / rate", "" };
+    ProgramSet set;
+    Token result = create_empty_token();
+    double values[] = { 4, 1 };
+
+    // no file yet, so the sources are compiled and saved
+    assert_count(PROGRAM_SET_RECOMPILED, program_set_load(&set, path, sources, 4));
+    delete_program_set(&set);
+
+    assert_count(PROGRAM_SET_MAPPED, program_set_load(&set, path, sources, 4));
+    assert_count(4, program_set_count(&set));
+    assert_count(2, set.names.count);
+
+    assert_success(program_set_status(&set, 0));
+    assert_success(evaluate(program_set_program(&set, 0), values, &result));
+    assert_number(result, 9);
+
+    // compile errors and columns survive the round trip
+    assert_error(program_set_status(&set, 1), UNMATCHED_LEFT_PAR, 1);
+    assert_count(0, program_set_program(&set, 1).count);
+    values[0] = 0;
+    assert_error(evaluate(program_set_program(&set, 2), values, &result),
+                 ZERO_DIVISON, 8);
+    assert_success(evaluate(program_set_program(&set, 3), values, &result));
+    assert_number(result, 0);
+    delete_program_set(&set);
+
+    // without sources the file is trusted as is
+    assert_count(PROGRAM_SET_MAPPED, program_set_load(&set, path, NULL, 0));
+    delete_program_set(&set);
+
+    // changed sources are recompiled
+    assert_count(PROGRAM_SET_RECOMPILED, program_set_load(&set, path, changed, 4));
+    values[0] = 4;
+    evaluate(program_set_program(&set, 0), values, &result);
+    assert_number(result, 13);
+    delete_program_set(&set);
+
+    // a damaged file fails its checksum
+    FILE *file = fopen(path, "r+b");
+    fseek(file, -3, SEEK_END);
+    fputc('x', file);
+    fclose(file);
+    assert_count(PROGRAM_SET_FAILED, program_set_load(&set, path, NULL, 0));
+    delete_program_set(&set);
+    assert_count(PROGRAM_SET_RECOMPILED, program_set_load(&set, path, changed, 4));
+    delete_program_set(&set);
+
+    // so does a file of another version
+    file = fopen(path, "r+b");
+    fseek(file, offsetof(ProgramFileHeader, version), SEEK_SET);
+    fputc(PROGRAM_FILE_VERSION + 1, file);
+    fclose(file);
+    assert_count(PROGRAM_SET_RECOMPILED, program_set_load(&set, path, changed, 4));
+    delete_program_set(&set);
+    assert_count(PROGRAM_SET_MAPPED, program_set_load(&set, path, changed, 4));
+    delete_program_set(&set);
+
+    // tokens are checked before a program is run, even with a valid checksum
+    const char *branching[] = { "x > 0 ? x * 2 : y", "x % 3" };
+    assert_count(PROGRAM_SET_RECOMPILED, program_set_load(&set, path, branching, 2));
+    delete_program_set(&set);
+    assert_count(PROGRAM_SET_MAPPED, program_set_load(&set, path, branching, 2));
+    TokenList branch = program_set_program(&set, 0);
+    assert_count(JUMP_FALSE, branch.list[3].value.operator);
+    delete_program_set(&set);
+
+    const Token damaged[] = {
+        create_variable_token(2, 0),                  // no such variable
+        create_operator_token((operator_type)999, 0), // no such operator
+        create_operator_token(COMMA, 0),              // not in a postfix program
+        create_operator_token(ADD, 0),                // nothing to add yet
+        create_number_token(1000, 0),                 // a jump past the end
+        create_number_token(5, 0),                    // a jump into its own branch
+    };
+    const unsigned int damaged_index[] = { 0, 2, 2, 0, 4, 4 };
+    for (unsigned int i = 0; i < sizeof(damaged) / sizeof(damaged[0]); i++)
+    {
+        replace_program_token(path, damaged_index[i], damaged[i]);
+        assert_count(PROGRAM_SET_FAILED, program_set_load(&set, path, NULL, 0));
+        delete_program_set(&set);
+        assert_count(PROGRAM_SET_RECOMPILED, program_set_load(&set, path, branching, 2));
+        delete_program_set(&set);
+    }
+
+    remove(path);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// an optimized program must agree with the plain one, errors included
+static void assert_same_optimized(const char *input, NameTable *names,
+                                  const double *values, unsigned int flags)
+{
+    TokenList plain = new_tokenlist();
+    TokenList optimized = new_tokenlist();
+    Token plain_result = create_empty_token();
+    Token optimized_result = create_empty_token();
+
+    assert_success(convert_names(input, &plain, names));
+    assert_success(convert_names(input, &optimized, names));
+    optimize(&optimized, flags);
+
+    ResultInfo expected = evaluate(plain, values, &plain_result);
+    ResultInfo result = evaluate(optimized, values, &optimized_result);
+
+    if (expected.status == SUCCESS)
+    {
+        assert_success(result);
+        assert_number(optimized_result, plain_result.value.number);
+    }
+
+    else
+    {
+        assert_error(result, expected.status, expected.error_index);
+    }
+
+    delete_tokenlist(optimized);
+    delete_tokenlist(plain);
+}
+
+static void optimize_test(void)
+{
+    begin_test_domain("Optimize");
+
+    TokenList subject = new_tokenlist();
+    TokenList expected = new_tokenlist();
+    NameTable names = new_nametable();
+    Token result = create_empty_token();
+    double values[] = { 2, -3, 0.5, 0 };
+
+    // a, b, c, z
+    nametable_add(&names, "a", 1);
+    nametable_add(&names, "b", 1);
+    nametable_add(&names, "c", 1);
+    nametable_add(&names, "z", 1);
+
+    // product followed by a leaf and a sum
+    convert_names("a * b + c", &subject, &names);
+    optimize(&subject, OPTIMIZE_FUSE);
+    tokenlist_add(&expected, create_variable_token(0, 0));
+    tokenlist_add(&expected, create_variable_token(1, 4));
+    tokenlist_add(&expected, create_variable_token(2, 8));
+    tokenlist_add(&expected, create_operator_token(MULT_ADD, 6));
+    assert_tokenlists_equal(expected, subject);
+
+    // sum whose right operand is a product
+    convert_names("c - a * b", &subject, &names);
+    optimize(&subject, OPTIMIZE_FUSE);
+    clear_tokenlist(&expected);
+    tokenlist_add(&expected, create_variable_token(2, 0));
+    tokenlist_add(&expected, create_variable_token(0, 4));
+    tokenlist_add(&expected, create_variable_token(1, 8));
+    tokenlist_add(&expected, create_operator_token(SUB_MULT, 2));
+    assert_tokenlists_equal(expected, subject);
+
+    // constants become immediates, the dispatch count drops
+    convert_names("a ^ 2 / 4", &subject, &names);
+    assert_count(5, program_dispatch_count(subject));
+    optimize(&subject, OPTIMIZE_FUSE);
+    clear_tokenlist(&expected);
+    tokenlist_add(&expected, create_variable_token(0, 0));
+    tokenlist_add(&expected, create_operator_token(POW_IMM, 2));
+    tokenlist_add(&expected, create_number_token(2, 4));
+    tokenlist_add(&expected, create_operator_token(DIV_IMM, 6));
+    tokenlist_add(&expected, create_number_token(4, 8));
+    assert_tokenlists_equal(expected, subject);
+    assert_count(3, program_dispatch_count(subject));
+
+    // fusing again changes nothing
+    optimize(&subject, OPTIMIZE_FUSE);
+    assert_tokenlists_equal(expected, subject);
+
+    // negation around a function, errors stay at the function
+    convert_names("sin(-a) - -cos a", &subject, &names);
+    optimize(&subject, OPTIMIZE_FUSE);
+    clear_tokenlist(&expected);
+    tokenlist_add(&expected, create_variable_token(0, 5));
+    tokenlist_add(&expected, create_operator_token(NEG_CALL, 0));
+    tokenlist_add(&expected, create_operator_token(SIN, 0));
+    tokenlist_add(&expected, create_variable_token(0, 15));
+    tokenlist_add(&expected, create_operator_token(CALL_NEG, 11));
+    tokenlist_add(&expected, create_operator_token(COS, 11));
+    tokenlist_add(&expected, create_operator_token(SUB, 8));
+    assert_tokenlists_equal(expected, subject);
+
+    // without the flag the program is left alone
+    convert_names("a * b + c", &subject, &names);
+    assert_success(convert_names("a * b + c", &expected, &names));
+    optimize(&subject, OPTIMIZE_NONE);
+    assert_tokenlists_equal(expected, subject);
+
+    // results and errors agree with the plain evaluator
+    assert_same_optimized("a * b + c", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("c - a * b * 3 + 1", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("(a + 1) * (b - 2) - c", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("a ^ 3 - 2 ^ a % 3", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("-ln(a) + sin(-b) * cos(-c)", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("a / z", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("a / 0", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("b ^ 0.5", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("z ^ -1", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("1 + ln(-a)", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("2 * -tan(pi / 2)", &names, values, OPTIMIZE_FUSE);
+    assert_same_optimized("-fac(c)", &names, values, OPTIMIZE_FUSE);
+
+    // constant powers and divisions are strength reduced
+    convert_names("a ^ 3 + b ^ 0.5 - c / 4", &subject, &names);
+    optimize(&subject, OPTIMIZE_STRENGTH);
+    clear_tokenlist(&expected);
+    tokenlist_add(&expected, create_variable_token(0, 0));
+    tokenlist_add(&expected, create_operator_token(POW_INT, 2));
+    tokenlist_add(&expected, create_number_token(3, 4));
+    tokenlist_add(&expected, create_variable_token(1, 8));
+    tokenlist_add(&expected, create_operator_token(SQRT, 10));
+    tokenlist_add(&expected, create_operator_token(ADD, 6));
+    tokenlist_add(&expected, create_variable_token(2, 18));
+    tokenlist_add(&expected, create_number_token(0.25, 22));
+    tokenlist_add(&expected, create_operator_token(MULT, 20));
+    tokenlist_add(&expected, create_operator_token(SUB, 16));
+    assert_tokenlists_equal(expected, subject);
+
+    // inexact reciprocals only on request, never of zero
+    convert_names("a / 3 + b / 0", &subject, &names);
+    assert_success(convert_names("a / 3 + b / 0", &expected, &names));
+    optimize(&subject, OPTIMIZE_STRENGTH);
+    assert_tokenlists_equal(expected, subject);
+    optimize(&subject, OPTIMIZE_STRENGTH | OPTIMIZE_RECIPROCAL);
+    assert_count(DIV, subject.list[5].value.operator);
+    assert_count(MULT, subject.list[2].value.operator);
+    assert_number(subject.list[1], 1.0 / 3);
+
+    unsigned int all = OPTIMIZE_STRENGTH | OPTIMIZE_RECIPROCAL | OPTIMIZE_FUSE;
+    assert_same_optimized("a ^ 2 + b ^ 3 - c ^ 4 + a ^ -3", &names, values, all);
+    assert_same_optimized("b ^ 31 / 7 + a ^ 0 + z ^ 0", &names, values, all);
+    assert_same_optimized("(a * 8) ^ 0.5 - c ^ 0.5", &names, values, all);
+    assert_same_optimized("b ^ 0.5", &names, values, all);
+    assert_same_optimized("-a ^ 0.5", &names, values, all);
+    assert_same_optimized("1 + z ^ -2", &names, values, all);
+    assert_same_optimized("b ^ 2.5", &names, values, all);
+    assert_same_optimized("a / 0 + 1", &names, values, all);
+
+    // repeated subexpressions share one node of the dag
+    convert_names("a * b + a * b", &subject, &names);
+    ExpressionDag dag = new_expression_dag(subject);
+    assert_true(dag.valid);
+    assert_count(4, dag.count);
+    assert_count(1, dag_shared_count(&dag));
+    assert_count(2, dag.nodes[2].uses);
+
+    // and are computed once into a temporary
+    assert_true(dag_emit(&dag, &subject));
+    delete_expression_dag(dag);
+    clear_tokenlist(&expected);
+    tokenlist_add(&expected, create_operator_token(RESERVE, 0));
+    tokenlist_add(&expected, create_number_token(1, 0));
+    tokenlist_add(&expected, create_variable_token(0, 0));
+    tokenlist_add(&expected, create_variable_token(1, 4));
+    tokenlist_add(&expected, create_operator_token(MULT, 2));
+    tokenlist_add(&expected, create_operator_token(STORE, 2));
+    tokenlist_add(&expected, create_number_token(0, 2));
+    tokenlist_add(&expected, create_operator_token(LOAD, 2));
+    tokenlist_add(&expected, create_number_token(0, 2));
+    tokenlist_add(&expected, create_operator_token(ADD, 6));
+    assert_tokenlists_equal(expected, subject);
+    assert_success(evaluate(subject, values, &result));
+    assert_number(result, -12);
+
+    // fused programs are not plain postfix any more
+    dag = new_expression_dag(subject);
+    assert_count(false, dag.valid);
+    assert_count(false, dag_emit(&dag, &subject));
+    delete_expression_dag(dag);
+
+    // nothing to share leaves the program alone
+    convert_names("a * b + b * a", &subject, &names);
+    assert_success(convert_names("a * b + b * a", &expected, &names));
+    optimize(&subject, OPTIMIZE_SHARE);
+    assert_tokenlists_equal(expected, subject);
+
+    // so does a fixed program without room for the temporaries
+    Token storage[8];
+    TokenList fixed = tokenlist_from_buffer(storage, 8);
+    convert_names("a * b + a * b", &fixed, &names);
+    optimize(&fixed, OPTIMIZE_SHARE);
+    assert_count(7, fixed.count);
+
+    assert_same_optimized("sin(a * b) + sin(a * b) * 2 + sin(a * b) ^ 2", &names, values,
+                          OPTIMIZE_SHARE);
+    assert_same_optimized("sin(a * b) + sin(a * b) * 2 + sin(a * b) ^ 2", &names, values,
+                          OPTIMIZE_SHARE | all);
+    assert_same_optimized("(a + b) * (a + b) - (a + b) / (c - a)", &names, values,
+                          OPTIMIZE_SHARE | all);
+    assert_same_optimized("ln(z - a) + ln(z - a)", &names, values, OPTIMIZE_SHARE | all);
+    assert_same_optimized("c / (a + b + 1) + c / (a + b + 1)", &names, values,
+                          OPTIMIZE_SHARE | all);
+    assert_same_optimized("-(a * c) + -(a * c) + fac(a * c)", &names, values,
+                          OPTIMIZE_SHARE | all);
+
+    // a context optimizes every program it converts
+    ParseContext context = new_parse_context();
+    context.optimize = OPTIMIZE_FUSE;
+    assert_success(parse_context(&context, "2 * 3 + 4 ^ 2", &result));
+    assert_number(result, 22);
+    assert_count(5, program_dispatch_count(context.program));
+    assert_error(parse_context(&context, "2 * 3 + 4 / 0", &result), ZERO_DIVISON, 10);
+    delete_parse_context(context);
+
     // release resources and conclude
+    delete_nametable(names);
+    delete_tokenlist(expected);
+    delete_tokenlist(subject);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// the vector scans must agree with the byte by byte lexer
+static void assert_same_scalar_lex(const char *input)
+{
+    TokenList vector = new_tokenlist();
+    TokenList scalar = new_tokenlist();
+    NameTable vector_names = new_nametable();
+    NameTable scalar_names = new_nametable();
+
+    scan_use_vectors(true);
+    ResultInfo expected = lex_names(input, &vector, &vector_names);
+    scan_use_vectors(false);
+    ResultInfo result = lex_names(input, &scalar, &scalar_names);
+    scan_use_vectors(true);
+
+    if (expected.status == SUCCESS)
+    {
+        assert_success(result);
+        assert_tokenlists_equal(vector, scalar);
+    }
+
+    else
+    {
+        assert_error(result, expected.status, expected.error_index);
+    }
+
+    delete_nametable(scalar_names);
+    delete_nametable(vector_names);
+    delete_tokenlist(scalar);
+    delete_tokenlist(vector);
+}
+
+static void scan_test(void)
+{
+    begin_test_domain("Scan");
+
+    char input[1024];
+
+    // runs ending on every position around the vector widths
+    for (unsigned int length = 0; length < 70; length += 3)
+    {
+        memset(input, ' ', length);
+        input[length] = '7';
+        input[length + 1] = '\0';
+        assert_count(length, scan_run(input, 0, length + 1, SCAN_SPACE));
+    }
+
+    memset(input, 'q', 100);
+    input[100] = '\0';
+    assert_count(100, scan_run(input, 0, 100, SCAN_LOWER));
+    assert_count(60, scan_run(input, 10, 60, SCAN_LOWER));
+    assert_count(10, scan_run(input, 10, 100, SCAN_DIGIT));
+
+    // every byte value next to the class boundaries
+    memset(input, '5', 64);
+    input[64] = '\0';
+    input[40] = '/';
+    assert_count(40, scan_run(input, 0, 64, SCAN_DIGIT));
+    input[40] = ':';
+    assert_count(40, scan_run(input, 0, 64, SCAN_DIGIT));
+    input[40] = (char)0xb5;
+    assert_count(40, scan_run(input, 0, 64, SCAN_DIGIT));
+    memset(input, '\t', 64);
+    input[50] = '\r';
+    input[51] = '\x0e';
+    assert_count(51, scan_run(input, 0, 64, SCAN_SPACE));
+
+    // long whitespace, digit and name runs lex to the same columns
+    char *long_input = input;
+    snprintf(long_input, sizeof(input),
+             "%60s%s%40s%s * %s", "", "12345678901234567890123456789.5",
+             "", "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz",
+             "sinsinsinsinsinsinsinsinsinsinsinsinsinsinsinsinsin");
+    assert_same_scalar_lex(long_input);
+
+    snprintf(long_input, sizeof(input), "%50s1234567890123456789012345678901234.5.5", "");
+    assert_same_scalar_lex(long_input);
+    TokenList subject = new_tokenlist();
+    assert_error(lex(long_input, &subject), MULTIPLE_DECIMAL_POINTS, 86);
+    delete_tokenlist(subject);
+
+    snprintf(long_input, sizeof(input), "\t\n%70s12345678901234567890123456789012345.", "");
+    assert_same_scalar_lex(long_input);
+
+    snprintf(long_input, sizeof(input), "%40sabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz#", "");
+    assert_same_scalar_lex(long_input);
+
+    // numbers longer than the build buffer keep their odd truncation
+    memset(input, '9', 600);
+    input[600] = '\0';
+    assert_same_scalar_lex(input);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// the first diagnostic is the error convert stops at
+static void assert_first_diagnostic(const char *input, NameTable *names)
+{
+    TokenList tokens = new_tokenlist();
+    DiagnosticList diagnostics = new_diagnostic_list();
+
+    ResultInfo expected = convert_names(input, &tokens, names);
+    unsigned int count = validate_expression(input, names, &tokens, &diagnostics);
+
+    if (expected.status == SUCCESS)
+    {
+        assert_count(0, count);
+    }
+
+    else if (count > 0)
+    {
+        assert_error(diagnostics.list[0], expected.status, expected.error_index);
+    }
+
+    else
+    {
+        assert_count(1, count);
+    }
+
+    delete_diagnostic_list(diagnostics);
+    delete_tokenlist(tokens);
+}
+
+static void diagnostic_test(void)
+{
+    begin_test_domain("Diagnostic");
+
+    TokenList tokens = new_tokenlist();
+    DiagnosticList diagnostics = new_diagnostic_list();
+
+    assert_count(0, validate_expression("(1 + 2) * sin 3", NULL, &tokens, &diagnostics));
+
+    // errors after the first one are found too
+    assert_count(4, validate_expression("3 + * 4 ) + (2 ..5", NULL, &tokens, &diagnostics));
+    assert_error(diagnostics.list[0], INVALID_INPUT_CHARACTER, 15);
+    assert_error(diagnostics.list[1], INVALID_TOKEN, 4);
+    assert_error(diagnostics.list[2], UNMATCHED_RIGHT_PAR, 8);
+    assert_error(diagnostics.list[3], UNMATCHED_LEFT_PAR, 15);
+
+    // a broken word is skipped up to the next operator or parenthesis
+    // and errors caused by guessing what it was are not reported
+    assert_count(4, validate_expression("sinc(1.2.3 + 4.) - q#x", NULL, &tokens, &diagnostics));
+    assert_error(diagnostics.list[0], INVALID_INPUT_CHARACTER, 0);
+    assert_error(diagnostics.list[1], MULTIPLE_DECIMAL_POINTS, 8);
+    assert_error(diagnostics.list[2], NUM_ENDS_WITH_DOT, 14);
+    assert_error(diagnostics.list[3], INVALID_INPUT_CHARACTER, 19);
+    assert_count(EMPTY, tokens.list[0].type);
+    assert_count(0, tokens.list[0].column);
+
+    // missing operators are reported once each
+    assert_count(3, validate_expression("2 3 (4) sin 5", NULL, &tokens, &diagnostics));
+    assert_error(diagnostics.list[0], INVALID_TOKEN, 2);
+    assert_error(diagnostics.list[1], INVALID_TOKEN, 4);
+    assert_error(diagnostics.list[2], INVALID_TOKEN, 8);
+
+    // the end of input reports both its checks
+    assert_count(2, validate_expression("(1 + ", NULL, &tokens, &diagnostics));
+    assert_error(diagnostics.list[0], UNMATCHED_LEFT_PAR, 3);
+    assert_error(diagnostics.list[1], INVALID_TOKEN, 3);
+
+    // an error the end of input repeats is reported once
+    assert_count(3, validate_expression(")(", NULL, &tokens, &diagnostics));
+    assert_error(diagnostics.list[0], INVALID_TOKEN, 0);
+    assert_error(diagnostics.list[1], INVALID_TOKEN, 1);
+    assert_error(diagnostics.list[2], UNMATCHED_LEFT_PAR, 1);
+
+    // names are allowed when a table is given
+    NameTable names = new_nametable();
+    assert_count(1, validate_expression("rate * * hours", &names, &tokens, &diagnostics));
+    assert_error(diagnostics.list[0], INVALID_TOKEN, 7);
+
+    assert_first_diagnostic("(3 + 17) * 2.57.7 - 8", NULL);
+    assert_first_diagnostic("x + (3 + 17) * 2.57 - 8 + 2", NULL);
+    assert_first_diagnostic("x + (3 + 17) * 2.57 - 8 + 2", &names);
+    assert_first_diagnostic("((2 + 3) * 4", NULL);
+    assert_first_diagnostic("(2 + 3)) * (4", NULL);
+    assert_first_diagnostic("2 + 3 *", NULL);
+    assert_first_diagnostic("-sin -2 ^ (3)", NULL);
+    assert_first_diagnostic("4 + / 2 (", NULL);
+    assert_first_diagnostic(") 2 (", NULL);
+    assert_first_diagnostic("", NULL);
+
+    delete_nametable(names);
+    delete_diagnostic_list(diagnostics);
+    delete_tokenlist(tokens);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define ROW_TEST_STRIDE 4
+
+// rows that differ from a plain evaluation of the same program
+static unsigned int row_mismatches(const TokenList program, const double *variables,
+                                   unsigned long long row_count,
+                                   const double *results, const error_type *errors)
+{
+    unsigned int mismatches = 0;
+    Token expected = create_empty_token();
+    for (unsigned long long row = 0; row < row_count; row++)
+    {
+        ResultInfo res = evaluate(program, variables + row * ROW_TEST_STRIDE, &expected);
+        if (res.status != errors[row])
+            mismatches += 1;
+        else if (res.status == SUCCESS && expected.value.number != results[row])
+            mismatches += 1;
+        else if (res.status != SUCCESS && !isnan(results[row]))
+            mismatches += 1;
+    }
+
+    return mismatches;
+}
+
+static void rows_test(void)
+{
+    begin_test_domain("Rows");
+
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    assert_success(convert_names("a / b + c ^ 2 - a ^ 0.5", &program, &names));
+
+    // the fourth column is never read
+    const unsigned long long row_count = 20000;
+    double *variables = (double *)malloc(row_count * ROW_TEST_STRIDE * sizeof(double));
+    double *results = (double *)aligned_alloc(64, row_count * sizeof(double));
+    error_type *errors = (error_type *)aligned_alloc(64, row_count * sizeof(error_type));
+    if (variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    // every 97th row divides by zero, every 89th takes the root of a negative
+    unsigned long long expected_failed = 0;
+    for (unsigned long long row = 0; row < row_count; row++)
+    {
+        double *values = variables + row * ROW_TEST_STRIDE;
+        values[0] = row % 89 == 0 ? -1.0 - row : row * 0.5;
+        values[1] = row % 97 == 0 ? 0 : 1 + row % 13;
+        values[2] = row * 1e-3;
+        values[3] = -7;
+        if (row % 89 == 0 || row % 97 == 0)
+            expected_failed += 1;
+    }
+
+    const unsigned int thread_counts[] = { 1, 2, 3, 8, 0 };
+    for (unsigned int i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        RowPool pool = new_row_pool(thread_counts[i]);
+
+        // repeated calls reuse the same threads
+        for (unsigned int repeat = 0; repeat < 3; repeat++)
+        {
+            memset(errors, 0xff, row_count * sizeof(error_type));
+            assert_count(expected_failed, evaluate_rows(&pool, program, variables, ROW_TEST_STRIDE,
+                                                        row_count, results, errors));
+            assert_count(0, row_mismatches(program, variables, row_count, results, errors));
+        }
+
+        // a few rows are evaluated by the caller alone
+        assert_count(3, evaluate_rows(&pool, program, variables, ROW_TEST_STRIDE,
+                                      100, results, errors));
+        assert_count(0, row_mismatches(program, variables, 100, results, errors));
+        assert_count(ZERO_DIVISON, errors[0]);
+        assert_count(NEGATIVE_FRACTIONAL_EXPONENT, errors[89]);
+        assert_count(ZERO_DIVISON, errors[97]);
+        assert_count(SUCCESS, errors[1]);
+
+        assert_count(0, evaluate_rows(&pool, program, variables, ROW_TEST_STRIDE,
+                                      0, results, errors));
+
+        delete_row_pool(&pool);
+        assert_count(0, pool.thread_count);
+    }
+
+    // a row count that is not a multiple of the chunk size
+    RowPool pool = new_row_pool(4);
+    evaluate_rows(&pool, program, variables, ROW_TEST_STRIDE, row_count - 37, results, errors);
+    assert_count(0, row_mismatches(program, variables, row_count - 37, results, errors));
+    delete_row_pool(&pool);
+
+    free(errors);
+    free(results);
+    free(variables);
+    delete_tokenlist(program);
+    delete_nametable(names);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define KERNEL_TEST_ROWS 5000
+#define KERNEL_TEST_OUTPUTS 5
+
+static const char *kernel_expressions[KERNEL_TEST_OUTPUTS] = {
+    "(a + b) * c",
+    "(a + b) ^ 2 - c / 2",
+    "a / b",
+    "",
+    "sin(a + b) + (a + b) * c",
+};
+
+// outputs that differ from evaluating each expression on its own
+// sharing decides which products are fused, so values may differ in rounding
+static unsigned int kernel_mismatches(const Kernel *kernel,
+                                      const double *variables, unsigned long long row_count,
+                                      double *const *columns, error_type *const *errors)
+{
+    unsigned int mismatches = 0;
+    Token expected = create_empty_token();
+
+    for (unsigned int k = 0; k < kernel->output_count; k++)
+    {
+        const TokenList program = kernel->programs[k];
+
+        for (unsigned long long row = 0; row < row_count; row++)
+        {
+            ResultInfo res = evaluate(program, variables + row * 3, &expected);
+            if (res.status != errors[k][row])
+                mismatches += 1;
+            else if (res.status == SUCCESS && fabs(expected.value.number - columns[k][row]) > 0.000001)
+                mismatches += 1;
+            else if (res.status != SUCCESS && !isnan(columns[k][row]))
+                mismatches += 1;
+        }
+    }
+
+    return mismatches;
+}
+
+static void kernel_test(void)
+{
+    begin_test_domain("Kernel");
+
+    NameTable names = new_nametable();
+
+    // a program of several expressions has one root each
+    TokenList program = new_tokenlist();
+    assert_success(convert_names("(a + b) * c", &program, &names));
+    TokenList second = new_tokenlist();
+    assert_success(convert_names("(a + b) / 2", &second, &names));
+    for (unsigned int i = 0; i < second.count; i++)
+        tokenlist_add(&program, second.list[i]);
+
+    ExpressionDag dag = new_expression_dag_roots(program, 2);
+    assert_true(dag.valid);
+    assert_count(2, dag.root_count);
+    assert_count(1, dag_shared_count(&dag));
+    delete_expression_dag(dag);
+
+    dag = new_expression_dag(program);
+    assert_count(false, dag.valid);
+    delete_expression_dag(dag);
+
+    // the shared sum is computed once, both values are left in order
+    dag = new_expression_dag_roots(program, 2);
+    assert_true(dag_emit(&dag, &program));
+    delete_expression_dag(dag);
+
+    ParseContext context = new_parse_context();
+    double variables[3] = { 1, 2, 4 };
+    double outputs[2] = { 0, 0 };
+    assert_success(evaluate_outputs(&context, program, variables, outputs, 2));
+    assert_count(12, (unsigned int)outputs[0]);
+    assert_count(1.5 == outputs[1], true);
+
+    // a broken expression is not added
+    Kernel kernel = new_kernel(OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+    assert_error(kernel_add(&kernel, "a + * b", &names), INVALID_TOKEN, 4);
+    assert_count(0, kernel.output_count);
+
+    for (unsigned int k = 0; k < KERNEL_TEST_OUTPUTS; k++)
+        assert_success(kernel_add(&kernel, kernel_expressions[k], &names));
+    kernel_compile(&kernel);
+    assert_count(KERNEL_TEST_OUTPUTS, kernel.output_count);
+
+    // a + b is computed once for all three expressions using it
+    unsigned int single_dispatches = 0;
+    for (unsigned int k = 0; k < KERNEL_TEST_OUTPUTS; k++)
+        single_dispatches += program_dispatch_count(kernel.programs[k]);
+    assert_true(program_dispatch_count(kernel.program) < single_dispatches);
+    assert_count(RESERVE, kernel.program.list[0].value.operator);
+
+    double *rows = (double *)malloc(KERNEL_TEST_ROWS * 3 * sizeof(double));
+    double *column_storage = (double *)malloc(KERNEL_TEST_OUTPUTS * KERNEL_TEST_ROWS * sizeof(double));
+    error_type *error_storage = (error_type *)malloc(KERNEL_TEST_OUTPUTS * KERNEL_TEST_ROWS *
+                                                    sizeof(error_type));
+    if (rows == NULL || column_storage == NULL || error_storage == NULL)
+        exit(1);
+
+    double *columns[KERNEL_TEST_OUTPUTS];
+    error_type *errors[KERNEL_TEST_OUTPUTS];
+    for (unsigned int k = 0; k < KERNEL_TEST_OUTPUTS; k++)
+    {
+        columns[k] = column_storage + k * KERNEL_TEST_ROWS;
+        errors[k] = error_storage + k * KERNEL_TEST_ROWS;
+    }
+
+    // every 50th row divides by zero in the third expression only
+    for (unsigned int row = 0; row < KERNEL_TEST_ROWS; row++)
+    {
+        rows[row * 3] = row * 0.25;
+        rows[row * 3 + 1] = row % 50 == 0 ? 0 : row % 7 + 0.5;
+        rows[row * 3 + 2] = 3 - row * 1e-3;
+    }
+
+    assert_count(KERNEL_TEST_ROWS / 50,
+                 kernel_evaluate_range(&kernel, &context, rows, 3, 0, KERNEL_TEST_ROWS,
+                                       columns, errors));
+    assert_count(0, kernel_mismatches(&kernel, rows, KERNEL_TEST_ROWS, columns, errors));
+    assert_count(ZERO_DIVISON, errors[2][0]);
+    assert_count(SUCCESS, errors[0][0]);
+    assert_count(SUCCESS, errors[4][0]);
+    assert_count(0, (unsigned int)columns[3][17]);
+
+    // the same through a row pool
+    RowPool pool = new_row_pool(3);
+    memset(error_storage, 0xff, KERNEL_TEST_OUTPUTS * KERNEL_TEST_ROWS * sizeof(error_type));
+    assert_count(KERNEL_TEST_ROWS / 50,
+                 evaluate_kernel_rows(&pool, &kernel, rows, 3, KERNEL_TEST_ROWS, columns, errors));
+    assert_count(0, kernel_mismatches(&kernel, rows, KERNEL_TEST_ROWS, columns, errors));
+    delete_row_pool(&pool);
+
+    // without passes the fused program is the expressions one after another
+    Kernel plain = new_kernel(OPTIMIZE_NONE);
+    for (unsigned int k = 0; k < KERNEL_TEST_OUTPUTS; k++)
+        assert_success(kernel_add(&plain, kernel_expressions[k], &names));
+    kernel_compile(&plain);
+    assert_count(single_dispatches > program_dispatch_count(plain.program), false);
+    assert_count(KERNEL_TEST_ROWS / 50,
+                 kernel_evaluate_range(&plain, &context, rows, 3, 0, KERNEL_TEST_ROWS,
+                                       columns, errors));
+    assert_count(0, kernel_mismatches(&plain, rows, KERNEL_TEST_ROWS, columns, errors));
+    delete_kernel(&plain);
+
+    free(error_storage);
+    free(column_storage);
+    free(rows);
+    delete_kernel(&kernel);
+    delete_parse_context(context);
+    delete_tokenlist(second);
+    delete_tokenlist(program);
+    delete_nametable(names);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+static void aggregate_test(void)
+{
+    begin_test_domain("Aggregate");
+
+    NameTable names = new_nametable();
+    TokenList quotient = new_tokenlist();
+    TokenList identity = new_tokenlist();
+    assert_success(convert_names("a / b", &quotient, &names));
+    assert_success(convert_names("a", &identity, &names));
+
+    const unsigned long long row_count = 30000;
+    double *variables = (double *)malloc(row_count * 2 * sizeof(double));
+    if (variables == NULL)
+        exit(1);
+
+    // every 101st row divides by zero
+    double naive_sum = 0;
+    for (unsigned long long row = 0; row < row_count; row++)
+    {
+        variables[row * 2] = (double)(row % 1000) - 300.25;
+        variables[row * 2 + 1] = row % 101 == 0 ? 0 : 1 + row % 3;
+        if (row % 101 != 0)
+            naive_sum += variables[row * 2] / variables[row * 2 + 1];
+    }
+
+    double naive_mean = naive_sum / (row_count - 298);
+    double naive_deviations = 0;
+    for (unsigned long long row = 0; row < row_count; row++)
+    {
+        if (row % 101 != 0)
+        {
+            double deviation = variables[row * 2] / variables[row * 2 + 1] - naive_mean;
+            naive_deviations += deviation * deviation;
+        }
+    }
+    double naive_variance = naive_deviations / (row_count - 299);
+
+    // the sum is the same to the bit for every thread count
+    double sums[4];
+    double variances[4];
+    const unsigned int thread_counts[] = { 1, 2, 3, 8 };
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        RowPool pool = new_row_pool(thread_counts[i]);
+        Aggregate aggregate = new_aggregate();
+        aggregate_rows(&pool, quotient, variables, 2, row_count, &aggregate);
+
+        assert_count(row_count - 298, aggregate.count);
+        assert_count(298, aggregate.failed);
+        assert_count(298, aggregate.error_counts[ZERO_DIVISON]);
+        assert_count(0, aggregate.error_counts[SUCCESS]);
+        assert_near(naive_sum, aggregate.sum, 0.000001);
+        assert_near(-300.25, aggregate.min, 0);
+        assert_near(698.75, aggregate.max, 0);
+        assert_near(aggregate.sum / aggregate.count, aggregate.mean, 0);
+        assert_near(naive_variance, aggregate.variance, naive_variance * 1e-12);
+        sums[i] = aggregate.sum;
+        variances[i] = aggregate.variance;
+
+        delete_aggregate(&aggregate);
+        delete_row_pool(&pool);
+    }
+    assert_count(0, memcmp(&sums[0], &sums[1], sizeof(double)));
+    assert_count(0, memcmp(&sums[0], &sums[2], sizeof(double)));
+    assert_count(0, memcmp(&sums[0], &sums[3], sizeof(double)));
+    assert_count(0, memcmp(&variances[0], &variances[1], sizeof(double)));
+    assert_count(0, memcmp(&variances[0], &variances[3], sizeof(double)));
+
+    // small values next to a huge one are not lost
+    for (unsigned long long row = 0; row < row_count; row++)
+        variables[row * 2] = 1;
+    variables[0] = 1e17;
+    variables[2 * (row_count - 1)] = -1e17;
+
+    RowPool pool = new_row_pool(4);
+    Aggregate aggregate = new_aggregate();
+    aggregate_rows(&pool, identity, variables, 2, row_count, &aggregate);
+    assert_count(row_count - 2, (unsigned int)aggregate.sum);
+    assert_near(row_count - 2, aggregate.sum, 0);
+    delete_aggregate(&aggregate);
+
+    // histogram over [0, 100) in ten bins
+    for (unsigned long long row = 0; row < row_count; row++)
+        variables[row * 2] = (double)(row % 120) - 10;
+    variables[2] = NAN;
+
+    aggregate = new_histogram_aggregate(0, 100, 10);
+    aggregate_rows(&pool, identity, variables, 2, row_count, &aggregate);
+    assert_count(250 * 10, aggregate.bins[0]);
+    assert_count(250 * 10, aggregate.bins[9]);
+    assert_count(250 * 10 - 1, aggregate.below);
+    assert_count(250 * 10, aggregate.above);
+    assert_count(1, aggregate.unordered);
+    assert_true(isnan(aggregate.sum));
+    delete_aggregate(&aggregate);
+
+    // no rows at all
+    aggregate = new_aggregate();
+    aggregate_rows(&pool, identity, variables, 2, 0, &aggregate);
+    assert_count(0, aggregate.count);
+    assert_near(0, aggregate.sum, 0);
+    assert_true(isnan(aggregate.min));
+    assert_true(isnan(aggregate.mean));
+    assert_true(isnan(aggregate.variance));
+    delete_aggregate(&aggregate);
+
+    delete_row_pool(&pool);
+    free(variables);
+    delete_tokenlist(identity);
+    delete_tokenlist(quotient);
+    delete_nametable(names);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+static void assert_exact(const char *input, long long expected)
+{
+    Token result = create_empty_token();
+    assert_success(parse_exact(input, &result));
+    assert_count(INTEGER, result.type);
+    assert_true(result.value.integer == expected);
+}
+
+static void integer_test(void)
+{
+    begin_test_domain("Integer");
+
+    // integer literals only switch when an integer operator takes them
+    TokenList program = new_tokenlist();
+    assert_success(convert("(2 + 3) * 0.5", &program));
+    optimize(&program, OPTIMIZE_INTEGER);
+    assert_count(6, program.count);
+    assert_count(INTEGER, program.list[0].type);
+    assert_count(INTEGER, program.list[1].type);
+    assert_count(IADD, program.list[2].value.operator);
+    assert_count(PROMOTE, program.list[3].value.operator);
+    assert_count(NUMBER, program.list[4].type);
+    assert_count(MULT, program.list[5].value.operator);
+
+    assert_success(convert("2 * 0.5 + 1", &program));
+    optimize(&program, OPTIMIZE_INTEGER);
+    assert_count(NUMBER, program.list[0].type);
+    assert_count(MULT, program.list[2].value.operator);
+
+    // beyond 2^53 doubles lose exactness, integers do not
+    assert_exact("12*7+3%2", 85);
+    assert_exact("fac(10)", 3628800);
+    assert_exact("fac(20)", 2432902008176640000LL);
+    assert_exact("-fac(5)", -120);
+    assert_exact("2^62", 4611686018427387904LL);
+    assert_exact("99999999 * 99999999", 9999999800000001LL);
+    assert_exact("3^39 - 3^39 + 1", 1);
+    assert_exact("8 / 2", 4);
+    assert_exact("-7 % 3", -1);
+    assert_exact("abs(3 - 10)", 7);
+    assert_exact("-(4 - 10)", 6);
+    assert_exact("42", 42);
+
+    // overflow and remainders continue in double
+    Token result = create_empty_token();
+    assert_success(parse_exact("2^63", &result));
+    assert_number(result, 9223372036854775808.0);
+    assert_success(parse_exact("fac(21)", &result));
+    assert_number(result, 51090942171709440000.0);
+    assert_success(parse_exact("7 / 2", &result));
+    assert_number(result, 3.5);
+    assert_success(parse_exact("2 ^ (0 - 2)", &result));
+    assert_number(result, 0.25);
+    assert_success(parse_exact("(2 + 3) * 0.5", &result));
+    assert_number(result, 2.5);
+
+    // errors are those of the double operators
+    assert_error(parse_exact("0 ^ (1 - 2)", &result), ZERO_NEGATIVE_EXPONENT, 2);
+    assert_error(parse_exact("10 / (5 - 5)", &result), ZERO_DIVISON, 3);
+    assert_error(parse_exact("fac(5 / 2)", &result), FAC_INPUT_NOT_INT, 0);
+
+    // evaluate rounds an integer result to a NUMBER
+    assert_success(convert("fac(20)", &program));
+    optimize(&program, OPTIMIZE_INTEGER);
+    assert_success(evaluate(program, NULL, &result));
+    assert_count(NUMBER, result.type);
+    assert_number(result, 2432902008176640000.0);
+
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    double values[1] = { 2.5 };
+
+    const char *inputs[] = {
+        "x * 2 + 3 * 4",
+        "(1 + 2) ^ 3 / x",
+        "fac(6) / (2 ^ 3) + x % 2",
+        "sin(2 * 3) + abs(0 - 4) * x",
+        "-(2 + 3) - -x",
+        "(2 + 3) * (2 + 3) + x * (2 + 3)",
+        "7 / 2 * 2 + 10 % 4",
+    };
+
+    for (unsigned int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        assert_same_optimized(inputs[i], &names, values, OPTIMIZE_INTEGER);
+        assert_same_optimized(inputs[i], &names, values,
+                              OPTIMIZE_INTEGER | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+    }
+
+    // shared integer subexpressions stay exact
+    assert_success(convert("(3 ^ 19) * (3 ^ 19)", &program));
+    optimize(&program, OPTIMIZE_INTEGER | OPTIMIZE_SHARE);
+    assert_count(RESERVE, program.list[0].value.operator);
+    assert_success(evaluate_exact(program, NULL, &result));
+    assert_true(result.type == INTEGER && result.value.integer == 1350851717672992089LL);
+
+    delete_nametable(names);
+    delete_tokenlist(program);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define CONDITIONAL_TEST_ROWS 3072
+
+static void conditional_test(void)
+{
+    begin_test_domain("Conditional");
+
+    // comparisons lex as operators, = and ! only as part of one
+    TokenList tokens = new_tokenlist();
+    assert_success(lex("1 <= 2 != 3 ? 4 : 5", &tokens));
+    assert_count(9, tokens.count);
+    assert_count(LESS_EQUAL, tokens.list[1].value.operator);
+    assert_count(NOT_EQUAL, tokens.list[3].value.operator);
+    assert_count(QUESTION, tokens.list[5].value.operator);
+    assert_count(COLON, tokens.list[7].value.operator);
+    assert_error(lex("1 = 2", &tokens), INVALID_INPUT_CHARACTER, 2);
+    assert_error(lex("1 ! 2", &tokens), INVALID_INPUT_CHARACTER, 2);
+    delete_tokenlist(tokens);
+
+    // c ? a : b  ->  c JUMP_FALSE [else] a JUMP [end] b
+    TokenList program = new_tokenlist();
+    assert_success(convert("1 < 2 ? 3 : 4", &program));
+    assert_count(9, program.count);
+    assert_count(LESS, program.list[2].value.operator);
+    assert_count(JUMP_FALSE, program.list[3].value.operator);
+    assert_count(8, (unsigned int)program.list[4].value.number);
+    assert_count(JUMP, program.list[6].value.operator);
+    assert_count(9, (unsigned int)program.list[7].value.number);
+
+    Token result = create_empty_token();
+    assert_success(parse("3 < 4", &result));
+    assert_number(result, 1);
+    assert_success(parse("3 >= 4", &result));
+    assert_number(result, 0);
+    assert_success(parse("1 + 2 == 3", &result));
+    assert_number(result, 1);
+    assert_success(parse("2 > 1 ? 10 : 20", &result));
+    assert_number(result, 10);
+    assert_success(parse("2 < 1 ? 10 : 20", &result));
+    assert_number(result, 20);
+    assert_success(parse("(0 ? 1 : 2) * 3", &result));
+    assert_number(result, 6);
+    assert_success(parse("0 ? 1 : 2 + 3", &result));
+    assert_number(result, 5);
+    assert_success(parse("1 ? -2 : 3", &result));
+    assert_number(result, -2);
+
+    // conditionals nest to the right
+    assert_success(parse("0 ? 1 : 0 ? 2 : 3", &result));
+    assert_number(result, 3);
+    assert_success(parse("0 ? 1 : 1 ? 2 : 3", &result));
+    assert_number(result, 2);
+    assert_success(parse("1 ? 0 ? 1 : 2 : 3", &result));
+    assert_number(result, 2);
+
+    // the branch not taken is never evaluated
+    assert_success(parse("1 ? 5 : 1 / 0", &result));
+    assert_number(result, 5);
+    assert_success(parse("0 ? ln(0 - 1) : 7", &result));
+    assert_number(result, 7);
+    assert_error(parse("0 ? 5 : 1 / 0", &result), ZERO_DIVISON, 10);
+
+    // a ? needs its : and the other way round
+    assert_error(parse("1 ? 2", &result), INVALID_TOKEN, 2);
+    assert_error(parse("1 : 2", &result), INVALID_TOKEN, 2);
+    assert_error(parse("(1 ? 2) : 3", &result), INVALID_TOKEN, 3);
+    assert_error(parse("1 ? 2 : 3 : 4", &result), INVALID_TOKEN, 10);
+    assert_error(parse("? 1 : 2", &result), INVALID_TOKEN, 0);
+
+    // passes that move tokens leave conditional programs alone
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    double values[1] = { 2.5 };
+
+    const char *inputs[] = {
+        "x > 2 ? x * 2 + 1 : x / 0",
+        "x < 2 ? 1 / 0 : (x + 1) * (x + 1)",
+        "x == 2.5 ? 2 ^ 3 : 0",
+        "(x + 1) * (x + 1) > 10 ? x % 2 : ln(x)",
+    };
+
+    for (unsigned int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        assert_same_optimized(inputs[i], &names, values,
+                              OPTIMIZE_INTEGER | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+    }
+
+    assert_success(convert_names("x > 2 ? x * 2 + 1 : 0", &program, &names));
+    unsigned int count = program.count;
+    optimize(&program, OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+    assert_count(count, program.count);
+    assert_true(program_has_jumps(program));
+
+    // a batch runs each branch over its own rows only
+    assert_success(convert_names("a < 100 ? a / b : a > 200 ? 1 / (a - 250) : ln(b - 5)",
+                                 &program, &names));
+
+    double *variables = (double *)calloc(CONDITIONAL_TEST_ROWS * ROW_TEST_STRIDE, sizeof(double));
+    double *results = (double *)aligned_alloc(64, CONDITIONAL_TEST_ROWS * sizeof(double));
+    error_type *errors = (error_type *)aligned_alloc(64, CONDITIONAL_TEST_ROWS * sizeof(error_type));
+    if (variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    // x is variable 0, a and b come after it
+    for (unsigned int row = 0; row < CONDITIONAL_TEST_ROWS; row++)
+    {
+        double *values = variables + row * ROW_TEST_STRIDE;
+        values[1] = row % 300;
+        values[2] = row % 11;
+    }
+
+    BatchContext batch = new_batch_context();
+    unsigned long long failed = evaluate_batch(&batch, program, variables, ROW_TEST_STRIDE,
+                                               CONDITIONAL_TEST_ROWS, results, errors);
+    assert_count(0, row_mismatches(program, variables, CONDITIONAL_TEST_ROWS, results, errors));
+    assert_true(failed > 0);
+    assert_count(ZERO_DIVISON, errors[0]);
+    assert_count(ZERO_DIVISON, errors[250]);
+    assert_count(LOG_OUT_OF_RANGE, errors[104]);
+    assert_count(SUCCESS, errors[1]);
+
+    assert_count(0, evaluate_batch(&batch, program, variables, ROW_TEST_STRIDE, 0, results, errors));
+    delete_batch_context(batch);
+
+    // rows of a conditional program are evaluated in batches
+    RowPool pool = new_row_pool(3);
+    assert_count(failed, evaluate_rows(&pool, program, variables, ROW_TEST_STRIDE,
+                                       CONDITIONAL_TEST_ROWS, results, errors));
+    assert_count(0, row_mismatches(program, variables, CONDITIONAL_TEST_ROWS, results, errors));
+    delete_row_pool(&pool);
+
+    // jump targets move with their expression in a kernel
+    Kernel kernel = new_kernel(OPTIMIZE_SHARE | OPTIMIZE_FUSE);
+    assert_success(kernel_add(&kernel, "a + 1", &names));
+    assert_success(kernel_add(&kernel, "a < b ? a : b", &names));
+    assert_success(kernel_add(&kernel, "b > 3 ? (a + 1) * 2 : 0 - 1", &names));
+    kernel_compile(&kernel);
+
+    ParseContext context = new_parse_context();
+    double outputs[3] = { 0, 0, 0 };
+    double row[ROW_TEST_STRIDE] = { 0, 7, 5, 0 };
+    assert_success(evaluate_outputs(&context, kernel.program, row, outputs, 3));
+    assert_true(outputs[0] == 8 && outputs[1] == 5 && outputs[2] == 16);
+    row[2] = 2;
+    assert_success(evaluate_outputs(&context, kernel.program, row, outputs, 3));
+    assert_true(outputs[0] == 8 && outputs[1] == 2 && outputs[2] == -1);
+    delete_parse_context(context);
+    delete_kernel(&kernel);
+
+    free(errors);
+    free(results);
+    free(variables);
+    delete_nametable(names);
+    delete_tokenlist(program);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// a program with calls inlined must match the pasted expression
+static void assert_same_inlined(const FunctionTable *functions, const char *call,
+                                const char *pasted, const double *values)
+{
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+
+    TokenList inlined = new_tokenlist();
+    TokenList expected = new_tokenlist();
+    assert_success(convert_functions(call, &inlined, &names, functions));
+    assert_success(convert_names(pasted, &expected, &names));
+
+    Token inlined_result = create_empty_token();
+    Token expected_result = create_empty_token();
+    assert_success(evaluate(expected, values, &expected_result));
+    assert_success(evaluate(inlined, values, &inlined_result));
+    assert_number(inlined_result, expected_result.value.number);
+
+    delete_tokenlist(expected);
+    delete_tokenlist(inlined);
+    delete_nametable(names);
+}
+
+static void function_test(void)
+{
+    begin_test_domain("Function");
+
+    FunctionTable functions = new_function_table();
+    assert_success(function_define(&functions, "sq(x) = x * x"));
+    assert_success(function_define(&functions, "clamp(x) = x < 0 ? 0 : x > 1 ? 1 : x"));
+    assert_success(function_define(&functions, "hyp(a, b) = (sq(a) + sq(b)) ^ 0.5"));
+    assert_success(function_define(&functions, "scale(v) = v * rate"));
+    assert_success(function_define(&functions, "two() = 2"));
+    assert_success(function_define(&functions, "  lerp ( a , b , t ) = a + (b - a) * t"));
+
+    // calls leave no trace in the program
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    assert_success(convert_functions("sq(3)", &program, &names, &functions));
+    assert_count(3, program.count);
+    assert_count(MULT, program.list[2].value.operator);
+    assert_count(0, names.count);
+
+    Token result = create_empty_token();
+    const char *inputs[] = { "sq(1 + 2)", "hyp(3, 4)", "sq(sq(2))", "two() + 1", "-sq(3)",
+                             "sq(-3)", "sq (3)", "clamp(2)", "clamp(-1)", "lerp(2, 4, 0.25)" };
+    const double expected[] = { 9, 5, 16, 3, -9, 9, 9, 1, 0, 2.5 };
+    for (unsigned int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        assert_success(convert_functions(inputs[i], &program, &names, &functions));
+        assert_success(evaluate(program, NULL, &result));
+        assert_number(result, expected[i]);
+    }
+
+    // a free variable of a body becomes a variable of the caller
+    assert_success(convert_functions("scale(2) + sq(x)", &program, &names, &functions));
+    assert_count(2, names.count);
+    double values[2] = { 3, 10 };
+    assert_success(evaluate(program, values, &result));
+    assert_number(result, 29);
+
+    // names go on with digits after their first letter
+    assert_success(function_define(&functions, "clamp01(x) = clamp(x)"));
+    assert_success(function_define(&functions, "sq2(v1) = sq(v1) * 2"));
+    assert_success(convert_functions("clamp01(3) + sq2(x2) - x", &program, &names, &functions));
+    assert_count(3, names.count);
+    double digits[3] = { 3, 10, 2 };
+    assert_success(evaluate(program, digits, &result));
+    assert_number(result, 6);
+    assert_error(function_define(&functions, "1k(x) = x"), INVALID_TOKEN, 0);
+    assert_error(function_define(&functions, "k(1x) = x"), INVALID_TOKEN, 2);
+    assert_error(function_define(&functions, "sin2(x) = x"), INVALID_TOKEN, 0);
+
+    double row[2] = { 0.5, -2 };
+    assert_same_inlined(&functions, "hyp(x, y) * clamp(x)", "((x * x + y * y) ^ 0.5) * x", row);
+    assert_same_inlined(&functions, "lerp(x, y, sq(x))", "x + (y - x) * (x * x)", row);
+    assert_same_inlined(&functions, "clamp(y) + clamp(x + 2)", "0 + 1", row);
+
+    // errors in a body are reported at the call
+    assert_error(convert_functions("1 + sq(1, 2)", &program, &names, &functions), INVALID_TOKEN, 4);
+    assert_error(convert_functions("sq()", &program, &names, &functions), INVALID_TOKEN, 0);
+    assert_error(convert_functions("hyp(3,)", &program, &names, &functions), INVALID_TOKEN, 6);
+    assert_error(convert_functions("sq(3", &program, &names, &functions), UNMATCHED_LEFT_PAR, 2);
+    assert_error(convert_functions("cube(3)", &program, &names, &functions), UNDEFINED_VARIABLE, 0);
+    assert_error(convert_functions("1, 2", &program, &names, &functions), INVALID_TOKEN, 1);
+    assert_error(convert_functions("scale(2)", &program, NULL, &functions), UNDEFINED_VARIABLE, 0);
+
+    assert_success(function_define(&functions, "inv(x) = 1 / x"));
+    assert_success(convert_functions("2 + inv(0)", &program, &names, &functions));
+    assert_error(evaluate(program, NULL, &result), ZERO_DIVISON, 4);
+
+    // without a table a call is the same syntax error as before
+    assert_error(convert_names("sq(3)", &program, &names), INVALID_TOKEN, 2);
+    assert_error(convert_names("1, 2", &program, &names), INVALID_TOKEN, 1);
+
+    // definitions are checked once, with the error in the definition
+    assert_error(function_define(&functions, "k(x, x) = x"), INVALID_TOKEN, 5);
+    assert_error(function_define(&functions, "sin(x) = x"), INVALID_TOKEN, 0);
+    assert_error(function_define(&functions, "k(pi) = 1"), INVALID_TOKEN, 2);
+    assert_error(function_define(&functions, "k x = 1"), INVALID_TOKEN, 2);
+    assert_error(function_define(&functions, "k(x) == 1"), INVALID_TOKEN, 5);
+    assert_error(function_define(&functions, "k(x) = "), INVALID_TOKEN, 6);
+    assert_error(function_define(&functions, "k(x) = x +"), INVALID_TOKEN, 9);
+    assert_error(function_define(&functions, "k(x) = sq(x, 1)"), INVALID_TOKEN, 7);
+    assert_error(function_define(&functions, "k(x) = cube(x)"), UNDEFINED_VARIABLE, 7);
+    assert_error(function_define(&functions, "k(x) = 1 ? x"), INVALID_TOKEN, 9);
+
+    // recursion, direct or through other functions, is rejected at the call
+    assert_error(function_define(&functions, "f(x) = 1 + f(x)"), CIRCULAR_REFERENCE, 11);
+    assert_success(function_define(&functions, "g(x) = x + 1"));
+    assert_success(function_define(&functions, "h(x) = 2 * g(x)"));
+    assert_error(function_define(&functions, "g(x) = h(x) - 1"), CIRCULAR_REFERENCE, 7);
+
+    // a failed redefinition keeps the old one, a successful one is used by callers
+    assert_success(convert_functions("h(1)", &program, &names, &functions));
+    assert_success(evaluate(program, NULL, &result));
+    assert_number(result, 4);
+    assert_success(function_define(&functions, "g(x) = x * 10"));
+    assert_success(convert_functions("h(1)", &program, &names, &functions));
+    assert_success(evaluate(program, NULL, &result));
+    assert_number(result, 20);
+
+    // inlined bodies are open to the optimizer
+    assert_success(convert_functions("sq(x + 1) + sq(x + 1)", &program, &names, &functions));
+    optimize(&program, OPTIMIZE_SHARE);
+    assert_count(RESERVE, program.list[0].value.operator);
+    assert_success(evaluate(program, values, &result));
+    assert_number(result, 32);
+
+    delete_tokenlist(program);
+    delete_nametable(names);
+    delete_function_table(&functions);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// native functions used by the tests
+static unsigned int native_test_calls = 0;
+static unsigned int native_test_vector_calls = 0;
+
+static double native_twice(const double *args)
+{
+    return 2 * args[0];
+}
+
+static double native_triple(const double *args)
+{
+    return 3 * args[0];
+}
+
+static double native_tick(const double *args)
+{
+    native_test_calls += 1;
+    return args[0];
+}
+
+static double native_mix(const double *args)
+{
+    return args[0] + (args[1] - args[0]) * args[2];
+}
+
+static void native_mix_vector(const double *const *args, double *results, unsigned int count)
+{
+    native_test_vector_calls += 1;
+    for (unsigned int i = 0; i < count; i++)
+        results[i] = args[0][i] + (args[1][i] - args[0][i]) * args[2][i];
+}
+
+#define NATIVE_TEST_ROWS 1024
+
+static void native_test(void)
+{
+    begin_test_domain("Native");
+
+    FunctionTable functions = new_function_table();
+    assert_success(function_register(&functions, "twice", 1, native_twice, NULL, NATIVE_PURE));
+    assert_success(function_register(&functions, "tick", 1, native_tick, NULL, NATIVE_NONE));
+    assert_success(function_register(&functions, "mix", 3, native_mix, native_mix_vector,
+                                     NATIVE_PURE));
+
+    // names follow the rules of user functions
+    assert_error(function_register(&functions, "sin", 1, native_twice, NULL, NATIVE_PURE),
+                 INVALID_TOKEN, 3);
+    assert_error(function_register(&functions, "Erf", 1, native_twice, NULL, NATIVE_PURE),
+                 INVALID_TOKEN, 0);
+    assert_error(function_register(&functions, "a b", 1, native_twice, NULL, NATIVE_PURE),
+                 INVALID_TOKEN, 1);
+    assert_error(function_register(&functions, "k", 0, native_twice, NULL, NATIVE_PURE),
+                 INVALID_TOKEN, 0);
+    assert_error(function_register(&functions, "k", FUNCTION_PARAMETERS_MAX + 1,
+                                   native_twice, NULL, NATIVE_PURE), INVALID_TOKEN, 0);
+    assert_error(function_register(&functions, "k", 1, NULL, NULL, NATIVE_PURE), INVALID_TOKEN, 0);
+
+    // a call is one token that points at the registration
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    assert_success(convert_functions("twice(3) + 1", &program, &names, &functions));
+    assert_count(4, program.count);
+    assert_count(NATIVE, program.list[1].type);
+    assert_true(program.list[1].value.native->scalar == native_twice);
+
+    Token result = create_empty_token();
+    const char *inputs[] = { "twice(3) + 1", "mix(1, 3, 0.5)", "-twice(2)", "twice(2) ^ 2",
+                             "2 ^ twice(1)", "mix(0, 10, twice(0.25))", "twice(1 ? 2 : 3)",
+                             "twice(2) > 3 ? 1 : 0", "0 ? twice(1) : mix(1, 2, 1 < 2)",
+                             "twice(-3)", "mix(1, twice(2), 0.5) * 2", "twice (sin(0))" };
+    const double expected[] = { 7, 2, -4, 16, 4, 5, 4, 1, 2, -6, 5, 0 };
+    for (unsigned int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        assert_success(convert_functions(inputs[i], &program, &names, &functions));
+        assert_success(evaluate(program, NULL, &result));
+        assert_number(result, expected[i]);
+    }
+
+    // user functions call natives, and inline around them
+    assert_success(function_define(&functions, "sqmix(a, t) = mix(a, a * a, t)"));
+    assert_success(convert_functions("sqmix(3, 0.5) + twice(x)", &program, &names, &functions));
+    double values[2] = { 4, 0 };
+    assert_success(evaluate(program, values, &result));
+    assert_number(result, 14);
+
+    // a wrong number of arguments is an error at the call
+    assert_error(convert_functions("1 + twice(1, 2)", &program, &names, &functions),
+                 INVALID_TOKEN, 4);
+    assert_error(convert_functions("mix(1)", &program, &names, &functions), INVALID_TOKEN, 0);
+    assert_error(convert_functions("twice()", &program, &names, &functions), INVALID_TOKEN, 0);
+    assert_error(convert_functions("twice(1) twice(2)", &program, &names, &functions),
+                 INVALID_TOKEN, 9);
+
+    // pure calls with constant arguments are folded, others are kept
+    assert_success(convert_functions("twice(3) + x", &program, &names, &functions));
+    optimize(&program, OPTIMIZE_FOLD);
+    assert_count(3, program.count);
+    assert_number(program.list[0], 6);
+
+    assert_success(convert_functions("tick(3) + x", &program, &names, &functions));
+    optimize(&program, OPTIMIZE_FOLD);
+    assert_count(4, program.count);
+    native_test_calls = 0;
+    assert_success(evaluate(program, values, &result));
+    assert_count(1, native_test_calls);
+
+    assert_success(convert_functions("mix(2 * 3, 10, 1 / 4) * x", &program, &names, &functions));
+    optimize(&program, OPTIMIZE_FOLD);
+    assert_count(3, program.count);
+    assert_number(program.list[0], 7);
+
+    assert_success(convert_names("x * (2 + 3) - 1 / 0", &program, &names));
+    optimize(&program, OPTIMIZE_FOLD);
+    assert_count(7, program.count);
+    assert_error(evaluate(program, values, &result), ZERO_DIVISON, 16);
+
+    assert_success(convert_names("x > 1 ? 2 * 3 : 4", &program, &names));
+    unsigned int count = program.count;
+    optimize(&program, OPTIMIZE_FOLD);
+    assert_count(count, program.count);
+
+    NameTable fold_names = new_nametable();
+    nametable_add(&fold_names, "x", 1);
+    double fold_values[1] = { 1.5 };
+    const char *folded[] = { "2 * 3 + x", "x * sin(0) + ln(1) - -(4)", "(1 < 2) + (3 == 3) * x",
+                             "abs(0 - 5) ^ 0.5 * fac(4)" };
+    for (unsigned int i = 0; i < sizeof(folded) / sizeof(folded[0]); i++)
+    {
+        assert_same_optimized(folded[i], &fold_names, fold_values,
+                              OPTIMIZE_INTEGER | OPTIMIZE_FOLD | OPTIMIZE_SHARE |
+                              OPTIMIZE_STRENGTH | OPTIMIZE_FUSE);
+    }
+    delete_nametable(fold_names);
+
+    // natives take integers from OPTIMIZE_INTEGER as doubles
+    assert_success(convert_functions("twice(2 * 3) + 1", &program, &names, &functions));
+    optimize(&program, OPTIMIZE_INTEGER);
+    assert_success(evaluate(program, NULL, &result));
+    assert_number(result, 13);
+
+    // registering again changes what compiled programs call
+    assert_success(convert_functions("twice(x)", &program, &names, &functions));
+    assert_success(function_register(&functions, "twice", 1, native_triple, NULL, NATIVE_PURE));
+    assert_success(evaluate(program, values, &result));
+    assert_number(result, 12);
+
+    // the vector form runs once per block of a batch, on the rows that reach it
+    NameTable row_names = new_nametable();
+    nametable_add(&row_names, "a", 1);
+    nametable_add(&row_names, "b", 1);
+    assert_success(convert_functions("a < 100 ? mix(a, b, 0.25) : b / (a - 150)",
+                                     &program, &row_names, &functions));
+    assert_true(program_has_vector_natives(program));
+
+    double *variables = (double *)calloc(NATIVE_TEST_ROWS * ROW_TEST_STRIDE, sizeof(double));
+    double *results = (double *)aligned_alloc(64, NATIVE_TEST_ROWS * sizeof(double));
+    error_type *errors = (error_type *)aligned_alloc(64, NATIVE_TEST_ROWS * sizeof(error_type));
+    if (variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    for (unsigned int row = 0; row < NATIVE_TEST_ROWS; row++)
+    {
+        variables[row * ROW_TEST_STRIDE] = row % 200;
+        variables[row * ROW_TEST_STRIDE + 1] = row % 13;
+    }
+
+    BatchContext batch = new_batch_context();
+    native_test_vector_calls = 0;
+    unsigned long long failed = evaluate_batch(&batch, program, variables, ROW_TEST_STRIDE,
+                                               NATIVE_TEST_ROWS, results, errors);
+    assert_count(NATIVE_TEST_ROWS / BATCH_ROWS, native_test_vector_calls);
+    assert_count(0, row_mismatches(program, variables, NATIVE_TEST_ROWS, results, errors));
+    assert_count(5, failed);
+    assert_count(ZERO_DIVISON, errors[150]);
+    delete_batch_context(batch);
+
+    RowPool pool = new_row_pool(3);
+    assert_count(failed, evaluate_rows(&pool, program, variables, ROW_TEST_STRIDE,
+                                       NATIVE_TEST_ROWS, results, errors));
+    assert_count(0, row_mismatches(program, variables, NATIVE_TEST_ROWS, results, errors));
+    delete_row_pool(&pool);
+
+    assert_success(convert_functions("twice(a)", &program, &row_names, &functions));
+    assert_count(false, program_has_vector_natives(program));
+
+    free(errors);
+    free(results);
+    free(variables);
+    delete_nametable(row_names);
+
+    // a user definition replaces a native of the same name
+    assert_success(function_define(&functions, "tick(x) = x + 1"));
+    assert_success(convert_functions("tick(1)", &program, &names, &functions));
+    assert_count(NUMBER, program.list[0].type);
+    assert_count(3, program.count);
+
+    delete_tokenlist(program);
+    delete_nametable(names);
+    delete_function_table(&functions);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define CALCULUS_TEST_TERMS 100000
+
+static void assert_close(double result, double expected)
+{
+    assert_near(expected, result, 1e-12 * fmax(1, fabs(expected)));
+}
+
+static void calculus_test(void)
+{
+    begin_test_domain("Calculus");
+
+    // names inside a call are its own, the same name is the same variable
+    NameTable names = new_nametable();
+    TokenList tokens = new_tokenlist();
+    assert_success(lex_names("sum(i, 1, 2, i * j) + i", &tokens, &names));
+    assert_count(SUM, tokens.list[0].value.operator);
+    assert_count(BOUND, tokens.list[2].type);
+    assert_count(BOUND, tokens.list[8].type);
+    assert_true(tokens.list[2].value.variable == tokens.list[8].value.variable);
+    assert_count(BOUND, tokens.list[10].type);
+    assert_true(tokens.list[2].value.variable != tokens.list[10].value.variable);
+    assert_count(VARIABLE, tokens.list[13].type);
+    assert_count(1, names.count);
+    delete_tokenlist(tokens);
+
+    const double pi = acos(-1);
+    Token result = create_empty_token();
+    assert_success(parse("integrate(x^2*sin(x), x, 0, pi)", &result));
+    assert_close(result.value.number, pi * pi - 4);
+    assert_success(parse("sum(i, 1, 10^6, 1/i^2)", &result));
+    assert_close(result.value.number, pi * pi / 6 - (1e-6 - 0.5e-12));
+    assert_success(parse("root(x^2 - 2, x, 0, 2)", &result));
+    assert_close(result.value.number, sqrt(2));
+    assert_success(parse("root(cos(x) - x, x, 1, 0)", &result));
+    assert_close(result.value.number, 0.739085133215160641655);
+
+    const char *inputs[] = { "2 * sum(i, 1, 10, i) + 1", "integrate(x, x, 1, 0)",
+                             "integrate(1 / (1 + x^2), x, 0 - 10^3, 10^3)",
+                             "integrate(abs(x), x, 0 - 1, 2)", "integrate(ln(x), x, 0, 1)",
+                             "sum(i, 0.5, 2, i)", "sum(i, 3, 1, i)", "sum(k, 1, 4, k > 2 ? k : 0)",
+                             "sum(k, 1, sum(j, 1, 3, j), k * integrate(1, x, 0, 2))",
+                             "root(x - 1, x, 1, 3)", "-sum(i, 1, 2, i)", "integrate(x, x, 2, 2)",
+                             "sum(x, 1, 3, integrate(x, x, 0, 2))" };
+    const double expected[] = { 111, -0.5, 2 * atan(1000), 2.5, -1, 2, 0, 7, 42, 1, -3, 0, 6 };
+    for (unsigned int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        assert_success(parse(inputs[i], &result));
+        assert_close(result.value.number, expected[i]);
+    }
+
+    // the variable is not one of the expression
+    TokenList program = new_tokenlist();
+    assert_success(convert_names("i * integrate(t, t, 0, 2)", &program, &names));
+    assert_count(1, names.count);
+    double values[1] = { 3 };
+    assert_success(evaluate(program, values, &result));
+    assert_number(result, 6);
+
+    // bodies call user functions, and user functions use calls
+    FunctionTable functions = new_function_table();
+    assert_success(function_define(&functions, "sq(x) = x * x"));
+    assert_success(function_define(&functions, "third() = integrate(sq(x), x, 0, 1)"));
+    assert_success(convert_functions("sum(i, 1, 4, sq(i)) + third()", &program, &names, &functions));
+    assert_success(evaluate(program, NULL, &result));
+    assert_close(result.value.number, 30 + 1.0 / 3);
+    assert_error(function_define(&functions, "sum(x) = x"), INVALID_TOKEN, 0);
+    assert_error(function_define(&functions, "k(a) = sum(i, 1, 2, a)"), UNDEFINED_VARIABLE, 20);
+    delete_function_table(&functions);
+
+    // errors are reported where they are found
+    assert_error(parse("integrate(y, x, 0, 1)", &result), UNDEFINED_VARIABLE, 10);
+    assert_error(parse("integrate(x, x, 0, x)", &result), UNDEFINED_VARIABLE, 19);
+    assert_error(parse("sum(k, 1, 2, integrate(k, x, 0, 1))", &result), UNDEFINED_VARIABLE, 23);
+    assert_error(convert_names("integrate(x, x, 0, y)", &program, &names), UNDEFINED_VARIABLE, 19);
+    assert_error(parse("sum(i, 1, 3, 1 / (i - 2))", &result), ZERO_DIVISON, 15);
+    assert_error(parse("integrate(x, x, 0, 1 / 0)", &result), ZERO_DIVISON, 21);
+    assert_error(parse("1 + integrate(x, x, 0, ln(0) + 2)", &result), LOG_OUT_OF_RANGE, 23);
+    assert_error(parse("1 + root(x, x, 1, 2)", &result), NO_SIGN_CHANGE, 4);
+    assert_error(parse("integrate(1 / x, x, 0 - 1, 1)", &result), NOT_CONVERGED, 0);
+    assert_error(parse("2 * integrate(1 / (x - 0.3), x, 0, 1)", &result), NOT_CONVERGED, 4);
+    assert_error(parse("sum(i, 1, 10^12, i)", &result), CAPACITY_EXCEEDED, 0);
+    assert_error(parse("integrate(x, x, 0, 1, 2)", &result), INVALID_TOKEN, 20);
+    assert_error(parse("integrate(x, 2, 0, 1)", &result), INVALID_TOKEN, 13);
+    assert_error(parse("integrate(x, x, 0)", &result), INVALID_TOKEN, 0);
+    assert_error(parse("integrate(x, x, , 1)", &result), INVALID_TOKEN, 16);
+    assert_error(parse("integrate(x +, x, 0, 1)", &result), INVALID_TOKEN, 12);
+    assert_error(parse("sum(i, 1, 2", &result), UNMATCHED_LEFT_PAR, 3);
+    assert_error(parse("sum + 1", &result), INVALID_TOKEN, 0);
+
+    // compiled bodies, the same sum for any number of threads
+    NameTable body_names = new_nametable();
+    assert_success(convert_names("1 / (t + 1) ^ 1.5", &program, &body_names));
+
+    double single = 0;
+    double parallel = 0;
+    double unpooled = 0;
+    RowPool one = new_row_pool(1);
+    RowPool four = new_row_pool(4);
+    assert_success(sum_program(&one, program, 0, CALCULUS_TEST_TERMS - 1, &single));
+    assert_success(sum_program(&four, program, 0, CALCULUS_TEST_TERMS - 1, &parallel));
+    assert_success(sum_program(NULL, program, 0, CALCULUS_TEST_TERMS - 1, &unpooled));
+    assert_true(single == parallel && single == unpooled);
+
+    assert_success(integrate_program(&four, program, 0, 3, &single));
+    assert_close(single, 2 - 2 / sqrt(4));
+    assert_error(integrate_program(NULL, program, 0, INFINITY, &single), BOUND_NOT_FINITE, 0);
+    assert_error(root_program(&one, program, 0, 1, &single), NO_SIGN_CHANGE, 0);
+    assert_success(convert_names("1 / t", &program, &body_names));
+    assert_error(integrate_program(&one, program, -1, 1, &single), NOT_CONVERGED, 0);
+    delete_row_pool(&four);
+    delete_row_pool(&one);
+    delete_nametable(body_names);
+
+    delete_tokenlist(program);
+    delete_nametable(names);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define SAMPLE_TEST_COUNT 200000
+
+static void sample_test(void)
+{
+    begin_test_domain("Sample");
+
+    // known answers of Philox 4x32 with 10 rounds
+    const uint32_t zeros[4] = { 0, 0, 0, 0 };
+    const uint32_t ones[4] = { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff };
+    const uint32_t digits[4] = { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 };
+    const uint32_t digit_key[2] = { 0xa4093822, 0x299f31d0 };
+    uint32_t output[4];
+    philox4x32(zeros, zeros, output);
+    assert_count(0x6627e8d5, output[0]);
+    assert_count(0x9b00dbd8, output[3]);
+    philox4x32(ones, ones, output);
+    assert_count(0x408f276d, output[0]);
+    assert_count(0x6d5451fd, output[3]);
+    philox4x32(digits, digit_key, output);
+    assert_count(0xd16cfe09, output[0]);
+    assert_count(0x94fdcceb, output[1]);
+    assert_count(0x5001e420, output[2]);
+    assert_count(0x24126ea1, output[3]);
+
+    // a sample is the same drawn alone or in a block,
+    // a variable without a distribution is 0
+    Sampler sampler = new_sampler(42);
+    sampler_uniform(&sampler, 0, -1, 1);
+    sampler_normal(&sampler, 2, 10, 3);
+    assert_count(3, sampler.variable_count);
+
+    const unsigned int draw_count = 1000;
+    double *draws = (double *)malloc(draw_count * 3 * sizeof(double));
+    if (draws == NULL)
+        exit(1);
+
+    sampler_draw(&sampler, 0, draw_count, draws);
+    double alone[3];
+    sampler_draw(&sampler, 777, 1, alone);
+    assert_count(0, memcmp(alone, draws + 777 * 3, sizeof(alone)));
+
+    unsigned int outside = 0;
+    for (unsigned int r = 0; r < draw_count; r++)
+        outside += draws[r * 3] < -1 || draws[r * 3] >= 1 || draws[r * 3 + 1] != 0;
+    assert_count(0, outside);
+
+    Sampler other = new_sampler(43);
+    sampler_uniform(&other, 0, -1, 1);
+    sampler_draw(&other, 777, 1, alone);
+    assert_true(alone[0] != draws[777 * 3]);
+    delete_sampler(&other);
+    free(draws);
+    delete_sampler(&sampler);
+
+    // pi from the share of points of a square inside its circle,
+    // the same to the bit for every thread count
+    NameTable names = new_nametable();
+    TokenList circle = new_tokenlist();
+    assert_success(convert_names("x^2 + y^2 <= 1 ? 4 : 0", &circle, &names));
+
+    Sampler square = new_sampler(7);
+    sampler_uniform(&square, 0, -1, 1);
+    sampler_uniform(&square, 1, -1, 1);
+
+    const double pi = acos(-1);
+    double means[4];
+    double variances[4];
+    const unsigned int thread_counts[] = { 1, 2, 3, 8 };
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        RowPool pool = new_row_pool(thread_counts[i]);
+        Aggregate aggregate = new_aggregate();
+        sample_rows(&pool, circle, &square, SAMPLE_TEST_COUNT, &aggregate);
+
+        assert_count(SAMPLE_TEST_COUNT, aggregate.count);
+        assert_count(0, aggregate.failed);
+        assert_true(aggregate.min == 0 && aggregate.max == 4);
+
+        double low, high;
+        aggregate_confidence(&aggregate, 0.999, &low, &high);
+        assert_true(low < pi && pi < high);
+        assert_true(high - low < 0.03);
+        means[i] = aggregate.mean;
+        variances[i] = aggregate.variance;
+
+        delete_aggregate(&aggregate);
+        delete_row_pool(&pool);
+    }
+    assert_count(0, memcmp(&means[0], &means[1], sizeof(double)));
+    assert_count(0, memcmp(&means[0], &means[2], sizeof(double)));
+    assert_count(0, memcmp(&means[0], &means[3], sizeof(double)));
+    assert_count(0, memcmp(&variances[0], &variances[3], sizeof(double)));
+
+    // moments of a normal distribution, and failed samples counted by error
+    TokenList identity = new_tokenlist();
+    TokenList logarithm = new_tokenlist();
+    assert_success(convert_names("x", &identity, &names));
+    assert_success(convert_names("ln(x)", &logarithm, &names));
+
+    Sampler normal = new_sampler(1234);
+    sampler_normal(&normal, 0, 10, 3);
+
+    RowPool pool = new_row_pool(4);
+    Aggregate aggregate = new_histogram_aggregate(1, 19, 6);
+    sample_rows(&pool, identity, &normal, SAMPLE_TEST_COUNT, &aggregate);
+    double error = 3 / sqrt(SAMPLE_TEST_COUNT);
+    assert_near(10, aggregate.mean, 5 * error);
+    assert_near(9, aggregate.variance, 9 * 0.02);
+
+    // within three deviations of the mean
+    unsigned long long binned = 0;
+    for (unsigned int b = 0; b < 6; b++)
+        binned += aggregate.bins[b];
+    assert_near(0.9973, (double)binned / SAMPLE_TEST_COUNT, 0.001);
+    delete_aggregate(&aggregate);
+
+    sampler_uniform(&normal, 0, -1, 1);
+    aggregate = new_aggregate();
+    sample_rows(&pool, logarithm, &normal, SAMPLE_TEST_COUNT, &aggregate);
+    assert_count(SAMPLE_TEST_COUNT, aggregate.count + aggregate.failed);
+    assert_count(aggregate.failed, aggregate.error_counts[LOG_OUT_OF_RANGE]);
+    assert_near(0.5, (double)aggregate.failed / SAMPLE_TEST_COUNT, 0.01);
+    assert_near(-1, aggregate.mean, 0.01);
+    delete_aggregate(&aggregate);
+
+    aggregate = new_aggregate();
+    sample_rows(&pool, logarithm, &normal, 0, &aggregate);
+    assert_count(0, aggregate.count);
+    assert_true(isnan(aggregate.variance));
+    delete_aggregate(&aggregate);
+
+    assert_near(1.959963984540054, normal_quantile(0.975), 1e-14);
+    assert_near(-3.090232306167813, normal_quantile(0.001), 1e-14);
+    assert_near(0, normal_quantile(0.5), 1e-15);
+    assert_true(isnan(normal_quantile(1)) && isnan(normal_quantile(0)));
+
+    delete_row_pool(&pool);
+    delete_sampler(&normal);
+    delete_sampler(&square);
+    delete_tokenlist(logarithm);
+    delete_tokenlist(identity);
+    delete_tokenlist(circle);
+    delete_nametable(names);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+// bounds of expression over the box x, y, z
+static ResultInfo interval_of(const char *expression, double low, double high, Interval *result)
+{
+    NameTable names = new_nametable();
+    TokenList program = new_tokenlist();
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+    nametable_add(&names, "z", 1);
+
+    Interval box[3] = { new_interval(low, high), new_interval(low, high), new_interval(low, high) };
+    ResultInfo res = convert_names(expression, &program, &names);
+    if (res.status == SUCCESS)
+        res = evaluate_interval(program, box, result);
+
+    delete_tokenlist(program);
+    delete_nametable(names);
+    return res;
+}
+
+static void assert_interval(Interval result, double low, double high, error_type possible)
+{
+    assert_true(result.low == low && result.high == high);
+    assert_count(possible, result.possible);
+}
+
+#define INTERVAL_TEST_BOXES 40
+#define INTERVAL_TEST_POINTS 500
+
+static void interval_test(void)
+{
+    begin_test_domain("Interval");
+
+    // exact bounds stay where they are, inexact ones move outwards
+    Interval result;
+    assert_success(interval_of("x + 2 * y", 1, 2, &result));
+    assert_interval(result, 3, 6, SUCCESS);
+    assert_success(interval_of("x + 0.1", 0.2, 0.2, &result));
+    assert_true(result.low < 0.2 + 0.1 && 0.2 + 0.1 <= result.high);
+    assert_true(nextafter(result.low, INFINITY) == result.high);
+    assert_success(interval_of("x * y", -2, 3, &result));
+    assert_interval(result, -6, 9, SUCCESS);
+    assert_success(interval_of("abs(x) - 1", -2, 1, &result));
+    assert_interval(result, -1, 1, SUCCESS);
+
+    // division by an interval reaching zero
+    assert_success(interval_of("1 / x", -1, 1, &result));
+    assert_interval(result, -INFINITY, INFINITY, ZERO_DIVISON);
+    assert_count(2, result.possible_index);
+    assert_success(interval_of("1 / x", 0, 2, &result));
+    assert_interval(result, 0.5, INFINITY, ZERO_DIVISON);
+    assert_success(interval_of("0 - 1 / x", -2, 0, &result));
+    assert_interval(result, 0.5, INFINITY, ZERO_DIVISON);
+    assert_error(interval_of("1 / x", 0, 0, &result), ZERO_DIVISON, 2);
+
+    // remainders within one period are exact
+    assert_success(interval_of("x % 3", 4, 5, &result));
+    assert_interval(result, 1, 2, SUCCESS);
+    assert_success(interval_of("x % 3", -5, -4, &result));
+    assert_interval(result, -2, -1, SUCCESS);
+    assert_success(interval_of("x % 3", 2, 4, &result));
+    assert_interval(result, 0, 3, SUCCESS);
+    assert_success(interval_of("(x * 5) % y", -2, 3, &result));
+    assert_interval(result, -3, 3, SUCCESS);
+
+    // powers
+    assert_success(interval_of("x ^ 2", -2, 3, &result));
+    assert_true(result.low == 0 && result.high >= 9 && result.high < 9.000001);
+    assert_success(interval_of("x ^ 3", -2, 3, &result));
+    assert_true(result.low <= -8 && result.high >= 27);
+    assert_success(interval_of("x ^ 0.5", -1, 4, &result));
+    assert_true(result.low == 0 && result.high >= 2 && result.high < 2.000001);
+    assert_count(NEGATIVE_FRACTIONAL_EXPONENT, result.possible);
+    assert_error(interval_of("x ^ 0.5", -2, -1, &result), NEGATIVE_FRACTIONAL_EXPONENT, 2);
+    assert_success(interval_of("x ^ (0 - 1)", 0, 2, &result));
+    assert_true(result.low <= 0.5 && result.low > 0.499999 && result.high == INFINITY);
+    assert_count(ZERO_NEGATIVE_EXPONENT, result.possible);
+    assert_error(interval_of("x ^ (0 - 2)", 0, 0, &result), ZERO_NEGATIVE_EXPONENT, 2);
+    assert_success(interval_of("x ^ (y + 0.5)", -2, 2, &result));
+    assert_true(result.low <= -4 && result.high >= 8);
+    assert_count(NEGATIVE_FRACTIONAL_EXPONENT, result.possible);
+
+    // periodic functions find their extremes and poles
+    const double pi = acos(-1);
+    assert_success(interval_of("sin(x)", 0, 3, &result));
+    assert_true(result.low <= 0 && result.low > -0.000001 && result.high == 1);
+    assert_success(interval_of("cos(x)", 1, 2, &result));
+    assert_true(result.low <= cos(2) && result.high >= cos(1) && result.high < cos(1) + 0.000001);
+    assert_success(interval_of("sin(x)", -100, 100, &result));
+    assert_interval(result, -1, 1, SUCCESS);
+    assert_success(interval_of("tan(x)", 0, 1, &result));
+    assert_true(result.low <= 0 && result.high >= tan(1) && result.high < tan(1) + 0.000001);
+    assert_count(SUCCESS, result.possible);
+    assert_success(interval_of("tan(x)", 1, 2, &result));
+    assert_interval(result, -INFINITY, INFINITY, TANGENT_UNDEFINED);
+    assert_success(interval_of("tand(x)", 80, 100, &result));
+    assert_interval(result, -INFINITY, INFINITY, TANGENT_UNDEFINED);
+    assert_error(interval_of("tand(x)", 90, 90, &result), TANGENT_UNDEFINED, 0);
+    assert_success(interval_of("sind(x)", 0, 180, &result));
+    assert_true(result.low <= 0 && result.high == 1);
+
+    // domains of the other functions
+    assert_success(interval_of("asin(x)", 0.5, 2, &result));
+    assert_true(result.low <= pi / 6 && result.high >= pi / 2);
+    assert_count(ARCUS_OUT_OF_RANGE, result.possible);
+    assert_error(interval_of("acos(x)", 2, 3, &result), ARCUS_OUT_OF_RANGE, 0);
+    assert_success(interval_of("ln(x)", -1, 1, &result));
+    assert_true(result.low == -INFINITY && result.high >= 0 && result.high < 0.000001);
+    assert_count(LOG_OUT_OF_RANGE, result.possible);
+    assert_count(0, result.possible_index);
+    assert_error(interval_of("1 + log(x)", -2, 0, &result), LOG_OUT_OF_RANGE, 4);
+    assert_success(interval_of("fac(x)", 2, 4, &result));
+    assert_interval(result, 2, 24, FAC_INPUT_NOT_INT);
+    assert_error(interval_of("fac(x)", 2.1, 2.9, &result), FAC_INPUT_NOT_INT, 0);
+    assert_success(interval_of("fac(x)", 5, 5, &result));
+    assert_interval(result, 120, 120, SUCCESS);
+
+    // a decided condition runs only its branch
+    assert_success(interval_of("x > 0 ? ln(x) : 0", -3, -2, &result));
+    assert_interval(result, 0, 0, SUCCESS);
+    assert_success(interval_of("x > 0 ? x * 2 : 0", 2, 3, &result));
+    assert_interval(result, 4, 6, SUCCESS);
+    assert_success(interval_of("x > 0 ? x * 2 : 0 - 1", -1, 3, &result));
+    assert_interval(result, -2, 6, SUCCESS);
+    assert_success(interval_of("x > 0 ? ln(x) : 0", -1, 1, &result));
+    assert_count(LOG_OUT_OF_RANGE, result.possible);
+    assert_success(interval_of("x > 0 ? ln(x - 5) : 1", -1, 1, &result));
+    assert_interval(result, 1, 1, LOG_OUT_OF_RANGE);
+    assert_count(8, result.possible_index);
+
+    // a branch that fails part way leaves nothing for the operator around it
+    assert_success(interval_of("4.56 - (x ? 6 : asin(4))", -4, 5, &result));
+    assert_true(result.low <= 4.56 - 6 && result.high >= 4.56 - 6);
+    assert_count(ARCUS_OUT_OF_RANGE, result.possible);
+    assert_success(interval_of("(x ? asin(4) : 6) * 2 - 1", -4, 5, &result));
+    assert_true(result.low <= 11 && result.high >= 11);
+    assert_count(ARCUS_OUT_OF_RANGE, result.possible);
+    assert_success(interval_of("x < y", 1, 1, &result));
+    assert_interval(result, 0, 0, SUCCESS);
+    assert_success(interval_of("x == 2", 1, 3, &result));
+    assert_interval(result, 0, 1, SUCCESS);
+
+    // x % 0 is NAN, which decides neither a condition nor a domain check
+    assert_success(interval_of("x % 0", -4, 5, &result));
+    assert_true(result.maybe_nan);
+    assert_success(interval_of("x % 3", 4, 5, &result));
+    assert_true(!result.maybe_nan);
+    assert_success(interval_of("(2 % x) ? 14 : 20", 0, 0, &result));
+    assert_true(result.low <= 14 && result.high >= 14 && !result.maybe_nan);
+    assert_success(interval_of("(x % 0) < 1", 0, 0, &result));
+    assert_interval(result, 0, 1, SUCCESS);
+    assert_true(!result.maybe_nan);
+    assert_success(interval_of("log((33*(15 % (180==2)))*0.5)", 0, 0, &result));
+    assert_count(LOG_OUT_OF_RANGE, result.possible);
+    assert_success(interval_of("fac((3 % y) % 9)", 0, 0, &result));
+    assert_count(FAC_INPUT_NOT_INT, result.possible);
+    assert_success(interval_of("(y-14)^(64*(4 % ((y?0:x)/sin(y))))", 1, 1, &result));
+    assert_count(NEGATIVE_FRACTIONAL_EXPONENT, result.possible);
+
+    // every value evaluate gives at a point of a box is in its bounds,
+    // for plain and optimized programs
+    const char *expressions[] = {
+        "x * y + z", "x^3 - 2*x + 1", "sin(x) * cos(y) + tan(z)", "(x - y) / (z + 2)",
+        "abs(x) ^ 0.5 + ln(y + 3)", "x % 1.5 + fac(3)", "asin(x / 4) + acosd(y / 4)",
+        "x ^ 0.5 + y ^ 2", "x > y ? x - y : y - x", "2 ^ x * 3 ^ (0 - y)",
+        "sind(x * 40) + tand(y * 10)", "atan(x * y) + atand(z)", "log(x * x + 1) / 3",
+        "(x + 1) * (x + 1) - x / 7 + y ^ 4", "x * 0.1 - y * 0.3 + z * 0.7",
+        "x % y > z ? ln(abs(y % z) + 1) : x % y",
+    };
+    const unsigned int flags[] = { OPTIMIZE_NONE, OPTIMIZE_FOLD | OPTIMIZE_SHARE |
+                                   OPTIMIZE_STRENGTH | OPTIMIZE_RECIPROCAL | OPTIMIZE_FUSE,
+                                   OPTIMIZE_INTEGER | OPTIMIZE_FUSE };
+
+    Sampler boxes = new_sampler(5);
+    for (unsigned int v = 0; v < 6; v++)
+        sampler_uniform(&boxes, v, -3, 3);
+    Sampler points = new_sampler(6);
+    double *draws = (double *)malloc(INTERVAL_TEST_POINTS * 3 * sizeof(double));
+    if (draws == NULL)
+        exit(1);
+
+    unsigned int outside = 0;
+    unsigned int unexpected = 0;
+    unsigned int boxes_bounded = 0;
+    for (unsigned int e = 0; e < sizeof(expressions) / sizeof(expressions[0]); e++)
+    {
+        for (unsigned int f = 0; f < 3; f++)
+        {
+            NameTable names = new_nametable();
+            TokenList program = new_tokenlist();
+            nametable_add(&names, "x", 1);
+            nametable_add(&names, "y", 1);
+            nametable_add(&names, "z", 1);
+            assert_success(convert_names(expressions[e], &program, &names));
+            optimize(&program, flags[f]);
+
+            for (unsigned int b = 0; b < INTERVAL_TEST_BOXES; b++)
+            {
+                double corners[6];
+                sampler_draw(&boxes, e * INTERVAL_TEST_BOXES + b, 1, corners);
+
+                Interval box[3];
+                for (unsigned int v = 0; v < 3; v++)
+                {
+                    double low = fmin(corners[v], corners[v + 3]);
+                    double high = fmax(corners[v], corners[v + 3]);
+                    box[v] = new_interval(low, high);
+                    sampler_uniform(&points, v, low, high);
+                }
+
+                Interval bounds;
+                ResultInfo res = evaluate_interval(program, box, &bounds);
+                boxes_bounded += res.status == SUCCESS;
+
+                sampler_draw(&points, b * INTERVAL_TEST_POINTS, INTERVAL_TEST_POINTS, draws);
+                for (unsigned int p = 0; p < INTERVAL_TEST_POINTS; p++)
+                {
+                    Token value = create_empty_token();
+                    ResultInfo point = evaluate(program, draws + p * 3, &value);
+
+                    if (point.status != SUCCESS)
+                        unexpected += res.status == SUCCESS && bounds.possible == SUCCESS;
+                    else if (res.status != SUCCESS)
+                        unexpected += 1;
+                    else if (isnan(value.value.number))
+                        outside += !bounds.maybe_nan;
+                    else
+                        outside += !(bounds.low <= value.value.number &&
+                                     value.value.number <= bounds.high);
+                }
+            }
+
+            delete_tokenlist(program);
+            delete_nametable(names);
+        }
+    }
+    assert_count(0, outside);
+    assert_count(0, unexpected);
+    assert_true(boxes_bounded > 1500);
+
+    free(draws);
+    delete_sampler(&points);
+    delete_sampler(&boxes);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define SHAPE_TEST_PROGRAMS 1500
+
+static void shape_test(void)
+{
+    begin_test_domain("Shape");
+
+    FunctionTable functions = new_function_table();
+    assert_success(function_register(&functions, "twice", 1, native_twice, NULL, NATIVE_PURE));
+    assert_success(function_register(&functions, "tick", 1, native_tick, NULL, NATIVE_NONE));
+    assert_success(function_register(&functions, "mix", 3, native_mix, native_mix_vector,
+                                     NATIVE_PURE));
+
+    // programs of a template differ only in their numbers,
+    // the last two do not group
+    const char *templates[] = {
+        "%g * x + %g",
+        "(x - %g) / (y - %g)",
+        "x > %g ? ln(x - %g) : y ^ %g",
+        "sin(x * %g) + tand(%g) - fac(%g)",
+        "x < %g ? (y > %g ? 1 / (x - %g) : %g) : abs(y) %% %g",
+        "asin(x / %g) + twice(y + %g)",
+        "mix(x, %g, y) * %g + (x == %g)",
+        "tick(x) + %g",
+        "",
+    };
+    const unsigned int template_count = sizeof(templates) / sizeof(templates[0]);
+
+    NameTable names = new_nametable();
+    unsigned int x = nametable_add(&names, "x", 1);
+    unsigned int y = nametable_add(&names, "y", 1);
+    TokenList *programs = (TokenList *)malloc(SHAPE_TEST_PROGRAMS * sizeof(TokenList));
+    double *variables = (double *)malloc(SHAPE_TEST_PROGRAMS * 2 * sizeof(double));
+    double *results = (double *)malloc(SHAPE_TEST_PROGRAMS * sizeof(double));
+    error_type *errors = (error_type *)malloc(SHAPE_TEST_PROGRAMS * sizeof(error_type));
+    if (programs == NULL || variables == NULL || results == NULL || errors == NULL)
+        exit(1);
+
+    ShapeBatch batch = new_shape_batch();
+    char input[256];
+    unsigned int unconverted = 0, misnumbered = 0;
+    for (unsigned int p = 0; p < SHAPE_TEST_PROGRAMS; p++)
+    {
+        double a = (double)(p % 13) - 6, b = (double)(p % 7) - 3, c = (double)(p % 5) + 0.5;
+        snprintf(input, sizeof(input), templates[p % template_count], a, b, c, a, c);
+
+        programs[p] = new_tokenlist();
+        unconverted += convert_functions(input, &programs[p], &names, &functions).status != SUCCESS;
+
+        variables[p * 2 + x] = (double)(p % 11) - 5;
+        variables[p * 2 + y] = (double)(p % 17) / 4 - 2;
+        misnumbered += shape_batch_add_program(&batch, programs[p]) != p;
+    }
+    assert_count(0, unconverted);
+    assert_count(0, misnumbered);
+
+    assert_count(SHAPE_TEST_PROGRAMS, batch.program_count);
+    assert_count(template_count - 2, batch.group_count);
+    assert_count(SHAPE_TEST_PROGRAMS / template_count * 2, batch.single_count);
+
+    // every program gives what evaluate gives on its own row
+    unsigned long long failed = shape_batch_evaluate(&batch, variables, 2, results, errors);
+    unsigned int mismatches = 0;
+    unsigned long long expected_failed = 0;
+    for (unsigned int p = 0; p < SHAPE_TEST_PROGRAMS; p++)
+    {
+        Token result = create_empty_token();
+        ResultInfo res = evaluate(programs[p], variables + p * 2, &result);
+        expected_failed += res.status != SUCCESS;
+
+        if (res.status != errors[p])
+            mismatches++;
+        else if (res.status == SUCCESS && result.value.number != results[p] &&
+                 !(isnan(result.value.number) && isnan(results[p])))
+            mismatches++;
+        else if (res.status != SUCCESS && !isnan(results[p]))
+            mismatches++;
+    }
+    assert_count(0, mismatches);
+    assert_count(expected_failed, failed);
+    assert_true(failed > 0);
+
+    // errors on the branch a program does not take are not reported
+    ShapeBatch branches = new_shape_batch();
+    assert_success(shape_batch_add(&branches, "x > 0 ? 1 / (x - 5) : ln(x)", &names));
+    assert_success(shape_batch_add(&branches, "x > 0 ? 1 / (x - 6) : ln(x)", &names));
+    assert_success(shape_batch_add(&branches, "x > 1 ? 1 / (x - 5) : ln(x)", &names));
+    assert_count(1, branches.group_count);
+
+    double rows[6] = { 0 };
+    rows[0 * 2 + x] = 5;
+    rows[1 * 2 + x] = 5;
+    rows[2 * 2 + x] = 0.5;
+    assert_count(1, shape_batch_evaluate(&branches, rows, 2, results, errors));
+    assert_count(ZERO_DIVISON, errors[0]);
+    assert_count(SUCCESS, errors[1]);
+    assert_count(SUCCESS, errors[2]);
+    assert_true(results[1] == -1 && results[2] == log(0.5));
+
+    rows[1 * 2 + x] = -1;
+    assert_count(2, shape_batch_evaluate(&branches, rows, 2, results, errors));
+    assert_count(LOG_OUT_OF_RANGE, errors[1]);
+    delete_shape_batch(&branches);
+
+    // a shared row, and no row for programs that read none
+    ShapeBatch constants = new_shape_batch();
+    assert_success(shape_batch_add(&constants, "1 + 2 * 3", &names));
+    assert_success(shape_batch_add(&constants, "4 + 5 * x", &names));
+    assert_success(shape_batch_add(&constants, "7 + 8 * 9", &names));
+    assert_error(shape_batch_add(&constants, "7 + * 9", &names), INVALID_TOKEN, 4);
+    assert_success(shape_batch_add(&constants, "x < 0 ? 1 : y", &names));
+    assert_count(4, constants.program_count);
+    assert_count(3, constants.group_count);
+
+    assert_count(2, shape_batch_evaluate(&constants, NULL, 0, results, errors));
+    assert_true(results[0] == 7 && results[2] == 79);
+    assert_count(UNDEFINED_VARIABLE, errors[1]);
+    assert_count(UNDEFINED_VARIABLE, errors[3]);
+
+    double row[2] = { 0 };
+    row[x] = -1;
+    row[y] = 5;
+    assert_count(0, shape_batch_evaluate(&constants, row, 0, results, errors));
+    assert_true(results[1] == -1 && results[3] == 1);
+
+    delete_shape_batch(&constants);
+    delete_shape_batch(&batch);
+    for (unsigned int p = 0; p < SHAPE_TEST_PROGRAMS; p++)
+        delete_tokenlist(programs[p]);
+    free(programs);
+    free(variables);
+    free(results);
+    free(errors);
+    delete_nametable(names);
+    delete_function_table(&functions);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+#define REGISTRY_TEST_READERS 3
+#define REGISTRY_TEST_PUBLISHES 300
+
+typedef struct
+{
+    FormulaRegistry *registry;
+    atomic_bool *done;
+    unsigned long long reads;
+    unsigned long long inconsistent;
+    unsigned long long newest;
+} RegistryTestReader;
+
+// every version n of "rate" is x + n, so a value tells which version ran
+static void *registry_test_read(void *argument)
+{
+    RegistryTestReader *self = (RegistryTestReader *)argument;
+    RegistryReader reader;
+    if (registry_open_reader(self->registry, &reader).status != SUCCESS)
+        return NULL;
+
+    unsigned int id = registry_lookup(&reader, "rate");
+    double x = 0.5;
+    do
+    {
+        Token result = create_empty_token();
+        unsigned long long version = 0;
+        if (registry_evaluate(&reader, id, &x, &result, &version).status != SUCCESS ||
+            result.value.number != x + (double)version || version < self->newest)
+            self->inconsistent++;
+
+        self->newest = version;
+        self->reads++;
+    } while (!atomic_load(self->done));
+
+    registry_close_reader(&reader);
+    return NULL;
+}
+
+static void registry_test(void)
+{
+    begin_test_domain("Registry");
+
+    NameTable variables = new_nametable();
+    nametable_add(&variables, "x", 1);
+    nametable_add(&variables, "y", 1);
+    FormulaRegistry registry = new_formula_registry(&variables, OPTIMIZE_FOLD | OPTIMIZE_FUSE);
+
+    RegistryReader reader;
+    assert_success(registry_open_reader(&registry, &reader));
+    assert_count(REGISTRY_NONE, registry_lookup(&reader, "total"));
+
+    assert_success(registry_publish(&registry, "total", "x * 2 + y"));
+    assert_success(registry_publish(&registry, "fee", "x / 100"));
+    unsigned int total = registry_lookup(&reader, "total");
+    unsigned int fee = registry_lookup(&reader, "fee");
+    assert_true(total != REGISTRY_NONE && fee != REGISTRY_NONE && total != fee);
+
+    double row[2] = { 3, 4 };
+    Token result = create_empty_token();
+    unsigned long long version = 0;
+    assert_success(registry_evaluate(&reader, total, row, &result, &version));
+    assert_true(result.value.number == 10 && version == 1);
+
+    // a new version replaces the old one under the same id
+    assert_success(registry_publish(&registry, "total", "x * 3 - y"));
+    assert_count(total, registry_lookup(&reader, "total"));
+    assert_success(registry_evaluate(&reader, total, row, &result, &version));
+    assert_true(result.value.number == 5 && version == 3);
+
+    // a failed publish keeps the current version
+    assert_error(registry_publish(&registry, "total", "x * * y"), INVALID_TOKEN, 4);
+    assert_error(registry_publish(&registry, "total", "x + rate"), UNDEFINED_VARIABLE, 4);
+    assert_success(registry_evaluate(&reader, total, row, &result, &version));
+    assert_true(result.value.number == 5 && version == 3);
+
+    assert_true(registry_remove(&registry, "fee"));
+    assert_count(false, registry_remove(&registry, "fee"));
+    assert_count(false, registry_remove(&registry, "none"));
+    assert_error(registry_evaluate(&reader, fee, row, &result, NULL), UNDEFINED_VARIABLE, 0);
+    assert_error(registry_evaluate(&reader, 1000, row, &result, NULL), UNDEFINED_VARIABLE, 0);
+    assert_success(registry_publish(&registry, "fee", "y / 100"));
+    assert_success(registry_evaluate(&reader, fee, row, &result, NULL));
+    assert_near(0.04, result.value.number, 0);
+
+    // with no reader inside a read every replaced version is freed
+    assert_count(0, registry_retired_count(&registry));
+    registry_close_reader(&reader);
+
+    // readers are limited, a closed slot is reused
+    RegistryReader *readers = (RegistryReader *)malloc(REGISTRY_READERS_MAX * sizeof(RegistryReader));
+    if (readers == NULL)
+        exit(1);
+    unsigned int opened = 0;
+    for (unsigned int i = 0; i < REGISTRY_READERS_MAX; i++)
+        opened += registry_open_reader(&registry, &readers[i]).status == SUCCESS;
+    assert_count(REGISTRY_READERS_MAX, opened);
+    assert_error(registry_open_reader(&registry, &reader), CAPACITY_EXCEEDED, 0);
+    registry_close_reader(&readers[7]);
+    assert_success(registry_open_reader(&registry, &reader));
+    registry_close_reader(&reader);
+    for (unsigned int i = 0; i < REGISTRY_READERS_MAX; i++)
+    {
+        if (i != 7)
+            registry_close_reader(&readers[i]);
+    }
+    free(readers);
+    delete_formula_registry(&registry);
+
+    // readers on other threads see whole versions, in order,
+    // while one is published after another
+    registry = new_formula_registry(&variables, OPTIMIZE_NONE);
+    assert_success(registry_publish(&registry, "rate", "x + 1"));
+
+    atomic_bool done;
+    atomic_init(&done, false);
+    pthread_t threads[REGISTRY_TEST_READERS];
+    RegistryTestReader states[REGISTRY_TEST_READERS];
+    for (unsigned int i = 0; i < REGISTRY_TEST_READERS; i++)
+    {
+        states[i].registry = &registry;
+        states[i].done = &done;
+        states[i].reads = 0;
+        states[i].inconsistent = 0;
+        states[i].newest = 0;
+        pthread_create(&threads[i], NULL, registry_test_read, &states[i]);
+    }
+
+    char expression[64];
+    unsigned int failed_publishes = 0;
+    for (unsigned int n = 2; n <= REGISTRY_TEST_PUBLISHES; n++)
+    {
+        snprintf(expression, sizeof(expression), "x + %u", n);
+        failed_publishes += registry_publish(&registry, "rate", expression).status != SUCCESS;
+        if (n % 16 == 0)
+            sched_yield();
+    }
+
+    atomic_store(&done, true);
+    unsigned long long inconsistent = 0, reads = 0;
+    for (unsigned int i = 0; i < REGISTRY_TEST_READERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        inconsistent += states[i].inconsistent;
+        reads += states[i].reads;
+    }
+
+    assert_count(0, failed_publishes);
+    assert_count(0, inconsistent);
+    assert_true(reads >= REGISTRY_TEST_READERS);
+
+    registry_reclaim(&registry);
+    assert_count(0, registry_retired_count(&registry));
+
+    delete_formula_registry(&registry);
+    delete_nametable(variables);
+
+    assert_zero_allocations();
+    conclude_test_domain();
+}
+
+static ProgramAnalysis analyze_expression(const char *input, NameTable *names,
+                                          const FunctionTable *functions,
+                                          unsigned int optimize_flags, const CostTable *costs)
+{
+    TokenList program = new_tokenlist();
+    assert_success(convert_functions(input, &program, names, functions));
+    optimize(&program, optimize_flags);
+
+    ProgramAnalysis analysis = analyze_program(program, costs);
+    delete_tokenlist(program);
+    return analysis;
+}
+
+static void analysis_test(void)
+{
+    begin_test_domain("Analysis");
+
+    FunctionTable functions = new_function_table();
+    assert_success(function_register(&functions, "twice", 1, native_twice, NULL, NATIVE_PURE));
+    assert_success(function_register(&functions, "tick", 1, native_tick, NULL, NATIVE_NONE));
+
+    NameTable names = new_nametable();
+    nametable_add(&names, "x", 1);
+    nametable_add(&names, "y", 1);
+
+    // every token costs one, so the cost is the tokens on the longest path
+    CostTable unit;
+    for (unsigned int t = 0; t < OPERATOR_TYPE_COUNT; t++)
+        unit.operators[t] = 1;
+    unit.operand = 1;
+    unit.native = 1;
+
+    ProgramAnalysis analysis = analyze_expression("2 * x + 3", &names, &functions, 0, &unit);
+    assert_count(5, analysis.token_count);
+    assert_count(3, analysis.category_counts[ANALYSIS_OPERAND]);
+    assert_count(2, analysis.category_counts[ANALYSIS_ARITHMETIC]);
+    assert_count(1, analysis.operator_counts[MULT]);
+    assert_count(1, analysis.operator_counts[ADD]);
+    assert_count(0, analysis.transcendental_count);
+    assert_count(2, analysis.stack_depth);
+    assert_near(0, analysis.constant_ratio, 0);
+    assert_count(5, (unsigned int)analysis.cost);
+
+    analysis = analyze_expression("sin(x) + ln(2) * cos(1)", &names, &functions, 0, &unit);
+    assert_count(3, analysis.transcendental_count);
+    assert_count(3, analysis.category_counts[ANALYSIS_TRANSCENDENTAL]);
+    assert_count(3, analysis.stack_depth);
+    assert_near(0.6, analysis.constant_ratio, 0);
+
+    analysis = analyze_expression("fac(4) ^ x % y", &names, &functions, 0, &unit);
+    assert_count(1, analysis.category_counts[ANALYSIS_FACTORIAL]);
+    assert_count(1, analysis.category_counts[ANALYSIS_POWER]);
+    assert_count(1, analysis.category_counts[ANALYSIS_ARITHMETIC]);
+
+    // a conditional costs its condition and its costlier branch,
+    // the jumps count as control and their targets not at all
+    analysis = analyze_expression("x > 0 ? sin(x) + 1 : 2", &names, &functions, 0, &unit);
+    assert_count(10, analysis.token_count);
+    assert_count(1, analysis.category_counts[ANALYSIS_COMPARISON]);
+    assert_count(2, analysis.category_counts[ANALYSIS_CONTROL]);
+    assert_count(9, (unsigned int)analysis.cost);
+
+    // the jump over the other branch belongs to the first
+    analysis = analyze_expression("x > 0 ? 2 : sin(x) + 1", &names, &functions, 0, &unit);
+    assert_count(8, (unsigned int)analysis.cost);
+
+    // a conditional is constant only if all of it is
+    analysis = analyze_expression("(1 < 2 ? 3 : 4) + 1", &names, &functions, 0, &unit);
+    assert_near(1, analysis.constant_ratio, 0);
+    analysis = analyze_expression("(1 < 2 ? 3 : x) + 1", &names, &functions, 0, &unit);
+    assert_near(0.5, analysis.constant_ratio, 0);
+    analysis = analyze_expression("(x < 2 ? 3 : 4) + 1", &names, &functions, 0, &unit);
+    assert_near(0, analysis.constant_ratio, 0);
+
+    // only pure native functions of constants are constant
+    analysis = analyze_expression("twice(3) + tick(4)", &names, &functions, 0, &unit);
+    assert_count(2, analysis.category_counts[ANALYSIS_NATIVE]);
+    assert_near(1.0 / 3, analysis.constant_ratio, 0);
+
+    // folding leaves nothing constant, immediate operands are part of their operator
+    analysis = analyze_expression("sin(x) * 2 + (1 + 2) * y", &names, &functions,
+                                  OPTIMIZE_FOLD | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH |
+                                  OPTIMIZE_FUSE, NULL);
+    assert_near(0, analysis.constant_ratio, 0);
+    assert_count(1, analysis.transcendental_count);
+    assert_true(analysis.token_count < 8);
+
+    analysis = analyze_expression("-sin(x) + sin(x) * sin(x)", &names, &functions,
+                                  OPTIMIZE_FOLD | OPTIMIZE_SHARE | OPTIMIZE_STRENGTH |
+                                  OPTIMIZE_FUSE, NULL);
+    assert_count(1, analysis.transcendental_count);
+    assert_true(analysis.cost > 0);
+
+    // the default table makes a transcendental call dearer than an addition
+    ProgramAnalysis cheap = analyze_expression("x + y", &names, &functions, 0, NULL);
+    ProgramAnalysis dear = analyze_expression("sin(x) + y", &names, &functions, 0, NULL);
+    assert_true(dear.cost > cheap.cost);
+
+    // a saved table loads back, unknown entries are refused
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/parser_costs_%d.txt", (int)getpid());
+    CostTable saved = default_cost_table();
+    saved.operators[SIN] = 123.5;
+    saved.operand = 2;
+    assert_true(cost_table_save(path, &saved));
+
+    CostTable loaded = unit;
+    assert_true(cost_table_load(path, &loaded));
+    assert_near(123.5, loaded.operators[SIN], 0);
+    assert_near(2, loaded.operand, 0);
+    assert_near(saved.operators[DIV], loaded.operators[DIV], 0);
+
+    // entries the file leaves out keep their value
+    assert_near(1, loaded.operators[MULT_ADD], 0);
+
+    FILE *file = fopen(path, "w");
+    fputs("# comment\n\nsin 7\nnonsense 3\n", file);
+    fclose(file);
+    assert_count(false, cost_table_load(path, &loaded));
+    assert_near(7, loaded.operators[SIN], 0);
+    remove(path);
+    assert_count(false, cost_table_load(path, &loaded));
+
+    assert_true(!strcmp(operator_name(MULT_ADD), "mult_add"));
+    assert_true(!strcmp(operator_name(LN), "ln"));
+
+    delete_nametable(names);
+    delete_function_table(&functions);
+
     assert_zero_allocations();
     conclude_test_domain();
 }
@@ -404,4 +3401,28 @@ int main()
     syntax_check_test();
     convert_test();
     parse_test();
+    bounded_test();
+    variable_test();
+    formula_test();
+    shm_ring_test();
+    daemon_test();
+    program_file_test();
+    optimize_test();
+    scan_test();
+    diagnostic_test();
+    rows_test();
+    kernel_test();
+    aggregate_test();
+    integer_test();
+    conditional_test();
+    function_test();
+    native_test();
+    calculus_test();
+    sample_test();
+    interval_test();
+    shape_test();
+    registry_test();
+    analysis_test();
 }
+
+#endif // BOUNDED_TEST
@@ -7,10 +7,21 @@
 #include "parser.h"
 #include "unittest.h"
 
+#define BOUNDED_LISTS 8
+#define BOUNDED_CAPACITY 256
+
 static const char *test_domain_name;
 static unsigned int test_count;
 static unsigned int successful_test_count;
 
+// fixed storage for bounded runs
+static bool bounded = false;
+static unsigned int next_bounded_list = 0;
+static Token bounded_lists[BOUNDED_LISTS][BOUNDED_CAPACITY];
+static Token parse_storage[3][BOUNDED_CAPACITY];
+static Token context_storage[3][BOUNDED_CAPACITY];
+static ParseContext parse_storage_context;
+
 void begin_test_domain(const char *name)
 {
     test_domain_name = name;
@@ -54,8 +65,22 @@ static void print_error_name(error_type input)
         printf("TANGENT_UNDEFINED");
     else if (input == ARCUS_OUT_OF_RANGE)
         printf("ARCUS_OUT_OF_RANGE");
+    else if (input == LOG_OUT_OF_RANGE)
+        printf("LOG_OUT_OF_RANGE");
     else if (input == FAC_INPUT_NOT_INT)
         printf("FAC_INPUT_NOT_INT");
+    else if (input == UNDEFINED_VARIABLE)
+        printf("UNDEFINED_VARIABLE");
+    else if (input == CIRCULAR_REFERENCE)
+        printf("CIRCULAR_REFERENCE");
+    else if (input == CAPACITY_EXCEEDED)
+        printf("CAPACITY_EXCEEDED");
+    else if (input == BOUND_NOT_FINITE)
+        printf("BOUND_NOT_FINITE");
+    else if (input == NO_SIGN_CHANGE)
+        printf("NO_SIGN_CHANGE");
+    else if (input == NOT_CONVERGED)
+        printf("NOT_CONVERGED");
     else if (input == SUCCESS)
         printf("SUCCESS");
 }
@@ -81,6 +106,12 @@ static bool tokens_equal(Token a, Token b)
             if (a.value.parenthesis == b.value.parenthesis)
                 return true;
         }
+
+        else if (a.type == VARIABLE)
+        {
+            if (a.value.variable == b.value.variable)
+                return true;
+        }
     }
     return false;
 }
@@ -166,7 +197,7 @@ void assert_parse_result(const char *input, double expected_result)
     ResultInfo res;
     Token output = create_empty_token();
 
-    res = parse(input, &output);
+    res = test_parse(input, &output);
     if (res.status == SUCCESS)
     {
         if (fabs(output.value.number - expected_result) < 0.000001)
@@ -191,6 +222,79 @@ void assert_parse_result(const char *input, double expected_result)
     }
 }
 
+void assert_number(Token result, double expected_result)
+{
+    test_count += 1;
+
+    if (result.type == NUMBER &&
+        fabs(result.value.number - expected_result) < 0.000001)
+    {
+        successful_test_count += 1;
+    }
+
+    else
+    {
+        printf( "%s test #%d failed\n", test_domain_name, test_count);
+        printf("Expected: %f\n", expected_result);
+        printf("Result  : %f\n", result.value.number);
+        putchar('\n');
+    }
+}
+
+void assert_count(unsigned int expected, unsigned int result)
+{
+    test_count += 1;
+
+    if (expected == result)
+    {
+        successful_test_count += 1;
+    }
+
+    else
+    {
+        printf( "%s test #%d failed\n", test_domain_name, test_count);
+        printf("Expected count: %d\n", expected);
+        printf("Result count  : %d\n", result);
+        putchar('\n');
+    }
+}
+
+void assert_near(double expected, double result, double tolerance)
+{
+    test_count += 1;
+
+    if (fabs(result - expected) <= tolerance)
+    {
+        successful_test_count += 1;
+    }
+
+    else
+    {
+        printf( "%s test #%d failed\n", test_domain_name, test_count);
+        printf("Expected: %.17g\n", expected);
+        printf("Result  : %.17g\n", result);
+        printf("Allowed : %.17g\n", tolerance);
+        putchar('\n');
+    }
+}
+
+void assert_condition(bool condition, const char *text)
+{
+    test_count += 1;
+
+    if (condition)
+    {
+        successful_test_count += 1;
+    }
+
+    else
+    {
+        printf( "%s test #%d failed\n", test_domain_name, test_count);
+        printf("Expected to hold: %s\n", text);
+        putchar('\n');
+    }
+}
+
 void assert_zero_allocations(void)
 {
     test_count += 1;
@@ -207,3 +311,57 @@ void assert_zero_allocations(void)
         successful_test_count += 1;
     }
 }
+
+void use_bounded_storage(void)
+{
+    bounded = true;
+    parse_storage_context = bounded_parse_context(
+            parse_storage[0], BOUNDED_CAPACITY,
+            parse_storage[1], BOUNDED_CAPACITY,
+            parse_storage[2], BOUNDED_CAPACITY);
+}
+
+TokenList test_tokenlist(void)
+{
+    if (!bounded)
+        return new_tokenlist();
+
+    // lists are handed out in turn, a test domain uses only a few
+    Token *buffer = bounded_lists[next_bounded_list];
+    next_bounded_list = (next_bounded_list + 1) % BOUNDED_LISTS;
+    return tokenlist_from_buffer(buffer, BOUNDED_CAPACITY);
+}
+
+ParseContext test_parse_context(void)
+{
+    if (!bounded)
+        return new_parse_context();
+
+    return bounded_parse_context(context_storage[0], BOUNDED_CAPACITY,
+                                 context_storage[1], BOUNDED_CAPACITY,
+                                 context_storage[2], BOUNDED_CAPACITY);
+}
+
+ResultInfo test_convert(const char *input, TokenList *output)
+{
+    if (!bounded)
+        return convert(input, output);
+
+    ResultInfo res = convert_context(&parse_storage_context, input, NULL);
+    if (res.status == SUCCESS)
+    {
+        clear_tokenlist(output);
+        for (unsigned int i = 0; i < parse_storage_context.program.count; i++)
+            tokenlist_add(output, parse_storage_context.program.list[i]);
+    }
+
+    return res;
+}
+
+ResultInfo test_parse(const char *input, Token *result)
+{
+    if (!bounded)
+        return parse(input, result);
+
+    return parse_context(&parse_storage_context, input, result);
+}
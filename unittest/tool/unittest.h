@@ -1,6 +1,9 @@
 #ifndef UNITTEST
 #define UNITTEST
 
+// standard library includes
+#include <stdbool.h>
+
 // project includes
 #include "parser.h"
 
@@ -10,6 +13,21 @@ void assert_tokenlists_equal(TokenList expected, TokenList result);
 void assert_error(ResultInfo input, error_type errtype, unsigned int index);
 void assert_success(ResultInfo input);
 void assert_parse_result(const char *input, double expected_result);
+void assert_number(Token result, double expected_result);
+void assert_count(unsigned int expected, unsigned int result);
+void assert_near(double expected, double result, double tolerance);
+
+// the condition is printed as written when it does not hold
+#define assert_true(condition) assert_condition((condition), #condition)
+void assert_condition(bool condition, const char *text);
 void assert_zero_allocations(void);
 
+// lists, conversions and parses made through these helpers
+// use fixed storage instead of the heap after use_bounded_storage
+void use_bounded_storage(void);
+TokenList test_tokenlist(void);
+ParseContext test_parse_context(void);
+ResultInfo test_convert(const char *input, TokenList *output);
+ResultInfo test_parse(const char *input, Token *result);
+
 #endif // UNITTEST